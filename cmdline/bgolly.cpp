@@ -8,6 +8,7 @@
 #include "jvnalgo.h"
 #include "superalgo.h"
 #include "ruleloaderalgo.h"
+#include "adaptivealgo.h"
 #include "readpattern.h"
 #include "util.h"
 #include "viewport.h"
@@ -136,7 +137,13 @@ char *liferule = 0 ;
 char *outfilename = 0 ;
 char *renderscale = (char *)"1" ;
 char *testscript = 0 ;
-int outputgzip, outputismc ;
+int outputgzip, outputismc, outputisbinary ;
+int numthreads = 1 ;
+int pardepth ;
+int calcbits = -1 ;
+int planesteps = -1 ;
+int segments ;
+int scaling ;
 int numberoffset ; // where to insert file name numbers
 options options[] = {
   { "-m", "--generation", "How far to run", 'I', &maxgen },
@@ -150,7 +157,7 @@ options options[] = {
   { "-s", "--search", "Search directory for .rule files", 's', &user_rules },
   { "-h", "--hashlife", "Use Hashlife algorithm", 'b', &hashlife },
   { "-a", "--algorithm", "Select algorithm by name", 's', &algoName },
-  { "-o", "--output", "Output file (*.rle, *.mc, *.rle.gz, *.mc.gz)", 's',
+  { "-o", "--output", "Output file (*.rle, *.mc, *.mcb, *.rle.gz, *.mc.gz, *.mcb.gz)", 's',
                                                                &outfilename },
   { "-v", "--verbose", "Verbose", 'b', &verbose },
   { "-t", "--timeline", "Use timeline", 'b', &timeline },
@@ -164,6 +171,17 @@ options options[] = {
 //                                                        'i', &stepfactor },
   { "",   "--autofit", "Autofit before each render", 'b', &autofit },
   { "",   "--exec", "Run testing script", 's', &testscript },
+  { "",   "--threads", "Number of threads to calculate with", 'i', &numthreads },
+  { "",   "--pardepth", "Smallest node depth HashLife splits up", 'i',
+                                                                  &pardepth },
+  { "",   "--calcbits", "Log2 of multistate slowcalc cache size (0 = off)",
+                                                             'i', &calcbits },
+  { "",   "--planesteps", "Longest Generations step run on bit-planes",
+                                                           'i', &planesteps },
+  { "",   "--segments", "Show which engine ran each segment (Adaptive)",
+                                                           'b', &segments },
+  { "",   "--scaling", "Time -m gens at 1, 2, 4 ... --threads threads", 'b',
+                                                                   &scaling },
   { 0, 0, 0, 0, 0 }
 } ;
 
@@ -210,6 +228,7 @@ void writepat(int fc) {
    if (!outputismc && (t < -MAXRLE || l < -MAXRLE || b > MAXRLE || r > MAXRLE))
       lifefatal("Pattern too large to write in RLE format") ;
    const char *err = writepattern(thisfilename, *imp,
+                                  outputisbinary ? MCB_format :
                                   outputismc ? MC_format : RLE_format,
                                   outputgzip ? gzip_compression : no_compression,
                                   t.toint(), l.toint(), b.toint(), r.toint()) ;
@@ -452,6 +471,7 @@ lifealgo *createUniverse() {
    if (imp == 0)
       lifefatal("Could not create universe") ;
    imp->setMaxMemory(maxmem) ;
+   imp->setNumThreads(numthreads) ;
    return imp ;
 }
 
@@ -515,6 +535,58 @@ void runtestscript(const char *testscript) {
    exit(0) ;
 }
 
+/*
+ *   The scaling benchmark runs the pattern to maxgen from scratch with
+ *   1, 2, 4, ... threads (and finally numthreads) and reports the time
+ *   and speedup of each run, plus the population so runs can be checked
+ *   against each other.
+ */
+void runscaling() {
+   if (maxgen < 0)
+      lifefatal("Scaling benchmark needs a generation count (-m)") ;
+   double base = 0 ;
+   int maxthreads = numthreads ;
+   for (int n=1; ; n=(2*n < maxthreads ? 2*n : maxthreads)) {
+      delete imp ;
+      numthreads = n ;
+      imp = createUniverse() ;
+      const char *err = readpattern(filename, *imp) ;
+      if (err) lifefatal(err) ;
+      if (liferule) {
+         err = imp->setrule(liferule) ;
+         if (err) lifefatal(err) ;
+      }
+      bool boundedgrid = imp->unbounded && (imp->gridwd > 0 || imp->gridht > 0) ;
+      if (boundedgrid)
+         imp->setIncrement(1) ;
+      else if (inc != 0)
+         imp->setIncrement(inc) ;
+      double t = gollySecondCount() ;
+      while (imp->getGeneration() < maxgen) {
+         if (!boundedgrid && inc == 0) {
+            bigint diff = maxgen ;
+            diff -= imp->getGeneration() ;
+            int bs = diff.lowbitset() ;
+            diff = 1 ;
+            diff <<= bs ;
+            imp->setIncrement(diff) ;
+         }
+         if (boundedgrid && !imp->CreateBorderCells()) break ;
+         imp->step() ;
+         if (boundedgrid && !imp->DeleteBorderCells()) break ;
+      }
+      t = gollySecondCount() - t ;
+      if (n == 1)
+         base = t ;
+      printf("threads %d: %.3fs speedup %.2f gen %s", n, t,
+             (t > 0 ? base / t : 0.0), imp->getGeneration().tostring()) ;
+      printf(" pop %s\n", imp->getPopulation().tostring()) ;
+      fflush(stdout) ;
+      if (n >= maxthreads)
+         break ;
+   }
+}
+
 int main(int argc, char *argv[]) {
    cout << "This is bgolly " STRINGIFY(VERSION) " Copyright 2005-2026 The Golly Gang."
         << endl ;
@@ -529,6 +601,7 @@ int main(int argc, char *argv[]) {
    jvnalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    superalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    ruleloaderalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   adaptivealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    while (argc > 1 && argv[1][0] == '-') {
       argc-- ;
       argv++ ;
@@ -578,15 +651,20 @@ case 's':
       if (endswith(outfilename, ".rle")) {
       } else if (endswith(outfilename, ".mc")) {
          outputismc = 1 ;
+      } else if (endswith(outfilename, ".mcb")) {
+         outputismc = outputisbinary = 1 ;
 #ifdef ZLIB
       } else if (endswith(outfilename, ".rle.gz")) {
          outputgzip = 1 ;
       } else if (endswith(outfilename, ".mc.gz")) {
          outputismc = 1 ;
          outputgzip = 1 ;
+      } else if (endswith(outfilename, ".mcb.gz")) {
+         outputismc = outputisbinary = 1 ;
+         outputgzip = 1 ;
 #endif
       } else {
-         lifefatal("Output filename must end with .rle or .mc.") ;
+         lifefatal("Output filename must end with .rle, .mc or .mcb.") ;
       }
       if (strlen(outfilename) > 200)
          lifefatal("Output filename too long") ;
@@ -601,8 +679,19 @@ case 's':
    if (verbose) {
       hlifealgo::setVerbose(1) ;
    }
+   if (pardepth)
+      hlifealgo::setParallelDepth(pardepth) ;
+   if (calcbits >= 0)
+      ghashbase::setCalcCacheBits(calcbits > 30 ? 30 : calcbits) ;
+   if (planesteps >= 0)
+      generationsalgo::setPlaneSteps(planesteps) ;
    imp->setMaxMemory(maxmem) ;
    timestamp() ;
+   if (scaling) {
+      filename = argv[1] ;
+      runscaling() ;
+      exit(0) ;
+   }
    if (testscript) {
       if (argc > 1) {
          filename = argv[1] ;
@@ -677,12 +766,29 @@ case 's':
       if (timeline) imp->extendtimeline() ;
       if (maxgen < 0 && outfilename != 0)
          writepat(fc++) ;
-      if (timeline && imp->getframecount() + 2 > MAX_FRAME_COUNT)
+      if (timeline && imp->timelinefull())
          imp->pruneframes() ;
       if (hyperxxx)
          imp->setIncrement(imp->getGeneration()) ;
    }
    if (maxgen >= 0 && outfilename != 0)
       writepat(-1) ;
+   if (verbose) {
+      const char *s = imp->getPerfSummary() ;
+      if (s)
+         lifestatus(s) ;
+   }
+   if (segments && strcmp(algoName, "Adaptive") == 0) {
+      const vector<adaptivesegment> &segs = ((adaptivealgo *)imp)->getSegments() ;
+      for (unsigned int i=0; i<segs.size(); i++) {
+         if (segs[i].steps == 0)
+            continue ;
+         cout << adaptivealgo::engineName(segs[i].engine) << " gens " ;
+         cout << segs[i].start.tostring() ;
+         cout << ".." << segs[i].end.tostring() ;
+         cout << " steps " << segs[i].steps << " time " << segs[i].seconds
+              << " copy " << segs[i].copyseconds << endl ;
+      }
+   }
    exit(0) ;
 }
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Round-trip test for the macrocell reader and writer.  Run it from the
+# top of the source tree once bgolly is built:
+#
+#    sh cmdline/mcroundtrip.sh [path/to/bgolly]
+#
+# Each pattern is loaded by a bgolly --exec script and saved as .mc and
+# .mc.gz, then both copies are loaded and saved again.  Every saved
+# file must be byte-identical to the first, and every load must give
+# the same generation, population and bounding box.  A random soup big
+# enough (over 1MB as .mc) to go through the mapped reader is included,
+# and everything is read with both 1 and 4 threads.
+
+BGOLLY=${1:-./bgolly}
+PATTERNS="Patterns/HashLife/Eventful/gotts-dots.mc
+Patterns/HashLife/Eventful/metacatacryst.mc
+Patterns/HashLife/Metacell/metapixel-galaxy.mc.gz
+Patterns/HashLife/Constructions/demonoid-c512-hashlife-friendly.mc.gz"
+
+T=`mktemp -d` || exit 1
+trap 'rm -rf $T' 0
+
+# 2000x2000 soup at 50% density
+awk 'BEGIN { srand(1) ; print "x = 2000, y = 2000, rule = B3/S23"
+             for (y = 0; y < 2000; y++) {
+                s = "" ; for (x = 0; x < 2000; x++) s = s (rand() < 0.5 ? "o" : "b")
+                print s "$"
+             }
+             print "!" }' > $T/soup.rle
+$BGOLLY -a HashLife -q -q -m 0 -o $T/soup.mc $T/soup.rle > /dev/null 2>&1
+if [ `wc -c < $T/soup.mc` -lt 1048576 ]; then
+   echo "FAIL: soup.mc is too small to use the mapped reader"
+   exit 1
+fi
+
+fails=0
+for f in $PATTERNS $T/soup.mc; do
+   for threads in 1 4; do
+      rm -f $T/a.mc $T/a.mc.gz $T/b.mc $T/c.mc
+      cat > $T/script <<EOF
+load $f
+show
+edges
+save $T/a.mc
+save $T/a.mc.gz
+new
+load $T/a.mc
+show
+edges
+save $T/b.mc
+new
+load $T/a.mc.gz
+show
+edges
+save $T/c.mc
+EOF
+      $BGOLLY -a HashLife --threads $threads --exec $T/script > $T/out 2>&1
+      status=$?
+      # each load must report the same generation:population and edges
+      loads=`grep -v -e '^Warning' -e '^Fatal' $T/out | sort | uniq -c | awk '{ print $1 }' | sort -u`
+      if [ $status -ne 0 ] || grep -q -e '^Warning' -e '^Fatal' $T/out ||
+         [ "$loads" != "3" ] ||
+         ! cmp -s $T/a.mc $T/b.mc || ! cmp -s $T/a.mc $T/c.mc ||
+         ! gzip -dc $T/a.mc.gz | cmp -s $T/a.mc -; then
+         echo "FAIL: $f with $threads thread(s)"
+         cat $T/out
+         fails=`expr $fails + 1`
+      else
+         echo "ok: $f with $threads thread(s)"
+      fi
+   done
+done
+if [ $fails -ne 0 ]; then
+   echo "$fails failed"
+   exit 1
+fi
+echo "all passed"
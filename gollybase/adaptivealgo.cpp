@@ -0,0 +1,351 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "adaptivealgo.h"
+#include "qlifealgo.h"
+#include "hlifealgo.h"
+#include <algorithm>
+#include <cmath>
+using namespace std ;
+/*
+ *   How many population samples we keep while in QuickLife, and the
+ *   normalized entropy of their differences below which we call the
+ *   pattern regular.
+ */
+const int ADAPTWINDOW = 16 ;
+const double REGULAR = 0.5 ;
+/*
+ *   A HashLife try lasts at least MINJUDGE seconds times the trial
+ *   factor, which doubles each time a try fails (up to MAXTRIAL) and
+ *   goes back to 1 when HashLife wins.  Moving the cells across isn't
+ *   free on a big pattern, so a try is charged for copying them both
+ *   ways, and QuickLife runs TRIALSHARE times as long as the last try
+ *   plus its copying took between tries; that way failed tries cost a
+ *   few percent at most.  A regular pattern gets tried after only
+ *   REGULARSHARE times as long.
+ */
+const double MINJUDGE = 0.05 ;
+const int MAXTRIAL = 1 << 10 ;
+const double TRIALSHARE = 16 ;
+const double REGULARSHARE = 2 ;
+/*
+ *   HashLife loses if it is slower than QuickLife was and either hits
+ *   its cache less than this often or had to gc.  QuickLife loses
+ *   straight away if HashLife was doing more than twice as well.
+ */
+const double MINHITRATE = 0.5 ;
+/*
+ *   Beyond these we never move a pattern from HashLife to QuickLife:
+ *   QuickLife coordinates are ints, and past a point copying the
+ *   cells costs more than anything it might buy us.  Cells are copied
+ *   in strips at most MIGRATESTRIP wide, so widths fit in an int.
+ */
+const int MAXQUICKCOORD = 1000000000 ;
+const double MAXMIGRATE = 1 << 26 ;
+const int MIGRATESTRIP = 1 << 30 ;
+/*
+ *   Passes the rows getrows finds in one engine to setrow in another.
+ */
+class rowcopier : public rowvisitor {
+public:
+   rowcopier(lifealgo *d) : dst(d) {}
+   virtual bool row(int x, int y, const int *runs, int nruns) {
+      return dst->setrow(x, y, runs, nruns) >= 0 ;
+   }
+   lifealgo *dst ;
+} ;
+adaptivealgo::adaptivealgo() {
+   maxCellStates = 2 ;
+   maxmem = 0 ;
+   quickrate = hashrate = 0 ;
+   trial = 1 ;
+   copyin = roundtrip = 0 ;
+   engine = QUICK ;
+   cur = newengine(QUICK) ;
+   startsegment() ;
+}
+adaptivealgo::~adaptivealgo() {
+   delete cur ;
+}
+lifealgo *adaptivealgo::newengine(int e) {
+   lifealgo *a ;
+   if (e == HASH)
+      a = new hlifealgo() ;
+   else
+      a = new qlifealgo() ;
+   if (maxmem > 0)
+      a->setMaxMemory(maxmem) ;
+   a->setNumThreads(numthreads) ;
+   a->setpoll(poller) ;
+   return a ;
+}
+/*
+ *   Start a new segment for the current engine, dropping the last
+ *   one if it never ran.
+ */
+void adaptivealgo::startsegment() {
+   if (!segments.empty() && segments.back().steps == 0)
+      segments.pop_back() ;
+   adaptivesegment s ;
+   s.engine = engine ;
+   s.start = s.end = generation ;
+   s.steps = 0 ;
+   s.seconds = s.copyseconds = 0 ;
+   segments.push_back(s) ;
+   pops.clear() ;
+   regular = 0 ;
+   wsteps = 0 ;
+   wseconds = wgens = wcopy = 0 ;
+   if (engine == HASH)
+      mark = ((hlifealgo *)cur)->getPerfCounters() ;
+}
+/*
+ *   The bounded grid parameters are parsed by the engine's setrule;
+ *   our copies are the ones the border routines look at.
+ */
+void adaptivealgo::syncgrid() {
+   gridwd = cur->gridwd ;
+   gridht = cur->gridht ;
+   gridleft = cur->gridleft ;
+   gridright = cur->gridright ;
+   gridtop = cur->gridtop ;
+   gridbottom = cur->gridbottom ;
+   boundedplane = cur->boundedplane ;
+   sphere = cur->sphere ;
+   htwist = cur->htwist ;
+   vtwist = cur->vtwist ;
+   hshift = cur->hshift ;
+   vshift = cur->vshift ;
+   unbounded = cur->unbounded ;
+   grid_type = cur->getgridtype() ;
+}
+/*
+ *   Move the pattern into a fresh engine of the given kind and free
+ *   the old one.  Cells go across a row at a time with getrows and
+ *   setrow, so nothing is written out as text.  The time it takes is
+ *   counted in the new segment.  Returns 0 (and changes nothing) if
+ *   the pattern can't or shouldn't go.
+ */
+int adaptivealgo::migrate(int e) {
+   if (e == engine)
+      return 1 ;
+   double start = gollySecondCount() ;
+   lifealgo *src = cur ;
+   bigint t, l, b, r ;
+   int empty = src->isEmpty() ;
+   if (!empty) {
+      src->findedges(&t, &l, &b, &r) ;
+      if (e == QUICK &&
+          (t < -MAXQUICKCOORD || l < -MAXQUICKCOORD ||
+           b > MAXQUICKCOORD || r > MAXQUICKCOORD ||
+           src->getPopulation().todouble() > MAXMIGRATE))
+         return 0 ;
+   }
+   lifealgo *dst = newengine(e) ;
+   // QuickLife's cell layout depends on the generation's parity
+   dst->setGeneration(generation) ;
+   dst->setIncrement(increment) ;
+   if (dst->setrule(src->getrule()) != 0) {
+      delete dst ;
+      return 0 ;
+   }
+   if (!empty) {
+      int top = t.toint(), left = l.toint() ;
+      int bottom = b.toint(), right = r.toint() ;
+      rowcopier copier(dst) ;
+      for (int x=left; ; x += MIGRATESTRIP) {
+         G_INT64 w = (G_INT64)right - x + 1 ;
+         if (w > MIGRATESTRIP)
+            w = MIGRATESTRIP ;
+         if (!src->getrows(x, top, (int)w, bottom - top + 1, copier)) {
+            delete dst ;
+            return 0 ;
+         }
+         if ((G_INT64)right - x < MIGRATESTRIP)
+            break ;
+      }
+   }
+   dst->endofpattern() ;
+   if (verbose)
+      lifestatus(engine == HASH ? "Adaptive: HashLife -> QuickLife" :
+                                  "Adaptive: QuickLife -> HashLife") ;
+   delete src ;
+   cur = dst ;
+   engine = e ;
+   startsegment() ;
+   double copy = gollySecondCount() - start ;
+   segments.back().seconds = segments.back().copyseconds = copy ;
+   if (e == HASH) {
+      // assume getting back will take as long
+      copyin = copy ;
+      wseconds = wcopy = 2 * copy ;
+   } else {
+      roundtrip = copyin + copy ;
+   }
+   return 1 ;
+}
+/*
+ *   Entropy of the population changes between recent steps, scaled
+ *   to 0..1.  Oscillators, spaceships and guns stepped by a multiple
+ *   of their period repeat the same few changes; soups almost never
+ *   do.
+ */
+double adaptivealgo::popentropy() {
+   vector<double> d ;
+   for (size_t i=1; i<pops.size(); i++)
+      d.push_back(pops[i] - pops[i-1]) ;
+   int n = (int)d.size() ;
+   if (n < 2)
+      return 1 ;
+   sort(d.begin(), d.end()) ;
+   double h = 0 ;
+   for (int i=0; i<n; ) {
+      int j = i ;
+      while (j < n && d[j] == d[i])
+         j++ ;
+      double p = (double)(j - i) / n ;
+      h -= p * log2(p) ;
+      i = j ;
+   }
+   return h / log2((double)n) ;
+}
+/*
+ *   Called after every step to decide whether to switch engines.
+ */
+void adaptivealgo::choose() {
+   adaptivesegment &s = segments.back() ;
+   if (engine == QUICK) {
+      // counting QuickLife's population costs about as much as a
+      // generation, so we only sample one window's worth of steps,
+      // once we could try HashLife if the pattern turned out regular
+      double gap = MINJUDGE * trial + roundtrip ;
+      if (s.seconds >= REGULARSHARE * gap && !regular &&
+          (int)pops.size() <= ADAPTWINDOW) {
+         pops.push_back(cur->getPopulation().todouble()) ;
+         if ((int)pops.size() == ADAPTWINDOW)
+            regular = popentropy() < REGULAR ;
+      }
+      if (s.seconds <= s.copyseconds)
+         return ;
+      bigint gens = s.end ;
+      gens -= s.start ;
+      double rate = gens.todouble() / (s.seconds - s.copyseconds) ;
+      if (!regular && s.seconds < TRIALSHARE * gap &&
+          !(hashrate > 0 && s.seconds >= MINJUDGE && rate * 2 < hashrate))
+         return ;
+      quickrate = rate ;
+      migrate(HASH) ;
+   } else {
+      if (wseconds - wcopy < MINJUDGE * trial)
+         return ;
+      const hperf &p = ((hlifealgo *)cur)->getPerfCounters() ;
+      double lookups = p.cacheLookups - mark.cacheLookups ;
+      double misses = p.nodesCalculated - mark.nodesCalculated ;
+      double hitrate = lookups > 0 ? 1 - misses / lookups : 1 ;
+      int thrashing = p.gcCount > mark.gcCount ;
+      hashrate = wgens / wseconds ;
+      mark = p ;
+      wsteps = 0 ;
+      wseconds = wgens = wcopy = 0 ;
+      if (verbose) {
+         char msg[200] ;
+         sprintf(msg, "Adaptive: HashLife %g gens/s (QuickLife %g) hits %.1f%%%s",
+                 hashrate, quickrate, 100 * hitrate, thrashing ? " gc" : "") ;
+         lifestatus(msg) ;
+      }
+      // with no QuickLife timing (we started from a macrocell file)
+      // only a failing cache sends us there
+      int worse = quickrate > 0 ? hashrate < quickrate : thrashing ;
+      if (worse && (hitrate < MINHITRATE || (quickrate > 0 && thrashing))) {
+         if (migrate(QUICK))
+            trial = min(2 * trial, MAXTRIAL) ;
+      } else if (!worse) {
+         trial = 1 ;
+      }
+   }
+}
+void adaptivealgo::step() {
+   cur->setpoll(poller) ;
+   double t = gollySecondCount() ;
+   cur->step() ;
+   t = gollySecondCount() - t ;
+   bigint gens = cur->getGeneration() ;
+   gens -= generation ;
+   generation = cur->getGeneration() ;
+   adaptivesegment &s = segments.back() ;
+   s.end = generation ;
+   s.steps++ ;
+   s.seconds += t ;
+   wsteps++ ;
+   wseconds += t ;
+   wgens += gens.todouble() ;
+   if (!poller->isInterrupted())
+      choose() ;
+}
+void adaptivealgo::setIncrement(bigint inc) {
+   increment = inc ;
+   cur->setIncrement(inc) ;
+}
+void adaptivealgo::setGeneration(bigint gen) {
+   generation = gen ;
+   cur->setGeneration(gen) ;
+   startsegment() ;
+}
+void adaptivealgo::setMaxMemory(int m) {
+   maxmem = m ;
+   cur->setMaxMemory(m) ;
+}
+void adaptivealgo::setNumThreads(int n) {
+   lifealgo::setNumThreads(n) ;
+   cur->setNumThreads(numthreads) ;
+}
+const char *adaptivealgo::setrule(const char *s) {
+   const char *err = cur->setrule(s) ;
+   if (err)
+      return err ;
+   syncgrid() ;
+   return 0 ;
+}
+/*
+ *   Only HashLife reads and writes macrocells.  Reading replaces the
+ *   whole pattern, so there is nothing to carry across.
+ */
+const char *adaptivealgo::readmacrocell(char *line) {
+   if (engine != HASH) {
+      lifealgo *h = newengine(HASH) ;
+      h->setrule(cur->getrule()) ;
+      delete cur ;
+      cur = h ;
+      engine = HASH ;
+   }
+   const char *err = cur->readmacrocell(line) ;
+   generation = cur->getGeneration() ;
+   syncgrid() ;
+   startsegment() ;
+   return err ;
+}
+const char *adaptivealgo::writeNativeFormat(std::ostream &os, char *comments) {
+   if (!migrate(HASH))
+      return "Pattern could not be moved to HashLife." ;
+   return cur->writeNativeFormat(os, comments) ;
+}
+const char *adaptivealgo::writeBinaryMacrocell(std::ostream &os) {
+   if (!migrate(HASH))
+      return "Pattern could not be moved to HashLife." ;
+   return cur->writeBinaryMacrocell(os) ;
+}
+static lifealgo *creator() { return new adaptivealgo() ; }
+void adaptivealgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
+   ai.setAlgorithmName("Adaptive") ;
+   ai.setAlgorithmCreator(&creator) ;
+   ai.setDefaultBaseStep(8) ;
+   ai.setDefaultMaxMem(500) ; // MB
+   ai.minstates = 2 ;
+   ai.maxstates = 2 ;
+   // init default color scheme
+   ai.defgradient = false;
+   ai.defr1 = ai.defg1 = ai.defb1 = 255;        // start color = white
+   ai.defr2 = ai.defg2 = ai.defb2 = 255;        // end color = white
+   ai.defr[0] = ai.defg[0] = ai.defb[0] = 48;   // 0 state = dark gray
+   ai.defr[1] = ai.defg[1] = ai.defb[1] = 255;  // 1 state = white
+}
@@ -0,0 +1,110 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   An algorithm that picks between QuickLife and HashLife for you.
+ *   The pattern lives in exactly one of the two at any time; every
+ *   call is passed on to it.  After each step we look at how the
+ *   engine is doing and, if the other one looks like it would do
+ *   better, we move the cells across directly (no text round trip)
+ *   and carry on from the same generation.
+ *
+ *   While in QuickLife we watch the population; when the sequence of
+ *   per-step changes has low entropy the pattern is regular and
+ *   HashLife probably wins, so we try it soon, and otherwise we try
+ *   it now and then.  While in HashLife we watch its cache hit rate
+ *   and gcs (see hperf); if the hit rate is low and it is running
+ *   slower than QuickLife did, we go back and wait twice as long
+ *   before trying again.
+ */
+#ifndef ADAPTIVEALGO_H
+#define ADAPTIVEALGO_H
+#include "lifealgo.h"
+#include "util.h"
+#include <vector>
+/*
+ *   A stretch of generations run by one engine.
+ */
+struct adaptivesegment {
+   int engine ;          // adaptivealgo::QUICK or adaptivealgo::HASH
+   bigint start, end ;   // generations
+   int steps ;
+   double seconds ;      // including copyseconds,
+   double copyseconds ;  // the time moving the cells in took
+} ;
+class adaptivealgo : public lifealgo {
+public:
+   adaptivealgo() ;
+   virtual ~adaptivealgo() ;
+   virtual int setcell(int x, int y, int newstate) {
+      return cur->setcell(x, y, newstate) ;
+   }
+   virtual int getcell(int x, int y) { return cur->getcell(x, y) ; }
+   virtual int setrow(int x, int y, const int *runs, int nruns) {
+      return cur->setrow(x, y, runs, nruns) ;
+   }
+   virtual bool getrows(int x, int y, int w, int h, rowvisitor &v) {
+      return cur->getrows(x, y, w, h, v) ;
+   }
+   virtual int nextcell(int x, int y, int &v) { return cur->nextcell(x, y, v) ; }
+   virtual void endofpattern() { cur->endofpattern() ; }
+   virtual void setIncrement(bigint inc) ;
+   virtual void setIncrement(int inc) { setIncrement(bigint(inc)) ; }
+   virtual void setGeneration(bigint gen) ;
+   virtual const bigint &getPopulation() { return cur->getPopulation() ; }
+   virtual int isEmpty() { return cur->isEmpty() ; }
+   virtual int hyperCapable() { return 1 ; }
+   virtual void setMaxMemory(int m) ;
+   virtual int getMaxMemory() { return cur->getMaxMemory() ; }
+   virtual const char *setrule(const char *s) ;
+   virtual const char *getrule() { return cur->getrule() ; }
+   virtual void step() ;
+   // no canonical state (the engine can change between frames), so
+   // lifealgo records timelines as cell frames, as for QuickLife
+   virtual void* getcurrentstate() { return 0 ; }
+   virtual void setcurrentstate(void *) {}
+   virtual void draw(viewport &view, liferender &renderer) {
+      cur->draw(view, renderer) ;
+   }
+   virtual void fit(viewport &view, int force) { cur->fit(view, force) ; }
+   virtual void lowerRightPixel(bigint &x, bigint &y, int mag) {
+      cur->lowerRightPixel(x, y, mag) ;
+   }
+   virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) {
+      cur->findedges(t, l, b, r) ;
+   }
+   virtual const char *readmacrocell(char *line) ;
+   virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual const char *writeBinaryMacrocell(std::ostream &os) ;
+   virtual void setNumThreads(int n) ;
+   virtual const char *getPerfSummary() { return cur->getPerfSummary() ; }
+   enum { QUICK = 0, HASH = 1 } ;
+   int getEngine() { return engine ; }
+   static const char *engineName(int e) { return e == HASH ? "HashLife" : "QuickLife" ; }
+   // one entry per engine switch, the last one still growing
+   const std::vector<adaptivesegment> &getSegments() { return segments ; }
+   static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+private:
+   lifealgo *newengine(int e) ;
+   int migrate(int e) ;
+   void startsegment() ;
+   void syncgrid() ;
+   double popentropy() ;
+   void choose() ;
+   lifealgo *cur ;
+   int engine ;
+   int maxmem ;
+   std::vector<adaptivesegment> segments ;
+   std::vector<double> pops ;   // population after some QuickLife steps
+   int regular ;                // and whether they changed regularly
+   double quickrate ;           // generations per second, last QuickLife run
+   double hashrate ;            // and last time HashLife was judged
+   int trial ;                  // scales how long tries and the gaps last
+   double copyin ;              // seconds the last move to HashLife took
+   double roundtrip ;           // and the last move there and back
+   double wcopy ;               // copying charged to the HashLife window
+   int wsteps ;                 // HashLife steps, time and generations
+   double wseconds, wgens ;     // since we last judged it
+   hperf mark ;                 // HashLife counters when we last judged it
+} ;
+#endif
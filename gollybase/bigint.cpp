@@ -394,6 +394,41 @@ void bigint::mul_smallint(int a) {
       v.p[pos+1] = -((c >> 31) & 1) ;
    }
 }
+/*
+ *   General multiplication.  We feed the multiplier to mul_smallint
+ *   fifteen bits at a time (it can't take more without overflowing)
+ *   and sum the shifted partial products; numbers that fit in an int
+ *   are multiplied directly.
+ */
+bigint& bigint::operator*=(const bigint &b) {
+   if ((v.i & 1) && (b.v.i & 1)) {
+      *this = bigint((G_INT64)(v.i >> 1) * (G_INT64)(b.v.i >> 1)) ;
+      return *this ;
+   }
+   bigint m(b) ;
+   int neg = (m < zero) ;
+   if (neg) {
+      m = 0 ;
+      m -= b ;
+   }
+   bigint r(0) ;
+   for (int sh=0; m > zero; sh += 15) {
+      int c = m.low31() & 0x7fff ;
+      if (c) {
+         bigint t(*this) ;
+         t.mul_smallint(c) ;
+         t.mulpow2(sh) ;
+         r += t ;
+      }
+      m >>= 15 ;
+   }
+   if (neg) {
+      *this = 0 ;
+      *this -= r ;
+   } else
+      *this = r ;
+   return *this ;
+}
 void bigint::div_smallint(int a) {
    if (v.i & 1) {
       int r = (v.i >> 1) / a ;
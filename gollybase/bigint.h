@@ -66,7 +66,7 @@
  *   The only upper bound on the size of these numbers is memory.
  *
  *   We only provide a limited number of arithmetic operations for the
- *   moment.  (Addition, subtraction, comparison, bit extraction,
+ *   moment.  (Addition, subtraction, multiplication, comparison, bit extraction,
  *   radix conversion, parsing, copying, assignment, to float, to double,
  *   to int, to long long, minbits).
  */
@@ -103,6 +103,7 @@ public:
    bigint& operator-=(const bigint &a) ;
    bigint& operator>>=(int i) ;
    bigint& operator<<=(int i) ;
+   bigint& operator*=(const bigint &b) ;
    void mulpow2(int p) ;
    int operator==(const bigint &b) const ;
    int operator!=(const bigint &b) const ;
@@ -51,6 +51,41 @@ state generationsalgo::slowcalc(state nw, state n, state ne, state w, state c,
    return result ;
 }
 
+/*
+ *   A whole block at once:  first a row of bits per input row marking the
+ *   cells in state 1 (leftmost cell in the high bit), from which each
+ *   3x3 index is three shifts and masks, and then the same rules as
+ *   slowcalc.  No loop here depends on the results of another cell, so
+ *   this needs neither the slowcalc cache nor a virtual call per cell.
+ */
+void generationsalgo::slowcalcblock(const state *in, state *out, int n) {
+   int wd = n + 2 ;
+   int rowbits[MAXCALCBLOCK + 2] ;
+   for (int y=0; y<wd; y++) {
+      int bits = 0 ;
+      for (int x=0; x<wd; x++)
+         bits = (bits << 1) | (in[y*wd+x] == 1) ;
+      rowbits[y] = bits ;
+   }
+   for (int y=0; y<n; y++) {
+      const state *crow = in + (y+1) * wd + 1 ;
+      for (int x=0; x<n; x++) {
+         int sh = n - 1 - x ;
+         int index = (((rowbits[y] >> sh) & 7) << 6) |
+                     (((rowbits[y+1] >> sh) & 7) << 3) |
+                     ((rowbits[y+2] >> sh) & 7) ;
+         state c = crow[x] ;
+         if (c <= 1 && rule3x3[index])
+            c = 1 ;
+         else if (c > 0 && c + 1 < maxCellStates)
+            c = c + 1 ;
+         else
+            c = 0 ;
+         *out++ = c ;
+      }
+   }
+}
+
 static lifealgo *creator() { return new generationsalgo() ; }
 
 void generationsalgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
@@ -138,10 +173,12 @@ generationsalgo::generationsalgo() {
    }
 
    // initialize
+   planeable = false ;
    initRule() ;
 }
 
 generationsalgo::~generationsalgo() {
+   spillallpinned() ;   // needs our getrule, so can't wait for ghashbase
 }
 
 // returns a count of the number of bits set in given int
@@ -1173,6 +1210,9 @@ const char *generationsalgo::setrule(const char *rulestring) {
    // save the canonical rule name
    createCanonicalName(bpos) ;
 
+   // see whether the bit-plane engine can run it
+   initPlanes() ;
+
    // set grid_type
    if (neighbormask == HEXAGONAL)
       grid_type = HEX_GRID;
@@ -1188,3 +1228,251 @@ const char *generationsalgo::setrule(const char *rulestring) {
 const char* generationsalgo::getrule() {
    return canonrule ;
 }
+
+/*
+ *   Bit-plane engine.  Many Generations patterns are chaotic, and
+ *   hashing buys nothing for them, so short steps are run by brute force
+ *   instead:  the live area is copied out of the tree into bit-planes
+ *   (plane p holds bit p of every cell's state, 64 cells to a word),
+ *   stepped a word at a time, and hashed back in.  Neighbor counts are
+ *   kept in four bit-sliced counter words, so this only works for rules
+ *   that depend on nothing but the number of live neighbors.
+ *
+ *   Only steps of MINPLANESTEP up to planesteps generations are tried
+ *   on planes.  Even then, hashing wins on patterns with enough
+ *   repetition in them, so step() times every step and keeps to
+ *   whichever way was faster per generation last time (a step planes
+ *   turn down counts as planes losing).  Patterns change, so now and
+ *   then it tries the other way again, less often each time that way
+ *   loses.  Hashing gets two steps, as the first one after planes
+ *   starts with nothing in the cache, unless the first is so far
+ *   behind that a warm cache won't save it.
+ */
+int generationsalgo::planesteps = 64 ;
+const int MINPLANESTEP = 8 ;         // shorter steps don't pay for the copying
+const int PLANERETRY = 16 ;          // steps between tries, to start with
+const int MAXPLANERETRY = 256 ;
+const double PLANEMARGIN = 4 ;
+const g_uintptr_t MAXPLANECELLS = 1 << 26 ;
+const int PLANEDENSITY = 64 ;        // at least 1 in this many cells live
+typedef unsigned long long pword ;
+
+void generationsalgo::initPlanes() {
+   // check each 3x3 against the others with the same center and count
+   int nbrs = neighbormask & ~0x10 ;
+   int seen = 0 ;
+   planesecs = hashsecs = 0 ;
+   planeruns = planetrial = 0 ;
+   planeretry = PLANERETRY ;
+   planeable = true ;
+   countbits = 0 ;
+   for (int i = 0 ; i < ALL3X3 ; i++) {
+      int k = 1 << (bitcount(i & nbrs) + ((i & 0x10) ? survival_offset : 0)) ;
+      int v = rule3x3[i] ? k : 0 ;
+      if (seen & k) {
+         if ((countbits & k) != v)
+            planeable = false ;
+      } else {
+         seen |= k ;
+         countbits |= v ;
+      }
+   }
+}
+
+// add x to the bit-sliced counters c0..c3
+static inline void addcount(pword &c0, pword &c1, pword &c2, pword &c3,
+                            pword x) {
+   pword t = c0 & x ;
+   c0 ^= x ;
+   x = c1 & t ;
+   c1 ^= t ;
+   t = c2 & x ;
+   c2 ^= x ;
+   c3 |= t ;
+}
+
+// cells whose count is one of those with a bit set in bits
+static inline pword countin(int bits, pword c0, pword c1, pword c2,
+                            pword c3) {
+   pword r = 0 ;
+   for (int k = 0 ; bits ; k++, bits >>= 1)
+      if (bits & 1)
+         r |= ((k & 1) ? c0 : ~c0) & ((k & 2) ? c1 : ~c1) &
+              ((k & 4) ? c2 : ~c2) & ((k & 8) ? c3 : ~c3) ;
+   return r ;
+}
+
+bool generationsalgo::stepPlanes(int gens) {
+   // sparse patterns are better off hashed
+   const bigint &pop = getPopulation() ;
+   if (pop < 0)
+      return false ;
+   g_uintptr_t maxcells = MAXPLANECELLS ;
+   if (pop.todouble() * PLANEDENSITY < maxcells)
+      maxcells = (g_uintptr_t)(pop.todouble() * PLANEDENSITY) ;
+   vector<state> cells ;
+   int x0, y0, wd, ht ;
+   if (!getgrid(gens, maxcells, cells, x0, y0, wd, ht))
+      return false ;
+   if (wd == 0) {
+      generation += gens ;
+      return true ;
+   }
+   int nplanes = 1 ;
+   while ((1 << nplanes) < maxCellStates)
+      nplanes++ ;
+   int ww = (wd + 63) >> 6 ;
+   g_uintptr_t pn = (g_uintptr_t)ww * ht ;
+   vector<pword> cur(nplanes * pn, 0), nxt(nplanes * pn, 0) ;
+   // live cells, with an empty row above and below
+   vector<pword> live(pn + 2 * ww, 0) ;
+   // pad rows to whole words so we can go 8 cells at a time
+   int pwd = ww << 6 ;
+   vector<state> row(pwd, 0) ;
+   for (int y = 0 ; y < ht ; y++) {
+      memcpy(&row[0], &cells[(g_uintptr_t)y * wd], wd) ;
+      for (int w = 0 ; w < ww ; w++) {
+         for (int j = 0 ; j < 8 ; j++) {
+            pword v ;
+            memcpy(&v, &row[(w << 6) + (j << 3)], 8) ;
+            if (v == 0)
+               continue ;
+            for (int p = 0 ; p < nplanes ; p++) {
+               // gather bit p of each byte into one byte, first cell lowest
+               pword b = (((v >> p) & 0x0101010101010101ULL) *
+                          0x0102040810204080ULL) >> 56 ;
+               cur[p * pn + (g_uintptr_t)y * ww + w] |= b << (j << 3) ;
+            }
+         }
+      }
+   }
+   // which of the eight neighbors count: nw n ne w e sw s se
+   pword en[8] ;
+   static const int nbit[8] = { 256, 128, 64, 32, 8, 4, 2, 1 } ;
+   for (int i = 0 ; i < 8 ; i++)
+      en[i] = (neighbormask & nbit[i]) ? ~(pword)0 : 0 ;
+   int births = countbits & 0x1ff ;
+   int survivals = countbits >> survival_offset ;
+   pword dies = (maxCellStates > 2) ? ~(pword)0 : 0 ;
+   for (int g = 0 ; g < gens ; g++) {
+      for (g_uintptr_t i = 0 ; i < pn ; i++) {
+         pword a = cur[i] ;
+         for (int p = 1 ; p < nplanes ; p++)
+            a &= ~cur[p * pn + i] ;
+         live[ww + i] = a ;
+      }
+      for (int y = 0 ; y < ht ; y++) {
+         if (poller->poll())
+            return false ;
+         const pword *up = &live[(g_uintptr_t)y * ww] ;
+         const pword *mid = up + ww ;
+         const pword *dn = mid + ww ;
+         for (int w = 0 ; w < ww ; w++) {
+            g_uintptr_t i = (g_uintptr_t)y * ww + w ;
+            pword c0 = 0, c1 = 0, c2 = 0, c3 = 0 ;
+            const pword *r3[3] = { up, mid, dn } ;
+            for (int k = 0 ; k < 3 ; k++) {
+               const pword *r = r3[k] ;
+               pword west = (r[w] << 1) | (w > 0 ? r[w-1] >> 63 : 0) ;
+               pword east = (r[w] >> 1) | (w + 1 < ww ? r[w+1] << 63 : 0) ;
+               if (k == 1) {
+                  addcount(c0, c1, c2, c3, west & en[3]) ;
+                  addcount(c0, c1, c2, c3, east & en[4]) ;
+               } else {
+                  int e = (k == 0) ? 0 : 5 ;
+                  addcount(c0, c1, c2, c3, west & en[e]) ;
+                  addcount(c0, c1, c2, c3, r[w] & en[e+1]) ;
+                  addcount(c0, c1, c2, c3, east & en[e+2]) ;
+               }
+            }
+            pword alive = mid[w] ;
+            pword any = 0 ;
+            for (int p = 0 ; p < nplanes ; p++)
+               any |= cur[p * pn + i] ;
+            pword born = ~any & countin(births, c0, c1, c2, c3) ;
+            pword survive = alive & countin(survivals, c0, c1, c2, c3) ;
+            // dying cells count up, and vanish on reaching maxCellStates
+            pword carry = any & ~alive ;
+            pword top = carry ;
+            for (int p = 0 ; p < nplanes ; p++) {
+               pword v = cur[p * pn + i] ;
+               pword nv = v ^ carry ;
+               carry &= v ;
+               nxt[p * pn + i] = nv ;
+               top &= ((maxCellStates >> p) & 1) ? nv : ~nv ;
+            }
+            for (int p = 0 ; p < nplanes ; p++)
+               nxt[p * pn + i] &= ~top ;
+            // live cells stay at 1 or start dying at 2
+            nxt[i] = (nxt[i] & ~alive) | born | survive ;
+            if (nplanes > 1)
+               nxt[pn + i] |= alive & ~survive & dies ;
+         }
+      }
+      cur.swap(nxt) ;
+   }
+   // spread[b] has bit k of b in the low bit of byte k
+   static pword spread[256] ;
+   if (spread[1] == 0)
+      for (int b = 0 ; b < 256 ; b++)
+         for (int k = 0 ; k < 8 ; k++)
+            if ((b >> k) & 1)
+               spread[b] |= (pword)1 << (k << 3) ;
+   for (int y = 0 ; y < ht ; y++) {
+      for (int w = 0 ; w < ww ; w++) {
+         for (int j = 0 ; j < 8 ; j++) {
+            pword v = 0 ;
+            for (int p = 0 ; p < nplanes ; p++)
+               v |= spread[(cur[p * pn + (g_uintptr_t)y * ww + w] >> (j << 3)) & 255] << p ;
+            memcpy(&row[(w << 6) + (j << 3)], &v, 8) ;
+         }
+      }
+      memcpy(&cells[(g_uintptr_t)y * wd], &row[0], wd) ;
+   }
+   setgrid(&cells[0], x0, y0, wd, ht) ;
+   generation += gens ;
+   return true ;
+}
+
+void generationsalgo::step() {
+   if (!planeable || increment < MINPLANESTEP || increment > planesteps) {
+      ghashbase::step() ;
+      return ;
+   }
+   // an untried way counts as fastest
+   bool planes = planesecs <= hashsecs ;
+   if (planetrial == 0 && ++planeruns >= planeretry) {
+      planetrial = planes ? -2 : 1 ;
+      planeruns = 0 ;
+   }
+   bool trial = (planetrial != 0) ;
+   if (trial) {
+      planes = planetrial > 0 ;
+      planetrial += planes ? -1 : 1 ;
+   }
+   double gens = increment.todouble() ;
+   double start = gollySecondCount() ;
+   bool done = false ;
+   if (planes) {
+      poller->bailIfCalculating() ;
+      done = stepPlanes(increment.toint()) ;
+      if (poller->isInterrupted())
+         return ;
+      planesecs = done ? (gollySecondCount() - start) / gens : 1e30 ;
+      start = gollySecondCount() ;
+   }
+   if (!done) {
+      ghashbase::step() ;
+      if (poller->isInterrupted())
+         return ;
+      hashsecs = (gollySecondCount() - start) / gens ;
+      if (planetrial < 0 && hashsecs > PLANEMARGIN * planesecs)
+         planetrial = 0 ;
+   }
+   if (trial && planetrial == 0) {
+      if ((planesecs <= hashsecs) != planes)
+         planeretry = planeretry < MAXPLANERETRY ? 2 * planeretry : MAXPLANERETRY ;
+      else
+         planeretry = PLANERETRY ;
+   }
+}
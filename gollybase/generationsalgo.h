@@ -13,6 +13,8 @@ public:
    virtual ~generationsalgo() ;
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) ;
+   virtual void slowcalcblock(const state *in, state *out, int n) ;
+   virtual void step() ;
    virtual const char* setrule(const char* s) ;
    virtual const char* getrule() ;
    virtual const char* DefaultRule() ;
@@ -28,6 +30,15 @@ public:
    bool isHexagonal() const { return neighbormask == HEXAGONAL ; }
    bool isVonNeumann() const { return neighbormask == VON_NEUMANN ; }
 
+   /*
+    *   Steps of 8 up to this many generations may be computed on
+    *   bit-planes rather than by hashing, if the rule only depends on how
+    *   many neighbors are alive and the pattern is dense enough; 0 always
+    *   hashes.  Each step is timed, and planes are only used while they
+    *   beat hashing.  Steps outside the range always hash.
+    */
+   static void setPlaneSteps(int gens) { planesteps = gens ; }
+
 private:
    char canonrule[MAXRULESIZE] ;      // canonical version of valid rule passed into setrule
    neighborhood_masks neighbormask ;  // neighborhood masks in 3x3 table
@@ -45,6 +56,13 @@ private:
    const int *rule_neighborhoods[4] ; // isotropic neighborhoods per neighbor count
    char rule3x3[ALL3X3] ;             // all 3x3 cell mappings 012345678->4'
    const char *base64_characters ;    // base 64 encoding characters
+   bool planeable ;                   // can rule be run on bit-planes?
+   int countbits ;                    // like rulebits, but for any rule
+   static int planesteps ;            // longest step run on bit-planes
+   double planesecs, hashsecs ;       // last time per gen each way, 0 if untried
+   int planeruns ;                    // steps since the slower way was tried
+   int planeretry ;                   // steps between tries of the slower way
+   int planetrial ;                   // steps left trying it (> 0 planes, < 0 hashing)
 
    void initRule() ;
    void setTotalistic(int value, bool survival) ;
@@ -60,6 +78,8 @@ private:
    void removeChar(char *string, char skip) ;
    bool lettersValid(const char *part) ;
    int addLetters(int count, int p) ;
+   void initPlanes() ;
+   bool stepPlanes(int gens) ;
 } ;
 
 #endif
@@ -17,6 +17,9 @@
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
+#ifdef COMPACTNODES
+#include <deque>
+#endif
 using namespace std ;
 /*
  *   Power of two hash sizes work fine.
@@ -73,6 +76,25 @@ g_uintptr_t ghnode_hash(void *a, void *b, void *c, void *d) {
  *   handles a large load factor fairly well.
  */
 double ghashbase::maxloadfactor = 0.7 ;
+/*
+ *   Entries in the slowcalc cache (as a power of two), and the most
+ *   index bits for a full table instead.
+ */
+int ghashbase::calccachebits = 14 ;
+const int MAXCALCTABLEBITS = 18 ;
+#ifdef OPENHASH
+#ifdef PRIMEMOD
+#error "OPENHASH needs power of two hash sizes"
+#endif
+/*
+ *   With OPENHASH the table holds every hashed ghnode and ghleaf, and
+ *   their next fields are zero except while they carry gc marks.  An
+ *   open table must keep some empty slots, so when memory is too tight
+ *   to grow we let it fill to 7/8 and then grow anyway.
+ */
+#define anyhash(p) (is_ghnode(p) ? ghnode_hash((p)->nw, (p)->ne, (p)->sw, (p)->se) \
+                    : ghleaf_hash(((ghleaf *)(p))->nw, ((ghleaf *)(p))->ne, \
+                                  ((ghleaf *)(p))->sw, ((ghleaf *)(p))->se))
 void ghashbase::resize() {
 #ifndef NOGCBEFORERESIZE
    if (okaytogc) {
@@ -80,10 +102,97 @@ void ghashbase::resize() {
    }
 #endif
    g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
-   ghnode *p, **nhashtab ;
+   g_uintptr_t filled = hashprime - hashprime / 8 ;
+   if (hashprime > (totalthings >> 2) && hashpop + hashpop / 16 < filled &&
+       (alloced > maxmem ||
+        openhashtable<ghnodeptr>::bytes(nhashprime) -
+        openhashtable<ghnodeptr>::bytes(hashprime) > (maxmem - alloced))) {
+      hashlimit = filled ;
+      return ;
+   }
+   if (verbose) {
+     sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
+     lifestatus(statusline) ;
+   }
+   openhashtable<ghnodeptr> nhash ;
+   if (!nhash.alloc(nhashprime))
+      lifefatal("Out of memory; try reducing the hash memory limit.") ;
+   alloced += openhashtable<ghnodeptr>::bytes(nhashprime) -
+              openhashtable<ghnodeptr>::bytes(hashprime) ;
+   for (i=0; i<hashprime; i++)
+      if (ohash.full(i)) {
+         ghnode *p = ohash.slots[i] ;
+         nhash.insert(anyhash(p), p) ;
+      }
+   ohash.release() ;
+   ohash = nhash ;
+   hashprime = nhashprime ;
+   hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
+   if (verbose) {
+     strcpy(statusline+strlen(statusline), " done.") ;
+     lifestatus(statusline) ;
+   }
+}
+ghnode *ghashbase::find_ghnode(ghnode *nw, ghnode *ne, ghnode *sw, ghnode *se) {
+   ghnode *p ;
+   g_uintptr_t h = ghnode_hash(nw,ne,sw,se) ;
+   ghnodeptr *s = ohash.find(h, [=](ghnode *q) {
+      return nw == q->nw && ne == q->ne && sw == q->sw && se == q->se ;
+   }) ;
+   if (s)
+      return save(*s) ;
+   p = newghnode() ;
+   p->nw = nw ;
+   p->ne = ne ;
+   p->sw = sw ;
+   p->se = se ;
+   p->res = 0 ;
+   p->next = 0 ;
+   ohash.insert(h, p) ;
+   hashpop++ ;
+   save(p) ;
+   if (hashpop > hashlimit)
+      resize() ;
+   return p ;
+}
+ghleaf *ghashbase::find_ghleaf(state nw, state ne, state sw, state se) {
+   ghleaf *p ;
+   g_uintptr_t h = ghleaf_hash(nw, ne, sw, se) ;
+   ghnodeptr *s = ohash.find(h, [=](ghnode *q) {
+      ghleaf *l = (ghleaf *)q ;
+      return nw == l->nw && ne == l->ne && sw == l->sw && se == l->se &&
+             !is_ghnode(q) ;
+   }) ;
+   if (s)
+      return (ghleaf *)save(*s) ;
+   p = newghleaf() ;
+   p->nw = nw ;
+   p->ne = ne ;
+   p->sw = sw ;
+   p->se = se ;
+   p->leafpop = bigint((short)((nw != 0) + (ne != 0) + (sw != 0) + (se != 0))) ;
+   p->isghnode = 0 ;
+   p->next = 0 ;
+   ohash.insert(h, (ghnode *)p) ;
+   hashpop++ ;
+   save((ghnode *)p) ;
+   if (hashpop > hashlimit)
+      resize() ;
+   return p ;
+}
+#else
+void ghashbase::resize() {
+#ifndef NOGCBEFORERESIZE
+   if (okaytogc) {
+      do_gc(0) ;
+   }
+#endif
+   g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
+   ghnode *p ;
+   ghnodeptr *nhashtab ;
    if (hashprime > (totalthings >> 2)) {
       if (alloced > maxmem ||
-          nhashprime * sizeof(ghnode *) > (maxmem - alloced)) {
+          nhashprime * sizeof(ghnodeptr) > (maxmem - alloced)) {
          hashlimit = G_MAX ;
          return ;
       }
@@ -92,14 +201,14 @@ void ghashbase::resize() {
      sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
      lifestatus(statusline) ;
    }
-   nhashtab = (ghnode **)calloc(nhashprime, sizeof(ghnode *)) ;
+   nhashtab = (ghnodeptr *)calloc(nhashprime, sizeof(ghnodeptr)) ;
    if (nhashtab == 0) {
      lifewarning("Out of memory; running in a somewhat slower mode; "
                  "try reducing the hash memory limit after restarting.") ;
      hashlimit = G_MAX ;
      return ;
    }
-   alloced += sizeof(ghnode *) * (nhashprime - hashprime) ;
+   alloced += sizeof(ghnodeptr) * (nhashprime - hashprime) ;
    g_uintptr_t ohashprime = hashprime ;
    hashprime = nhashprime ;
 #ifndef PRIMEMOD
@@ -197,6 +306,7 @@ ghleaf *ghashbase::find_ghleaf(state nw, state ne, state sw, state se) {
       resize() ;
    return p ;
 }
+#endif
 /*
  *   The following routine does the same, but first it checks to see if
  *   the cached result is any good.  If it is, it directly returns that.
@@ -256,9 +366,35 @@ void ghashbase::setupprefetch(ghsetup_t &su, ghnode *nw, ghnode *ne, ghnode *sw,
    su.ne = ne ;
    su.sw = sw ;
    su.se = se ;
+#ifdef OPENHASH
+   ohash.prefetch(su.h) ;
+#else
    su.prefetch(hashtab + HASHMOD(su.h)) ;
+#endif
 }
 ghnode *ghashbase::find_ghnode(ghsetup_t &su) {
+#ifdef OPENHASH
+   ghnode *p ;
+   ghnodeptr *s = ohash.find(su.h, [&](ghnode *q) {
+      return su.nw == q->nw && su.ne == q->ne && su.sw == q->sw &&
+             su.se == q->se ;
+   }) ;
+   if (s)
+      return save(*s) ;
+   p = newghnode() ;
+   p->nw = su.nw ;
+   p->ne = su.ne ;
+   p->sw = su.sw ;
+   p->se = su.se ;
+   p->res = 0 ;
+   p->next = 0 ;
+   ohash.insert(su.h, p) ;
+   hashpop++ ;
+   save(p) ;
+   if (hashpop > hashlimit)
+      resize() ;
+   return p ;
+#else
    ghnode *p ;
    ghnode *pred = 0 ;
    g_uintptr_t h = HASHMOD(su.h) ;
@@ -286,6 +422,7 @@ ghnode *ghashbase::find_ghnode(ghsetup_t &su) {
    if (hashpop > hashlimit)
       resize() ;
    return p ;
+#endif
 }
 ghnode *ghashbase::dorecurs(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) {
    int sp = gsp ;
@@ -413,41 +550,139 @@ ghnode *ghashbase::dorecurs_half(ghnode *n, ghnode *ne, ghnode *t,
  */
 ghleaf *ghashbase::dorecurs_ghleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
                                    ghleaf *se) {
-   return find_ghleaf(
-             slowcalc(nw->nw, nw->ne, ne->nw,
-                      nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw),
-             slowcalc(nw->ne, ne->nw, ne->ne,
-                      nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne),
-             slowcalc(nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw,
-                      sw->sw, sw->se, se->sw),
-             slowcalc(nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne,
-                      sw->se, se->sw, se->se)) ;
+   state g[16] = { nw->nw, nw->ne, ne->nw, ne->ne,
+                   nw->sw, nw->se, ne->sw, ne->se,
+                   sw->nw, sw->ne, se->nw, se->ne,
+                   sw->sw, sw->se, se->sw, se->se } ;
+   state r[4] ;
+   slowcalcblock(g, r, 2) ;
+   return find_ghleaf(r[0], r[1], r[2], r[3]) ;
+}
+/*
+ *   slowcalc with memoization.  The same few neighborhoods come up over
+ *   and over, and slowcalc can be expensive (RuleTable scans all of its
+ *   rules, for instance).
+ */
+state ghashbase::calc(state nw, state n, state ne, state w, state c,
+                      state e, state sw, state s, state se) {
+   // (cells can have states outside the table's range if the rule
+   // was changed to one with fewer states, so we check for that)
+   if (calctable && ((nw | n | ne | w | c | e | sw | s | se) >> calcbits) == 0) {
+      g_uintptr_t i = nw ;
+      i = (i << calcbits) | n ;
+      i = (i << calcbits) | ne ;
+      i = (i << calcbits) | w ;
+      i = (i << calcbits) | c ;
+      i = (i << calcbits) | e ;
+      i = (i << calcbits) | sw ;
+      i = (i << calcbits) | s ;
+      i = (i << calcbits) | se ;
+      running_hperf.calcLookups++ ;
+      if (calctable[i])
+         return (state)(calctable[i] - 1) ;
+      running_hperf.calcMisses++ ;
+      state r = slowcalc(nw, n, ne, w, c, e, sw, s, se) ;
+      calctable[i] = (unsigned short)(r + 1) ;
+      return r ;
+   }
+   if (calccache) {
+      unsigned long long key = nw | ((unsigned long long)n << 8) |
+         ((unsigned long long)ne << 16) | ((unsigned long long)w << 24) |
+         ((unsigned long long)c << 32) | ((unsigned long long)e << 40) |
+         ((unsigned long long)sw << 48) | ((unsigned long long)s << 56) ;
+      unsigned long long h = (key ^ ((unsigned long long)se << 7)) *
+                             0x9E3779B97F4A7C15ULL ;
+      ghcalcentry &ce = calccache[h >> (64 - calccachebits)] ;
+      running_hperf.calcLookups++ ;
+      if (ce.used && ce.key == key && ce.se == se)
+         return ce.res ;
+      running_hperf.calcMisses++ ;
+      ce.key = key ;
+      ce.se = se ;
+      ce.res = slowcalc(nw, n, ne, w, c, e, sw, s, se) ;
+      ce.used = 1 ;
+      return ce.res ;
+   }
+   return slowcalc(nw, n, ne, w, c, e, sw, s, se) ;
+}
+void ghashbase::slowcalcblock(const state *in, state *out, int n) {
+   int wd = n + 2 ;
+   for (int y=0; y<n; y++, in += wd)
+      for (int x=0; x<n; x++)
+         *out++ = calc(in[x], in[x+1], in[x+2],
+                       in[wd+x], in[wd+x+1], in[wd+x+2],
+                       in[2*wd+x], in[2*wd+x+1], in[2*wd+x+2]) ;
+}
+/*
+ *   Set up the memo tables for the current number of states.  Rules with
+ *   up to 4 states get the full table, indexed by 2 bits per cell; it is
+ *   filled in lazily so patterns that only use a few neighborhoods don't
+ *   pay for calling slowcalc on all of them.
+ */
+void ghashbase::setupcalc() {
+   freecalc() ;
+   calcstates = maxCellStates ;
+   if (calccachebits <= 0)
+      return ;
+   calcbits = 1 ;
+   while ((1 << calcbits) < calcstates)
+      calcbits++ ;
+   g_uintptr_t n = (g_uintptr_t)1 << (9 * calcbits) ;
+   if (9 * calcbits <= MAXCALCTABLEBITS) {
+      calctable = (unsigned short *)calloc(n, sizeof(unsigned short)) ;
+      if (calctable)
+         calcentries = n ;
+   }
+   if (calctable == 0) {
+      calccache = (ghcalcentry *)calloc((g_uintptr_t)1 << calccachebits,
+                                        sizeof(ghcalcentry)) ;
+      if (calccache)
+         calcentries = (g_uintptr_t)1 << calccachebits ;
+   }
+   running_hperf.calcBytes = (double)calcentries *
+      (calctable ? sizeof(unsigned short) : sizeof(ghcalcentry)) ;
+}
+void ghashbase::freecalc() {
+   if (calctable)
+      free(calctable) ;
+   if (calccache)
+      free(calccache) ;
+   calctable = 0 ;
+   calccache = 0 ;
+   calcentries = 0 ;
+   calcstates = 0 ;
+   calcbits = 0 ;
 }
 /*
  *   We keep free ghnodes in a linked list for allocation, and we allocate
- *   them 1000 at a time.
+ *   them NODEBLOCK-1 (about 1000) at a time.  If no block can be had
+ *   we try a gc before giving up.
  */
 ghnode *ghashbase::newghnode() {
    ghnode *r ;
    if (freeghnodes == 0) {
       int i ;
-      freeghnodes = (ghnode *)calloc(1001, sizeof(ghnode)) ;
-      if (freeghnodes == 0)
-         lifefatal("Out of memory; try reducing the hash memory limit.") ;
-      alloced += 1001 * sizeof(ghnode) ;
+      freeghnodes = (ghnode *)nodeblockalloc(sizeof(ghnode)) ;
+      if (freeghnodes == 0) {
+         if (okaytogc)
+            do_gc(0) ;
+         if (freeghnodes == 0)
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+         r = freeghnodes ;
+         freeghnodes = freeghnodes->next ;
+         return r ;
+      }
+      alloced += NODEBLOCK * sizeof(ghnode) ;
       freeghnodes->next = ghnodeblocks ;
       ghnodeblocks = freeghnodes++ ;
-      for (i=0; i<999; i++) {
+      for (i=0; i<NODEBLOCK-2; i++) {
          freeghnodes[1].next = freeghnodes ;
          freeghnodes++ ;
       }
-      totalthings += 1000 ;
+      totalthings += NODEBLOCK-1 ;
    }
-   if (freeghnodes->next == 0 && alloced + 1000 * sizeof(ghnode) > maxmem &&
+   if (freeghnodes->next == 0 &&
+       alloced + (NODEBLOCK-1) * sizeof(ghnode) > maxmem &&
        okaytogc) {
       do_gc(0) ;
    }
@@ -482,10 +717,16 @@ ghashbase::ghashbase() {
 #endif
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    hashpop = 0 ;
-   hashtab = (ghnode **)calloc(hashprime, sizeof(ghnode *)) ;
+#ifdef OPENHASH
+   if (!ohash.alloc(hashprime))
+     lifefatal("Out of memory (1).") ;
+   alloced = openhashtable<ghnodeptr>::bytes(hashprime) ;
+#else
+   hashtab = (ghnodeptr *)calloc(hashprime, sizeof(ghnodeptr)) ;
    if (hashtab == 0)
      lifefatal("Out of memory (1).") ;
-   alloced = hashprime * sizeof(ghnode *) ;
+   alloced = hashprime * sizeof(ghnodeptr) ;
+#endif
    ngens = 0 ;
    stacksize = 0 ;
    halvesdone = 0 ;
@@ -522,16 +763,27 @@ ghashbase::ghashbase() {
    inc_hperf = running_hperf ;
    step_hperf = running_hperf ;
    softinterrupt = 0 ;
+   calctable = 0 ;
+   calccache = 0 ;
+   calcentries = 0 ;
+   calcstates = 0 ;
+   calcbits = 0 ;
+   cgrid = 0 ;
 }
 /**
  *   Destructor frees memory.
  */
 ghashbase::~ghashbase() {
+   freecalc() ;
+#ifdef OPENHASH
+   ohash.release() ;
+#else
    free(hashtab) ;
+#endif
    while (ghnodeblocks) {
       ghnode *r = ghnodeblocks ;
       ghnodeblocks = ghnodeblocks->next ;
-      free(r) ;
+      nodeblockfree(r) ;
    }
    if (zeroghnodea)
       free(zeroghnodea) ;
@@ -623,9 +875,25 @@ void ghashbase::setMaxMemory(int newmemlimit) {
       lifewarning("Sorry, more memory currently used than allowed.") ;
       return ;
    }
+#ifdef COMPACTNODES
+   // the node slabs are shared, so we can't count on more than are left
+   g_uintptr_t room = alloced + (g_uintptr_t)nodeblocksleft() * NODEBLOCK * sizeof(ghnode) ;
+   if (newlimit > room)
+      newlimit = room ;
+#endif
    maxmem = newlimit ;
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
 }
+/*
+ *   The totals include what all our memory buys us, counting the hash
+ *   table and stacks against the nodes, so a run that fills its memory
+ *   limit measures the real cost of a node.
+ */
+const char *ghashbase::getPerfSummary() {
+   running_hperf.memBytes = (double)alloced ;
+   running_hperf.memNodes = (double)totalthings ;
+   return running_hperf.summary() ;
+}
 /*
  *   This routine expands our universe by a factor of two, maintaining
  *   centering.  We use four new ghnodes, and *reuse* the root so this cannot
@@ -747,7 +1015,7 @@ ghnode *ghashbase::gsetbit(ghnode *n, int x, int y, int newstate, int depth) {
          wh = 1 << (depth - 1) ;
       }
       depth-- ;
-      ghnode **nptr ;
+      ghnodeptr *nptr ;
       if (depth+1 == this->depth || depth < 31) {
          if (x < 0) {
             if (y < 0)
@@ -782,10 +1050,10 @@ ghnode *ghashbase::gsetbit(ghnode *n, int x, int y, int newstate, int depth) {
       ghnode *s = gsetbit(*nptr, (x & (w - 1)) - wh,
                                  (y & (w - 1)) - wh, newstate, depth) ;
       if (hashed) {
-         ghnode *nw = (nptr == &(n->nw) ? s : n->nw) ;
-         ghnode *sw = (nptr == &(n->sw) ? s : n->sw) ;
-         ghnode *ne = (nptr == &(n->ne) ? s : n->ne) ;
-         ghnode *se = (nptr == &(n->se) ? s : n->se) ;
+         ghnode *nw = (nptr == &(n->nw) ? s : (ghnode *)n->nw) ;
+         ghnode *sw = (nptr == &(n->sw) ? s : (ghnode *)n->sw) ;
+         ghnode *ne = (nptr == &(n->ne) ? s : (ghnode *)n->ne) ;
+         ghnode *se = (nptr == &(n->se) ? s : (ghnode *)n->se) ;
          n = save(find_ghnode(nw, ne, sw, se)) ;
       } else {
          *nptr = s ;
@@ -1066,6 +1334,115 @@ ghnode *ghashbase::popzeros(ghnode *n) {
    }
    return n ;
 }
+/*
+ *   Copy the part of n (a square at the given depth with top-left cell
+ *   gx, gy) that overlaps the copy grid into it.
+ */
+void ghashbase::fillgrid(ghnode *n, int depth, int gx, int gy) {
+   int sz = 2 << depth ;
+   if (gx >= cgridx + cgridwd || gx + sz <= cgridx ||
+       gy >= cgridy + cgridht || gy + sz <= cgridy ||
+       n == zeroghnode(depth))
+      return ;
+   if (depth == 0) {
+      ghleaf *l = (ghleaf *)n ;
+      state v[4] = { l->nw, l->ne, l->sw, l->se } ;
+      for (int i=0; i<4; i++) {
+         int x = gx + (i & 1) - cgridx ;
+         int y = gy + (i >> 1) - cgridy ;
+         if (x >= 0 && x < cgridwd && y >= 0 && y < cgridht)
+            cgrid[(g_uintptr_t)y * cgridwd + x] = v[i] ;
+      }
+      return ;
+   }
+   int h = sz >> 1 ;
+   fillgrid(n->nw, depth-1, gx, gy) ;
+   fillgrid(n->ne, depth-1, gx+h, gy) ;
+   fillgrid(n->sw, depth-1, gx, gy+h) ;
+   fillgrid(n->se, depth-1, gx+h, gy+h) ;
+}
+bool ghashbase::getgrid(int border, g_uintptr_t maxcells,
+                        std::vector<state> &cells,
+                        int &x0, int &y0, int &wd, int &ht) {
+   ensure_hashed() ;
+   wd = ht = 0 ;
+   x0 = y0 = 0 ;
+   cells.clear() ;
+   if (root == zeroghnode(depth))
+      return true ;
+   if (depth > 29)
+      return false ;
+   bigint t, l, b, r ;
+   findedges(&t, &l, &b, &r) ;
+   // the root covers -2^depth .. 2^depth-1 both ways, so all of these
+   // fit in an int
+   x0 = l.toint() - border ;
+   y0 = t.toint() - border ;
+   wd = r.toint() - l.toint() + 1 + 2 * border ;
+   ht = b.toint() - t.toint() + 1 + 2 * border ;
+   if ((double)wd * ht > (double)maxcells)
+      return false ;
+   cells.assign((g_uintptr_t)wd * ht, 0) ;
+   // y is negated in the tree, and its top row is 2^depth-1
+   cgrid = &cells[0] ;
+   cgridx = x0 + (1 << depth) ;
+   cgridy = y0 + (1 << depth) - 1 ;
+   cgridwd = wd ;
+   cgridht = ht ;
+   fillgrid(root, depth, 0, 0) ;
+   return true ;
+}
+/*
+ *   Build the square at the given depth with top-left cell gx, gy from
+ *   the copy grid (cells outside it are zero).
+ */
+ghnode *ghashbase::buildgrid(int depth, int gx, int gy) {
+   int sz = 2 << depth ;
+   if (gx >= cgridx + cgridwd || gx + sz <= cgridx ||
+       gy >= cgridy + cgridht || gy + sz <= cgridy)
+      return zeroghnode(depth) ;
+   if (depth == 0) {
+      state v[4] ;
+      for (int i=0; i<4; i++) {
+         int x = gx + (i & 1) - cgridx ;
+         int y = gy + (i >> 1) - cgridy ;
+         if (x >= 0 && x < cgridwd && y >= 0 && y < cgridht)
+            v[i] = cgrid[(g_uintptr_t)y * cgridwd + x] ;
+         else
+            v[i] = 0 ;
+      }
+      return (ghnode *)find_ghleaf(v[0], v[1], v[2], v[3]) ;
+   }
+   int h = sz >> 1 ;
+   int sp = gsp ;
+   ghnode *nw = save(buildgrid(depth-1, gx, gy)) ;
+   ghnode *ne = save(buildgrid(depth-1, gx+h, gy)) ;
+   ghnode *sw = save(buildgrid(depth-1, gx, gy+h)) ;
+   ghnode *se = save(buildgrid(depth-1, gx+h, gy+h)) ;
+   ghnode *r = find_ghnode(nw, ne, sw, se) ;
+   pop(sp) ;
+   return r ;
+}
+void ghashbase::setgrid(const state *cells, int x0, int y0, int wd, int ht) {
+   ensure_hashed() ;
+   int d = 1 ;
+   while (x0 < -(1 << d) || x0 + wd - 1 >= (1 << d) ||
+          y0 < 1 - (1 << d) || y0 + ht - 1 > (1 << d))
+      d++ ;
+   // the old universe can be collected while we build the new one
+   root = zeroghnode(d) ;
+   clearstack() ;
+   okaytogc = 1 ;
+   cgrid = (state *)cells ;
+   cgridx = x0 + (1 << d) ;
+   cgridy = y0 + (1 << d) - 1 ;
+   cgridwd = wd ;
+   cgridht = ht ;
+   root = popzeros(buildgrid(d, 0, 0)) ;
+   okaytogc = 0 ;
+   depth = ghnode_depth(root) ;
+   popValid = 0 ;
+}
 /*
  *   A lot of the routines from here on down traverse the universe, hanging
  *   information off the ghnodes.  The way they generally do so is by using
@@ -1084,6 +1461,34 @@ ghnode *ghashbase::popzeros(ghnode *n) {
 #define mark2(n) ((n)->res = (ghnode *)(1 | (g_uintptr_t)(n)->res))
 #define mark2v(n, v) ((n)->res = (ghnode *)(v | (g_uintptr_t)(n)->res))
 #define clearmark2(n) ((n)->res = (ghnode *)(~3 & (g_uintptr_t)(n)->res))
+/*
+ *   Ghnodes marked this way have their next field free to hold a label
+ *   (and leaves their isghnode field).  See hlifealgo.cpp for how this
+ *   works with COMPACTNODES.
+ */
+#ifdef COMPACTNODES
+static std::deque<bigint> ghnodepops ;
+#define getlabel(p) ((g_uintptr_t)(p).i)
+#define setlabel(p,v) ((p).i = (unsigned int)(v))
+#define ghnodepop(n) (ghnodepops[(n)->next.i])
+#else
+#define getlabel(p) ((g_uintptr_t)(p))
+#define setlabel(p,v) ((p) = (ghnode *)(v))
+#define ghnodepop(n) (*(bigint *)&((n)->next))
+#endif
+#ifdef OPENHASH
+/*
+ *   Hashed ghnodes do not need their next fields here, so there is
+ *   nothing to unhash.
+ */
+void ghashbase::unhash_ghnode(ghnode *) {
+}
+void ghashbase::unhash_ghnode2(ghnode *) {
+}
+void ghashbase::rehash_ghnode(ghnode *n) {
+   n->next = 0 ;
+}
+#else
 void ghashbase::unhash_ghnode(ghnode *n) {
    ghnode *p ;
    g_uintptr_t h = ghnode_hash(n->nw,n->ne,n->sw,n->se) ;
@@ -1124,6 +1529,7 @@ void ghashbase::rehash_ghnode(ghnode *n) {
    n->next = hashtab[h] ;
    hashtab[h] = n ;
 }
+#endif
 /*
  *   This recursive routine calculates the population by hanging the
  *   population on marked ghnodes.
@@ -1134,7 +1540,7 @@ const bigint &ghashbase::calcpop(ghnode *root, int depth) {
    if (depth == 0)
       return ((ghleaf *)root)->leafpop ;
    if (marked2(root))
-      return *(bigint*)&(root->next) ;
+      return ghnodepop(root) ;
    depth-- ;
    if (root->next == 0)
       mark2v(root, 3) ;
@@ -1147,10 +1553,17 @@ const bigint &ghashbase::calcpop(ghnode *root, int depth) {
  *   make sure the copy constructor doesn't "clean up" something that
  *   doesn't exist.  So we clear it to zero here.
  */
+#ifdef COMPACTNODES
+   bigint pop(calcpop(root->nw, depth), calcpop(root->ne, depth),
+              calcpop(root->sw, depth), calcpop(root->se, depth)) ;
+   setlabel(root->next, ghnodepops.size()) ;
+   ghnodepops.push_back(pop) ;
+#else
    new(&(root->next))bigint(
         calcpop(root->nw, depth), calcpop(root->ne, depth),
         calcpop(root->sw, depth), calcpop(root->se, depth)) ;
-   return *(bigint *)&(root->next) ;
+#endif
+   return ghnodepop(root) ;
 }
 /*
  *   Call this after doing something that unhashes ghnodes in order to
@@ -1169,7 +1582,9 @@ void ghashbase::aftercalcpop2(ghnode *root, int depth) {
          aftercalcpop2(root->sw, depth) ;
          aftercalcpop2(root->se, depth) ;
       }
+#ifndef COMPACTNODES
       ((bigint *)&(root->next))->~bigint() ;
+#endif
       if (v == 3)
          root->next = 0 ;
       else
@@ -1206,6 +1621,9 @@ void ghashbase::calcPopulation() {
    depth = ghnode_depth(root) ;
    population = calcpop(root, depth) ;
    aftercalcpop2(root, depth) ;
+#ifdef COMPACTNODES
+   ghnodepops.clear() ;
+#endif
 }
 /*
  *   Is the universe empty?
@@ -1265,6 +1683,12 @@ void ghashbase::gc_mark(ghnode *root, int invalidate) {
       }
    }
 }
+/*
+ *   Which nodes the frame store may keep remembering after a gc.
+ */
+static int keptnode(void *n) {
+   return marked((ghnode *)n) ;
+}
 /**
  *   If the invalidate flag is set, we want to kill *all* cache entries
  *   and recalculate all leaves.
@@ -1295,23 +1719,37 @@ void ghashbase::do_gc(int invalidate) {
       gc_mark((ghnode *)stack[i], invalidate) ;
    }
    for (i=0; i<timeline.framecount; i++)
-      gc_mark((ghnode *)timeline.frames[i], invalidate) ;
+      if (timeline.frames[i])
+         gc_mark((ghnode *)timeline.frames[i], invalidate) ;
+   for (i=0; i<(int)pinned.size(); i++)
+      gc_mark((ghnode *)pinned[i].state, invalidate) ;
+   timeline.store.forget(keptnode) ;
    hashpop = 0 ;
-   memset(hashtab, 0, sizeof(ghnode *) * hashprime) ;
+#ifdef OPENHASH
+   ohash.clear() ;
+#else
+   memset(hashtab, 0, sizeof(ghnodeptr) * hashprime) ;
+#endif
    freeghnodes = 0 ;
    for (p=ghnodeblocks; p; p=p->next) {
       poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++) {
+      for (pp=p+1, i=1; i<NODEBLOCK; i++, pp++) {
          if (marked(pp)) {
             g_uintptr_t h = 0 ;
             if (pp->nw) { /* yes, it's a ghnode */
-               h = HASHMOD(ghnode_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
+               h = ghnode_hash(pp->nw, pp->ne, pp->sw, pp->se) ;
             } else {
                ghleaf *lp = (ghleaf *)pp ;
-               h = HASHMOD(ghleaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+               h = ghleaf_hash(lp->nw, lp->ne, lp->sw, lp->se) ;
             }
+#ifdef OPENHASH
+            pp->next = 0 ;
+            ohash.insert(h, pp) ;
+#else
+            h = HASHMOD(h) ;
             pp->next = hashtab[h] ;
             hashtab[h] = pp ;
+#endif
             hashpop++ ;
          } else {
             pp->next = freeghnodes ;
@@ -1320,6 +1758,12 @@ void ghashbase::do_gc(int invalidate) {
          }
       }
    }
+   // if undo snapshots are keeping most of memory live, stop pinning
+   if (!pinned.empty() && freed_ghnodes < totalthings / 4)
+      pinpressure = 1 ;
+   // and if timeline frames are, keep fewer of them in memory
+   if (timeline.resident.size() > 1 && freed_ghnodes < totalthings / 4)
+      timeline.keep = (int)timeline.resident.size() / 2 ;
    inGC = 0 ;
    if (verbose) {
      double perc = (double)freed_ghnodes / (double)totalthings * 100.0 ;
@@ -1427,13 +1871,22 @@ void ghashbase::new_ngens(int newval) {
       clearto = 1 ;
    ngens = newval ;
    inGC = 1 ;
+#ifdef OPENHASH
+   for (i=0; i<hashprime; i++)
+      if (ohash.full(i)) {
+         p = ohash.slots[i] ;
+         if (is_ghnode(p) && !marked(p))
+            clearcache(p, ghnode_depth(p), clearto) ;
+      }
+#else
    for (i=0; i<hashprime; i++)
       for (p=hashtab[i]; p; p=clearmarkbit(p->next))
          if (is_ghnode(p) && !marked(p))
             clearcache(p, ghnode_depth(p), clearto) ;
+#endif
    for (p=ghnodeblocks; p; p=p->next) {
       poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++)
+      for (pp=p+1, i=1; i<NODEBLOCK; i++, pp++)
          clearmark(pp) ;
    }
    halvesdone = 0 ;
@@ -1498,6 +1951,8 @@ ghnode *ghashbase::runpattern() {
       do_gc(1) ; // invalidate the entire cache and recalc leaves
       cacheinvalid = 0 ;
    }
+   if (calcstates == 0)
+      setupcalc() ;
    int depth = ghnode_depth(n) ;
    ghnode *n2 ;
    n = pushroot(n) ;
@@ -1528,6 +1983,8 @@ const char *ghashbase::readmacrocell(char *line) {
    g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
    int r, d ;
    ghnode **ind = 0 ;
+   if (strncmp(line, "[MB]", 4) == 0)
+      return "Binary macrocell files can only be read by HashLife." ;
    root = 0 ;
    while (getline(line, 10000)) {
       if (i >= indlen) {
@@ -1622,7 +2079,7 @@ const char *ghashbase::readmacrocell(char *line) {
 	       if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
 		   nodeind > i || timeline.framecount != frameind)
 		  return "Bad FRAME line" ;
-	       timeline.frames.push_back(ind[nodeind]) ;
+	       addframe(ind[nodeind]) ;
 	       timeline.framecount++ ;
 	       timeline.end = timeline.next ;
 	       timeline.next += timeline.inc ;
@@ -1682,6 +2139,7 @@ const char *ghashbase::readmacrocell(char *line) {
 const char *ghashbase::setrule(const char *) {
    poller->bailIfCalculating() ;
    clearcache() ;
+   freecalc() ;
    return 0 ;
 }
 /**
@@ -1693,18 +2151,18 @@ g_uintptr_t ghashbase::writecell(std::ostream &os, ghnode *root, int depth) {
    if (root == zeroghnode(depth))
       return 0 ;
    if (depth == 0) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (getlabel(root->nw) != 0)
+         return getlabel(root->nw) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       unhash_ghnode2(root) ;
       mark2(root) ;
    }
    thiscell = ++cellcounter ;
    if (depth == 0) {
       ghleaf *n = (ghleaf *)root ;
-      root->nw = (ghnode *)thiscell ;
+      setlabel(root->nw, thiscell) ;
       os << 1 << ' ' << int(n->nw) << ' ' << int(n->ne)
               << ' ' << int(n->sw) << ' ' << int(n->se) << '\n' ;
    } else {
@@ -1712,7 +2170,7 @@ g_uintptr_t ghashbase::writecell(std::ostream &os, ghnode *root, int depth) {
       g_uintptr_t ne = writecell(os, root->ne, depth-1) ;
       g_uintptr_t sw = writecell(os, root->sw, depth-1) ;
       g_uintptr_t se = writecell(os, root->se, depth-1) ;
-      root->next = (ghnode *)thiscell ;
+      setlabel(root->next, thiscell) ;
       os << depth+1 << ' ' << nw << ' ' << ne
                     << ' ' << sw << ' ' << se << '\n' ;
    }
@@ -1728,11 +2186,11 @@ g_uintptr_t ghashbase::writecell_2p1(ghnode *root, int depth) {
    if (root == zeroghnode(depth))
       return 0 ;
    if (depth == 0) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (getlabel(root->nw) != 0)
+         return getlabel(root->nw) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       unhash_ghnode2(root) ;
       mark2(root) ;
    }
@@ -1741,7 +2199,7 @@ g_uintptr_t ghashbase::writecell_2p1(ghnode *root, int depth) {
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->nw = (ghnode *)thiscell ;
+      setlabel(root->nw, thiscell) ;
    } else {
       writecell_2p1(root->nw, depth-1) ;
       writecell_2p1(root->ne, depth-1) ;
@@ -1751,7 +2209,7 @@ g_uintptr_t ghashbase::writecell_2p1(ghnode *root, int depth) {
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->next = (ghnode *)thiscell ;
+      setlabel(root->next, thiscell) ;
    }
    return thiscell ;
 }
@@ -1765,8 +2223,8 @@ g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth)
    if (root == zeroghnode(depth))
       return 0 ;
    if (depth == 0) {
-      if (cellcounter + 1 != (g_uintptr_t)(root->nw))
-         return (g_uintptr_t)(root->nw) ;
+      if (cellcounter + 1 != getlabel(root->nw))
+         return getlabel(root->nw) ;
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
          std::streampos siz = os.tellp() ;
@@ -1774,20 +2232,20 @@ g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth)
          lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
       }
       ghleaf *n = (ghleaf *)root ;
-      root->nw = (ghnode *)thiscell ;
+      setlabel(root->nw, thiscell) ;
       os << 1 << ' ' << int(n->nw) << ' ' << int(n->ne)
               << ' ' << int(n->sw) << ' ' << int(n->se) << '\n';
    } else {
-      if (cellcounter + 1 > (g_uintptr_t)(root->next) || isaborted())
-         return (g_uintptr_t)(root->next) ;
+      if (cellcounter + 1 > getlabel(root->next) || isaborted())
+         return getlabel(root->next) ;
       g_uintptr_t nw = writecell_2p2(os, root->nw, depth-1) ;
       g_uintptr_t ne = writecell_2p2(os, root->ne, depth-1) ;
       g_uintptr_t sw = writecell_2p2(os, root->sw, depth-1) ;
       g_uintptr_t se = writecell_2p2(os, root->se, depth-1) ;
       if (!isaborted() &&
-          cellcounter + 1 != (g_uintptr_t)(root->next)) { // this should never happen
+          cellcounter + 1 != getlabel(root->next)) { // this should never happen
          lifefatal("Internal in writecell_2p2") ;
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       }
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
@@ -1795,7 +2253,7 @@ g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth)
          sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
          lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
       }
-      root->next = (ghnode *)thiscell ;
+      setlabel(root->next, thiscell) ;
       os << depth+1 << ' ' << nw << ' ' << ne
                     << ' ' << sw << ' ' << se << '\n' ;
    }
@@ -1803,7 +2261,69 @@ g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth)
 }
 #define STRINGIFY(arg) STR2(arg)
 #define STR2(arg) #arg
+/*
+ *   Paging timeline frames out to the frame store.  We write a node's
+ *   children before the node itself, and only nodes the store doesn't
+ *   already have; we read them back the same way.
+ */
+G_INT64 ghashbase::writeframe(void *frame) {
+   return writeframenode((ghnode *)frame) ;
+}
+G_INT64 ghashbase::writeframenode(ghnode *n) {
+   G_INT64 ref = timeline.store.find(n) ;
+   if (ref != 0)
+      return ref ;
+   G_INT64 w[4] ;
+   if (is_ghnode(n)) {
+      if ((w[0] = writeframenode(n->nw)) == 0 ||
+          (w[1] = writeframenode(n->ne)) == 0 ||
+          (w[2] = writeframenode(n->sw)) == 0 ||
+          (w[3] = writeframenode(n->se)) == 0)
+         return 0 ;
+      ref = timeline.store.put(w, 0) ;
+   } else {
+      ghleaf *l = (ghleaf *)n ;
+      w[0] = l->nw ;
+      w[1] = l->ne ;
+      w[2] = l->sw ;
+      w[3] = l->se ;
+      ref = timeline.store.put(w, 1) ;
+   }
+   if (ref != 0)
+      timeline.store.remember(n, ref) ;
+   return ref ;
+}
+void *ghashbase::readframe(G_INT64 ref) {
+   return readframenode(ref) ;
+}
+ghnode *ghashbase::readframenode(G_INT64 ref) {
+   ghnode *n = (ghnode *)timeline.store.lookup(ref) ;
+   if (n != 0)
+      return n ;
+   G_INT64 w[4] ;
+   if (!timeline.store.get(ref, w))
+      return 0 ;
+   if (framestore::isleaf(ref)) {
+      n = (ghnode *)find_ghleaf((state)w[0], (state)w[1],
+                                (state)w[2], (state)w[3]) ;
+   } else {
+      ghnode *nw, *ne, *sw, *se ;
+      if ((nw = readframenode(w[0])) == 0 ||
+          (ne = readframenode(w[1])) == 0 ||
+          (sw = readframenode(w[2])) == 0 ||
+          (se = readframenode(w[3])) == 0)
+         return 0 ;
+      n = find_ghnode(nw, ne, sw, se) ;
+   }
+   timeline.store.remember(n, ref) ;
+   return n ;
+}
 const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
+   // the writer marks nodes, so page in any paged-out frames first
+   if (timeline.savetimeline)
+      for (int i=0; i<timeline.framecount; i++)
+         if (getframe(i) == 0)
+            return "Timeline frame could not be read back from disk." ;
    int depth = ghnode_depth(root) ;
    os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
    
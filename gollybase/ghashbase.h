@@ -6,6 +6,7 @@
 #include "lifealgo.h"
 #include "liferules.h"
 #include "util.h"
+#include <vector>
 /*
  *   This class forms the basis of all hashlife-type algorithms except
  *   the highly-optimized hlifealgo (which is most appropriate for
@@ -17,22 +18,44 @@
  */
 typedef unsigned char state ;
 /**
- *   Nodes, like the standard hlifealgo nodes.
+ *   Nodes, like the standard hlifealgo nodes (including their
+ *   COMPACTNODES variant).
  */
+#ifdef COMPACTNODES
+struct ghnode ;
+typedef compactptr<ghnode> ghnodeptr ;
+#else
+typedef struct ghnode *ghnodeptr ;
+#endif
 struct ghnode {
-   ghnode *next ;              /* hash link */
-   ghnode *nw, *ne, *sw, *se ; /* constant; nw != 0 means nonjleaf */
-   ghnode *res ;               /* cache */
+   ghnodeptr next ;            /* hash link */
+   ghnodeptr nw, ne, sw, se ;  /* constant; nw != 0 means nonjleaf */
+   ghnodeptr res ;             /* cache */
 } ;
 /*
  *   Leaves, like the standard hlifealgo leaves.
  */
 struct ghleaf {
-   ghnode *next ;              /* hash link */
-   ghnode *isghnode ;          /* must always be zero for leaves */
+   ghnodeptr next ;            /* hash link */
+   ghnodeptr isghnode ;        /* must always be zero for leaves */
    state nw, ne, sw, se ;      /* constant */
    bigint leafpop ;            /* how many set bits */
 } ;
+/*
+ *   An entry in the slowcalc cache:  the first eight neighborhood states
+ *   (in slowcalc argument order, nw in the low byte), the last one, and
+ *   the result.
+ */
+struct ghcalcentry {
+   unsigned long long key ;
+   state se ;
+   state res ;
+   state used ;
+} ;
+/*
+ *   The largest block (n x n) slowcalcblock is asked for.
+ */
+const int MAXCALCBLOCK = 2 ;
 /*
  *   If it is a struct ghnode, this returns a non-zero value, otherwise it
  *   returns a zero value.
@@ -46,14 +69,15 @@ struct ghleaf {
 struct ghsetup_t { 
    g_uintptr_t h ;
    struct ghnode *nw, *ne, *sw, *se ;
-   void prefetch(struct ghnode **addr) const { PREFETCH(addr) ; }
+   void prefetch(ghnodeptr *addr) const { PREFETCH(addr) ; }
 } ;
 #endif
 
 /**
  *   Our ghashbase class.  Note that this is an abstract class; you need
  *   to expand specific methods to specialize it for a particular multi-state
- *   automata.
+ *   automata.  Subclasses must call spillallpinned() in their
+ *   destructors, since writing a pinned state needs their getrule().
  */
 class ghashbase : public lifealgo {
 public:
@@ -63,6 +87,11 @@ public:
    //  This should be overridden by a deriving class.
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) = 0 ;
+   //  This computes the n x n block of new states whose neighborhoods
+   //  make up the (n+2) x (n+2) block of old states (both row by row).
+   //  By default it calls the memoized slowcalc for each cell; a
+   //  deriving class can override it to compute whole blocks at once.
+   virtual void slowcalcblock(const state *in, state *out, int n) ;
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &v) ;
@@ -80,6 +109,10 @@ public:
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual int pinstate(const char *path) {
+      ensure_hashed() ;
+      return lifealgo::pinstate(path) ;
+   }
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -90,8 +123,27 @@ public:
    virtual void lowerRightPixel(bigint &x, bigint &y, int mag) ;
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
    virtual const char *readmacrocell(char *line) ;
+   virtual const char *getPerfSummary() ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   /*
+    *   The slowcalc cache has 2^bits entries; 0 turns off memoizing
+    *   slowcalc results altogether.
+    */
+   static void setCalcCacheBits(int bits) { calccachebits = bits ; }
+
+protected:
+   /*
+    *   For deriving classes that can step some patterns faster some
+    *   other way.  getgrid copies the live area of the universe, plus a
+    *   border of the given width, into a row-major grid whose top-left
+    *   cell is at x0, y0; it returns false if that would take more than
+    *   maxcells cells or doesn't fit in int coordinates.  setgrid
+    *   replaces the universe with the contents of such a grid.
+    */
+   bool getgrid(int border, g_uintptr_t maxcells, std::vector<state> &cells,
+                int &x0, int &y0, int &wd, int &ht) ;
+   void setgrid(const state *cells, int x0, int y0, int wd, int ht) ;
    
 private:
 /*
@@ -122,7 +174,11 @@ private:
    g_uintptr_t hashmask ;
 #endif
    static double maxloadfactor ;
-   ghnode **hashtab ;
+#ifdef OPENHASH
+   openhashtable<ghnodeptr> ohash ;
+#else
+   ghnodeptr *hashtab ;
+#endif
    int halvesdone ;
    int gsp ;
    g_uintptr_t alloced, maxmem ;
@@ -154,6 +210,27 @@ private:
    hperf running_hperf, step_hperf, inc_hperf ;
    int softinterrupt ;
    static char statusline[] ;
+/*
+ *   Memoized slowcalc results for the current rule.  If there are few
+ *   states the neighborhood (calcbits per cell) indexes calctable directly
+ *   (entries are the result plus one, zero meaning not known yet);
+ *   otherwise calccache is a direct-mapped cache indexed by a hash of
+ *   the neighborhood.
+ *   Both are set up by setupcalc when the first leaf is calculated
+ *   after a rule change.
+ */
+   unsigned short *calctable ;
+   ghcalcentry *calccache ;
+   int calcstates ;           // states the tables were set up for; 0 if none
+   int calcbits ;
+   g_uintptr_t calcentries ;  // size of calctable or calccache
+   static int calccachebits ;
+   /*
+    *   The grid being copied by getgrid or setgrid, in the coordinates
+    *   of the root (0, 0 is its top-left cell).
+    */
+   state *cgrid ;
+   int cgridx, cgridy, cgridwd, cgridht ;
 //
    void resize() ;
    ghnode *find_ghnode(ghnode *nw, ghnode *ne, ghnode *sw, ghnode *se) ;
@@ -169,6 +246,10 @@ private:
    ghnode *dorecurs(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
    ghnode *dorecurs_half(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
    ghleaf *dorecurs_ghleaf(ghleaf *n, ghleaf *ne, ghleaf *t, ghleaf *e) ;
+   state calc(state nw, state n, state ne, state w, state c,
+              state e, state sw, state s, state se) ;
+   void setupcalc() ;
+   void freecalc() ;
    ghnode *newghnode() ;
    ghleaf *newghleaf() ;
    ghnode *newclearedghnode() ;
@@ -182,6 +263,8 @@ private:
    int nextbit(ghnode *n, int x, int y, int depth, int &v) ;
    ghnode *hashpattern(ghnode *root, int depth) ;
    ghnode *popzeros(ghnode *n) ;
+   void fillgrid(ghnode *n, int depth, int gx, int gy) ;
+   ghnode *buildgrid(int depth, int gx, int gy) ;
    const bigint &calcpop(ghnode *root, int depth) ;
    void aftercalcpop2(ghnode *root, int depth) ;
    void afterwritemc(ghnode *root, int depth) ;
@@ -205,6 +288,10 @@ private:
    g_uintptr_t writecell(std::ostream &os, ghnode *root, int depth) ;
    g_uintptr_t writecell_2p1(ghnode *root, int depth) ;
    g_uintptr_t writecell_2p2(std::ostream &os, ghnode *root, int depth) ;
+   virtual G_INT64 writeframe(void *frame) ;
+   virtual void *readframe(G_INT64 ref) ;
+   G_INT64 writeframenode(ghnode *n) ;
+   ghnode *readframenode(G_INT64 ref) ;
    void drawpixel(int x, int y);
    void draw4x4_1(state sw, state se, state nw, state ne, int llx, int lly) ;
    void draw4x4_1(ghnode *n, ghnode *z, int llx, int lly) ;
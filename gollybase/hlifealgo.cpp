@@ -18,6 +18,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#ifdef COMPACTNODES
+#include <deque>
+#endif
 using namespace std ;
 /*
  *   Power of two hash sizes work fine.
@@ -43,6 +51,17 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
    return i ;
 }
 #endif
+/*
+ *   Deleted slots in an open table use it up just as live ones do.
+ */
+#ifdef OPENHASH
+#ifdef PRIMEMOD
+#error "OPENHASH needs power of two hash sizes"
+#endif
+#define HASHDEAD (ohash.deleted)
+#else
+#define HASHDEAD 0
+#endif
 /*
  *   Note that all the places we represent 4-squares by short, we use
  *   unsigned shorts; this is so we can directly index into these arrays.
@@ -99,9 +118,26 @@ void hlifealgo::leafres(leaf *n) {
    (ruletable[(t01 << 10) | (t02 << 8) | (t11 << 2) | t12] << 8) |
    (ruletable[(t10 << 10) | (t11 << 8) | (t20 << 2) | t21] << 2) |
     ruletable[(t11 << 10) | (t12 << 8) | (t21 << 2) | t22] ;
+#ifdef COMPACTNODES
+   n->leafpop = (unsigned short)(shortpop[n->nw] + shortpop[n->ne] +
+                                 shortpop[n->sw] + shortpop[n->se]) ;
+#else
    n->leafpop = bigint((short)(shortpop[n->nw] + shortpop[n->ne] +
                                shortpop[n->sw] + shortpop[n->se])) ;
+#endif
 }
+/*
+ *   With COMPACTNODES a leaf only has room for a short population, and
+ *   a node only has room for an index into nodepops when calcpop()
+ *   hangs a population on it.
+ */
+#ifdef COMPACTNODES
+static bigint leafpops[65] ;
+static std::deque<bigint> nodepops ;
+#define initleafpop(l) ((l)->leafpop = 0)
+#else
+#define initleafpop(l) (new(&((l)->leafpop))bigint)
+#endif
 /*
  *   We do now support garbage collection, but there are some routines we
  *   call frequently to help us.
@@ -116,6 +152,118 @@ g_uintptr_t node_hash(void *a, void *b, void *c, void *d) {
 }
 #endif
 #define leaf_hash(a,b,c,d) (65537*(d)+257*(c)+17*(b)+5*(a))
+/*
+ *   When stepping in parallel, a res field may be filled in by one
+ *   thread while another is looking at it.  Both threads always compute
+ *   the same canonical node, so all we need is for the pointer to be
+ *   published after the node it points to.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#ifdef COMPACTNODES
+#define loadres(n) ((node *)nodeslabs::decode( \
+                       __atomic_load_n(&((n)->res.i), __ATOMIC_ACQUIRE)))
+#define storeres(n,r) __atomic_store_n(&((n)->res.i), \
+                                       nodeslabs::encode(r), __ATOMIC_RELEASE)
+#else
+#define loadres(n) __atomic_load_n(&((n)->res), __ATOMIC_ACQUIRE)
+#define storeres(n,r) __atomic_store_n(&((n)->res), (r), __ATOMIC_RELEASE)
+#endif
+#else
+#define loadres(n) ((n)->res)
+#define storeres(n,r) ((n)->res = (r))
+#endif
+/*
+ *   Cache replacement is a CLOCK.  Between steps, after a gc, we sweep
+ *   the hash table and set a cold bit in the res field of every node;
+ *   using the cached result clears the bit again, so a sweep that finds
+ *   the bit still set knows nobody has needed that result since the
+ *   last one and drops it.  We never drop results inside a step, since
+ *   dorecurs() holds the results it has already fetched only through
+ *   the res fields.  Nodes are at least 8-byte aligned, so the bit
+ *   never collides with the two low bits that the marking routines
+ *   further down use.
+ */
+#define COLDRES 4
+#define coldres(r) (COLDRES & (g_uintptr_t)(r))
+#define warmres(r) ((node *)(~(g_uintptr_t)COLDRES & (g_uintptr_t)(r)))
+#define chillres(r) ((node *)(COLDRES | (g_uintptr_t)(r)))
+/*
+ *   State for parallel stepping.  Each thread gets its own save stack
+ *   and a small private free list; the hash chains are protected by
+ *   striped spinlocks that are only ever held for a chain walk, never
+ *   across an allocation.  Garbage collection and hash resizing need
+ *   every thread to stand still, so workers park at safepoints while
+ *   the calling (main) thread does that work; this keeps all polling
+ *   and status reporting on the main thread.
+ */
+const int NSTRIPES = 4096 ;
+const int FREEBATCH = 64 ;
+struct hspinlock {
+   hspinlock() : held(false) {}
+   void lock() {
+      int spins = 0 ;
+      while (held.exchange(true, std::memory_order_acquire))
+         while (held.load(std::memory_order_relaxed))
+            if (++spins > 100)
+               std::this_thread::yield() ;
+   }
+   void unlock() { held.store(false, std::memory_order_release) ; }
+   std::atomic<bool> held ;
+} ;
+/*
+ *   The results of a batch of tasks are roots for gc until the thread
+ *   that is waiting on them has saved them on its own stack.
+ */
+struct hbatch {
+   node *out[9] ;
+   int n ;
+   hbatch *prev ;
+} ;
+struct hthreadctx {
+   hthreadctx() : stack(0), gsp(0), stacksize(0), freenodes(0), batches(0),
+                  nesting(0), halvesdone(0) {
+      young.nodes = touched.nodes = 0 ;
+      young.n = young.size = touched.n = touched.size = 0 ;
+      young.full = touched.full = 1 ;
+   }
+   node **stack ;
+   int gsp, stacksize ;
+   node *freenodes ;
+   hnodelog young, touched ;
+   hbatch *batches ;
+   int nesting ;
+   int halvesdone ;
+   hperf perf ;
+} ;
+struct hparallel {
+   hparallel(int n) : nthreads(n), ctx(new hthreadctx[n]), newnodes(0),
+                      stopreq(0), wantgc(0), running(0) {}
+   ~hparallel() {
+      for (int i=0; i<nthreads; i++) {
+         free(ctx[i].stack) ;
+         free(ctx[i].young.nodes) ;
+         free(ctx[i].touched.nodes) ;
+      }
+      delete [] ctx ;
+   }
+   int nthreads ;
+   hthreadctx *ctx ;
+   hspinlock stripes[NSTRIPES] ;
+   std::atomic<g_uintptr_t> newnodes ; // hashed since the last stop
+   std::mutex alloclock ;
+   std::mutex gclock ;
+   std::condition_variable gccond ;
+   std::atomic<int> stopreq ;
+   int wantgc ;
+   int running ;
+} ;
+struct hgetrestask : public lifetask {
+   virtual void run() ;
+   hlifealgo *algo ;
+   node *in ;
+   node **out ;
+   int depth ;
+} ;
 /*
  *   Resize the hash.  The max load factor defined here does not actually
  *   yield the maximum load factor the hash will see, because when we
@@ -133,17 +281,133 @@ g_uintptr_t node_hash(void *a, void *b, void *c, void *d) {
  *   handles a large load factor fairly well.
  */
 double hlifealgo::maxloadfactor = 0.7 ;
+#ifdef OPENHASH
+/*
+ *   With OPENHASH the table holds every hashed node and leaf; their
+ *   next fields are zero except while they carry gc marks.  The table
+ *   also has to keep some empty slots for lookups to stop at, so
+ *   deleted slots count against the load (a table that is mostly
+ *   deleted slots is just rebuilt at the same size).  When memory is
+ *   too tight to grow we let it fill to 7/8, rebuilding as needed to
+ *   clear deleted slots, and grow anyway only if live nodes fill it.
+ */
+#define anyhash(p) (is_node(p) ? node_hash((p)->nw, (p)->ne, (p)->sw, (p)->se) \
+                    : leaf_hash(((leaf *)(p))->nw, ((leaf *)(p))->ne, \
+                                ((leaf *)(p))->sw, ((leaf *)(p))->se))
+void hlifealgo::resize() {
+   g_uintptr_t i, nhashprime = hashprime ;
+   g_uintptr_t filled = hashprime - hashprime / 8 ;
+   if (hashlimit >= filled) {
+      if (hashpop + hashpop / 16 >= filled)
+         nhashprime = nexthashsize(2 * hashprime) ;
+   } else if (hashpop + hashpop / 8 > hashlimit) {
+#ifndef NOGCBEFORERESIZE
+      if (okaytogc) {
+         collect() ; // faster resizes if we do a gc first
+      }
+#endif
+      nhashprime = nexthashsize(2 * hashprime) ;
+      if (hashprime > (totalthings >> 2) && hashpop + hashpop / 16 < filled &&
+          (alloced > maxmem ||
+           openhashtable<nodeptr>::bytes(nhashprime) -
+           openhashtable<nodeptr>::bytes(hashprime) > (maxmem - alloced))) {
+         hashlimit = filled ;
+         if (hashpop + HASHDEAD <= hashlimit)
+            return ;
+         nhashprime = hashprime ;
+      }
+   }
+   if (verbose) {
+     sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
+     lifestatus(statusline) ;
+   }
+   openhashtable<nodeptr> nhash ;
+   if (!nhash.alloc(nhashprime))
+      lifefatal("Out of memory; try reducing the hash memory limit.") ;
+   alloced += openhashtable<nodeptr>::bytes(nhashprime) -
+              openhashtable<nodeptr>::bytes(hashprime) ;
+   for (i=0; i<hashprime; i++)
+      if (ohash.full(i)) {
+         node *p = ohash.slots[i] ;
+         nhash.insert(anyhash(p), p) ;
+      }
+   ohash.release() ;
+   ohash = nhash ;
+   if (nhashprime > hashprime)
+      hashlimit = (g_uintptr_t)(maxloadfactor * nhashprime) ;
+   hashprime = nhashprime ;
+   if (verbose) {
+     strcpy(statusline+strlen(statusline), " done.") ;
+     lifestatus(statusline) ;
+   }
+}
+node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
+   if (parallel)
+      return find_node_par(nw, ne, sw, se) ;
+   node *p ;
+   g_uintptr_t h = node_hash(nw,ne,sw,se) ;
+   nodeptr *s = ohash.find(h, [=](node *q) {
+      return nw == q->nw && ne == q->ne && sw == q->sw && se == q->se ;
+   }) ;
+   if (s)
+      return save(*s) ;
+   p = newnode() ;
+   p->nw = nw ;
+   p->ne = ne ;
+   p->sw = sw ;
+   p->se = se ;
+   p->res = 0 ;
+   p->next = 0 ;
+   ohash.insert(h, p) ;
+   hashpop++ ;
+   lognode(young, p) ;
+   save(p) ;
+   if (hashpop + HASHDEAD > hashlimit)
+      resize() ;
+   return p ;
+}
+leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
+                                  unsigned short sw, unsigned short se) {
+   if (parallel)
+      return find_leaf_par(nw, ne, sw, se) ;
+   leaf *p ;
+   g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
+   nodeptr *s = ohash.find(h, [=](node *q) {
+      leaf *l = (leaf *)q ;
+      return nw == l->nw && ne == l->ne && sw == l->sw && se == l->se &&
+             !is_node(q) ;
+   }) ;
+   if (s)
+      return (leaf *)save(*s) ;
+   p = newleaf() ;
+   p->nw = nw ;
+   p->ne = ne ;
+   p->sw = sw ;
+   p->se = se ;
+   leafres(p) ;
+   p->isnode = 0 ;
+   p->next = 0 ;
+   ohash.insert(h, (node *)p) ;
+   hashpop++ ;
+   lognode(young, (node *)p) ;
+   save((node *)p) ;
+   if (hashpop + HASHDEAD > hashlimit)
+      resize() ;
+   return p ;
+}
+#else
 void hlifealgo::resize() {
 #ifndef NOGCBEFORERESIZE
    if (okaytogc) {
-      do_gc(0) ; // faster resizes if we do a gc first
+      collect() ; // faster resizes if we do a gc first
    }
 #endif
    g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
-   node *p, **nhashtab ;
+   node *p ;
+   nodeptr *nhashtab ;
    if (hashprime > (totalthings >> 2)) {
       if (alloced > maxmem ||
-          nhashprime * sizeof(node *) > (maxmem - alloced)) {
+          nhashprime * sizeof(nodeptr) > (maxmem - alloced)) {
          hashlimit = G_MAX ;
          return ;
       }
@@ -152,14 +416,14 @@ void hlifealgo::resize() {
      sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
      lifestatus(statusline) ;
    }
-   nhashtab = (node **)calloc(nhashprime, sizeof(node *)) ;
+   nhashtab = (nodeptr *)calloc(nhashprime, sizeof(nodeptr)) ;
    if (nhashtab == 0) {
      lifewarning("Out of memory; running in a somewhat slower mode; "
                  "try reducing the hash memory limit after restarting.") ;
      hashlimit = G_MAX ;
      return ;
    }
-   alloced += sizeof(node *) * (nhashprime - hashprime) ;
+   alloced += sizeof(nodeptr) * (nhashprime - hashprime) ;
    g_uintptr_t ohashprime = hashprime ;
    hashprime = nhashprime ;
 #ifndef PRIMEMOD
@@ -196,6 +460,8 @@ void hlifealgo::resize() {
  *   new node and store it in the hash table, and return that.
  */
 node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
+   if (parallel)
+      return find_node_par(nw, ne, sw, se) ;
    node *p ;
    g_uintptr_t h = node_hash(nw,ne,sw,se) ;
    node *pred = 0 ;
@@ -220,6 +486,7 @@ node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
    p->next = hashtab[h] ;
    hashtab[h] = p ;
    hashpop++ ;
+   lognode(young, p) ;
    save(p) ;
    if (hashpop > hashlimit)
       resize() ;
@@ -227,6 +494,8 @@ node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
 }
 leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
                                   unsigned short sw, unsigned short se) {
+   if (parallel)
+      return find_leaf_par(nw, ne, sw, se) ;
    leaf *p ;
    leaf *pred = 0 ;
    g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
@@ -253,11 +522,13 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
    p->next = hashtab[h] ;
    hashtab[h] = (node *)p ;
    hashpop++ ;
+   lognode(young, (node *)p) ;
    save((node *)p) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
 }
+#endif
 /*
  *   The following routine does the same, but first it checks to see if
  *   the cached result is any good.  If it is, it directly returns that.
@@ -267,9 +538,16 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
  *   stack pointer and garbage collection stuff.
  */
 node *hlifealgo::getres(node *n, int depth) {
-   if (n->res)
-     return n->res ;
-   node *res = 0 ;
+   node *res = loadres(n) ;
+   if (res) {
+     if (coldres(res)) { // wanted again, so keep it another cycle
+       res = warmres(res) ;
+       storeres(n, res) ;
+     }
+     return res ;
+   }
+   if (parallel)
+     return getres_par(n, depth) ;
    /**
     *   This routine be the only place we assign to res.  We use
     *   the fact that the poll routine is *sticky* to allow us to
@@ -287,6 +565,8 @@ node *hlifealgo::getres(node *n, int depth) {
    if (running_hperf.fastinc(depth, ngens < depth))
       running_hperf.report(inc_hperf, verbose) ;
    depth-- ;
+   if (is_node(n->nw))
+      running_hperf.cacheLookups += (ngens >= depth ? 13 : 9) ;
    if (ngens >= depth) {
      if (is_node(n->nw)) {
        res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
@@ -312,7 +592,8 @@ node *hlifealgo::getres(node *n, int depth) {
    else {
      if (ngens < depth && halvesdone < 1000)
        halvesdone++ ;
-     n->res = res ;
+     storeres(n, res) ;
+     lognode(touched, n) ;
    }
    return res ;
 }
@@ -323,9 +604,38 @@ void hlifealgo::setupprefetch(setup_t &su, node *nw, node *ne, node *sw, node *s
    su.ne = ne ;
    su.sw = sw ;
    su.se = se ;
+#ifdef OPENHASH
+   ohash.prefetch(su.h) ;
+#else
    su.prefetch(hashtab + HASHMOD(su.h)) ;
+#endif
 }
 node *hlifealgo::find_node(setup_t &su) {
+   if (parallel)
+      return find_node_par(su.nw, su.ne, su.sw, su.se) ;
+#ifdef OPENHASH
+   node *p ;
+   nodeptr *s = ohash.find(su.h, [&](node *q) {
+      return su.nw == q->nw && su.ne == q->ne && su.sw == q->sw &&
+             su.se == q->se ;
+   }) ;
+   if (s)
+      return save(*s) ;
+   p = newnode() ;
+   p->nw = su.nw ;
+   p->ne = su.ne ;
+   p->sw = su.sw ;
+   p->se = su.se ;
+   p->res = 0 ;
+   p->next = 0 ;
+   ohash.insert(su.h, p) ;
+   hashpop++ ;
+   lognode(young, p) ;
+   save(p) ;
+   if (hashpop + HASHDEAD > hashlimit)
+      resize() ;
+   return p ;
+#else
    node *p ;
    node *pred = 0 ;
    g_uintptr_t h = HASHMOD(su.h) ;
@@ -349,13 +659,15 @@ node *hlifealgo::find_node(setup_t &su) {
    p->next = hashtab[h] ;
    hashtab[h] = p ;
    hashpop++ ;
+   lognode(young, p) ;
    save(p) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
+#endif
 }
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    setup_t su[5] ;
    setupprefetch(su[2], n->se, ne->sw, t->ne, e->nw) ;
    setupprefetch(su[0], n->ne, ne->nw, n->se, ne->sw) ;
@@ -399,7 +711,7 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
  *   then put these together into a new n/2-square.  Simple, eh?
  */
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    node
    *t11 = getres(find_node(n->se, ne->sw, t->ne, e->nw), depth),
    *t00 = getres(n, depth),
@@ -424,7 +736,7 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
  */
 node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
                                node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    node
    *t00 = getres(n, depth),
    *t01 = getres(find_node(n->ne, ne->nw, n->se, ne->sw), depth),
@@ -468,6 +780,9 @@ node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
  *   save/pop mumbo-jumbo.
  */
 leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
+#ifndef NOLEAFKERNEL
+   return leafkernel(n, ne, t, e, 4) ;
+#else
    unsigned short
    t00 = n->res2,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
@@ -482,6 +797,7 @@ leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
                     find_leaf(t01, t02, t11, t12)->res2,
                     find_leaf(t10, t11, t20, t21)->res2,
                     find_leaf(t11, t12, t21, t22)->res2) ;
+#endif
 }
 /*
  *   Same as above but we only do two generations.
@@ -489,6 +805,9 @@ leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
 #define combine4(t00,t01,t10,t11) (unsigned short)\
 ((((t00)<<10)&0xcc00)|(((t01)<<6)&0x3300)|(((t10)>>6)&0xcc)|(((t11)>>10)&0x33))
 leaf *hlifealgo::dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) {
+#ifndef NOLEAFKERNEL
+   return leafkernel(n, ne, t, e, 2) ;
+#else
    unsigned short
    t00 = n->res2,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
@@ -503,12 +822,16 @@ leaf *hlifealgo::dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) {
                     combine4(t01, t02, t11, t12),
                     combine4(t10, t11, t20, t21),
                     combine4(t11, t12, t21, t22)) ;
+#endif
 }
 /*
  *   Same as above but we only do one generation.
  */
 leaf *hlifealgo::dorecurs_leaf_quarter(leaf *n, leaf *ne,
                                    leaf *t, leaf *e) {
+#ifndef NOLEAFKERNEL
+   return leafkernel(n, ne, t, e, 1) ;
+#else
    unsigned short
    t00 = n->res1,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res1,
@@ -523,30 +846,179 @@ leaf *hlifealgo::dorecurs_leaf_quarter(leaf *n, leaf *ne,
                     combine4(t01, t02, t11, t12),
                     combine4(t10, t11, t20, t21),
                     combine4(t11, t12, t21, t22)) ;
+#endif
+}
+#ifndef NOLEAFKERNEL
+/*
+ *   The leaf kernel.  Building a leaf result the way dorecurs does
+ *   hashes up to twelve intermediate leaves that are never used again;
+ *   instead we lay the four leaves out as a 16x16 bitmap, step it one
+ *   to four generations in place, and hash only the 8x8 center.
+ *
+ *   For rules that just count neighbors the bitmap is four 64-bit
+ *   words of four 16-bit rows each, top row in the high bits and the
+ *   leftmost cell in the high bit of its row, so that the neighbors of
+ *   every cell are the bitmap shifted by 1, 15, 16 or 17.  A shift by
+ *   one drags a cell in from the far end of the next row, but only
+ *   into the border that is invalid after the generation anyway.  We
+ *   count the neighbors bit-sliced with a ripple of half adders into
+ *   four count planes and then pick out the counts the rule wants.
+ *   The loops run over all four words so the compiler can keep them
+ *   in vector registers.
+ */
+typedef unsigned long long kernelword ;
+static inline void kernelshr(const kernelword *b, kernelword *r, int s) {
+   r[0] = b[0] >> s ;
+   for (int i=1; i<4; i++)
+      r[i] = (b[i] >> s) | (b[i-1] << (64 - s)) ;
+}
+static inline void kernelshl(const kernelword *b, kernelword *r, int s) {
+   for (int i=0; i<3; i++)
+      r[i] = (b[i] << s) | (b[i+1] >> (64 - s)) ;
+   r[3] = b[3] << s ;
+}
+static void kernelcount(kernelword *b, int nbrs, const int *rule) {
+   // rule3x3 bit order is nw n ne w center e sw s se, high to low
+   static const int shift[9] = { 17, 16, 15, 1, 0, -1, -15, -16, -17 } ;
+   kernelword s0[4], s1[4], s2[4], s3[4], x[4] ;
+   int i, k ;
+   for (i=0; i<4; i++)
+      s0[i] = s1[i] = s2[i] = s3[i] = 0 ;
+   for (k=0; k<9; k++) {
+      if (k == 4 || !(nbrs & (256 >> k)))
+         continue ;
+      if (shift[k] > 0)
+         kernelshr(b, x, shift[k]) ;
+      else
+         kernelshl(b, x, -shift[k]) ;
+      for (i=0; i<4; i++) {
+         kernelword c0 = s0[i] & x[i] ;
+         s0[i] ^= x[i] ;
+         kernelword c1 = s1[i] & c0 ;
+         s1[i] ^= c0 ;
+         kernelword c2 = s2[i] & c1 ;
+         s2[i] ^= c1 ;
+         s3[i] |= c2 ;
+      }
+   }
+   kernelword born[4], live[4] ;
+   for (i=0; i<4; i++)
+      born[i] = live[i] = 0 ;
+   for (k=0; k<9; k++) {
+      if (!((rule[0] | rule[1]) & (1 << k)))
+         continue ;
+      for (i=0; i<4; i++) {
+         kernelword eq = ((k & 1) ? s0[i] : ~s0[i]) &
+                         ((k & 2) ? s1[i] : ~s1[i]) &
+                         ((k & 4) ? s2[i] : ~s2[i]) &
+                         ((k & 8) ? s3[i] : ~s3[i]) ;
+         if (rule[0] & (1 << k))
+            born[i] |= eq ;
+         if (rule[1] & (1 << k))
+            live[i] |= eq ;
+      }
+   }
+   for (i=0; i<4; i++)
+      b[i] = (b[i] & live[i]) | (~b[i] & born[i]) ;
+}
+/*
+ *   For other rules we step the bitmap with the ruletable, a 4x4
+ *   window (two cells bigger all round than the 2x2 it yields) at a
+ *   time.  Cells g..15-g of row are valid on the way in.
+ */
+static void kerneltable(const char *rt, unsigned short *row, int g) {
+   unsigned short nrow[16] ;
+   int r, c ;
+   for (r=g+1; r<15-g; r++)
+      nrow[r] = 0 ;
+   for (r=g; r+3<16-g; r+=2)
+      for (c=g; c+3<16-g; c+=2) {
+         int sh = 12 - c ;
+         int o = rt[(((row[r] >> sh) & 0xf) << 12) |
+                    (((row[r+1] >> sh) & 0xf) << 8) |
+                    (((row[r+2] >> sh) & 0xf) << 4) |
+                    ((row[r+3] >> sh) & 0xf)] ;
+         nrow[r+1] |= ((o >> 4) & 3) << (sh + 1) ;
+         nrow[r+2] |= (o & 3) << (sh + 1) ;
+      }
+   for (r=g+1; r<15-g; r++)
+      row[r] = nrow[r] ;
+}
+#define kernelnibble(q,i) (((q) >> (12 - 4 * (i))) & 0xf)
+leaf *hlifealgo::leafkernel(leaf *n, leaf *ne, leaf *t, leaf *e, int gens) {
+   unsigned short row[16] ;
+   int r, g ;
+   for (r=0; r<16; r++) {
+      leaf *a = (r < 8 ? n : t), *b = (r < 8 ? ne : e) ;
+      int i = r & 3 ;
+      if (r & 4)
+         row[r] = (unsigned short)((kernelnibble(a->sw, i) << 12) |
+                                   (kernelnibble(a->se, i) << 8) |
+                                   (kernelnibble(b->sw, i) << 4) |
+                                    kernelnibble(b->se, i)) ;
+      else
+         row[r] = (unsigned short)((kernelnibble(a->nw, i) << 12) |
+                                   (kernelnibble(a->ne, i) << 8) |
+                                   (kernelnibble(b->nw, i) << 4) |
+                                    kernelnibble(b->ne, i)) ;
+   }
+   if (kernelnbrs >= 0) {
+      kernelword bits[4] ;
+      for (r=0; r<4; r++)
+         bits[r] = ((kernelword)row[4*r] << 48) |
+                   ((kernelword)row[4*r+1] << 32) |
+                   ((kernelword)row[4*r+2] << 16) | row[4*r+3] ;
+      for (g=0; g<gens; g++)
+         kernelcount(bits, kernelnbrs, kernelrule) ;
+      for (r=4; r<12; r++)
+         row[r] = (unsigned short)(bits[r>>2] >> (48 - 16 * (r & 3))) ;
+   } else {
+      for (g=0; g<gens; g++)
+         kerneltable(ruletable, row, g) ;
+   }
+   unsigned short q[4] = { 0, 0, 0, 0 } ;
+   for (r=0; r<4; r++) {
+      q[0] |= ((row[r+4] >> 8) & 0xf) << (12 - 4 * r) ;
+      q[1] |= ((row[r+4] >> 4) & 0xf) << (12 - 4 * r) ;
+      q[2] |= ((row[r+8] >> 8) & 0xf) << (12 - 4 * r) ;
+      q[3] |= ((row[r+8] >> 4) & 0xf) << (12 - 4 * r) ;
+   }
+   return find_leaf(q[0], q[1], q[2], q[3]) ;
 }
+#endif
 /*
  *   We keep free nodes in a linked list for allocation, and we allocate
- *   them 1000 at a time.
+ *   them NODEBLOCK-1 (about 1000) at a time.  Returns 0 if no block
+ *   can be had; the callers then try a gc before giving up.
  */
+int hlifealgo::allocnodeblock() {
+   int i ;
+   freenodes = (node *)nodeblockalloc(sizeof(node)) ;
+   if (freenodes == 0)
+      return 0 ;
+   alloced += NODEBLOCK * sizeof(node) ;
+   freenodes->next = nodeblocks ;
+   nodeblocks = freenodes++ ;
+   for (i=0; i<NODEBLOCK-2; i++) {
+      freenodes[1].next = freenodes ;
+      freenodes++ ;
+   }
+   totalthings += NODEBLOCK-1 ;
+   return 1 ;
+}
 node *hlifealgo::newnode() {
    node *r ;
-   if (freenodes == 0) {
-      int i ;
-      freenodes = (node *)calloc(1001, sizeof(node)) ;
+   if (parallel)
+      return newnode_par() ;
+   if (freenodes == 0 && !allocnodeblock()) {
+      if (okaytogc)
+         collect() ;
       if (freenodes == 0)
          lifefatal("Out of memory; try reducing the hash memory limit.") ;
-      alloced += 1001 * sizeof(node) ;
-      freenodes->next = nodeblocks ;
-      nodeblocks = freenodes++ ;
-      for (i=0; i<999; i++) {
-         freenodes[1].next = freenodes ;
-         freenodes++ ;
-      }
-      totalthings += 1000 ;
    }
-   if (freenodes->next == 0 && alloced + 1000 * sizeof(node) > maxmem &&
+   if (freenodes->next == 0 && alloced + (NODEBLOCK-1) * sizeof(node) > maxmem &&
        okaytogc) {
-      do_gc(0) ;
+      collect() ;
    }
    r = freenodes ;
    freenodes = freenodes->next ;
@@ -557,7 +1029,7 @@ node *hlifealgo::newnode() {
  */
 leaf *hlifealgo::newleaf() {
    leaf *r = (leaf *)newnode() ;
-   new(&(r->leafpop))bigint ;
+   initleafpop(r) ;
    return r ;
 }
 /*
@@ -569,7 +1041,7 @@ node *hlifealgo::newclearednode() {
 }
 leaf *hlifealgo::newclearedleaf() {
    leaf *r = (leaf *)newclearednode() ;
-   new(&(r->leafpop))bigint ;
+   initleafpop(r) ;
    return r ;
 }
 hlifealgo::hlifealgo() {
@@ -583,16 +1055,26 @@ hlifealgo::hlifealgo() {
    if (shortpop[1] == 0)
       for (i=1; i<65536; i++)
          shortpop[i] = shortpop[i & (i - 1)] + 1 ;
+#ifdef COMPACTNODES
+   for (i=0; i<65; i++)
+      leafpops[i] = bigint(i) ;
+#endif
    hashprime = nexthashsize(1000) ;
 #ifndef PRIMEMOD
    hashmask = hashprime - 1 ;
 #endif
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    hashpop = 0 ;
-   hashtab = (node **)calloc(hashprime, sizeof(node *)) ;
+#ifdef OPENHASH
+   if (!ohash.alloc(hashprime))
+     lifefatal("Out of memory (1).") ;
+   alloced = openhashtable<nodeptr>::bytes(hashprime) ;
+#else
+   hashtab = (nodeptr *)calloc(hashprime, sizeof(nodeptr)) ;
    if (hashtab == 0)
      lifefatal("Out of memory (1).") ;
-   alloced = hashprime * sizeof(node *) ;
+   alloced = hashprime * sizeof(nodeptr) ;
+#endif
    ngens = 0 ;
    stacksize = 0 ;
    halvesdone = 0 ;
@@ -606,6 +1088,20 @@ hlifealgo::hlifealgo() {
    nodeblocks = 0 ;
    zeronodea = 0 ;
    ruletable = hliferules.rule0 ;
+#ifndef NOLEAFKERNEL
+   kernelnbrs = liferules::countingRule(ruletable, kernelrule) ;
+#endif
+   threads = 0 ;
+   par = 0 ;
+   parallel = 0 ;
+   young.nodes = touched.nodes = 0 ;
+   young.n = young.size = touched.n = touched.size = 0 ;
+   young.full = touched.full = 1 ;
+   logbytes = 0 ;
+   gclogging = 0 ;
+   gcwait = 0 ;
+   gcbackoff = 1 ;
+   clockgc = 0 ;
 /*
  *   We initialize our universe to be a 16-square.  We are in drawing
  *   mode at this point.
@@ -635,16 +1131,25 @@ hlifealgo::hlifealgo() {
  *   Destructor frees memory.
  */
 hlifealgo::~hlifealgo() {
+   spillallpinned() ;
+   delete threads ;
+   delete par ;
+#ifdef OPENHASH
+   ohash.release() ;
+#else
    free(hashtab) ;
+#endif
    while (nodeblocks) {
       node *r = nodeblocks ;
       nodeblocks = nodeblocks->next ;
-      free(r) ;
+      nodeblockfree(r) ;
    }
    if (zeronodea)
       free(zeronodea) ;
    if (stack)
       free(stack) ;
+   free(young.nodes) ;
+   free(touched.nodes) ;
    if (llsize) {
       delete [] llxb ;
       delete [] llyb ;
@@ -731,9 +1236,31 @@ void hlifealgo::setMaxMemory(int newmemlimit) {
       lifewarning("Sorry, more memory currently used than allowed.") ;
       return ;
    }
+#ifdef COMPACTNODES
+   // the node slabs are shared, so we can't count on more than are left
+   g_uintptr_t room = alloced + (g_uintptr_t)nodeblocksleft() * NODEBLOCK * sizeof(node) ;
+   if (newlimit > room)
+      newlimit = room ;
+#endif
    maxmem = newlimit ;
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
 }
+/*
+ *   The totals include what all our memory buys us, counting the hash
+ *   table and stacks against the nodes, so a run that fills its memory
+ *   limit measures the real cost of a node.
+ */
+const hperf &hlifealgo::getPerfCounters() {
+   running_hperf.nodesCalculated += running_hperf.fastNodeInc ;
+   running_hperf.fastNodeInc = 0 ;
+   running_hperf.memBytes = (double)alloced ;
+   running_hperf.memNodes = (double)totalthings ;
+   return running_hperf ;
+}
+const char *hlifealgo::getPerfSummary() {
+   getPerfCounters() ;
+   return running_hperf.summary() ;
+}
 /*
  *   This routine expands our universe by a factor of two, maintaining
  *   centering.  We use four new nodes, and *reuse* the root so this cannot
@@ -889,7 +1416,7 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
          wh = 1 << (depth - 1) ;
       }
       depth-- ;
-      node **nptr ;
+      nodeptr *nptr ;
       if (depth+1 == this->depth || depth < 31) {
          if (x < 0) {
             if (y < 0)
@@ -924,10 +1451,10 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
       node *s = gsetbit(*nptr, (x & (w - 1)) - wh,
                                (y & (w - 1)) - wh, newstate, depth) ;
       if (hashed) {
-         node *nw = (nptr == &(n->nw) ? s : n->nw) ;
-         node *sw = (nptr == &(n->sw) ? s : n->sw) ;
-         node *ne = (nptr == &(n->ne) ? s : n->ne) ;
-         node *se = (nptr == &(n->se) ? s : n->se) ;
+         node *nw = (nptr == &(n->nw) ? s : (node *)n->nw) ;
+         node *sw = (nptr == &(n->sw) ? s : (node *)n->sw) ;
+         node *ne = (nptr == &(n->ne) ? s : (node *)n->ne) ;
+         node *se = (nptr == &(n->se) ? s : (node *)n->se) ;
          n = save(find_node(nw, ne, sw, se)) ;
       } else {
          *nptr = s ;
@@ -1092,6 +1619,133 @@ int hlifealgo::setcell(int x, int y, int newstate) {
    }
    return 0 ;
 }
+/*
+ *   Set the cells in one row of our universe that fall within the
+ *   given spans, pairs of [start, end) x coordinates sorted and not
+ *   overlapping.  off is the x coordinate of our center, and y is
+ *   relative to it as in gsetbit.  Each node the row passes through
+ *   is visited once rather than once for every cell under it, and
+ *   when hashed each changed node is looked up once.
+ */
+node *hlifealgo::gsetrow(node *n, int off, int y, const int *spans,
+                         int nspans, int depth) {
+   if (depth == 2) {
+      leaf *l = (leaf *)n ;
+      unsigned short w = 0, e = 0 ;
+      for (int i=0; i<nspans; i++) {
+         int a = spans[2*i] - off, b = spans[2*i+1] - off ;
+         if (a < -4)
+            a = -4 ;
+         if (b > 4)
+            b = 4 ;
+         for (int x=a; x<b; x++)
+            if (x < 0)
+               w |= 1 << (3 - (x & 3)) ;
+            else
+               e |= 1 << (3 - (x & 3)) ;
+      }
+      w <<= 4 * (y & 3) ;
+      e <<= 4 * (y & 3) ;
+      if (hashed) {
+         if (y < 0)
+            return save((node *)find_leaf(l->nw, l->ne, l->sw | w, l->se | e)) ;
+         return save((node *)find_leaf(l->nw | w, l->ne | e, l->sw, l->se)) ;
+      }
+      if (y < 0) {
+         l->sw |= w ;
+         l->se |= e ;
+      } else {
+         l->nw |= w ;
+         l->ne |= e ;
+      }
+      return (node *)l ;
+   }
+   int wh = 1 << (depth - 1) ;
+   int cy = (y & (2 * wh - 1)) - wh ;
+   depth-- ;
+   nodeptr *wptr = (y < 0 ? &(n->sw) : &(n->nw)) ;
+   nodeptr *eptr = (y < 0 ? &(n->se) : &(n->ne)) ;
+   // spans starting left of center go west; those ending right of it east
+   int nw = 0 ;
+   while (nw < nspans && spans[2*nw] < off)
+      nw++ ;
+   int first = (nw > 0 && spans[2*nw-1] > off) ? nw - 1 : nw ;
+   node *ws = *wptr, *es = *eptr ;
+   if (nw > 0) {
+      if (ws == 0)
+         ws = (depth == 2 ? (node *)newclearedleaf() : newclearednode()) ;
+      ws = gsetrow(ws, off - wh, cy, spans, nw, depth) ;
+   }
+   if (first < nspans) {
+      if (es == 0)
+         es = (depth == 2 ? (node *)newclearedleaf() : newclearednode()) ;
+      es = gsetrow(es, off + wh, cy, spans + 2 * first, nspans - first, depth) ;
+   }
+   if (hashed) {
+      if (y < 0)
+         return save(find_node(n->nw, n->ne, ws, es)) ;
+      return save(find_node(ws, es, n->sw, n->se)) ;
+   }
+   *wptr = ws ;
+   *eptr = es ;
+   return n ;
+}
+/*
+ *   Setting a row works like setcell, except that we expand the
+ *   universe to hold both ends first and then walk down once.  Past
+ *   30 levels the coordinates no longer fit our arithmetic, so we
+ *   leave those to setcell.
+ */
+int hlifealgo::setrow(int x, int y, const int *runs, int nruns) {
+   std::vector<int> spans ;
+   int cx = x ;
+   for (int i=0; i<nruns; i++) {
+      int len = runs[2*i], state = runs[2*i+1] ;
+      if (state & ~1)
+         return -1 ;
+      if (state && len > 0) {
+         if (!spans.empty() && spans.back() == cx)
+            spans.back() += len ;
+         else {
+            spans.push_back(cx) ;
+            spans.push_back(cx + len) ;
+         }
+      }
+      cx += len ;
+   }
+   if (spans.empty())
+      return 0 ;
+   if (hashed) {
+      clearstack() ;
+      save(root) ;
+      okaytogc = 1 ;
+   }
+   inGC = 1 ;
+   y = - y ;
+   int lo = spans.front(), hi = spans.back() - 1 ;
+   for (;;) {
+      int d = (depth <= 31 ? depth : 31) ;
+      int slo = lo >> d, shi = hi >> d, sy = y >> d ;
+      if (slo >= -1 && shi <= 0 && sy >= -1 && sy <= 0)
+         break ;
+      if (hashed) {
+         root = save(pushroot(root)) ;
+         depth++ ;
+      } else {
+         pushroot_1() ;
+      }
+   }
+   if (depth > 30) {
+      if (hashed)
+         okaytogc = 0 ;
+      return lifealgo::setrow(x, - y, runs, nruns) ;
+   }
+   root = gsetrow(root, 0, y, &spans[0], (int)(spans.size() >> 1), depth) ;
+   if (hashed) {
+      okaytogc = 0 ;
+   }
+   return 0 ;
+}
 /*
  *   Our nonrecurse top-level bit getting routine.
  */
@@ -1152,6 +1806,109 @@ int hlifealgo::nextcell(int x, int y, int &v) {
    }
    return nextbit(root, x, y, depth) ;
 }
+/*
+ *   Collect the leaves in the band of eight rows starting at y = band
+ *   that overlap columns xlo..xhi, left to right, skipping empty nodes.
+ *   The node is centered on (cx, cy).
+ */
+void hlifealgo::bandleaves(node *n, int depth, int cx, int cy, int band,
+                           int xlo, int xhi, std::vector<leaf *> &leaves,
+                           std::vector<int> &lx) {
+   if (n == 0 || n == zeronode(depth))
+      return ;
+   int half = 1 << depth ;
+   if (cx + half <= xlo || cx - half > xhi ||
+       band < cy - half || band >= cy + half)
+      return ;
+   if (depth == 2) {
+      leaves.push_back((leaf *)n) ;
+      lx.push_back(cx) ;
+      return ;
+   }
+   int wh = half >> 1 ;
+   if (band >= cy) {
+      bandleaves(n->nw, depth-1, cx-wh, cy+wh, band, xlo, xhi, leaves, lx) ;
+      bandleaves(n->ne, depth-1, cx+wh, cy+wh, band, xlo, xhi, leaves, lx) ;
+   } else {
+      bandleaves(n->sw, depth-1, cx-wh, cy-wh, band, xlo, xhi, leaves, lx) ;
+      bandleaves(n->se, depth-1, cx+wh, cy-wh, band, xlo, xhi, leaves, lx) ;
+   }
+}
+/*
+ *   Rather than walking down from the root for every live cell, as
+ *   nextcell would, we walk down once for every band of eight rows
+ *   (the height of a leaf) and then read the rows out of the leaves.
+ *   As with nextcell, universes deeper than 30 levels are cut down
+ *   to their central 2^31 by 2^31 square.
+ */
+bool hlifealgo::getrows(int x, int y, int w, int h, rowvisitor &v) {
+   if (w <= 0 || h <= 0)
+      return true ;
+   node *r = root ;
+   int d = depth ;
+   struct node tnode ;
+   if (d > 30) {
+      tnode = *root ;
+      while (d > 30) {
+         tnode.nw = tnode.nw->se ;
+         tnode.ne = tnode.ne->sw ;
+         tnode.sw = tnode.sw->ne ;
+         tnode.se = tnode.se->nw ;
+         d-- ;
+      }
+      r = &tnode ;
+   }
+   int xhi = x + w - 1 ;
+   std::vector<leaf *> leaves ;
+   std::vector<int> lx, runs ;
+   // our y runs up the screen, so the top row is the highest
+   int top = - y, bottom = - (y + h - 1) ;
+   for (int band = top & ~7; band + 7 >= bottom; band -= 8) {
+      leaves.clear() ;
+      lx.clear() ;
+      bandleaves(r, d, 0, 0, band, x, xhi, leaves, lx) ;
+      int nleaves = (int)leaves.size() ;
+      if (nleaves == 0)
+         continue ;
+      int iy0 = (band + 7 < top ? band + 7 : top) ;
+      int iy1 = (band > bottom ? band : bottom) ;
+      for (int iy=iy0; iy>=iy1; iy--) {
+         int sh = 4 * (iy & 3) ;
+         int north = (iy - band >= 4) ;
+         int first = 0, end = 0 ;
+         runs.clear() ;
+         for (int i=0; i<nleaves; i++) {
+            leaf *l = leaves[i] ;
+            int bits = north ? ((((l->nw >> sh) & 15) << 4) | ((l->ne >> sh) & 15))
+                             : ((((l->sw >> sh) & 15) << 4) | ((l->se >> sh) & 15)) ;
+            for (int b=7; bits; b--) {
+               if (((bits >> b) & 1) == 0)
+                  continue ;
+               bits &= ~(1 << b) ;
+               int cx = lx[i] - 4 + 7 - b ;
+               if (cx < x || cx > xhi)
+                  continue ;
+               if (runs.empty()) {
+                  first = cx ;
+               } else if (cx == end) {
+                  runs[runs.size() - 2]++ ;
+                  end++ ;
+                  continue ;
+               } else {
+                  runs.push_back(cx - end) ;
+                  runs.push_back(0) ;
+               }
+               runs.push_back(1) ;
+               runs.push_back(1) ;
+               end = cx + 1 ;
+            }
+         }
+         if (!runs.empty() && !v.row(first, - iy, &runs[0], (int)(runs.size() >> 1)))
+            return false ;
+      }
+   }
+   return true ;
+}
 /*
  *   Canonicalize a universe by filling in the null pointers and then
  *   invoking find_node on each node.  Drops the original universe on
@@ -1229,6 +1986,33 @@ node *hlifealgo::popzeros(node *n) {
 #define mark2(n) ((n)->res = (node *)(1 | (g_uintptr_t)(n)->res))
 #define mark2v(n,v) ((n)->res = (node *)(v | (g_uintptr_t)(n)->res))
 #define clearmark2(n) ((n)->res = (node *)(~3 & (g_uintptr_t)(n)->res))
+/*
+ *   Nodes marked this way have their next field free to hold a label
+ *   (and leaves their isnode field).  With COMPACTNODES the label goes
+ *   in the raw 32 bits of the compactptr.
+ */
+#ifdef COMPACTNODES
+#define getlabel(p) ((g_uintptr_t)(p).i)
+#define setlabel(p,v) ((p).i = (unsigned int)(v))
+#define nodepop(n) (nodepops[(n)->next.i])
+#else
+#define getlabel(p) ((g_uintptr_t)(p))
+#define setlabel(p,v) ((p) = (node *)(v))
+#define nodepop(n) (*(bigint *)&((n)->next))
+#endif
+#ifdef OPENHASH
+/*
+ *   Hashed nodes do not need their next fields here, so there is
+ *   nothing to unhash.
+ */
+void hlifealgo::unhash_node(node *) {
+}
+void hlifealgo::unhash_node2(node *) {
+}
+void hlifealgo::rehash_node(node *n) {
+   n->next = 0 ;
+}
+#else
 void hlifealgo::unhash_node(node *n) {
    node *p ;
    g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
@@ -1269,6 +2053,7 @@ void hlifealgo::rehash_node(node *n) {
    n->next = hashtab[h] ;
    hashtab[h] = n ;
 }
+#endif
 /*
  *   This recursive routine calculates the population by hanging the
  *   population on marked nodes.
@@ -1277,9 +2062,13 @@ const bigint &hlifealgo::calcpop(node *root, int depth) {
    if (root == zeronode(depth))
       return bigint::zero ;
    if (depth == 2)
+#ifdef COMPACTNODES
+      return leafpops[((leaf *)root)->leafpop] ;
+#else
       return ((leaf *)root)->leafpop ;
+#endif
    if (marked2(root))
-      return *(bigint*)&(root->next) ;
+      return nodepop(root) ;
    depth-- ;
    if (root->next == 0)
       mark2v(root, 3) ;
@@ -1291,10 +2080,17 @@ const bigint &hlifealgo::calcpop(node *root, int depth) {
  *   We use allocate-in-place bigint constructor here to initialize the
  *   node.  This should compile to a single instruction.
  */
+#ifdef COMPACTNODES
+   bigint pop(calcpop(root->nw, depth), calcpop(root->ne, depth),
+              calcpop(root->sw, depth), calcpop(root->se, depth)) ;
+   setlabel(root->next, nodepops.size()) ;
+   nodepops.push_back(pop) ;
+#else
    new(&(root->next))bigint(
         calcpop(root->nw, depth), calcpop(root->ne, depth),
         calcpop(root->sw, depth), calcpop(root->se, depth)) ;
-   return *(bigint *)&(root->next) ;
+#endif
+   return nodepop(root) ;
 }
 /*
  *   Call this after doing something that unhashes nodes in order to
@@ -1313,7 +2109,9 @@ void hlifealgo::aftercalcpop2(node *root, int depth) {
          aftercalcpop2(root->sw, depth) ;
          aftercalcpop2(root->se, depth) ;
       }
+#ifndef COMPACTNODES
       ((bigint *)&(root->next))->~bigint() ;
+#endif
       if (v == 3)
          root->next = 0 ;
       else
@@ -1349,6 +2147,9 @@ void hlifealgo::calcPopulation() {
    depth = node_depth(root) ;
    population = calcpop(root, depth) ;
    aftercalcpop2(root, depth) ;
+#ifdef COMPACTNODES
+   nodepops.clear() ;
+#endif
 }
 /*
  *   Is the universe empty?
@@ -1361,6 +2162,8 @@ int hlifealgo::isEmpty() {
  *   This routine marks a node as needed to be saved.
  */
 node *hlifealgo::save(node *n) {
+   if (parallel)
+      return save_par(n) ;
    if (gsp >= stacksize) {
       int nstacksize = stacksize * 2 + 100 ;
       alloced += sizeof(node *)*(nstacksize-stacksize) ;
@@ -1376,7 +2179,10 @@ node *hlifealgo::save(node *n) {
  *   This routine pops the stack back to a previous depth.
  */
 void hlifealgo::pop(int n) {
-   gsp = n ;
+   if (parallel)
+      threadctx().gsp = n ;
+   else
+      gsp = n ;
 }
 /*
  *   This routine clears the stack altogether.
@@ -1403,11 +2209,17 @@ void hlifealgo::gc_mark(node *root, int invalidate) {
             if (invalidate)
               root->res = 0 ;
             else
-              gc_mark(root->res, invalidate) ;
+              gc_mark(warmres(root->res), invalidate) ;
          }
       }
    }
 }
+/*
+ *   Which nodes the frame store may keep remembering after a gc.
+ */
+static int keptnode(void *n) {
+   return marked((node *)n) ;
+}
 /**
  *   If the invalidate flag is set, we want to kill *all* cache entries
  *   and recalculate all leaves.
@@ -1416,6 +2228,7 @@ void hlifealgo::do_gc(int invalidate) {
    int i ;
    g_uintptr_t freed_nodes=0 ;
    node *p, *pp ;
+   double start = gollySecondCount() ;
    inGC = 1 ;
    gccount++ ;
    gcstep++ ;
@@ -1437,26 +2250,55 @@ void hlifealgo::do_gc(int invalidate) {
       poller->poll() ;
       gc_mark(stack[i], invalidate) ;
    }
+   if (parallel) {
+      for (int t=0; t<par->nthreads; t++) {
+         hthreadctx &c = par->ctx[t] ;
+         for (i=0; i<c.gsp; i++) {
+            poller->poll() ;
+            gc_mark(c.stack[i], invalidate) ;
+         }
+         for (hbatch *b=c.batches; b; b=b->prev)
+            for (int j=0; j<b->n; j++)
+               if (b->out[j])
+                  gc_mark(b->out[j], invalidate) ;
+         c.freenodes = 0 ;
+      }
+      par->newnodes = 0 ;
+   }
    for (i=0; i<timeline.framecount; i++)
-      gc_mark((node *)timeline.frames[i], invalidate) ;
+      if (timeline.frames[i])
+         gc_mark((node *)timeline.frames[i], invalidate) ;
+   for (i=0; i<(int)pinned.size(); i++)
+      gc_mark((node *)pinned[i].state, invalidate) ;
+   timeline.store.forget(keptnode) ;
    hashpop = 0 ;
-   memset(hashtab, 0, sizeof(node *) * hashprime) ;
+#ifdef OPENHASH
+   ohash.clear() ;
+#else
+   memset(hashtab, 0, sizeof(nodeptr) * hashprime) ;
+#endif
    freenodes = 0 ;
    for (p=nodeblocks; p; p=p->next) {
       poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++) {
+      for (pp=p+1, i=1; i<NODEBLOCK; i++, pp++) {
          if (marked(pp)) {
             g_uintptr_t h = 0 ;
             if (pp->nw) { /* yes, it's a node */
-               h = HASHMOD(node_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
+               h = node_hash(pp->nw, pp->ne, pp->sw, pp->se) ;
             } else {
                leaf *lp = (leaf *)pp ;
                if (invalidate)
                   leafres(lp) ;
-               h = HASHMOD(leaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+               h = leaf_hash(lp->nw, lp->ne, lp->sw, lp->se) ;
             }
+#ifdef OPENHASH
+            pp->next = 0 ;
+            ohash.insert(h, pp) ;
+#else
+            h = HASHMOD(h) ;
             pp->next = hashtab[h] ;
             hashtab[h] = pp ;
+#endif
             hashpop++ ;
          } else {
             pp->next = freenodes ;
@@ -1465,11 +2307,188 @@ void hlifealgo::do_gc(int invalidate) {
          }
       }
    }
+   // everything left is old now; if most of it is still live, the
+   // next gc can probably get away with a minor one
+   if (gcwait > 0) {
+      gcwait-- ;
+      clearlogs(0) ;
+   } else {
+      clearlogs(freed_nodes < totalthings / 2) ;
+   }
+   // if undo snapshots are keeping most of memory live, stop pinning
+   // until a gc frees a good share of it again
+   if (freed_nodes >= totalthings / 4)
+      pinpressure = 0 ;
+   else if (!pinned.empty())
+      pinpressure = 1 ;
+   // and if timeline frames are, keep fewer of them in memory
+   if (timeline.resident.size() > 1 && freed_nodes < totalthings / 4)
+      timeline.keep = (int)timeline.resident.size() / 2 ;
    inGC = 0 ;
+   gcreport(0, start, freed_nodes) ;
+}
+/*
+ *   Minor gc.  Tag every young node with the second bit of its next
+ *   field, then mark from the usual roots, but only descend through
+ *   young nodes; old nodes can only point at young ones through their
+ *   cache field, and every node whose cache field we filled in is in
+ *   the touched log, so those results are roots too.  Finally unlink
+ *   each unmarked young node from its hash chain and free it; the
+ *   survivors become old.  Returns the number of nodes freed, or 0 if
+ *   the logs are incomplete and only a full gc will do.
+ */
+#define isyoung(n) (2 & (g_uintptr_t)(n)->next)
+static int keptyoung(void *n) {
+   return !isyoung((node *)n) || marked((node *)n) ;
+}
+#define setyoung(n) ((n)->next = (node *)(2 | (g_uintptr_t)(n)->next))
+#define clearbits(p) ((node *)(~3 & (g_uintptr_t)(p)))
+void hlifealgo::gc_mark_young(node *root) {
+   if (isyoung(root) && !marked(root)) {
+      mark(root) ;
+      if (is_node(root)) {
+         gc_mark_young(root->nw) ;
+         gc_mark_young(root->ne) ;
+         gc_mark_young(root->sw) ;
+         gc_mark_young(root->se) ;
+         if (root->res)
+            gc_mark_young(warmres(root->res)) ;
+      }
+   }
+}
+void hlifealgo::unlink_young(node *n) {
+#ifdef OPENHASH
+   nodeptr *s = ohash.find(anyhash(n), [n](node *q) { return q == n ; }) ;
+   if (s == 0)
+      lifefatal("Didn't find node to collect") ;
+   ohash.erase(s) ;
+#else
+   g_uintptr_t h ;
+   if (is_node(n)) {
+      h = HASHMOD(node_hash(n->nw, n->ne, n->sw, n->se)) ;
+   } else {
+      leaf *lp = (leaf *)n ;
+      h = HASHMOD(leaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+   }
+   nodeptr *pp = hashtab + h ;
+   while (clearbits(*pp) != n) {
+      if (*pp == 0)
+         lifefatal("Didn't find node to collect") ;
+      pp = &(clearbits(*pp)->next) ;
+   }
+   *pp = (node *)((3 & (g_uintptr_t)*pp) | (g_uintptr_t)clearbits(n->next)) ;
+#endif
+}
+g_uintptr_t hlifealgo::do_minor_gc() {
+   std::vector<hnodelog *> ylogs, tlogs ;
+   g_uintptr_t i, freed_nodes=0 ;
+   int j ;
+   ylogs.push_back(&young) ;
+   tlogs.push_back(&touched) ;
+   if (par) {
+      for (int t=0; t<par->nthreads; t++) {
+         ylogs.push_back(&par->ctx[t].young) ;
+         tlogs.push_back(&par->ctx[t].touched) ;
+      }
+   }
+   for (j=0; j<(int)ylogs.size(); j++)
+      if (ylogs[j]->full || tlogs[j]->full)
+         return 0 ;
+   double start = gollySecondCount() ;
+   inGC = 1 ;
+   gccount++ ;
+   gcstep++ ;
    if (verbose) {
-     double perc = (double)freed_nodes / (double)totalthings * 100.0 ;
-     sprintf(statusline+strlen(statusline), " freed %g percent (%" PRIuPTR ").",
-                                                   perc, freed_nodes) ;
+     if (gcstep > 1)
+       sprintf(statusline, "GC #%d(%d) minor", gccount, gcstep) ;
+     else
+       sprintf(statusline, "GC #%d minor", gccount) ;
+     lifestatus(statusline) ;
+   }
+   for (j=0; j<(int)ylogs.size(); j++)
+      for (i=0; i<ylogs[j]->n; i++)
+         setyoung(ylogs[j]->nodes[i]) ;
+   for (j=nzeros-1; j>=0; j--)
+      if (zeronodea[j] != 0)
+         break ;
+   if (j >= 0)
+      gc_mark_young(zeronodea[j]) ;
+   if (root != 0)
+      gc_mark_young(root) ;
+   for (j=0; j<gsp; j++)
+      gc_mark_young(stack[j]) ;
+   if (parallel) {
+      for (int t=0; t<par->nthreads; t++) {
+         hthreadctx &c = par->ctx[t] ;
+         for (j=0; j<c.gsp; j++)
+            gc_mark_young(c.stack[j]) ;
+         for (hbatch *b=c.batches; b; b=b->prev)
+            for (int k=0; k<b->n; k++)
+               if (b->out[k])
+                  gc_mark_young(b->out[k]) ;
+      }
+   }
+   for (j=0; j<timeline.framecount; j++)
+      if (timeline.frames[j])
+         gc_mark_young((node *)timeline.frames[j]) ;
+   for (j=0; j<(int)pinned.size(); j++)
+      gc_mark_young((node *)pinned[j].state) ;
+   for (j=0; j<(int)tlogs.size(); j++) {
+      poller->poll() ;
+      for (i=0; i<tlogs[j]->n; i++) {
+         node *p = tlogs[j]->nodes[i] ;
+         if (!isyoung(p) && p->res)
+            gc_mark_young(warmres(p->res)) ;
+      }
+   }
+   timeline.store.forget(keptyoung) ;
+   for (j=0; j<(int)ylogs.size(); j++) {
+      poller->poll() ;
+      for (i=0; i<ylogs[j]->n; i++) {
+         node *p = ylogs[j]->nodes[i] ;
+         if (!isyoung(p)) // listed twice, already handled
+            continue ;
+         if (marked(p)) {
+            p->next = clearbits(p->next) ;
+         } else {
+            unlink_young(p) ;
+            p->next = freenodes ;
+            freenodes = p ;
+            freed_nodes++ ;
+         }
+      }
+   }
+   hashpop -= freed_nodes ;
+   clearlogs(1) ;
+   inGC = 0 ;
+   gcreport(1, start, freed_nodes) ;
+   return freed_nodes ;
+}
+/*
+ *   What we do when memory runs out.  A minor gc is usually enough; if
+ *   it frees less than an eighth of our nodes, the old generation must
+ *   be full of garbage too, so we follow it with a full one.
+ */
+void hlifealgo::collect() {
+   if (do_minor_gc() >= (totalthings >> 3)) {
+      gcbackoff = 1 ;
+      return ;
+   }
+   if (gclogging) {
+      if (gcbackoff < 64)
+         gcbackoff *= 2 ;
+      gcwait = gcbackoff ;
+   }
+   do_gc(0) ;
+}
+void hlifealgo::gcreport(int minor, double start, g_uintptr_t freed) {
+   double pause = gollySecondCount() - start ;
+   running_hperf.gcdone(minor, pause, (double)freed, (double)totalthings,
+                        (double)freed * sizeof(node)) ;
+   if (verbose) {
+     double perc = (double)freed / (double)totalthings * 100.0 ;
+     sprintf(statusline+strlen(statusline),
+             " freed %g percent (%" PRIuPTR ") in %g s.", perc, freed, pause) ;
      lifestatus(statusline) ;
    }
    if (needPop) {
@@ -1479,6 +2498,96 @@ void hlifealgo::do_gc(int invalidate) {
       poller->updatePop() ;
    }
 }
+/*
+ *   One turn of the clock hand; see the comment on COLDRES.  Dropped
+ *   results are left for the next gc to free.
+ */
+void hlifealgo::clockres() {
+   g_uintptr_t evicted = 0 ;
+   for (g_uintptr_t i=0; i<hashprime; i++) {
+#ifdef OPENHASH
+      if (!ohash.full(i))
+         continue ;
+      node *p = ohash.slots[i] ;
+#else
+      for (node *p=hashtab[i]; p; p=p->next)
+#endif
+         if (is_node(p) && p->res) {
+            if (coldres(p->res)) {
+               p->res = 0 ;
+               evicted++ ;
+            } else {
+               p->res = chillres(p->res) ;
+            }
+         }
+   }
+   running_hperf.cacheEvictions += (double)evicted ;
+   clockgc = gccount ;
+}
+/*
+ *   Every node we hash and every cache entry we fill in is logged for
+ *   the minor gc.  The logs may use up to an eighth of the memory
+ *   limit; past that we give their memory back and stop logging, and
+ *   the next gc is a full one.
+ */
+void hlifealgo::lognode(hnodelog &l, node *n) {
+   if (l.n >= l.size && (l.full || !growlog(l)))
+      return ;
+   l.nodes[l.n++] = n ;
+}
+int hlifealgo::growlog(hnodelog &l) {
+   g_uintptr_t nsize = 2 * l.size + 1000 ;
+   g_uintptr_t more = (nsize - l.size) * sizeof(node *) ;
+   std::unique_lock<std::mutex> g ;
+   if (parallel)
+      g = std::unique_lock<std::mutex>(par->alloclock) ;
+   if (logbytes + more > maxmem / 8) {
+      droplog(l) ;
+      return 0 ;
+   }
+   node **nnodes = (node **)realloc(l.nodes, nsize * sizeof(node *)) ;
+   if (nnodes == 0) {
+      droplog(l) ;
+      return 0 ;
+   }
+   l.nodes = nnodes ;
+   l.size = nsize ;
+   logbytes += more ;
+   alloced += more ;
+   return 1 ;
+}
+void hlifealgo::droplog(hnodelog &l) {
+   g_uintptr_t bytes = l.size * sizeof(node *) ;
+   free(l.nodes) ;
+   l.nodes = 0 ;
+   l.n = l.size = 0 ;
+   l.full = 1 ;
+   logbytes -= bytes ;
+   alloced -= bytes ;
+}
+/*
+ *   Start a new generation, with logging on or off.
+ */
+void hlifealgo::clearlogs(int enable) {
+   std::vector<hnodelog *> logs ;
+   logs.push_back(&young) ;
+   logs.push_back(&touched) ;
+   if (par) {
+      for (int t=0; t<par->nthreads; t++) {
+         logs.push_back(&par->ctx[t].young) ;
+         logs.push_back(&par->ctx[t].touched) ;
+      }
+   }
+   for (int i=0; i<(int)logs.size(); i++) {
+      if (enable) {
+         logs[i]->n = 0 ;
+         logs[i]->full = 0 ;
+      } else {
+         droplog(*logs[i]) ;
+      }
+   }
+   gclogging = enable ;
+}
 /*
  *   Clear the cache bits down to the appropriate level, marking the
  *   nodes we've handled.
@@ -1494,7 +2603,7 @@ void hlifealgo::clearcache(node *n, int depth, int clearto) {
          clearcache(n->sw, depth, clearto) ;
          clearcache(n->se, depth, clearto) ;
          if (n->res)
-            clearcache(n->res, depth, clearto) ;
+            clearcache(warmres(n->res), depth, clearto) ;
       }
       if (depth >= clearto)
          n->res = 0 ;
@@ -1534,13 +2643,22 @@ void hlifealgo::new_ngens(int newval) {
       clearto = 3 ;
    ngens = newval ;
    inGC = 1 ;
+#ifdef OPENHASH
+   for (i=0; i<hashprime; i++)
+      if (ohash.full(i)) {
+         p = ohash.slots[i] ;
+         if (is_node(p) && !marked(p))
+            clearcache(p, node_depth(p), clearto) ;
+      }
+#else
    for (i=0; i<hashprime; i++)
       for (p=hashtab[i]; p; p=clearmarkbit(p->next))
          if (is_node(p) && !marked(p))
             clearcache(p, node_depth(p), clearto) ;
+#endif
    for (p=nodeblocks; p; p=p->next) {
       poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++)
+      for (pp=p+1, i=1; i<NODEBLOCK; i++, pp++)
          clearmark(pp) ;
    }
    halvesdone = 0 ;
@@ -1617,230 +2735,951 @@ node *hlifealgo::runpattern() {
    }
    save(zeronode(nzeros-1)) ;
    save(n) ;
-   n2 = getres(n, depth) ;
+   running_hperf.cacheLookups++ ;
+   if (threads && depth > pardepth) {
+      beginparallel(depth) ;
+      n2 = getres(n, depth) ;
+      endparallel() ;
+   } else {
+      n2 = getres(n, depth) ;
+   }
    okaytogc = 0 ;
    clearstack() ;
    if (halvesdone == 1 && n->res != 0) {
       n->res = 0 ;
       halvesdone = 0 ;
    }
+   if (clockgc != gccount)
+      clockres() ;
    if (poller->isInterrupted() || softinterrupt)
       return 0 ; // indicate it was interrupted
    n = popzeros(n2) ;
    generation += pow2step ;
    return n ;
 }
+/*
+ *   Parallel stepping.  These routines mirror the serial ones above;
+ *   see the comment on struct hparallel for how the threads cooperate.
+ *   Because every thread canonicalizes through the same hash table, the
+ *   result of a parallel step is exactly the node a serial step yields.
+ */
+int hlifealgo::pardepth = 10 ;
+hthreadctx &hlifealgo::threadctx() {
+   return par->ctx[lifethreads::threadindex()] ;
+}
+int hlifealgo::stackpos() {
+   if (parallel)
+      return threadctx().gsp ;
+   return gsp ;
+}
+node *hlifealgo::save_par(node *n) {
+   hthreadctx &c = threadctx() ;
+   if (c.gsp >= c.stacksize) {
+      int nstacksize = c.stacksize * 2 + 100 ;
+      {
+         std::lock_guard<std::mutex> g(par->alloclock) ;
+         alloced += sizeof(node *)*(nstacksize-c.stacksize) ;
+      }
+      c.stack = (node **)realloc(c.stack, nstacksize * sizeof(node *)) ;
+      if (c.stack == 0)
+        lifefatal("Out of memory (3).") ;
+      c.stacksize = nstacksize ;
+   }
+   c.stack[c.gsp++] = n ;
+   return n ;
+}
+/*
+ *   Threads take nodes from the shared free list a batch at a time.
+ *   If memory is full we collect once and then grow, just like the
+ *   serial newnode(); if there is no block to grow with we collect
+ *   first, and give up only if that still leaves nothing.
+ */
+node *hlifealgo::newnode_par() {
+   hthreadctx &c = threadctx() ;
+   int collected = 0 ;
+   while (c.freenodes == 0) {
+      safepoint() ;
+      {
+         std::lock_guard<std::mutex> g(par->alloclock) ;
+         if (freenodes == 0 && (collected || !okaytogc ||
+                                alloced + (NODEBLOCK-1) * sizeof(node) <= maxmem) &&
+             !allocnodeblock() && (collected || !okaytogc))
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+         if (freenodes) {
+            node *last = freenodes ;
+            for (int i=1; i<FREEBATCH && last->next; i++)
+               last = last->next ;
+            c.freenodes = freenodes ;
+            freenodes = last->next ;
+            last->next = 0 ;
+            break ;
+         }
+      }
+      if (lifethreads::threadindex() == 0)
+         stopworld(1) ;
+      else
+         requeststop(1) ;
+      collected = 1 ;
+   }
+   node *r = c.freenodes ;
+   c.freenodes = r->next ;
+   return r ;
+}
+#ifdef OPENHASH
+/*
+ *   An open table moves entries around as it fills, so here one lock
+ *   covers the whole table.  A miss drops it to allocate (which may
+ *   stop the world), then looks again in case another thread built
+ *   the same node in the meantime.
+ */
+node *hlifealgo::find_node_par(node *nw, node *ne, node *sw, node *se) {
+   node *q = 0 ;
+   g_uintptr_t h = node_hash(nw,ne,sw,se) ;
+   hspinlock &l = par->stripes[0] ;
+   for (;;) {
+      l.lock() ;
+      nodeptr *s = ohash.find(h, [=](node *p) {
+         return nw == p->nw && ne == p->ne && sw == p->sw && se == p->se ;
+      }) ;
+      if (s) {
+         node *p = *s ;
+         l.unlock() ;
+         if (q) {
+            hthreadctx &c = threadctx() ;
+            q->next = c.freenodes ;
+            c.freenodes = q ;
+         }
+         return save(p) ;
+      }
+      if (q) {
+         ohash.insert(h, q) ;
+         l.unlock() ;
+         lognode(threadctx().young, q) ;
+         break ;
+      }
+      l.unlock() ;
+      q = newnode_par() ;
+      q->nw = nw ;
+      q->ne = ne ;
+      q->sw = sw ;
+      q->se = se ;
+      q->res = 0 ;
+      q->next = 0 ;
+   }
+   save(q) ;
+   if (hashpop + HASHDEAD + ++par->newnodes > hashlimit) {
+      if (lifethreads::threadindex() == 0)
+         stopworld(0) ;
+      else
+         requeststop(0) ;
+   }
+   return q ;
+}
+leaf *hlifealgo::find_leaf_par(unsigned short nw, unsigned short ne,
+                               unsigned short sw, unsigned short se) {
+   leaf *q = 0 ;
+   g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
+   hspinlock &l = par->stripes[0] ;
+   for (;;) {
+      l.lock() ;
+      nodeptr *s = ohash.find(h, [=](node *n) {
+         leaf *p = (leaf *)n ;
+         return nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
+                !is_node(n) ;
+      }) ;
+      if (s) {
+         node *p = *s ;
+         l.unlock() ;
+         if (q) {
+            hthreadctx &c = threadctx() ;
+            q->next = c.freenodes ;
+            c.freenodes = (node *)q ;
+         }
+         return (leaf *)save(p) ;
+      }
+      if (q) {
+         ohash.insert(h, (node *)q) ;
+         l.unlock() ;
+         lognode(threadctx().young, (node *)q) ;
+         break ;
+      }
+      l.unlock() ;
+      q = (leaf *)newnode_par() ;
+      initleafpop(q) ;
+      q->nw = nw ;
+      q->ne = ne ;
+      q->sw = sw ;
+      q->se = se ;
+      leafres(q) ;
+      q->isnode = 0 ;
+      q->next = 0 ;
+   }
+   save((node *)q) ;
+   if (hashpop + HASHDEAD + ++par->newnodes > hashlimit) {
+      if (lifethreads::threadindex() == 0)
+         stopworld(0) ;
+      else
+         requeststop(0) ;
+   }
+   return q ;
+}
+#else
+/*
+ *   The chain is locked only while we walk it.  A miss drops the lock
+ *   to allocate (which may stop the world), then looks again in case
+ *   another thread built the same node in the meantime.
+ */
+node *hlifealgo::find_node_par(node *nw, node *ne, node *sw, node *se) {
+   node *p, *pred, *q = 0 ;
+   for (;;) {
+      g_uintptr_t h = HASHMOD(node_hash(nw,ne,sw,se)) ;
+      hspinlock &l = par->stripes[h & (NSTRIPES - 1)] ;
+      l.lock() ;
+      pred = 0 ;
+      for (p=hashtab[h]; p; p = p->next) {
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            if (pred) {
+               pred->next = p->next ;
+               p->next = hashtab[h] ;
+               hashtab[h] = p ;
+            }
+            l.unlock() ;
+            if (q) {
+               hthreadctx &c = threadctx() ;
+               q->next = c.freenodes ;
+               c.freenodes = q ;
+            }
+            return save(p) ;
+         }
+         pred = p ;
+      }
+      if (q) {
+         q->next = hashtab[h] ;
+         hashtab[h] = q ;
+         l.unlock() ;
+         lognode(threadctx().young, q) ;
+         break ;
+      }
+      l.unlock() ;
+      q = newnode_par() ;
+      q->nw = nw ;
+      q->ne = ne ;
+      q->sw = sw ;
+      q->se = se ;
+      q->res = 0 ;
+   }
+   save(q) ;
+   if (hashpop + HASHDEAD + ++par->newnodes > hashlimit) {
+      if (lifethreads::threadindex() == 0)
+         stopworld(0) ;
+      else
+         requeststop(0) ;
+   }
+   return q ;
+}
+leaf *hlifealgo::find_leaf_par(unsigned short nw, unsigned short ne,
+                               unsigned short sw, unsigned short se) {
+   leaf *p, *pred, *q = 0 ;
+   for (;;) {
+      g_uintptr_t h = HASHMOD(leaf_hash(nw, ne, sw, se)) ;
+      hspinlock &l = par->stripes[h & (NSTRIPES - 1)] ;
+      l.lock() ;
+      pred = 0 ;
+      for (p=(leaf *)hashtab[h]; p; p = (leaf *)p->next) {
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
+             !is_node(p)) {
+            if (pred) {
+               pred->next = p->next ;
+               p->next = hashtab[h] ;
+               hashtab[h] = (node *)p ;
+            }
+            l.unlock() ;
+            if (q) {
+               hthreadctx &c = threadctx() ;
+               q->next = c.freenodes ;
+               c.freenodes = (node *)q ;
+            }
+            return (leaf *)save((node *)p) ;
+         }
+         pred = p ;
+      }
+      if (q) {
+         q->next = hashtab[h] ;
+         hashtab[h] = (node *)q ;
+         l.unlock() ;
+         lognode(threadctx().young, (node *)q) ;
+         break ;
+      }
+      l.unlock() ;
+      q = (leaf *)newnode_par() ;
+      initleafpop(q) ;
+      q->nw = nw ;
+      q->ne = ne ;
+      q->sw = sw ;
+      q->se = se ;
+      leafres(q) ;
+      q->isnode = 0 ;
+   }
+   save((node *)q) ;
+   if (hashpop + HASHDEAD + ++par->newnodes > hashlimit) {
+      if (lifethreads::threadindex() == 0)
+         stopworld(0) ;
+      else
+         requeststop(0) ;
+   }
+   return q ;
+}
+#endif
+/*
+ *   Only the main thread polls for events and reports performance.
+ *   When a poll reports an interrupt it sets softinterrupt, and that
+ *   is all the workers look at; the poller itself is not thread-safe.
+ */
+node *hlifealgo::getres_par(node *n, int depth) {
+   hthreadctx &c = threadctx() ;
+   int mainthread = (&c == par->ctx) ;
+   node *res = 0 ;
+   safepoint() ;
+   if (mainthread && poller->poll())
+     softinterrupt = 1 ;
+   if (softinterrupt)
+     return zeronodea[depth-1] ;
+   int sp = c.gsp ;
+   if (mainthread) {
+      if (running_hperf.fastinc(depth, ngens < depth))
+         running_hperf.report(inc_hperf, verbose) ;
+   } else {
+      c.perf.fastinc(depth, ngens < depth) ;
+   }
+   depth-- ;
+   if (is_node(n->nw))
+      c.perf.cacheLookups += (ngens >= depth ? 13 : 9) ;
+   if (ngens >= depth) {
+     if (!is_node(n->nw)) {
+       res = (node *)dorecurs_leaf((leaf *)n->nw, (leaf *)n->ne,
+                                   (leaf *)n->sw, (leaf *)n->se) ;
+     } else if (depth >= pardepth) {
+       res = dorecurs_par(n->nw, n->ne, n->sw, n->se, depth) ;
+     } else {
+       res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
+     }
+   } else {
+     if (!is_node(n->nw)) {
+       if (ngens == 0)
+         res = (node *)dorecurs_leaf_quarter((leaf *)n->nw, (leaf *)n->ne,
+                                             (leaf *)n->sw, (leaf *)n->se) ;
+       else
+         res = (node *)dorecurs_leaf_half((leaf *)n->nw, (leaf *)n->ne,
+                                          (leaf *)n->sw, (leaf *)n->se) ;
+     } else if (depth >= pardepth) {
+       res = dorecurs_half_par(n->nw, n->ne, n->sw, n->se, depth) ;
+     } else {
+       res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
+     }
+   }
+   c.gsp = sp ;
+   if (softinterrupt)
+     res = zeronodea[depth] ;
+   else {
+     if (ngens < depth)
+       c.halvesdone++ ;
+     storeres(n, res) ;
+     lognode(c.touched, n) ;
+   }
+   return res ;
+}
+void hgetrestask::run() {
+   hthreadctx &c = algo->threadctx() ;
+   if (c.nesting++ == 0)
+      algo->enterworld() ;
+   int sp = c.gsp ;
+   *out = algo->getres(in, depth) ;
+   c.gsp = sp ;
+   if (--c.nesting == 0)
+      algo->exitworld() ;
+}
+/*
+ *   Evaluate getres on each of the input nodes, spread across the
+ *   pool, and save the results on this thread's stack.
+ */
+void hlifealgo::runtasks(node **in, node **out, int ntasks, int depth) {
+   hthreadctx &c = threadctx() ;
+   hbatch b ;
+   hgetrestask tasks[9] ;
+   lifetask *tp[9] ;
+   b.n = ntasks ;
+   b.prev = c.batches ;
+   c.batches = &b ;
+   for (int i=0; i<ntasks; i++) {
+      b.out[i] = 0 ;
+      tasks[i].algo = this ;
+      tasks[i].in = in[i] ;
+      tasks[i].out = &b.out[i] ;
+      tasks[i].depth = depth ;
+      tasks[i].level = depth ;
+      tp[i] = &tasks[i] ;
+   }
+   threads->runbatch(tp, ntasks) ;
+   for (int i=0; i<ntasks; i++)
+      out[i] = save(b.out[i]) ;
+   c.batches = b.prev ;
+}
+/*
+ *   The same as dorecurs, but the nine and then the four subresults
+ *   are each calculated in parallel.
+ */
+node *hlifealgo::dorecurs_par(node *n, node *ne, node *t, node *e, int depth) {
+   int sp = stackpos() ;
+   node *in[9], *r[9] ;
+   in[0] = n ;
+   in[1] = find_node(n->ne, ne->nw, n->se, ne->sw) ;
+   in[2] = ne ;
+   in[3] = find_node(n->sw, n->se, t->nw, t->ne) ;
+   in[4] = find_node(n->se, ne->sw, t->ne, e->nw) ;
+   in[5] = find_node(ne->sw, ne->se, e->nw, e->ne) ;
+   in[6] = t ;
+   in[7] = find_node(t->ne, e->nw, t->se, e->sw) ;
+   in[8] = e ;
+   runtasks(in, r, 9, depth) ;
+   in[0] = find_node(r[0], r[1], r[3], r[4]) ;
+   in[1] = find_node(r[1], r[2], r[4], r[5]) ;
+   in[2] = find_node(r[3], r[4], r[6], r[7]) ;
+   in[3] = find_node(r[4], r[5], r[7], r[8]) ;
+   runtasks(in, r, 4, depth) ;
+   n = find_node(r[0], r[1], r[2], r[3]) ;
+   pop(sp) ;
+   return save(n) ;
+}
+node *hlifealgo::dorecurs_half_par(node *n, node *ne, node *t,
+                                   node *e, int depth) {
+   int sp = stackpos() ;
+   node *in[9], *r[9] ;
+   in[0] = n ;
+   in[1] = find_node(n->ne, ne->nw, n->se, ne->sw) ;
+   in[2] = ne ;
+   in[3] = find_node(n->sw, n->se, t->nw, t->ne) ;
+   in[4] = find_node(n->se, ne->sw, t->ne, e->nw) ;
+   in[5] = find_node(ne->sw, ne->se, e->nw, e->ne) ;
+   in[6] = t ;
+   in[7] = find_node(t->ne, e->nw, t->se, e->sw) ;
+   in[8] = e ;
+   runtasks(in, r, 9, depth) ;
+   if (depth > 3) {
+      n = find_node(find_node(r[0]->se, r[1]->sw, r[3]->ne, r[4]->nw),
+                    find_node(r[1]->se, r[2]->sw, r[4]->ne, r[5]->nw),
+                    find_node(r[3]->se, r[4]->sw, r[6]->ne, r[7]->nw),
+                    find_node(r[4]->se, r[5]->sw, r[7]->ne, r[8]->nw)) ;
+   } else {
+      leaf **l = (leaf **)r ;
+      n = find_node((node *)find_leaf(l[0]->se, l[1]->sw, l[3]->ne, l[4]->nw),
+                    (node *)find_leaf(l[1]->se, l[2]->sw, l[4]->ne, l[5]->nw),
+                    (node *)find_leaf(l[3]->se, l[4]->sw, l[6]->ne, l[7]->nw),
+                    (node *)find_leaf(l[4]->se, l[5]->sw, l[7]->ne, l[8]->nw)) ;
+   }
+   pop(sp) ;
+   return save(n) ;
+}
+void hlifealgo::beginparallel(int depth) {
+   zeronode(depth) ; // the workers must never have to build one
+   for (int i=0; i<par->nthreads; i++) {
+      hthreadctx &c = par->ctx[i] ;
+      c.gsp = 0 ;
+      c.freenodes = 0 ;
+      c.batches = 0 ;
+      c.nesting = 0 ;
+      c.halvesdone = 0 ;
+      c.perf.clear() ;
+   }
+   par->ctx[0].nesting = 1 ;
+   par->running = 1 ;
+   par->stopreq = 0 ;
+   par->wantgc = 0 ;
+   par->newnodes = 0 ;
+   parallel = 1 ;
+}
+void hlifealgo::endparallel() {
+   parallel = 0 ;
+   hashpop += par->newnodes.exchange(0) ;
+   for (int i=0; i<par->nthreads; i++) {
+      hthreadctx &c = par->ctx[i] ;
+      while (c.freenodes) {
+         node *p = c.freenodes ;
+         c.freenodes = p->next ;
+         p->next = freenodes ;
+         freenodes = p ;
+      }
+      halvesdone += c.halvesdone ;
+      running_hperf.nodesCalculated += c.perf.fastNodeInc ;
+      running_hperf.depthSum += c.perf.depthSum ;
+      running_hperf.halfNodes += c.perf.halfNodes ;
+      running_hperf.cacheLookups += c.perf.cacheLookups ;
+   }
+   if (halvesdone > 1000)
+      halvesdone = 1000 ;
+}
+/*
+ *   Workers check in here regularly; if the main thread wants the
+ *   world stopped they stand aside until it is done.  The main thread
+ *   never parks; it is the one that does the work.
+ */
+void hlifealgo::safepoint() {
+   if (par->stopreq.load(std::memory_order_relaxed) == 0)
+      return ;
+   if (lifethreads::threadindex() == 0) {
+      stopworld(0) ;
+      return ;
+   }
+   std::unique_lock<std::mutex> g(par->gclock) ;
+   if (par->stopreq) {
+      par->running-- ;
+      par->gccond.notify_all() ;
+      par->gccond.wait(g, [this]{ return par->stopreq == 0 ; }) ;
+      par->running++ ;
+   }
+}
+void hlifealgo::requeststop(int wantgc) {
+   std::unique_lock<std::mutex> g(par->gclock) ;
+   if (wantgc)
+      par->wantgc = 1 ;
+   par->stopreq = 1 ;
+   par->running-- ;
+   par->gccond.notify_all() ;
+   par->gccond.wait(g, [this]{ return par->stopreq == 0 ; }) ;
+   par->running++ ;
+}
+void hlifealgo::stopworld(int wantgc) {
+   std::unique_lock<std::mutex> g(par->gclock) ;
+   if (wantgc)
+      par->wantgc = 1 ;
+   par->stopreq = 1 ;
+   par->gccond.wait(g, [this]{ return par->running == 1 ; }) ;
+   g.unlock() ;
+   hashpop += par->newnodes.exchange(0) ;
+   if (par->wantgc)
+      collect() ;
+   if (hashpop + HASHDEAD > hashlimit)
+      resize() ;
+   g.lock() ;
+   par->wantgc = 0 ;
+   par->stopreq = 0 ;
+   par->gccond.notify_all() ;
+}
+void hlifealgo::enterworld() {
+   std::unique_lock<std::mutex> g(par->gclock) ;
+   par->gccond.wait(g, [this]{ return par->stopreq == 0 ; }) ;
+   par->running++ ;
+}
+void hlifealgo::exitworld() {
+   std::lock_guard<std::mutex> g(par->gclock) ;
+   par->running-- ;
+   par->gccond.notify_all() ;
+}
+void hlifealgo::waithook(void *arg) {
+   hlifealgo *h = (hlifealgo *)arg ;
+   h->safepoint() ;
+   if (lifethreads::threadindex() == 0 && h->poller->poll())
+      h->softinterrupt = 1 ;
+}
+void hlifealgo::setNumThreads(int n) {
+   poller->bailIfCalculating() ;
+   lifealgo::setNumThreads(n) ;
+   delete threads ;
+   delete par ;
+   threads = 0 ;
+   par = 0 ;
+   if (numthreads > 1) {
+      threads = new lifethreads(numthreads) ;
+      threads->setwaithook(&waithook, this) ;
+      par = new hparallel(numthreads) ;
+   }
+   clearlogs(0) ; // the old workers' logs are gone
+}
 /* Returns the center 4-square of an 8x8 leaf node. */
 static unsigned short unpack4x4center(leaf *leaf) {
    return combine4(leaf->nw, leaf->ne, leaf->sw, leaf->se);
 }
-const char *hlifealgo::readmacrocell(char *line) {
+/*
+ *   Decode the text of a leaf line, which ends at the first control
+ *   character or space or at e, into its four 4x4 quadrants.
+ */
+static const char *mcleaf(const char *p, const char *e, unsigned short *lnw,
+                          unsigned short *lne, unsigned short *lsw,
+                          unsigned short *lse) {
+   int x=0, y=7 ;
+   unsigned int rows[8] = { 0 } ;  // bit 7 - x of row y
+   for (; p < e && *p > ' '; p++) {
+      // the '.' and '*' in a soup are all but random, so we don't
+      // branch on which one we have
+      int star = (*p == '*') ;
+      if (star | (*p == '.')) {
+         if (x > 7 || y < 0) {
+            if (star)
+               return "Illegal coordinates in readmacrocell." ;
+         } else {
+            rows[y] |= star << (7 - x) ;
+         }
+         x++ ;
+      } else if (*p == '$') {
+         x = 0 ;
+         y-- ;
+      } else {
+         return "Illegal character in readmacrocell." ;
+      }
+   }
+   *lnw = *lne = *lsw = *lse = 0 ;
+   for (y=0; y<4; y++) {
+      *lsw |= (rows[y] >> 4) << (4 * y) ;
+      *lse |= (rows[y] & 15) << (4 * y) ;
+      *lnw |= (rows[y+4] >> 4) << (4 * y) ;
+      *lne |= (rows[y+4] & 15) << (4 * y) ;
+   }
+   return 0 ;
+}
+/*
+ *   Add a node line's node to ind; d is the depth as written in the
+ *   file.
+ */
+const char *hlifealgo::mcnode(int d, g_uintptr_t nw, g_uintptr_t ne,
+                              g_uintptr_t sw, g_uintptr_t se,
+                              std::vector<node *> &ind) {
+   g_uintptr_t i = ind.size() ;
+   if (d < 1)
+      return "Oops; bad depth in readmacrocell." ;
+   if (d > 1) {
+      ind[0] = zeronode(d <= 4 ? 2 : d-2) ; /* allow zeros to work right */
+      if (nw >= i || ind[nw] == 0 || ne >= i || ind[ne] == 0 ||
+         sw >= i || ind[sw] == 0 || se >= i || ind[se] == 0) {
+         return "Node out of range in readmacrocell." ;
+      }
+   }
+   if (d < 4) {
+      /* Support macrocell nodes in multicell format (i.e. with 2-square
+         leaf nodes) for compatibility. Cell values must be 0 or 1! */
+      unsigned short lnw=0, lne=0, lsw=0, lse=0 ;
+      if (d == 1) {
+         if (nw > 1 || ne > 1 || sw > 1 || se > 1) {
+            return "Cell value out of range in readmacrocell." ;
+         }
+         lnw = nw ? 1 <<  0 : 0 ;
+         lne = ne ? 1 <<  3 : 0 ;
+         lsw = sw ? 1 << 12 : 0 ;
+         lse = se ? 1 << 15 : 0 ;
+      } else { // d == 2 || d == 3
+         node *pnw=ind[nw], *pne=ind[ne], *psw=ind[sw], *pse=ind[se] ;
+         if (is_node(pnw) || is_node(pne) || is_node(psw) || is_node(pse)) {
+            return "Invalid leaf node reference in readmacrocell." ;
+         }
+         lnw = unpack4x4center((leaf *)pnw) ;
+         lne = unpack4x4center((leaf *)pne) ;
+         lsw = unpack4x4center((leaf *)psw) ;
+         lse = unpack4x4center((leaf *)pse) ;
+         if (d == 2) {
+            lnw >>= 5 ;
+            lne >>= 3 ;
+            lsw <<= 3 ;
+            lse <<= 5 ;
+         }
+      }
+      clearstack() ;
+      root = (node *)find_leaf(lnw, lne, lsw, lse) ;
+   } else {  // d >= 4
+      clearstack() ;
+      root = find_node(ind[nw], ind[ne], ind[sw], ind[se]) ;
+   }
+   ind.push_back(root) ;
+   depth = d - 1 ;
+   return 0 ;
+}
+/*
+ *   Handle one line of a macrocell file.
+ */
+const char *hlifealgo::mcline(char *line, std::vector<node *> &ind) {
    int n=0 ;
-   g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
+   g_uintptr_t nw=0, ne=0, sw=0, se=0 ;
    int r, d ;
-   node **ind = 0 ;
-   root = 0 ;
-   while (getline(line, 10000)) {
-      if (i >= indlen) {
-         g_uintptr_t nlen = i + indlen + 10 ;
-         ind = (node **)realloc(ind, sizeof(node*) * nlen) ;
-         if (ind == 0)
-           lifefatal("Out of memory (4).") ;
-         while (indlen < nlen)
-            ind[indlen++] = 0 ;
-      }
-      if (line[0] == '.' || line[0] == '*' || line[0] == '$') {
-         int x=0, y=7 ;
-         unsigned short lnw=0, lne=0, lsw=0, lse=0 ;
-         char *p = 0 ;
-         for (p=line; *p > ' '; p++) {
-            switch(*p) {
-case '*':      if (x > 7 || y < 0)
-                  return "Illegal coordinates in readmacrocell." ;
-               if (x < 4)
-                  if (y < 4)
-                     lsw |= 1 << (3 - (x & 3) + 4 * (y & 3)) ;
-                  else
-                     lnw |= 1 << (3 - (x & 3) + 4 * (y & 3)) ;
-               else
-                  if (y < 4)
-                     lse |= 1 << (3 - (x & 3) + 4 * (y & 3)) ;
-                  else
-                     lne |= 1 << (3 - (x & 3) + 4 * (y & 3)) ;
-               /* note: fall through here */
-case '.':      x++ ;
-               break ;
-case '$':      x = 0 ;
-               y-- ;
-               break ;
-default:       return "Illegal character in readmacrocell." ;
+   if (line[0] == '.' || line[0] == '*' || line[0] == '$') {
+      unsigned short lnw, lne, lsw, lse ;
+      const char *err = mcleaf(line, line + strlen(line),
+                               &lnw, &lne, &lsw, &lse) ;
+      if (err)
+         return err ;
+      clearstack() ;
+      root = (node *)find_leaf(lnw, lne, lsw, lse) ;
+      ind.push_back(root) ;
+      depth = 2;
+   } else if (line[0] == '#') {
+      char *p, *pp ;
+      const char *err ;
+      switch (line[1]) {
+      case 'R':
+         p = line + 2 ;
+         while (*p && *p <= ' ') p++ ;
+         pp = p ;
+         while (*pp > ' ') pp++ ;
+         *pp = 0 ;
+         
+         // AKT: need to check for B0-not-Smax rule
+         err = setrule(p);
+         if (err)
+            return err;
+         if (hliferules.alternate_rules)
+            return "B0-not-Smax rules are not allowed in HashLife.";
+         
+         break ;
+      case 'G':
+         p = line + 2 ;
+         while (*p && *p <= ' ') p++ ;
+         pp = p ;
+         while (*pp >= '0' && *pp <= '9') pp++ ;
+         *pp = 0 ;
+         generation = bigint(p) ;
+         break ;
+	 // either:
+	 //   #FRAMES count base inc
+	 // or
+	 //   #FRAME index node
+      case 'F':
+	 if (strncmp(line, "#FRAMES ", 8) == 0) {
+	    p = line + 8 ;
+	    while (*p && *p <= ' ')
+	      p++ ;
+	    long cnt = atol(p) ;
+	    if (cnt < 0 || cnt > MAX_FRAME_COUNT)
+	       return "Bad FRAMES line" ;
+	    destroytimeline() ;
+	    while ('0' <= *p && *p <= '9')
+	      p++ ;
+	    while (*p && *p <= ' ')
+	      p++ ;
+	    pp = p ;
+	    while ((*pp >= '0' && *pp <= '9') || *pp == ',') pp++ ;
+	    if (*pp == 0)
+	       return "Bad FRAMES line" ;
+	    *pp = 0 ;
+	    timeline.start = bigint(p) ;
+	    timeline.end = timeline.start ;
+            timeline.next = timeline.start ;
+	    p = pp + 1 ;
+	    while (*p && *p <= ' ')
+	      p++ ;
+	    pp = p ;
+	    while (*pp > ' ')
+               pp++ ;
+	    *pp = 0 ;
+            if (strchr(p, '^')) {
+               int tbase=0, texpo=0 ;
+               if (sscanf(p, "%d^%d", &tbase, &texpo) != 2 ||
+                   tbase < 2 || texpo < 0)
+                  return "Bad FRAMES line" ;
+               timeline.base = tbase ;
+               timeline.expo = texpo ;
+               timeline.inc = 1 ;
+               while (texpo--)
+                  timeline.inc.mul_smallint(tbase) ;
+            } else {
+	       timeline.inc = bigint(p) ;
+               // if it's a power of two, we're good
+               int texpo = timeline.inc.lowbitset() ;
+               int tbase = 2 ;
+               bigint test = 1 ;
+               for (int i=0; i<texpo; i++)
+                  test += test ;
+               if (test != timeline.inc)
+                  return "Bad increment (missing ^) in FRAMES" ;
+               timeline.base = tbase ;
+               timeline.expo = texpo ;
             }
-         }
-         clearstack() ;
-         root = ind[i++] = (node *)find_leaf(lnw, lne, lsw, lse) ;
-         depth = 2;
-      } else if (line[0] == '#') {
-         char *p, *pp ;
-         const char *err ;
-         switch (line[1]) {
-         case 'R':
-            p = line + 2 ;
-            while (*p && *p <= ' ') p++ ;
-            pp = p ;
-            while (*pp > ' ') pp++ ;
-            *pp = 0 ;
-            
-            // AKT: need to check for B0-not-Smax rule
-            err = setrule(p);
-            if (err)
-               return err;
-            if (hliferules.alternate_rules)
-               return "B0-not-Smax rules are not allowed in HashLife.";
-            
+	 } else if (strncmp(line, "#FRAME ", 7) == 0) {
+	    int frameind = 0 ;
+	    g_uintptr_t nodeind = 0 ;
+	    n = sscanf(line+7, "%d %" PRIuPTR, &frameind, &nodeind) ;
+	    if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
+		nodeind >= ind.size() || timeline.framecount != frameind)
+	       return "Bad FRAME line" ;
+	    addframe(make_internal_node(ind[nodeind])) ;
+	    timeline.framecount++ ;
+	    timeline.end = timeline.next ;
+	    timeline.next += timeline.inc ;
+	 }
+	 break ;
+      }
+   } else {
+      n = sscanf(line, "%d %" PRIuPTR " %" PRIuPTR " %" PRIuPTR " %" PRIuPTR " %d", &d, &nw, &ne, &sw, &se, &r) ;
+      if (n < 0) // blank line; permit
+         return 0 ;
+      if (n == 0) {
+         // conversion error in first argument; we allow only if the only
+         // content on the line is whitespace.
+         char *ws = line ;
+         while (*ws && *ws <= ' ')
+            ws++ ;
+         if (*ws > 0)
+            return "Parse error in macrocell format." ;
+         return 0 ;
+      }
+      if (n < 5)
+         // AKT: best not to use lifefatal here because user won't see any
+         // error message when reading clipboard data starting with "[..."
+         return "Parse error in readmacrocell." ;
+      return mcnode(d, nw, ne, sw, se, ind) ;
+   }
+   return 0 ;
+}
+/*
+ *   Big uncompressed macrocell files are read from a memory mapping.
+ *   Each window of the file is cut into chunks at line ends and the
+ *   chunks are parsed on as many threads as we calculate with; then
+ *   the nodes are hashed in file order, since a node line only refers
+ *   to lines before it.  Only plain leaf and node lines are parsed
+ *   ahead; anything else, including any line with a mistake in it,
+ *   is handed to mcline as getline would have returned it.
+ */
+const long MINFASTMC = 1 << 20 ;    // smaller files aren't worth mapping
+const long MCCHUNK = 1 << 22 ;      // bytes per parse task
+const int MCLINE = 10000 ;          // getline splits longer lines
+struct mcrec {
+   int d ;               // depth from the file; 0 for a leaf, -1 for mcline
+   g_uintptr_t a[4] ;    // children, or quadrants of a leaf
+   const char *line ;    // for mcline
+   int len ;
+} ;
+class mcchunk : public lifetask {
+public:
+   virtual void run() ;
+   void parse(const char *p, const char *e) ;
+   const char *start, *end ;
+   std::vector<mcrec> recs ;
+} ;
+void mcchunk::run() {
+   recs.clear() ;
+   const char *p = start ;
+   while (p < end) {
+      const char *lim = end - p > MCLINE ? p + MCLINE : end ;
+      const char *q = p ;
+      while (q < lim && *q != '\n' && *q != '\r')
+         q++ ;
+      if (q > p)
+         parse(p, q) ;
+      p = (q < lim ? q + 1 : q) ;
+   }
+}
+void mcchunk::parse(const char *p, const char *e) {
+   mcrec r ;
+   r.line = p ;
+   r.len = (int)(e - p) ;
+   r.d = -1 ;
+   if (*p == '.' || *p == '*' || *p == '$') {
+      unsigned short l[4] ;
+      if (mcleaf(p, e, &l[0], &l[1], &l[2], &l[3]) == 0) {
+         r.d = 0 ;
+         for (int i=0; i<4; i++)
+            r.a[i] = l[i] ;
+      }
+   } else if (*p != '#') {
+      // depth and children as unsigned decimal numbers, then maybe the
+      // unused sixth field, separated by blanks; the depth must fit an
+      // int and the children a g_uintptr_t
+      const int maxdigits = sizeof(g_uintptr_t) > 4 ? 18 : 9 ;
+      g_uintptr_t v[6] ;
+      int n = 0 ;
+      const char *q = p ;
+      for (;;) {
+         while (q < e && (*q == ' ' || *q == '\t'))
+            q++ ;
+         if (q == e || n == 6 || *q < '0' || *q > '9')
             break ;
-         case 'G':
-            p = line + 2 ;
-            while (*p && *p <= ' ') p++ ;
-            pp = p ;
-            while (*pp >= '0' && *pp <= '9') pp++ ;
-            *pp = 0 ;
-            generation = bigint(p) ;
+         const char *s = q ;
+         g_uintptr_t x = 0 ;
+         while (q < e && '0' <= *q && *q <= '9')
+            x = 10 * x + (*q++ - '0') ;
+         if (q - s > (n == 0 ? 9 : maxdigits) ||
+             (q < e && *q != ' ' && *q != '\t'))
             break ;
-	    // either:
-	    //   #FRAMES count base inc
-	    // or
-	    //   #FRAME index node
-	 case 'F':
-	    if (strncmp(line, "#FRAMES ", 8) == 0) {
-	       p = line + 8 ;
-	       while (*p && *p <= ' ')
-		 p++ ;
-	       long cnt = atol(p) ;
-	       if (cnt < 0 || cnt > MAX_FRAME_COUNT)
-		  return "Bad FRAMES line" ;
-	       destroytimeline() ;
-	       while ('0' <= *p && *p <= '9')
-		 p++ ;
-	       while (*p && *p <= ' ')
-		 p++ ;
-	       pp = p ;
-	       while ((*pp >= '0' && *pp <= '9') || *pp == ',') pp++ ;
-	       if (*pp == 0)
-		  return "Bad FRAMES line" ;
-	       *pp = 0 ;
-	       timeline.start = bigint(p) ;
-	       timeline.end = timeline.start ;
-               timeline.next = timeline.start ;
-	       p = pp + 1 ;
-	       while (*p && *p <= ' ')
-		 p++ ;
-	       pp = p ;
-	       while (*pp > ' ')
-                  pp++ ;
-	       *pp = 0 ;
-               if (strchr(p, '^')) {
-                  int tbase=0, texpo=0 ;
-                  if (sscanf(p, "%d^%d", &tbase, &texpo) != 2 ||
-                      tbase < 2 || texpo < 0)
-                     return "Bad FRAMES line" ;
-                  timeline.base = tbase ;
-                  timeline.expo = texpo ;
-                  timeline.inc = 1 ;
-                  while (texpo--)
-                     timeline.inc.mul_smallint(tbase) ;
-               } else {
-	          timeline.inc = bigint(p) ;
-                  // if it's a power of two, we're good
-                  int texpo = timeline.inc.lowbitset() ;
-                  int tbase = 2 ;
-                  bigint test = 1 ;
-                  for (int i=0; i<texpo; i++)
-                     test += test ;
-                  if (test != timeline.inc)
-                     return "Bad increment (missing ^) in FRAMES" ;
-                  timeline.base = tbase ;
-                  timeline.expo = texpo ;
-               }
-	    } else if (strncmp(line, "#FRAME ", 7) == 0) {
-	       int frameind = 0 ;
-	       g_uintptr_t nodeind = 0 ;
-	       n = sscanf(line+7, "%d %" PRIuPTR, &frameind, &nodeind) ;
-	       if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
-		   nodeind > i || timeline.framecount != frameind)
-		  return "Bad FRAME line" ;
-	       timeline.frames.push_back(make_internal_node(ind[nodeind])) ;
-	       timeline.framecount++ ;
-	       timeline.end = timeline.next ;
-	       timeline.next += timeline.inc ;
-	    }
-	    break ;
-         }
-      } else {
-         n = sscanf(line, "%d %" PRIuPTR " %" PRIuPTR " %" PRIuPTR " %" PRIuPTR " %d", &d, &nw, &ne, &sw, &se, &r) ;
-         if (n < 0) // blank line; permit
-            continue ;
-         if (n == 0) {
-            // conversion error in first argument; we allow only if the only
-            // content on the line is whitespace.
-            char *ws = line ;
-            while (*ws && *ws <= ' ')
-               ws++ ;
-            if (*ws > 0)
-               return "Parse error in macrocell format." ;
-            continue ;
-         }
-         if (n < 5)
-            // AKT: best not to use lifefatal here because user won't see any
-            // error message when reading clipboard data starting with "[..."
-            return "Parse error in readmacrocell." ;
-         if (d < 1)
-            return "Oops; bad depth in readmacrocell." ;
-         if (d > 1) {
-            ind[0] = zeronode(d <= 4 ? 2 : d-2) ; /* allow zeros to work right */
-            if (nw >= i || ind[nw] == 0 || ne >= i || ind[ne] == 0 ||
-               sw >= i || ind[sw] == 0 || se >= i || ind[se] == 0) {
-               return "Node out of range in readmacrocell." ;
-            }
+         v[n++] = x ;
+      }
+      if (q == e && n == 0)
+         return ; // blank line
+      if (q == e && n >= 5 && v[0] >= 1) {
+         r.d = (int)v[0] ;
+         for (int i=0; i<4; i++)
+            r.a[i] = v[i+1] ;
+      }
+   }
+   recs.push_back(r) ;
+}
+const char *hlifealgo::readmcbody(const char *p, const char *end, char *line,
+                                  std::vector<node *> &ind) {
+   const char *data = p ;
+   double size = (double)(end - p) ;
+   int nchunks = 2 * numthreads ;
+   lifethreads *pool = numthreads > 1 ? new lifethreads(numthreads) : 0 ;
+   std::vector<mcchunk> chunks(nchunks) ;
+   std::vector<lifetask *> tasks(nchunks) ;
+   const char *err = 0 ;
+   while (p < end && err == 0) {
+      if (lifeabortprogress((p - data) / size, ""))
+         break ;
+      int ntasks = 0 ;
+      while (ntasks < nchunks && p < end) {
+         mcchunk &c = chunks[ntasks] ;
+         c.start = p ;
+         if (end - p > MCCHUNK) {
+            p += MCCHUNK ;
+            while (p < end && *p != '\n' && *p != '\r')
+               p++ ;
+         } else {
+            p = end ;
          }
-         if (d < 4) {
-            /* Support macrocell nodes in multicell format (i.e. with 2-square
-               leaf nodes) for compatibility. Cell values must be 0 or 1! */
-            unsigned short lnw=0, lne=0, lsw=0, lse=0 ;
-            if (d == 1) {
-               if (nw > 1 || ne > 1 || sw > 1 || se > 1) {
-                  return "Cell value out of range in readmacrocell." ;
-               }
-               lnw = nw ? 1 <<  0 : 0 ;
-               lne = ne ? 1 <<  3 : 0 ;
-               lsw = sw ? 1 << 12 : 0 ;
-               lse = se ? 1 << 15 : 0 ;
-            } else { // d == 2 || d == 3
-               node *pnw=ind[nw], *pne=ind[ne], *psw=ind[sw], *pse=ind[se] ;
-               if (is_node(pnw) || is_node(pne) || is_node(psw) || is_node(pse)) {
-                  return "Invalid leaf node reference in readmacrocell." ;
-               }
-               lnw = unpack4x4center((leaf *)pnw) ;
-               lne = unpack4x4center((leaf *)pne) ;
-               lsw = unpack4x4center((leaf *)psw) ;
-               lse = unpack4x4center((leaf *)pse) ;
-               if (d == 2) {
-                  lnw >>= 5 ;
-                  lne >>= 3 ;
-                  lsw <<= 3 ;
-                  lse <<= 5 ;
-               }
+         c.end = p ;
+         c.level = 0 ;
+         tasks[ntasks++] = &c ;
+      }
+      if (pool)
+         pool->runbatch(&tasks[0], ntasks) ;
+      else
+         for (int i=0; i<ntasks; i++)
+            tasks[i]->run() ;
+      for (int i=0; i<ntasks && err == 0; i++) {
+         std::vector<mcrec> &recs = chunks[i].recs ;
+         for (size_t j=0; j<recs.size() && err == 0; j++) {
+            mcrec &r = recs[j] ;
+            if (r.d < 0) {
+               memcpy(line, r.line, r.len) ;
+               line[r.len] = 0 ;
+               err = mcline(line, ind) ;
+            } else if (r.d == 0) {
+               clearstack() ;
+               root = (node *)find_leaf((unsigned short)r.a[0],
+                        (unsigned short)r.a[1], (unsigned short)r.a[2],
+                        (unsigned short)r.a[3]) ;
+               ind.push_back(root) ;
+               depth = 2 ;
+            } else {
+               err = mcnode(r.d, r.a[0], r.a[1], r.a[2], r.a[3], ind) ;
             }
-            clearstack() ;
-            root = ind[i++] = (node *)find_leaf(lnw, lne, lsw, lse) ;
-         } else {  // d >= 4
-            clearstack() ;
-            root = ind[i++] = find_node(ind[nw], ind[ne], ind[sw], ind[se]) ;
          }
-         depth = d - 1 ;
       }
+      releasepattern(p) ;
+   }
+   delete pool ;
+   return err ;
+}
+const char *hlifealgo::readmacrocell(char *line) {
+   if (strncmp(line, "[MB]", 4) == 0)
+      return readbinarymc() ;
+   std::vector<node *> ind(1) ;
+   const char *err = 0 ;
+   root = 0 ;
+   const char *p, *end ;
+   if (mappattern(&p, &end, MINFASTMC)) {
+      err = readmcbody(p, end, line, ind) ;
+      unmappattern() ;
+   } else {
+      while (err == 0 && getline(line, 10000))
+         err = mcline(line, ind) ;
    }
-   if (ind)
-      free(ind) ;
+   if (err)
+      return err ;
    if (root == 0) {
       // AKT: allow empty macrocell pattern; note that endofpattern()
       // will be called soon so don't set hashed here
@@ -1854,6 +3693,151 @@ default:       return "Illegal character in readmacrocell." ;
    hashed = 1 ;
    return 0 ;
 }
+/*
+ *   A binary macrocell file starts with a "[MB]" line and then holds,
+ *   as varints (seven bits a byte, low first, top bit set on all but
+ *   the last) unless noted:  the format version; the rule, generation
+ *   and step as a length and that many characters; the number of
+ *   leaves and of nodes; each leaf as eight bytes, one per row from
+ *   the top with the leftmost cell in the high bit; and each node as
+ *   four children.  Leaves are numbered from 1 and nodes follow them;
+ *   a child is given as its node's number minus its own, so most are
+ *   a byte, or 0 for an empty child.  Children always come before
+ *   their parent, and the last node (or the only leaf) is the root.
+ */
+const int MCBVERSION = 1 ;
+static const char *getvarint(const char *p, const char *end,
+                             g_uintptr_t *v) {
+   g_uintptr_t r = 0 ;
+   for (int shift=0; p < end && shift < 64; shift += 7) {
+      unsigned char c = (unsigned char)*p++ ;
+      r |= (g_uintptr_t)(c & 127) << shift ;
+      if (c < 128) {
+         *v = r ;
+         return p ;
+      }
+   }
+   return 0 ;
+}
+static const char *getmcbstring(const char *p, const char *end,
+                                std::string &s) {
+   g_uintptr_t n ;
+   if ((p = getvarint(p, end, &n)) == 0 || n > (g_uintptr_t)(end - p))
+      return 0 ;
+   s.assign(p, n) ;
+   return p + n ;
+}
+const char *hlifealgo::readbinarybody(const char *p, const char *end) {
+   const char *bad = "Invalid binary macrocell file." ;
+   const char *aborted = "Binary macrocell file was not completely read." ;
+   g_uintptr_t version, nleaves, nnodes ;
+   std::string rule, gen, inc ;
+   if ((p = getvarint(p, end, &version)) == 0)
+      return bad ;
+   if (version != MCBVERSION)
+      return "Unsupported binary macrocell version." ;
+   if ((p = getmcbstring(p, end, rule)) == 0 ||
+       (p = getmcbstring(p, end, gen)) == 0 ||
+       (p = getmcbstring(p, end, inc)) == 0 ||
+       (p = getvarint(p, end, &nleaves)) == 0 ||
+       (p = getvarint(p, end, &nnodes)) == 0 ||
+       nleaves > (g_uintptr_t)(end - p) / 8 ||
+       nnodes > (g_uintptr_t)(end - p))
+      return bad ;
+   const char *err = setrule(rule.c_str()) ;
+   if (err)
+      return err ;
+   double size = (double)(nleaves + nnodes) ;
+   std::vector<node *> ind(nleaves + nnodes + 1) ;
+   std::vector<int> depths(nnodes) ;
+   for (g_uintptr_t i=1; i<=nleaves; i++) {
+      if ((i & 4095) == 0 && lifeabortprogress(i / size, ""))
+         return aborted ;
+      const unsigned char *b = (const unsigned char *)p ;
+      unsigned short q[4] ;
+      for (int k=0; k<4; k++) {
+         int top = k < 2 ? 0 : 4 ;
+         int shift = k & 1 ? 0 : 4 ;
+         q[k] = (unsigned short)(((b[top] >> shift & 15) << 12) |
+                                 ((b[top+1] >> shift & 15) << 8) |
+                                 ((b[top+2] >> shift & 15) << 4) |
+                                 (b[top+3] >> shift & 15)) ;
+      }
+      p += 8 ;
+      clearstack() ;
+      ind[i] = (node *)find_leaf(q[0], q[1], q[2], q[3]) ;
+   }
+   for (g_uintptr_t i=0; i<nnodes; i++) {
+      g_uintptr_t self = nleaves + 1 + i ;
+      if ((self & 4095) == 0 && lifeabortprogress(self / size, ""))
+         return aborted ;
+      g_uintptr_t c[4] ;
+      int d = 0 ;
+      for (int k=0; k<4; k++) {
+         if ((p = getvarint(p, end, &c[k])) == 0 || c[k] >= self)
+            return bad ;
+         if (c[k] == 0)
+            continue ;
+         g_uintptr_t j = self - c[k] ;
+         int cd = j > nleaves ? depths[j - nleaves - 1] : 2 ;
+         if (d != 0 && cd != d)
+            return bad ;
+         d = cd ;
+      }
+      if (d == 0)
+         return bad ;
+      node *q[4] ;
+      for (int k=0; k<4; k++)
+         q[k] = c[k] ? ind[self - c[k]] : zeronode(d) ;
+      depths[i] = d + 1 ;
+      clearstack() ;
+      ind[self] = find_node(q[0], q[1], q[2], q[3]) ;
+   }
+   if (p != end)
+      return bad ;
+   generation = bigint(gen.c_str()) ;
+   bigint step(inc.c_str()) ;
+   if (step > bigint::zero)
+      setIncrement(step) ;
+   if (nleaves + nnodes == 0) {
+      // an empty universe; endofpattern() will be called soon
+      root = 0 ;
+      return 0 ;
+   }
+   root = ind[nleaves + nnodes] ;
+   depth = nnodes ? depths[nnodes-1] : 2 ;
+   if (depth < 3) {
+      root = make_internal_node(root) ;
+      depth = 3 ;
+   }
+   hashed = 1 ;
+   return 0 ;
+}
+/*
+ *   The rest of a binary macrocell file is read from a memory mapping
+ *   when we can, so loading is a single pass over the bytes; otherwise
+ *   (say for a compressed file) it's read into memory first.
+ */
+const char *hlifealgo::readbinarymc() {
+   root = 0 ;
+   const char *p, *end, *err ;
+   if (mappattern(&p, &end, 0)) {
+      err = readbinarybody(p, end) ;
+      unmappattern() ;
+   } else {
+      std::vector<char> buf ;
+      size_t used = 0 ;
+      for (;;) {
+         buf.resize(used + (1 << 20) + buf.size()) ;
+         size_t n = getbytes(&buf[used], buf.size() - used) ;
+         used += n ;
+         if (used < buf.size())
+            break ;
+      }
+      err = readbinarybody(&buf[0], &buf[0] + used) ;
+   }
+   return err ;
+}
 
 // Flip bits in given rule table.
 static void fliprule(char *rptr) {
@@ -1880,6 +3864,9 @@ const char *hlifealgo::setrule(const char *s) {
    if (!(hliferules.isHexagonal() || hliferules.isWolfram())) {
       fliprule(hliferules.rule0);
    }
+#ifndef NOLEAFKERNEL
+   kernelnbrs = liferules::countingRule(ruletable, kernelrule) ;
+#endif
 
    clearcache() ;
    
@@ -1914,11 +3901,11 @@ g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (getlabel(root->nw) != 0)
+         return getlabel(root->nw) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       unhash_node2(root) ;
       mark2(root) ;
    }
@@ -1927,7 +3914,7 @@ g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
       unsigned int top, bot ;
       leaf *n = (leaf *)root ;
       thiscell = ++cellcounter ;
-      root->nw = (node *)thiscell ;
+      setlabel(root->nw, thiscell) ;
       unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
       for (j=7; (top | bot) && j>=0; j--) {
          int bits = (top >> 24) ;
@@ -1947,7 +3934,7 @@ g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
       g_uintptr_t sw = writecell(os, root->sw, depth-1) ;
       g_uintptr_t se = writecell(os, root->se, depth-1) ;
       thiscell = ++cellcounter ;
-      root->next = (node *)thiscell ;
+      setlabel(root->next, thiscell) ;
       os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
    }
    return thiscell ;
@@ -1962,11 +3949,11 @@ g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (getlabel(root->nw) != 0)
+         return getlabel(root->nw) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       unhash_node2(root) ;
       mark2(root) ;
    }
@@ -1975,7 +3962,7 @@ g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->nw = (node *)thiscell ;
+      setlabel(root->nw, thiscell) ;
    } else {
       writecell_2p1(root->nw, depth-1) ;
       writecell_2p1(root->ne, depth-1) ;
@@ -1985,71 +3972,191 @@ g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->next = (node *)thiscell ;
+      setlabel(root->next, thiscell) ;
    }
    return thiscell ;
 }
+/**
+ *   writecell_2p2 formats the nodes into this buffer, which goes to
+ *   the stream a megabyte at a time rather than through operator<< a
+ *   character or number at a time.
+ */
+const int MCWRITEBUF = 1 << 20 ;
+struct mcwriter {
+   mcwriter(std::ostream &os) : os(os), buf(MCWRITEBUF) {
+      p = &buf[0] ;
+   }
+   ~mcwriter() { flush() ; }
+   void flush() {
+      os.write(&buf[0], p - &buf[0]) ;
+      p = &buf[0] ;
+   }
+   // make room for a line of up to n characters
+   void reserve(int n) {
+      if (p + n > &buf[0] + MCWRITEBUF)
+         flush() ;
+   }
+   void put(char c) { *p++ = c ; }
+   // seven bits a byte, low bits first, top bit set on all but the last
+   void putvarint(g_uintptr_t v) {
+      while (v >= 128) {
+         *p++ = (char)((v & 127) | 128) ;
+         v >>= 7 ;
+      }
+      *p++ = (char)v ;
+   }
+   void putstring(const char *s) {
+      size_t n = strlen(s) ;
+      reserve(10) ;
+      putvarint(n) ;
+      flush() ;
+      os.write(s, n) ;
+   }
+   void put(g_uintptr_t v) {
+      char digits[24] ;
+      int n = 0 ;
+      do {
+         digits[n++] = (char)('0' + v % 10) ;
+         v /= 10 ;
+      } while (v) ;
+      while (n)
+         *p++ = digits[--n] ;
+   }
+   // bytes written so far
+   double size() { return double(os.tellp()) + (p - &buf[0]) ; }
+   std::ostream &os ;
+   std::vector<char> buf ;
+   char *p ;
+} ;
 /**
  *   This one writes the cells, but assuming they've already been
  *   numbered, and displaying a progress dialog.
  */
 static char progressmsg[80] ;
-g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
+g_uintptr_t hlifealgo::writecell_2p2(mcwriter &w, node *root, int depth) {
    g_uintptr_t thiscell = 0 ;
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (cellcounter + 1 != (g_uintptr_t)(root->nw))
-         return (g_uintptr_t)(root->nw) ;
+      if (cellcounter + 1 != getlabel(root->nw))
+         return getlabel(root->nw) ;
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp();
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
+         sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
          lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
       }
       int i, j ;
       unsigned int top, bot ;
       leaf *n = (leaf *)root ;
-      root->nw = (node *)thiscell ;
+      setlabel(root->nw, thiscell) ;
       unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
+      w.reserve(8 * 9 + 1) ;
       for (j=7; (top | bot) && j>=0; j--) {
          int bits = (top >> 24) ;
          top = (top << 8) | (bot >> 24) ;
          bot = (bot << 8) ;
          for (i=0; bits && i<8; i++, bits = (bits << 1) & 255)
-            if (bits & 128)
-               os << '*' ;
-            else
-               os << '.' ;
-         os << '$' ;
+            w.put(bits & 128 ? '*' : '.') ;
+         w.put('$') ;
       }
-      os << '\n' ;
+      w.put('\n') ;
    } else {
-      if (cellcounter + 1 > (g_uintptr_t)(root->next) || isaborted())
-         return (g_uintptr_t)(root->next) ;
-      g_uintptr_t nw = writecell_2p2(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell_2p2(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell_2p2(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell_2p2(os, root->se, depth-1) ;
+      if (cellcounter + 1 > getlabel(root->next) || isaborted())
+         return getlabel(root->next) ;
+      g_uintptr_t nw = writecell_2p2(w, root->nw, depth-1) ;
+      g_uintptr_t ne = writecell_2p2(w, root->ne, depth-1) ;
+      g_uintptr_t sw = writecell_2p2(w, root->sw, depth-1) ;
+      g_uintptr_t se = writecell_2p2(w, root->se, depth-1) ;
       if (!isaborted() &&
-          cellcounter + 1 != (g_uintptr_t)(root->next)) { // this should never happen
+          cellcounter + 1 != getlabel(root->next)) { // this should never happen
          lifefatal("Internal in writecell_2p2") ;
-         return (g_uintptr_t)(root->next) ;
+         return getlabel(root->next) ;
       }
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp();
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
+         sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
          lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
       }
-      root->next = (node *)thiscell ;
-      os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
+      setlabel(root->next, thiscell) ;
+      w.reserve(5 * 24) ;
+      w.put((g_uintptr_t)(depth+1)) ;
+      w.put(' ') ;
+      w.put(nw) ;
+      w.put(' ') ;
+      w.put(ne) ;
+      w.put(' ') ;
+      w.put(sw) ;
+      w.put(' ') ;
+      w.put(se) ;
+      w.put('\n') ;
    }
    return thiscell ;
 }
 #define STRINGIFY(arg) STR2(arg)
 #define STR2(arg) #arg
+/*
+ *   Paging timeline frames out to the frame store.  We write a node's
+ *   children before the node itself, and only nodes the store doesn't
+ *   already have; we read them back the same way.
+ */
+G_INT64 hlifealgo::writeframe(void *frame) {
+   return writeframenode((node *)frame) ;
+}
+G_INT64 hlifealgo::writeframenode(node *n) {
+   G_INT64 ref = timeline.store.find(n) ;
+   if (ref != 0)
+      return ref ;
+   G_INT64 w[4] ;
+   if (is_node(n)) {
+      if ((w[0] = writeframenode(n->nw)) == 0 ||
+          (w[1] = writeframenode(n->ne)) == 0 ||
+          (w[2] = writeframenode(n->sw)) == 0 ||
+          (w[3] = writeframenode(n->se)) == 0)
+         return 0 ;
+      ref = timeline.store.put(w, 0) ;
+   } else {
+      leaf *l = (leaf *)n ;
+      w[0] = l->nw ;
+      w[1] = l->ne ;
+      w[2] = l->sw ;
+      w[3] = l->se ;
+      ref = timeline.store.put(w, 1) ;
+   }
+   if (ref != 0)
+      timeline.store.remember(n, ref) ;
+   return ref ;
+}
+void *hlifealgo::readframe(G_INT64 ref) {
+   return readframenode(ref) ;
+}
+node *hlifealgo::readframenode(G_INT64 ref) {
+   node *n = (node *)timeline.store.lookup(ref) ;
+   if (n != 0)
+      return n ;
+   G_INT64 w[4] ;
+   if (!timeline.store.get(ref, w))
+      return 0 ;
+   if (framestore::isleaf(ref)) {
+      n = (node *)find_leaf((unsigned short)w[0], (unsigned short)w[1],
+                            (unsigned short)w[2], (unsigned short)w[3]) ;
+   } else {
+      node *nw, *ne, *sw, *se ;
+      if ((nw = readframenode(w[0])) == 0 ||
+          (ne = readframenode(w[1])) == 0 ||
+          (sw = readframenode(w[2])) == 0 ||
+          (se = readframenode(w[3])) == 0)
+         return 0 ;
+      n = find_node(nw, ne, sw, se) ;
+   }
+   timeline.store.remember(n, ref) ;
+   return n ;
+}
 const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
+   // the writer marks nodes, so page in any paged-out frames first
+   if (timeline.savetimeline)
+      for (int i=0; i<timeline.framecount; i++)
+         if (getframe(i) == 0)
+            return "Timeline frame could not be read back from disk." ;
    int depth = node_depth(root) ;
    os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
 
@@ -2107,6 +4214,7 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
    writecell_2p1(root, depth) ;
    writecells = cellcounter ;
    cellcounter = 0 ;
+   mcwriter w(os) ;
    if (framestosave) {
       os << "#FRAMES"
          << ' ' << timeline.framecount
@@ -2114,11 +4222,13 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
          << ' ' << timeline.base << '^' << timeline.expo << '\n' ;
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
-       writecell_2p2(os, frame, depths[i]) ;
+       writecell_2p2(w, frame, depths[i]) ;
+       w.flush() ;
        os << "#FRAME " << i << ' ' << (g_uintptr_t)frame->next << '\n' ;
      }
    }
-   writecell_2p2(os, root, depth) ;
+   writecell_2p2(w, root, depth) ;
+   w.flush() ;
    /* end new two-pass way */
    if (framestosave) {
      for (int i=0; i<timeline.framecount; i++) {
@@ -2130,6 +4240,103 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
    inGC = 0 ;
    return 0 ;
 }
+/*
+ *   Number the nodes for a binary macrocell file, children before
+ *   parents, collecting leaves and nodes separately.  Like
+ *   writecell_2p1 this labels leaves and marks nodes, so
+ *   afterwritemc must be called when we're done.
+ */
+void hlifealgo::binaryscan(node *root, int depth, std::vector<node *> &leaves,
+                           std::vector<node *> &nodes,
+                           std::vector<int> &depths) {
+   if (root == zeronode(depth))
+      return ;
+   if (depth == 2) {
+      if (getlabel(root->nw) != 0)
+         return ;
+      leaves.push_back(root) ;
+      setlabel(root->nw, leaves.size()) ;
+   } else {
+      if (marked2(root))
+         return ;
+      unhash_node2(root) ;
+      mark2(root) ;
+      binaryscan(root->nw, depth-1, leaves, nodes, depths) ;
+      binaryscan(root->ne, depth-1, leaves, nodes, depths) ;
+      binaryscan(root->sw, depth-1, leaves, nodes, depths) ;
+      binaryscan(root->se, depth-1, leaves, nodes, depths) ;
+      nodes.push_back(root) ;
+      depths.push_back(depth) ;
+      setlabel(root->next, nodes.size()) ;
+   }
+   // note:  we *must* not abort this prescan
+   if (((leaves.size() + nodes.size()) & 4095) == 0)
+      lifeabortprogress(0, "Scanning tree") ;
+}
+/*
+ *   Write the layout described above readbinarybody.  The timeline,
+ *   if any, isn't saved.
+ */
+const char *hlifealgo::writeBinaryMacrocell(std::ostream &os) {
+   int depth = node_depth(root) ;
+   os << "[MB] (golly " STRINGIFY(VERSION) ")\n" ;
+   inGC = 1 ;
+   std::vector<node *> leaves, nodes ;
+   std::vector<int> depths ;
+   binaryscan(root, depth, leaves, nodes, depths) ;
+   g_uintptr_t nleaves = leaves.size() ;
+   double size = (double)(nleaves + nodes.size()) ;
+   {
+      mcwriter w(os) ;
+      w.reserve(10) ;
+      w.putvarint(MCBVERSION) ;
+      w.putstring(hliferules.getrule()) ;
+      w.putstring(generation.tostring('\0')) ;
+      w.putstring(increment.tostring('\0')) ;
+      w.reserve(20) ;
+      w.putvarint(nleaves) ;
+      w.putvarint(nodes.size()) ;
+      for (g_uintptr_t i=0; i<nleaves && !isaborted(); i++) {
+         if (((i + 1) & 4095) == 0) {
+            sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
+            lifeabortprogress((i + 1) / size, progressmsg) ;
+         }
+         leaf *n = (leaf *)leaves[i] ;
+         unsigned int top, bot ;
+         unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
+         w.reserve(8) ;
+         for (int j=24; j>=0; j -= 8)
+            w.put((char)(top >> j)) ;
+         for (int j=24; j>=0; j -= 8)
+            w.put((char)(bot >> j)) ;
+      }
+      for (size_t i=0; i<nodes.size() && !isaborted(); i++) {
+         g_uintptr_t self = nleaves + 1 + i ;
+         if ((self & 4095) == 0) {
+            sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
+            lifeabortprogress(self / size, progressmsg) ;
+         }
+         node *n = nodes[i] ;
+         node *c[4] = { n->nw, n->ne, n->sw, n->se } ;
+         int d = depths[i] - 1 ;
+         node *z = zeronode(d) ;
+         w.reserve(4 * 10) ;
+         for (int k=0; k<4; k++) {
+            if (c[k] == z)
+               w.putvarint(0) ;
+            else if (d == 2)
+               w.putvarint(self - getlabel(c[k]->nw)) ;
+            else
+               w.putvarint(self - nleaves - getlabel(c[k]->next)) ;
+         }
+      }
+   }
+   afterwritemc(root, depth) ;
+   inGC = 0 ;
+   if (isaborted())
+      return "Binary macrocell file was not completed." ;
+   return 0 ;
+}
 char hlifealgo::statusline[200] ;
 static lifealgo *creator() { return new hlifealgo() ; }
 void hlifealgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
@@ -6,6 +6,7 @@
 #include "lifealgo.h"
 #include "liferules.h"
 #include "util.h"
+#include <atomic>
 /*
  *   Into instances of this node structure is where almost all of the
  *   memory allocated by this program goes.  Thus, it is imperative we
@@ -92,10 +93,16 @@
  *   this together, and you get the following structure for the 16-squares
  *   and larger:
  */
+#ifdef COMPACTNODES
+struct node ;
+typedef compactptr<node> nodeptr ;
+#else
+typedef struct node *nodeptr ;
+#endif
 struct node {
-   node *next ;              /* hash link */
-   node *nw, *ne, *sw, *se ; /* constant; nw != 0 means nonleaf */
-   node *res ;               /* cache */
+   nodeptr next ;            /* hash link */
+   nodeptr nw, ne, sw, se ;  /* constant; nw != 0 means nonleaf */
+   nodeptr res ;             /* cache */
 } ;
 /*
  *   For the 8-squares, we do not have `children', we have actual data
@@ -121,10 +128,14 @@ struct node {
  *   so on.
  */
 struct leaf {
-   node *next ;              /* hash link */
-   node *isnode ;            /* must always be zero for leaves */
+   nodeptr next ;            /* hash link */
+   nodeptr isnode ;          /* must always be zero for leaves */
    unsigned short nw, ne, sw, se ;  /* constant */
+#ifdef COMPACTNODES
+   unsigned short leafpop ;  /* how many set bits; see leafpopulation() */
+#else
    bigint leafpop ;         /* how many set bits */
+#endif
    unsigned short res1, res2 ;      /* constant */
 } ;
 /*
@@ -140,9 +151,26 @@ struct leaf {
 struct setup_t { 
    g_uintptr_t h ;
    struct node *nw, *ne, *sw, *se ;
-   void prefetch(node **addr) const { PREFETCH(addr) ; }
+   void prefetch(nodeptr *addr) const { PREFETCH(addr) ; }
 } ;
 #endif
+/*
+ *   A growable list of nodes, used by the generational gc.
+ */
+struct hnodelog {
+   node **nodes ;
+   g_uintptr_t n, size ;
+   int full ; // we had to drop entries
+} ;
+/*
+ *   Parallel stepping state lives in hlifealgo.cpp.
+ */
+struct hparallel ;
+struct hthreadctx ;
+/*
+ *   Macrocell writing goes through a buffer in hlifealgo.cpp.
+ */
+struct mcwriter ;
 /**
  *   Our hlifealgo class.
  */
@@ -152,6 +180,8 @@ public:
    virtual ~hlifealgo() ;
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
+   virtual int setrow(int x, int y, const int *runs, int nruns) ;
+   virtual bool getrows(int x, int y, int w, int h, rowvisitor &v) ;
    virtual int nextcell(int x, int y, int &state) ;
    virtual void endofpattern() ;
    virtual void setIncrement(bigint inc) ;
@@ -167,6 +197,10 @@ public:
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual int pinstate(const char *path) {
+      ensure_hashed() ;
+      return lifealgo::pinstate(path) ;
+   }
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -178,6 +212,13 @@ public:
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
    virtual const char *readmacrocell(char *line) ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual const char *writeBinaryMacrocell(std::ostream &os) ;
+   virtual void setNumThreads(int n) ;
+   virtual const char *getPerfSummary() ;
+   // the running counters behind getPerfSummary()
+   const hperf &getPerfCounters() ;
+   static void setParallelDepth(int d) { pardepth = (d < 3 ? 3 : d) ; }
+   static int getParallelDepth() { return pardepth ; }
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
 private:
 /*
@@ -208,7 +249,11 @@ private:
    g_uintptr_t hashmask ;
 #endif
    static double maxloadfactor ;
-   node **hashtab ;
+#ifdef OPENHASH
+   openhashtable<nodeptr> ohash ;
+#else
+   nodeptr *hashtab ;
+#endif
    int halvesdone ;
    int gsp ;
    g_uintptr_t alloced, maxmem ;
@@ -217,6 +262,19 @@ private:
    g_uintptr_t totalthings ;
    node *nodeblocks ;
    char *ruletable ;
+#ifndef NOLEAFKERNEL
+/*
+ *   The leaf kernel steps the 16-square made of four leaves directly
+ *   as a bitmap.  If the rule just counts some subset of the eight
+ *   neighbors, kernelnbrs is that subset (in rule3x3 bit order) and
+ *   kernelrule[c] has bit k set if k neighbors give a live cell when
+ *   the center is c; then the kernel is bit-sliced.  Otherwise
+ *   kernelnbrs is -1 and the kernel uses ruletable on the bitmap.
+ *   See liferules::countingRule().
+ */
+   int kernelnbrs ;
+   int kernelrule[2] ;
+#endif
    bigint population ;
    bigint setincrement ;
    bigint pow2step ; // greatest power of two in increment
@@ -239,8 +297,35 @@ private:
    int gccount ; // how many gcs total this pattern
    int gcstep ; // how many gcs this step
    hperf running_hperf, step_hperf, inc_hperf ;
-   int softinterrupt ;
+   std::atomic<int> softinterrupt ; // set by the main thread, read by all
    static char statusline[] ;
+/*
+ *   Parallel stepping.  With more than one thread, nodes at pardepth
+ *   and above hand their nine (and then four) independent subresults
+ *   to a pool of worker threads that share the hash table.  The
+ *   parallel flag is set only while the workers are running.
+ */
+   lifethreads *threads ;
+   hparallel *par ;
+   int parallel ;
+   static int pardepth ;
+   friend struct hgetrestask ;
+/*
+ *   Generational gc.  Every node we hash is logged as young, and every
+ *   node whose cache field we fill in is logged as touched.  When we
+ *   run out of memory we first try a minor collection, which frees
+ *   only unreachable young nodes and unlinks them from their chains
+ *   one at a time instead of rebuilding the whole hash.  If that does
+ *   not free enough, or the logs outgrew their budget, we fall back
+ *   to a full do_gc.  Logging only pays off when most nodes survive a
+ *   gc, so we only turn it on after a full gc that freed less than
+ *   half of them, and after a minor gc fails we leave it off for
+ *   gcwait full gcs, doubling each time.
+ */
+   hnodelog young, touched ;
+   g_uintptr_t logbytes ;
+   int gclogging, gcwait, gcbackoff ;
+   int clockgc ; // gccount at the last clockres() sweep
 //
    void leafres(leaf *n) ;
    void resize() ;
@@ -255,11 +340,34 @@ private:
    leaf *find_leaf(unsigned short nw, unsigned short ne,
                    unsigned short sw, unsigned short se) ;
    node *getres(node *n, int depth) ;
+   node *getres_par(node *n, int depth) ;
+   node *dorecurs_par(node *n, node *ne, node *t, node *e, int depth) ;
+   node *dorecurs_half_par(node *n, node *ne, node *t, node *e, int depth) ;
+   void runtasks(node **in, node **out, int ntasks, int depth) ;
+   hthreadctx &threadctx() ;
+   node *find_node_par(node *nw, node *ne, node *sw, node *se) ;
+   leaf *find_leaf_par(unsigned short nw, unsigned short ne,
+                       unsigned short sw, unsigned short se) ;
+   node *newnode_par() ;
+   node *save_par(node *n) ;
+   int stackpos() ;
+   int allocnodeblock() ;
+   void beginparallel(int depth) ;
+   void endparallel() ;
+   void safepoint() ;
+   void stopworld(int wantgc) ;
+   void requeststop(int wantgc) ;
+   void enterworld() ;
+   void exitworld() ;
+   static void waithook(void *arg) ;
    node *dorecurs(node *n, node *ne, node *t, node *e, int depth) ;
    node *dorecurs_half(node *n, node *ne, node *t, node *e, int depth) ;
    leaf *dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) ;
    leaf *dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) ;
    leaf *dorecurs_leaf_quarter(leaf *n, leaf *ne, leaf *t, leaf *e) ;
+#ifndef NOLEAFKERNEL
+   leaf *leafkernel(leaf *n, leaf *ne, leaf *t, leaf *e, int gens) ;
+#endif
    node *newnode() ;
    leaf *newleaf() ;
    node *newclearednode() ;
@@ -270,8 +378,13 @@ private:
    node *pushroot(node *n) ;
    node *make_internal_node(node *n);
    node *gsetbit(node *n, int x, int y, int newstate, int depth) ;
+   node *gsetrow(node *n, int off, int y, const int *spans, int nspans,
+                 int depth) ;
    int getbit(node *n, int x, int y, int depth) ;
    int nextbit(node *n, int x, int y, int depth) ;
+   void bandleaves(node *n, int depth, int cx, int cy, int band, int xlo,
+                   int xhi, std::vector<leaf *> &leaves,
+                   std::vector<int> &lx) ;
    node *hashpattern(node *root, int depth) ;
    node *popzeros(node *n) ;
    const bigint &calcpop(node *root, int depth) ;
@@ -284,6 +397,16 @@ private:
    void clearcache() ;
    void gc_mark(node *root, int invalidate) ;
    void do_gc(int invalidate) ;
+   void gc_mark_young(node *root) ;
+   g_uintptr_t do_minor_gc() ;
+   void unlink_young(node *n) ;
+   void collect() ;
+   void lognode(hnodelog &l, node *n) ;
+   int growlog(hnodelog &l) ;
+   void droplog(hnodelog &l) ;
+   void clearlogs(int enable) ;
+   void gcreport(int minor, double start, g_uintptr_t freed) ;
+   void clockres() ;
    void clearcache(node *n, int depth, int clearto) ;
    void clearcache_p1(node *n, int depth, int clearto) ;
    void clearcache_p2(node *n, int depth, int clearto) ;
@@ -296,7 +419,20 @@ private:
    void ensure_hashed() ;
    g_uintptr_t writecell(std::ostream &os, node *root, int depth) ;
    g_uintptr_t writecell_2p1(node *root, int depth) ;
-   g_uintptr_t writecell_2p2(std::ostream &os, node *root, int depth) ;
+   g_uintptr_t writecell_2p2(mcwriter &w, node *root, int depth) ;
+   virtual G_INT64 writeframe(void *frame) ;
+   virtual void *readframe(G_INT64 ref) ;
+   G_INT64 writeframenode(node *n) ;
+   node *readframenode(G_INT64 ref) ;
+   const char *mcline(char *line, std::vector<node *> &ind) ;
+   const char *mcnode(int d, g_uintptr_t nw, g_uintptr_t ne,
+                      g_uintptr_t sw, g_uintptr_t se, std::vector<node *> &ind) ;
+   const char *readmcbody(const char *p, const char *end, char *line,
+                          std::vector<node *> &ind) ;
+   void binaryscan(node *root, int depth, std::vector<node *> &leaves,
+                   std::vector<node *> &nodes, std::vector<int> &depths) ;
+   const char *readbinarymc() ;
+   const char *readbinarybody(const char *p, const char *end) ;
    void unpack8x8(unsigned short nw, unsigned short ne,
                   unsigned short sw, unsigned short se,
                   unsigned int *top, unsigned int *bot) ;
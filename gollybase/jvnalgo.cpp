@@ -190,6 +190,7 @@ jvnalgo::jvnalgo() {
 }
 
 jvnalgo::~jvnalgo() {
+   spillallpinned() ;
 }
 
 state slowcalc_Hutton32(state c,state n,state s,state e,state w);
@@ -3,7 +3,10 @@
 
 #include "lifealgo.h"
 #include "util.h"       // for lifestatus
+#include "writepattern.h"
 #include "string.h"
+#include <vector>
+#include <climits>
 using namespace std ;
 lifealgo::~lifealgo() {
    poller = 0 ;
@@ -21,11 +24,12 @@ int lifealgo::startrecording(int basearg, int expoarg) {
   } else {
     // use the current frame and increment to start a new timeline
     void *now = getcurrentstate() ;
-    if (now == 0)
+    if (now != 0)
+      addframe(now) ;
+    else if (!timeline.cells.append(*this))
       return 0 ;
     timeline.base = basearg ;
     timeline.expo = expoarg ;
-    timeline.frames.push_back(now) ;
     timeline.framecount = 1 ;
     timeline.end = timeline.start = generation ;
     timeline.inc = increment ;
@@ -41,10 +45,11 @@ pair<int, int> lifealgo::stoprecording() {
   return make_pair(timeline.base, timeline.expo) ;
 }
 void lifealgo::extendtimeline() {
-  if (timeline.recording && generation == timeline.next) {
+  if (timeline.recording && generation == timeline.next && !timelinefull()) {
     void *now = getcurrentstate() ;
-    if (now && timeline.framecount < MAX_FRAME_COUNT) {
-      timeline.frames.push_back(now) ;
+    if (now != 0)
+      addframe(now) ;
+    if (now != 0 || timeline.cells.append(*this)) {
       timeline.framecount++ ;
       timeline.end = timeline.next ;
       timeline.next += timeline.inc ;
@@ -61,13 +66,24 @@ void lifealgo::extendtimeline() {
  */
 void lifealgo::pruneframes() {
    if (timeline.framecount > 1) {
-      for (int i=2; i<timeline.framecount; i += 2)
-         timeline.frames[i >> 1]  = timeline.frames[i] ;
+      if (timeline.cells.size()) {
+         timeline.cells.halve() ;
+      } else {
+         for (int i=2; i<timeline.framecount; i += 2) {
+            timeline.frames[i >> 1]  = timeline.frames[i] ;
+            timeline.paged[i >> 1]  = timeline.paged[i] ;
+         }
+         timeline.frames.resize((timeline.framecount + 1) >> 1) ;
+         timeline.paged.resize((timeline.framecount + 1) >> 1) ;
+         timeline.resident.clear() ;
+         for (int i=0; i<(int)timeline.frames.size(); i++)
+            if (timeline.frames[i])
+               timeline.resident.push_back(i) ;
+      }
       timeline.framecount = (timeline.framecount + 1) >> 1 ;
-      timeline.frames.resize(timeline.framecount) ;
       timeline.inc += timeline.inc ;
       timeline.end = timeline.inc ;
-      timeline.end.mul_smallint(timeline.framecount-1) ;
+      timeline.end *= bigint(timeline.framecount-1) ;
       timeline.end += timeline.start ;
       timeline.next = timeline.end ;
       timeline.next += timeline.inc ;
@@ -78,19 +94,34 @@ void lifealgo::pruneframes() {
 int lifealgo::gotoframe(int i) {
   if (i < 0 || i >= timeline.framecount)
     return 0 ;
-  setcurrentstate(timeline.frames[i]) ;
-  // AKT: avoid mul_smallint(i) crashing with divide-by-zero if i is 0
-  if (i > 0) {
-    generation = timeline.inc ;
-    generation.mul_smallint(i) ;
+  bigint gen = timeline.inc ;
+  gen *= bigint(i) ;
+  gen += timeline.start ;
+  if (timeline.cells.size()) {
+    timeline.cells.restore(*this, i, gen) ;
   } else {
-    generation = 0;
+    void *frame = getframe(i) ;
+    if (frame == 0)
+      return 0 ;
+    setcurrentstate(frame) ;
+    generation = gen ;
+    pageoutframes() ;
   }
-  generation += timeline.start ;
   return timeline.framecount ;
 }
+int lifealgo::timelinefull() {
+  if (timeline.framecount >= MAX_FRAME_COUNT)
+    return 1 ;
+  size_t mb = getMaxMemory() > 0 ? getMaxMemory() : 1024 ;
+  return (timeline.cells.memory() >> 20) >= mb ;
+}
 void lifealgo::destroytimeline() {
   timeline.frames.clear() ;
+  timeline.paged.clear() ;
+  timeline.resident.clear() ;
+  timeline.keep = RESIDENT_FRAMES ;
+  timeline.store.clear() ;
+  timeline.cells.clear() ;
   timeline.recording = 0 ;
   timeline.framecount = 0 ;
   timeline.end = 0 ;
@@ -98,6 +129,569 @@ void lifealgo::destroytimeline() {
   timeline.inc = 0 ;
   timeline.next = 0 ;
 }
+void lifealgo::addframe(void *frame) {
+   timeline.frames.push_back(frame) ;
+   timeline.paged.push_back(0) ;
+   timeline.resident.push_back((int)timeline.frames.size() - 1) ;
+   pageoutframes() ;
+}
+void *lifealgo::getframe(int i) {
+   if (timeline.frames[i] == 0) {
+      timeline.frames[i] = readframe(timeline.paged[i]) ;
+      if (timeline.frames[i] != 0)
+         timeline.resident.push_back(i) ;
+   }
+   return timeline.frames[i] ;
+}
+/*
+ *   Drop the oldest frames from memory until only timeline.keep are
+ *   left, writing each to the store the first time.  If the algorithm
+ *   can't write frames (or the disk is full) we keep them all.
+ */
+void lifealgo::pageoutframes() {
+   while ((int)timeline.resident.size() > timeline.keep) {
+      int i = timeline.resident.front() ;
+      if (timeline.paged[i] == 0 &&
+          (timeline.paged[i] = writeframe(timeline.frames[i])) == 0)
+         return ;
+      timeline.frames[i] = 0 ;
+      timeline.resident.pop_front() ;
+   }
+}
+/*
+ *   The frame store.  Pages are PAGERECS records; the last is kept in
+ *   tail until it fills, and the others are read back into one of
+ *   CACHEPAGES slots in cache by page number.
+ */
+const int PAGERECS = 1024 ;
+const int CACHEPAGES = 256 ;
+static int seekrecord(FILE *f, G_INT64 rec) {
+#ifdef _WIN32
+   return _fseeki64(f, rec * 4 * sizeof(G_INT64), SEEK_SET) ;
+#else
+   return fseeko(f, (off_t)(rec * 4 * sizeof(G_INT64)), SEEK_SET) ;
+#endif
+}
+framestore::~framestore() {
+   clear() ;
+}
+G_INT64 framestore::put(const G_INT64 *w, int isleaf) {
+   if (f == 0) {
+      if (failed || (f = tmpfile()) == 0) {
+         failed = 1 ;
+         return 0 ;
+      }
+   }
+   tail.insert(tail.end(), w, w + 4) ;
+   if ((int)tail.size() == 4 * PAGERECS) {
+      if (seekrecord(f, count + 1 - PAGERECS) != 0 ||
+          fwrite(&tail[0], sizeof(G_INT64), tail.size(), f) != tail.size()) {
+         tail.resize(tail.size() - 4) ;
+         return 0 ;
+      }
+      tail.clear() ;
+   }
+   count++ ;
+   return (count << 1) | isleaf ;
+}
+int framestore::get(G_INT64 ref, G_INT64 *w) {
+   G_INT64 rec = (ref >> 1) - 1 ;
+   G_INT64 page = rec / PAGERECS ;
+   int off = 4 * (int)(rec % PAGERECS) ;
+   const G_INT64 *p ;
+   if (rec < 0 || rec >= count)
+      return 0 ;
+   if (page == count / PAGERECS) {
+      p = &tail[off] ;
+   } else {
+      if (cache.size() == 0) {
+         cache.resize(4 * PAGERECS * CACHEPAGES) ;
+         cached.resize(CACHEPAGES, -1) ;
+      }
+      int slot = (int)(page % CACHEPAGES) ;
+      G_INT64 *pp = &cache[4 * PAGERECS * slot] ;
+      if (cached[slot] != page) {
+         cached[slot] = -1 ;
+         if (seekrecord(f, page * PAGERECS) != 0 ||
+             fread(pp, sizeof(G_INT64), 4 * PAGERECS, f) != 4 * PAGERECS)
+            return 0 ;
+         cached[slot] = page ;
+      }
+      p = pp + off ;
+   }
+   for (int i=0; i<4; i++)
+      w[i] = p[i] ;
+   return 1 ;
+}
+G_INT64 framestore::find(void *n) {
+   std::unordered_map<void *, G_INT64>::iterator it = known.find(n) ;
+   return it == known.end() ? 0 : it->second ;
+}
+void *framestore::lookup(G_INT64 ref) {
+   std::unordered_map<G_INT64, void *>::iterator it = nodes.find(ref) ;
+   return it == nodes.end() ? 0 : it->second ;
+}
+void framestore::remember(void *n, G_INT64 ref) {
+   known[n] = ref ;
+   nodes[ref] = n ;
+}
+void framestore::forget(int (*kept)(void *)) {
+   for (std::unordered_map<void *, G_INT64>::iterator it = known.begin() ;
+        it != known.end() ; )
+      if (kept(it->first))
+         ++it ;
+      else
+         it = known.erase(it) ;
+   for (std::unordered_map<G_INT64, void *>::iterator it = nodes.begin() ;
+        it != nodes.end() ; )
+      if (kept(it->second))
+         ++it ;
+      else
+         it = nodes.erase(it) ;
+}
+void framestore::clear() {
+   if (f)
+      fclose(f) ;
+   f = 0 ;
+   failed = 0 ;
+   count = 0 ;
+   tail.clear() ;
+   cache.clear() ;
+   cached.clear() ;
+   known.clear() ;
+   nodes.clear() ;
+}
+/*
+ *   Pinned states.  These are just the roots the undo code would
+ *   otherwise have written to disk, so pinning is free and restoring
+ *   is instant; the cost is that gc can't reclaim what they hold.  If
+ *   gc tells us that is hurting, we write them all out and stop pinning
+ *   until a later gc frees a good share of memory again.
+ */
+int lifealgo::pinstate(const char *path) {
+   void *now = getcurrentstate() ;
+   if (now == 0)
+      return 0 ;
+   if (pinpressure) {
+      spillallpinned() ;
+      return 0 ;
+   }
+   unpinstate(path) ;
+   pinnedstate_t p ;
+   p.path = path ;
+   p.rule = getrule() ;
+   p.state = now ;
+   p.gen = generation ;
+   pinned.push_back(p) ;
+   return 1 ;
+}
+int lifealgo::restorepinned(const char *path) {
+   for (size_t i=0; i<pinned.size(); i++)
+      if (pinned[i].path == path) {
+         if (pinned[i].rule != getrule())
+            setrule(pinned[i].rule.c_str()) ;
+         setcurrentstate(pinned[i].state) ;
+         generation = pinned[i].gen ;
+         return 1 ;
+      }
+   return 0 ;
+}
+void lifealgo::unpinstate(const char *path) {
+   for (size_t i=0; i<pinned.size(); i++)
+      if (pinned[i].path == path) {
+         pinned.erase(pinned.begin() + i) ;
+         return ;
+      }
+}
+/*
+ *   Write a pinned state to its file just as the undo code would have,
+ *   then forget it.  If the file has gone its undo node went with it,
+ *   so there is nothing to write.
+ */
+int lifealgo::spillpinned(const char *path) {
+   for (size_t i=0; i<pinned.size(); i++)
+      if (pinned[i].path == path) {
+         FILE *f = fopen(path, "r") ;
+         if (f) {
+            fclose(f) ;
+            void *now = getcurrentstate() ;
+            bigint gen = generation ;
+            std::string rule = getrule() ;
+            int savetimeline = timeline.savetimeline ;
+            if (pinned[i].rule != rule)
+               setrule(pinned[i].rule.c_str()) ;
+            setcurrentstate(pinned[i].state) ;
+            generation = pinned[i].gen ;
+            timeline.savetimeline = 0 ;
+            writepattern(path, *this, MC_format, no_compression, 0, 0, 0, 0) ;
+            timeline.savetimeline = savetimeline ;
+            if (pinned[i].rule != rule)
+               setrule(rule.c_str()) ;
+            setcurrentstate(now) ;
+            generation = gen ;
+         }
+         pinned.erase(pinned.begin() + i) ;
+         return 1 ;
+      }
+   return 0 ;
+}
+void lifealgo::spillallpinned() {
+   while (!pinned.empty()) {
+      std::string path = pinned.back().path ;
+      spillpinned(path.c_str()) ;
+   }
+}
+
+// -----------------------------------------------------------------------------
+
+/*
+ *   Cell frames.  Decoded, a frame is an image:  for each row with live
+ *   cells, ascending, its y and run count n then n runs of x, length
+ *   and state, ascending and nonzero.  The xor of two images is an
+ *   image of the cells that differ, and xoring that with either one
+ *   gives back the other.
+ */
+static const int KEYFRAME = 32 ;
+class imagebuilder : public rowvisitor {
+public:
+   imagebuilder(vector<int> &img) : image(img) {}
+   virtual bool row(int x, int y, const int *runs, int nruns) {
+      size_t n = image.size() ;
+      image.push_back(y) ;
+      image.push_back(0) ;
+      for (int i=0; i<nruns; i++, runs += 2) {
+         if (runs[1]) {
+            image.push_back(x) ;
+            image.push_back(runs[0]) ;
+            image.push_back(runs[1]) ;
+            image[n+1]++ ;
+         }
+         x += runs[0] ;
+      }
+      return true ;
+   }
+   vector<int> &image ;
+} ;
+static int capture(lifealgo &imp, vector<int> &image) {
+   image.clear() ;
+   if (imp.isEmpty())
+      return 1 ;
+   bigint t, l, b, r ;
+   imp.findedges(&t, &l, &b, &r) ;
+   if (t < bigint::min_coord || l < bigint::min_coord ||
+       b > bigint::max_coord || r > bigint::max_coord)
+      return 0 ;
+   int top = t.toint(), left = l.toint() ;
+   imagebuilder ib(image) ;
+   imp.getrows(left, top, r.toint() - left + 1, b.toint() - top + 1, ib) ;
+   return 1 ;
+}
+/*
+ *   Walk the two rows' runs together, one stretch at a time, where a
+ *   stretch ends wherever either row's state might change.
+ */
+static void xorrow(const int *a, int na, const int *b, int nb,
+                   vector<int> &out) {
+   int i = 0, j = 0, x = INT_MIN ;
+   while (i < na || j < nb) {
+      int sa = 0, sb = 0, ea = INT_MAX, eb = INT_MAX ;
+      if (i < na) {
+         if (a[0] <= x) {
+            sa = a[2] ;
+            ea = a[0] + a[1] ;
+         } else
+            ea = a[0] ;
+      }
+      if (j < nb) {
+         if (b[0] <= x) {
+            sb = b[2] ;
+            eb = b[0] + b[1] ;
+         } else
+            eb = b[0] ;
+      }
+      int e = ea < eb ? ea : eb ;
+      if (sa != sb) {
+         size_t n = out.size() ;
+         if (n > 2 && out[n-3] + out[n-2] == x && out[n-1] == (sa ^ sb))
+            out[n-2] += e - x ;
+         else {
+            out.push_back(x) ;
+            out.push_back(e - x) ;
+            out.push_back(sa ^ sb) ;
+         }
+      }
+      x = e ;
+      if (i < na && a[0] + a[1] == x) {
+         a += 3 ;
+         i++ ;
+      }
+      if (j < nb && b[0] + b[1] == x) {
+         b += 3 ;
+         j++ ;
+      }
+   }
+}
+static void xorimage(const vector<int> &a, const vector<int> &b,
+                     vector<int> &out) {
+   out.clear() ;
+   const int *p = a.empty() ? 0 : &a[0], *pe = p + a.size() ;
+   const int *q = b.empty() ? 0 : &b[0], *qe = q + b.size() ;
+   while (p < pe || q < qe) {
+      if (q == qe || (p < pe && p[0] < q[0])) {
+         out.insert(out.end(), p, p + 2 + 3 * p[1]) ;
+         p += 2 + 3 * p[1] ;
+      } else if (p == pe || q[0] < p[0]) {
+         out.insert(out.end(), q, q + 2 + 3 * q[1]) ;
+         q += 2 + 3 * q[1] ;
+      } else {
+         size_t n = out.size() ;
+         out.push_back(p[0]) ;
+         out.push_back(0) ;
+         xorrow(p + 2, p[1], q + 2, q[1], out) ;
+         if (out.size() == n + 2)
+            out.resize(n) ;
+         else
+            out[n+1] = (int)(out.size() - n - 2) / 3 ;
+         p += 2 + 3 * p[1] ;
+         q += 2 + 3 * q[1] ;
+      }
+   }
+}
+/*
+ *   Packed, each number is a varint; y and x are zigzagged differences
+ *   from the row before and the end of the run before.
+ */
+static void putnum(vector<unsigned char> &v, unsigned int n) {
+   while (n >= 0x80) {
+      v.push_back((unsigned char)(n | 0x80)) ;
+      n >>= 7 ;
+   }
+   v.push_back((unsigned char)n) ;
+}
+static unsigned int getnum(const unsigned char *&p) {
+   unsigned int n = 0 ;
+   for (int sh=0; ; sh += 7) {
+      n |= (unsigned int)(*p & 0x7f) << sh ;
+      if ((*p++ & 0x80) == 0)
+         return n ;
+   }
+}
+static unsigned int zig(int n) {
+   return ((unsigned int)n << 1) ^ (unsigned int)(n >> 31) ;
+}
+static int unzig(unsigned int n) {
+   return (int)(n >> 1) ^ -(int)(n & 1) ;
+}
+static void pack(const vector<int> &image, vector<unsigned char> &v) {
+   v.clear() ;
+   int y = 0 ;
+   for (size_t k=0; k<image.size(); ) {
+      int n = image[k+1] ;
+      putnum(v, zig(image[k] - y)) ;
+      putnum(v, n) ;
+      y = image[k] ;
+      k += 2 ;
+      int x = 0 ;
+      for (int i=0; i<n; i++, k += 3) {
+         putnum(v, zig(image[k] - x)) ;
+         putnum(v, image[k+1]) ;
+         v.push_back((unsigned char)image[k+2]) ;
+         x = image[k] + image[k+1] ;
+      }
+   }
+}
+static void unpack(const vector<unsigned char> &v, vector<int> &image) {
+   image.clear() ;
+   if (v.empty())
+      return ;
+   const unsigned char *p = &v[0], *e = p + v.size() ;
+   int y = 0 ;
+   while (p < e) {
+      y += unzig(getnum(p)) ;
+      int n = getnum(p) ;
+      image.push_back(y) ;
+      image.push_back(n) ;
+      int x = 0 ;
+      for (int i=0; i<n; i++) {
+         x += unzig(getnum(p)) ;
+         int len = getnum(p) ;
+         image.push_back(x) ;
+         image.push_back(len) ;
+         image.push_back(*p++) ;
+         x += len ;
+      }
+   }
+}
+void cellframes::add(vector<int> &image) {
+   vector<unsigned char> v ;
+   if (data.size() % KEYFRAME == 0) {
+      pack(image, v) ;
+   } else {
+      vector<int> d ;
+      xorimage(last, image, d) ;
+      pack(d, v) ;
+   }
+   data.push_back(v) ;   // a copy, so no spare capacity
+   bytes += v.size() ;
+   last.swap(image) ;
+}
+static G_INT64 population(const vector<int> &image) {
+   G_INT64 n = 0 ;
+   for (size_t k=0; k<image.size(); k += 2 + 3 * image[k+1])
+      for (int i=0; i<image[k+1]; i++)
+         n += image[k+3+3*i] ;
+   return n ;
+}
+void cellframes::setshown(lifealgo &imp, int i, const vector<int> &image) {
+   shown = i ;
+   showngen = imp.getGeneration() ;
+   shownpop = bigint(population(image)) ;
+}
+int cellframes::append(lifealgo &imp) {
+   vector<int> image ;
+   if (!capture(imp, image))
+      return 0 ;
+   add(image) ;
+   setshown(imp, size() - 1, last) ;
+   return 1 ;
+}
+/*
+ *   Leave frame i in at.  Within a keyframe's run of deltas we can go
+ *   either way from where we were, since xoring a delta undoes it, so
+ *   scrubbing backwards costs no more than scrubbing forwards.
+ */
+void cellframes::decode(int i) {
+   int k = i - i % KEYFRAME ;
+   if (atframe < k || atframe >= k + KEYFRAME || i - k < atframe - i) {
+      unpack(data[k], at) ;
+      atframe = k ;
+   }
+   vector<int> d, x ;
+   while (atframe < i) {
+      unpack(data[++atframe], d) ;
+      xorimage(at, d, x) ;
+      at.swap(x) ;
+   }
+   while (atframe > i) {
+      unpack(data[atframe--], d) ;
+      xorimage(at, d, x) ;
+      at.swap(x) ;
+   }
+}
+/*
+ *   Set the cells in one row of the difference to what they are in the
+ *   target row t.  setrow only sets live cells, so dead ones are done
+ *   one at a time.
+ */
+static void fixrow(lifealgo &imp, int y, const int *d, int nd,
+                   const int *t, int nt, vector<int> &runs) {
+   runs.clear() ;
+   int first = 0, end = 0 ;
+   for (int i=0; i<nd; i++, d += 3) {
+      int x = d[0], e = d[0] + d[1] ;
+      while (x < e) {
+         while (nt > 0 && t[0] + t[1] <= x) {
+            t += 3 ;
+            nt-- ;
+         }
+         int s = 0, nx = e ;
+         if (nt > 0) {
+            if (t[0] <= x) {
+               s = t[2] ;
+               if (t[0] + t[1] < e)
+                  nx = t[0] + t[1] ;
+            } else if (t[0] < e)
+               nx = t[0] ;
+         }
+         if (s == 0) {
+            for (int cx=x; cx<nx; cx++)
+               imp.setcell(cx, y, 0) ;
+         } else {
+            if (runs.empty())
+               first = end = x ;
+            if (x > end) {
+               runs.push_back(x - end) ;
+               runs.push_back(0) ;
+            }
+            runs.push_back(nx - x) ;
+            runs.push_back(s) ;
+            end = nx ;
+         }
+         x = nx ;
+      }
+   }
+   if (!runs.empty())
+      imp.setrow(first, y, &runs[0], (int)(runs.size() >> 1)) ;
+}
+/*
+ *   Change only the cells that differ from what the universe holds.
+ *   Usually that is the frame we left there, and for a neighbouring
+ *   frame the difference is just the stored delta; otherwise we have
+ *   to read the universe.
+ */
+void cellframes::restore(lifealgo &imp, int i, const bigint &gen) {
+   vector<int> now, d, runs ;
+   // QuickLife keeps its cells in different places depending on the
+   // generation's parity, so if that changes they all seem to move
+   int same = shown >= 0 && imp.getGeneration() == showngen &&
+              imp.getPopulation() == shownpop && gen.odd() == showngen.odd() ;
+   imp.setGeneration(gen) ;
+   if (same) {
+      int later = i > shown ? i : shown ;
+      if ((i == shown + 1 || i == shown - 1) && later % KEYFRAME != 0) {
+         unpack(data[later], d) ;
+         decode(i) ;
+      } else {
+         decode(shown) ;
+         now = at ;
+         decode(i) ;
+         xorimage(now, at, d) ;
+      }
+   } else {
+      decode(i) ;
+      if (!capture(imp, now))
+         return ;
+      xorimage(now, at, d) ;
+   }
+   const int *t = at.empty() ? 0 : &at[0], *te = t + at.size() ;
+   for (size_t k=0; k<d.size(); k += 2 + 3 * d[k+1]) {
+      while (t < te && t[0] < d[k])
+         t += 2 + 3 * t[1] ;
+      if (t < te && t[0] == d[k])
+         fixrow(imp, d[k], &d[k+2], d[k+1], t + 2, t[1], runs) ;
+      else
+         fixrow(imp, d[k], &d[k+2], d[k+1], 0, 0, runs) ;
+   }
+   imp.endofpattern() ;
+   setshown(imp, i, at) ;
+}
+void cellframes::halve() {
+   vector< vector<unsigned char> > old ;
+   old.swap(data) ;
+   clear() ;
+   vector<int> image, d, x ;
+   for (size_t i=0; i<old.size(); i++) {
+      if (i % KEYFRAME == 0) {
+         unpack(old[i], image) ;
+      } else {
+         unpack(old[i], d) ;
+         xorimage(image, d, x) ;
+         image.swap(x) ;
+      }
+      if ((i & 1) == 0) {
+         x = image ;
+         add(x) ;
+      }
+   }
+}
+void cellframes::clear() {
+   data.clear() ;
+   bytes = 0 ;
+   last.clear() ;
+   at.clear() ;
+   atframe = -1 ;
+   shown = -1 ;
+}
 
 // -----------------------------------------------------------------------------
 
@@ -876,6 +1470,67 @@ bool lifealgo::DeleteBorderCells()
     return true;
 }
 
+int lifealgo::setrow(int x, int y, const int *runs, int nruns) {
+   for (int i=0; i<nruns; i++, runs += 2) {
+      int n = runs[0], state = runs[1] ;
+      if (state != 0)
+         for (int j=0; j<n; j++)
+            if (setcell(x + j, y, state) < 0)
+               return -1 ;
+      x += n ;
+   }
+   return 0 ;
+}
+
+int lifealgo::setcells(const unsigned char *buf, int x, int y, int w, int h) {
+   std::vector<int> runs ;
+   for (int j=0; j<h; j++, buf += w) {
+      runs.clear() ;
+      for (int i=0; i<w; ) {
+         int k = i + 1 ;
+         while (k < w && buf[k] == buf[i])
+            k++ ;
+         runs.push_back(k - i) ;
+         runs.push_back(buf[i]) ;
+         i = k ;
+      }
+      if (!runs.empty() && setrow(x, y + j, &runs[0], (int)(runs.size() >> 1)) < 0)
+         return -1 ;
+   }
+   return 0 ;
+}
+
+bool lifealgo::getrows(int x, int y, int w, int h, rowvisitor &v) {
+   std::vector<int> runs ;
+   int right = x + w - 1 ;
+   for (int cy=y; cy<y+h; cy++) {
+      runs.clear() ;
+      int first = 0, end = 0, state = 0 ;
+      for (int cx=x; cx<=right; cx++) {
+         int skip = nextcell(cx, cy, state) ;
+         if (skip < 0 || cx + skip > right)
+            break ;
+         cx += skip ;
+         if (runs.empty()) {
+            first = cx ;
+         } else if (cx == end && runs.back() == state) {
+            runs[runs.size() - 2]++ ;
+            end++ ;
+            continue ;
+         } else if (cx > end) {
+            runs.push_back(cx - end) ;
+            runs.push_back(0) ;
+         }
+         runs.push_back(1) ;
+         runs.push_back(state) ;
+         end = cx + 1 ;
+      }
+      if (!runs.empty() && !v.row(first, cy, &runs[0], (int)(runs.size() >> 1)))
+         return false ;
+   }
+   return true ;
+}
+
 void lifealgo::getcells(unsigned char *buf, int x, int y, int w, int h) {
    viewport vp(w, h) ;
    vp.setpositionmag(x+(w>>1), y+(h>>1), 0) ;
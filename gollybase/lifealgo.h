@@ -25,21 +25,125 @@
 #endif
 using std::vector;
 #include <iostream>
+#include <string>
+#include <deque>
+#include <unordered_map>
 
-// this must not be increased beyond 32767, because we use a bigint
-// multiply that only supports multiplicands up to that size.
-const int MAX_FRAME_COUNT = 32000 ;
+// the most frames a timeline can hold; if the algorithm can page its
+// frames out to disk at most RESIDENT_FRAMES are kept in memory
+const int MAX_FRAME_COUNT = 1 << 24 ;
+const int RESIDENT_FRAMES = 1024 ;
+
+class lifealgo ;
+
+/**
+ *   Timeline frames for algorithms that have no canonical state to
+ *   keep (getcurrentstate returns 0).  A frame is the pattern's live
+ *   cells as runs; every KEYFRAME'th one is stored whole and the rest
+ *   as the xor with the frame before, both as run lengths in varints,
+ *   so going to any frame decodes at most KEYFRAME-1 deltas.
+ */
+class cellframes {
+public:
+   cellframes() : bytes(0), atframe(-1), shown(-1) {}
+   int size() { return (int)data.size() ; }
+   size_t memory() { return bytes ; }
+   // returns 0 if the pattern is outside the getrows limits
+   int append(lifealgo &imp) ;
+   void restore(lifealgo &imp, int i, const bigint &gen) ;
+   void halve() ;                      // keep every other frame
+   void clear() ;
+private:
+   void add(vector<int> &image) ;
+   void decode(int i) ;
+   void setshown(lifealgo &imp, int i, const vector<int> &image) ;
+   vector< vector<unsigned char> > data ;
+   size_t bytes ;
+   vector<int> last ;                  // the last frame, decoded
+   vector<int> at ;                    // and frame atframe
+   int atframe ;
+   // the frame we last left in the universe, with its generation and
+   // population to check it is still there (timelines can't be edited)
+   int shown ;
+   bigint showngen, shownpop ;
+} ;
+
+/**
+ *   Timeline frames paged out to disk.  A record is four 64-bit words,
+ *   normally a tree node's children as references to other records,
+ *   so frames share whatever subtrees they have in common; we remember
+ *   which nodes we have written or read (until gc frees them) so each
+ *   is written only once.  A reference is the record number shifted
+ *   left one with the low bit set for leaves.  The file is created on
+ *   first use and read back a page at a time through a small cache.
+ */
+class framestore {
+public:
+   framestore() : f(0), failed(0), count(0) {}
+   ~framestore() ;
+   // returns the new record's reference, or 0 if we can't write it
+   G_INT64 put(const G_INT64 *w, int isleaf) ;
+   // copies the record into w; returns 0 on a read error
+   int get(G_INT64 ref, G_INT64 *w) ;
+   static int isleaf(G_INT64 ref) { return (int)(ref & 1) ; }
+   // the reference of a node we've seen, or the node for a reference
+   G_INT64 find(void *n) ;
+   void *lookup(G_INT64 ref) ;
+   void remember(void *n, G_INT64 ref) ;
+   // gc calls this after marking, with a test for the nodes it keeps
+   void forget(int (*kept)(void *)) ;
+   void clear() ;
+private:
+   FILE *f ;
+   int failed ;
+   G_INT64 count ;                     // records written, from 1
+   vector<G_INT64> tail ;              // the last page, not yet written
+   vector<G_INT64> cache ;             // pages read back, and which
+   vector<G_INT64> cached ;            // page is in each slot
+   std::unordered_map<void *, G_INT64> known ;
+   std::unordered_map<G_INT64, void *> nodes ;
+} ;
 
 /**
- *   Timeline support is pretty generic.
+ *   Timeline support is pretty generic.  A frame paged out to the
+ *   store has a zero in frames and its reference in paged.
  */
 class timeline_t {
 public:
    timeline_t() : recording(0), framecount(0), savetimeline(1),
-                  start(0), inc(0), next(0), end(0), frames() {}
+                  keep(RESIDENT_FRAMES), start(0), inc(0), next(0), end(0),
+                  frames() {}
    int recording, framecount, base, expo, savetimeline ;
+   int keep ;            // frames to keep in memory; gc lowers it
    bigint start, inc, next, end ;
    vector<void *> frames ;
+   vector<G_INT64> paged ;
+   std::deque<int> resident ;   // frames in memory, oldest first
+   framestore store ;
+   cellframes cells ;    // used instead of frames if there's no state
+} ;
+
+/**
+ *   An undo snapshot kept in memory instead of in the temporary file
+ *   named by path (see pinstate).
+ */
+struct pinnedstate_t {
+   std::string path, rule ;
+   void *state ;
+   bigint gen ;
+} ;
+
+/**
+ *   getrows hands the live cells in a rectangle to one of these, one
+ *   row at a time from the top down, leaving out empty rows.  Like
+ *   setrow's, runs holds nruns pairs of (length, state) from x
+ *   rightwards; the first and last runs are live.  Return false to
+ *   stop early.
+ */
+class rowvisitor {
+public:
+   virtual ~rowvisitor() {}
+   virtual bool row(int x, int y, const int *runs, int nruns) = 0 ;
 } ;
 
 class lifealgo {
@@ -48,6 +152,8 @@ public:
       {  poller = &default_poller ;
          gridwd = gridht = 0 ;      // default is an unbounded universe
          unbounded = true ;         // most algorithms use an unbounded universe
+         numthreads = 1 ;           // calculate on the calling thread only
+         pinpressure = 0 ;
       }
    virtual ~lifealgo() ;
    // returns <0 if error
@@ -55,6 +161,17 @@ public:
    virtual int getcell(int x, int y) = 0 ;
    virtual int nextcell(int x, int y, int &v) = 0 ;
    void getcells(unsigned char *buf, int x, int y, int w, int h) ;
+   // set a row of cells from (x, y) rightwards given as nruns pairs
+   // of (length, state) in runs; runs of state 0 are skipped, not
+   // cleared.  Returns <0 if a state is out of range.
+   virtual int setrow(int x, int y, const int *runs, int nruns) ;
+   // the other way round from getcells:  set the w*h rectangle at
+   // (x, y) from one state byte per cell, skipping 0s; uses setrow
+   int setcells(const unsigned char *buf, int x, int y, int w, int h) ;
+   // pass the rows of the w*h rectangle at (x, y) to v; returns false
+   // if v stopped it.  The default calls nextcell for every live cell;
+   // algorithms that can walk their structure once should override it.
+   virtual bool getrows(int x, int y, int w, int h, rowvisitor &v) ;
    // call after setcell calls
    virtual void endofpattern() = 0 ;
    virtual void setIncrement(bigint inc) = 0 ;
@@ -78,12 +195,26 @@ public:
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) = 0 ;
    void setpoll(lifepoll *pollerarg) { poller = pollerarg ; }
    virtual const char *readmacrocell(char *) { return "Cannot read macrocell format." ; }
+   // a versioned binary dump of the tree with the generation, rule and
+   // step size, for checkpoints; readmacrocell reads it back
+   virtual const char *writeBinaryMacrocell(std::ostream &) {
+      return "Binary macrocell format is only supported by HashLife." ;
+   }
    
    // Verbosity crosses algorithms.  We need to embed this sort of option
    // into some global shared thing or something rather than use static.
    static void setVerbose(int v) { verbose = v ; }
    static int getVerbose() { return verbose ; }
 
+   // how many threads step() may use; algorithms that cannot calculate
+   // in parallel simply remember the value
+   virtual void setNumThreads(int n) { numthreads = (n < 1 ? 1 : n) ; }
+   int getNumThreads() { return numthreads ; }
+
+   // one line of performance counters (cache hits and misses, gc
+   // activity) for verbose output; 0 if the algorithm keeps none
+   virtual const char *getPerfSummary() { return 0 ; }
+
    virtual const char* DefaultRule() { return "B3/S23"; }
    // return number of cell states in this universe (2..256)
    virtual int NumCellStates() { return 2; }
@@ -103,11 +234,24 @@ public:
    const bigint &gettimelineend() { return timeline.end ; }
    const bigint &gettimelineinc() { return timeline.inc ; }
    int getframecount() { return timeline.framecount ; }
+   // no more frames fit, either MAX_FRAME_COUNT or, for cell frames,
+   // the algorithm's max memory (or 1GB if that is unlimited)
+   int timelinefull() ;
    int isrecording() { return timeline.recording ; }
    int gotoframe(int i) ;
    void destroytimeline() ;
    void savetimelinewithframe(int yesno) { timeline.savetimeline = yesno ; }
 
+   // undo/redo support: if getcurrentstate is a canonical node we can
+   // keep the current pattern, generation and rule in memory on behalf
+   // of the temp file at path; pinstate returns 0 if it can't (so the
+   // caller should write the file) and spillpinned writes the file
+   // after all, for when somebody else needs to read it
+   virtual int pinstate(const char *path) ;
+   int restorepinned(const char *path) ;
+   int spillpinned(const char *path) ;
+   void unpinstate(const char *path) ;
+
    // support for a bounded universe with various topologies:
    // plane, cylinder, torus, Klein bottle, cross-surface, sphere
    unsigned int gridwd, gridht ;    // bounded universe if either is > 0
@@ -157,10 +301,24 @@ protected:
    lifepoll *poller ;
    static int verbose ;
    int maxCellStates ; // keep up to date; setcell depends on it
+   int numthreads ;
    bigint generation ;
    bigint increment ;
    timeline_t timeline ;
    TGridType grid_type ;
+   // pinned states; gc must mark them like timeline frames, and the
+   // destructor must call spillallpinned while it still can
+   vector<pinnedstate_t> pinned ;
+   int pinpressure ;   // set by gc while memory is short, so stop pinning
+   void spillallpinned() ;
+   // timeline frames go through these so old ones can be paged out;
+   // getframe pages a frame back in (0 if that fails)
+   void addframe(void *frame) ;
+   void *getframe(int i) ;
+   // algorithms whose states are hashed trees override these to write
+   // a frame's nodes to timeline.store and to build them again
+   virtual G_INT64 writeframe(void *) { return 0 ; }
+   virtual void *readframe(G_INT64) { return 0 ; }
 
 private:
    // following are called by CreateBorderCells() to join edges in various ways
@@ -171,6 +329,7 @@ private:
    void JoinEdges(int pt, int pl, int pb, int pr) ;
    // following is called by DeleteBorderCells()
    void ClearRect(int top, int left, int bottom, int right) ;
+   void pageoutframes() ;
 } ;
 
 /**
@@ -1255,3 +1255,41 @@ const char* liferules::getrule() {
 bool liferules::isRegularLife() {
    return (neighbormask == MOORE && totalistic && rulebits == 0x1808 && wolfram < 0) ;
 }
+
+// Work out whether a 4x4 rule table (maybe flipped by the algorithm)
+// just counts some subset of the eight neighbors.  We read the 3x3 rule
+// back out of it (the new state of the cell at row 1, column 1 of a 4x4
+// depends only on rows and columns 0 through 2) and find which neighbors
+// it looks at.  If it only counts them we return that subset in rule3x3
+// bit order and set bit k of rule[c] if k of them give a live cell when
+// the center is c; otherwise we return -1.
+int liferules::countingRule(const char *table, int rule[2]) {
+   char f[ALL3X3] ;
+   int p, k, nbrs = 0 ;
+   for (p = 0 ; p < ALL3X3 ; p++)
+      f[p] = (char)((table[((p & 0x1c0) << 7) | ((p & 0x38) << 6) |
+                           ((p & 7) << 5)] >> 5) & 1) ;
+   for (k = 0 ; k < 9 ; k++) {
+      if (k == 4) continue ;
+      for (p = 0 ; p < ALL3X3 ; p++) {
+         if (f[p] != f[p ^ (256 >> k)]) {
+            nbrs |= 256 >> k ;
+            break ;
+         }
+      }
+   }
+   int seen[2] = { 0, 0 } ;
+   rule[0] = rule[1] = 0 ;
+   for (p = 0 ; p < ALL3X3 ; p++) {
+      int c = (p >> 4) & 1, count = 0 ;
+      for (k = 0 ; k < 9 ; k++)
+         if (nbrs & p & (256 >> k)) count++ ;
+      if (seen[c] & (1 << count)) {
+         if (((rule[c] >> count) & 1) != f[p]) return -1 ;
+      } else {
+         seen[c] |= 1 << count ;
+         rule[c] |= f[p] << count ;
+      }
+   }
+   return nbrs ;
+}
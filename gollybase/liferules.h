@@ -48,6 +48,8 @@ public:
    bool isHexagonal() const { return neighbormask == HEXAGONAL ; }
    bool isVonNeumann() const { return neighbormask == VON_NEUMANN ; }
    bool isWolfram() const { return wolfram >= 0 ; }
+   // neighbors counted by a rule table, or -1 if it does more than count
+   static int countingRule(const char *table, int rule[2]) ;
 
 private:
    char canonrule[MAXRULESIZE] ;      // canonical version of valid rule passed into setrule
@@ -39,6 +39,174 @@ static const char *HEXCHARACTERS = "0123456789ABCDEF";
 
 // -----------------------------------------------------------------------------
 
+// The banded versions of faster_Moore_* and faster_Neumann_* split the grid
+// into bands of rows (or strips of columns) that can be processed in parallel.
+// These are the passes a band can run:
+
+#define BAND_SUMS 0         // cumulative counts for rows lo..hi (serial if no threads)
+#define BAND_ROWSUMS 1      // row sums only for rows lo..hi
+#define BAND_COLSUMS 2      // add up the row sums in columns lo..hi
+#define BAND_MOORE 3        // update rows lo..hi using Moore counts in colcounts
+#define BAND_NEUMANN 4      // update rows lo..hi using von Neumann counts in colcounts
+#define BAND_PACKED 5       // update rows lo..hi of nextbits using Moore counts from currbits
+
+// without threads faster_Moore_banded is only used for regions with at least
+// this many cells (faster_Moore_* have less overhead for small regions)
+#define MIN_BANDED_CELLS 4096
+
+struct ltlband : public lifetask {
+    ltlalgo* algo;
+    int pass;                           // one of the BAND_* values
+    int lo, hi;                         // first and last row (or column) in this band
+    int mincol, minrow, maxcol, maxrow; // region passed into do_gen
+    int popchange;                      // change in population caused by this band
+    int minx, miny, maxx, maxy;         // boundary of live cells in this band
+    bool cornerlives;                   // top left cell in region survived (see update_row)
+    virtual void run() { algo->do_band(*this); }
+};
+
+// The innermost loops of the banded versions are simple enough for the compiler
+// to vectorize.  We compile them twice on x86: once for the default instruction
+// set (SSE2 on x86-64) and once for AVX2, which is used if the CPU supports it.
+
+static inline void row_sums_body(int* ccptr, const unsigned char* cellptr, int width)
+{
+    // set ccptr[j] to the number of state-1 cells in cellptr[0..j]; we do 8 cells
+    // at a time by turning them into 8 bytes of 0 or 1 and multiplying by
+    // 0x0101010101010101, which leaves the running total in each byte
+    const unsigned long long ones = 0x0101010101010101ULL;
+    const unsigned long long low7 = 0x7f7f7f7f7f7f7f7fULL;
+    int rowcount = 0;
+    int j = 0;
+    for (; j + 8 <= width; j += 8) {
+        unsigned long long cells;
+        memcpy(&cells, cellptr + j, 8);
+        if (cells == 0) {
+            for (int k = 0; k < 8; k++) ccptr[j + k] = rowcount;
+            continue;
+        }
+        // set the high bit of each byte that is 1 and then move it to the low bit
+        unsigned long long t = cells ^ ones;
+        unsigned long long is1 = (~(((t & low7) + low7) | t | low7) >> 7) * ones;
+        for (int k = 0; k < 8; k++) ccptr[j + k] = rowcount + (int)((is1 >> (8 * k)) & 0xff);
+        rowcount += (int)(is1 >> 56);
+    }
+    for (; j < width; j++) {
+        if (cellptr[j] == 1) rowcount++;
+        ccptr[j] = rowcount;
+    }
+}
+
+// spreadbits[b] has byte i set to bit i of b
+static unsigned long long spreadbits[256];
+
+static inline void colsum_body(int* row, const int* prev, int width)
+{
+    // add the cumulative counts in the previous row
+    for (int j = 0; j < width; j++) {
+        row[j] += prev[j];
+    }
+}
+
+static inline void moore_counts_body(int* counts, const int* bot, const int* top, int width, int span)
+{
+    // the count for cell j is the sum of the square with bottom right corner at
+    // bot[j] (the row below the square is at top[j]); the square for cell 0 has
+    // no columns to its left and if top is NULL there are no rows above it
+    const int* botl = bot - span;
+    counts[0] = top ? bot[0] - top[0] : bot[0];
+    if (top) {
+        const int* topl = top - span;
+        for (int j = 1; j < width; j++) {
+            counts[j] = bot[j] - botl[j] - top[j] + topl[j];
+        }
+    } else {
+        for (int j = 1; j < width; j++) {
+            counts[j] = bot[j] - botl[j];
+        }
+    }
+}
+
+static inline int update_row2_body(unsigned char* stateptr, const int* counts, int width, const int* rule, int& popchange)
+{
+    // update a row of 2-state cells where births and survivals are each a
+    // single range of counts: rule[0]..rule[1] and rule[2]..rule[3]
+    int blo = rule[0], bhi = rule[1], slo = rule[2], shi = rule[3];
+    int change = 0;
+    unsigned char alive = 0;
+    for (int j = 0; j < width; j++) {
+        unsigned char state = stateptr[j];
+        int n = counts[j];
+        unsigned char born = (n >= blo) & (n <= bhi);
+        unsigned char survives = (n >= slo) & (n <= shi);
+        unsigned char newstate = state ? survives : born;
+        stateptr[j] = newstate;
+        change += newstate - state;
+        alive |= newstate;
+    }
+    popchange += change;
+    return alive;
+}
+
+typedef void (*rowsumsfunc)(int*, const unsigned char*, int);
+typedef void (*colsumfunc)(int*, const int*, int);
+typedef void (*moorecountsfunc)(int*, const int*, const int*, int, int);
+typedef int (*updaterow2func)(unsigned char*, const int*, int, const int*, int&);
+
+static void row_sums(int* ccptr, const unsigned char* cellptr, int width)
+{
+    row_sums_body(ccptr, cellptr, width);
+}
+
+static void colsum(int* row, const int* prev, int width)
+{
+    colsum_body(row, prev, width);
+}
+
+static void moore_counts(int* counts, const int* bot, const int* top, int width, int span)
+{
+    moore_counts_body(counts, bot, top, width, span);
+}
+
+static int update_row2(unsigned char* stateptr, const int* counts, int width, const int* rule, int& popchange)
+{
+    return update_row2_body(stateptr, counts, width, rule, popchange);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LTLAVX2
+__attribute__((target("avx2")))
+static void row_sums_avx2(int* ccptr, const unsigned char* cellptr, int width)
+{
+    row_sums_body(ccptr, cellptr, width);
+}
+
+__attribute__((target("avx2")))
+static void colsum_avx2(int* row, const int* prev, int width)
+{
+    colsum_body(row, prev, width);
+}
+
+__attribute__((target("avx2")))
+static void moore_counts_avx2(int* counts, const int* bot, const int* top, int width, int span)
+{
+    moore_counts_body(counts, bot, top, width, span);
+}
+
+__attribute__((target("avx2")))
+static int update_row2_avx2(unsigned char* stateptr, const int* counts, int width, const int* rule, int& popchange)
+{
+    return update_row2_body(stateptr, counts, width, rule, popchange);
+}
+#endif
+
+static rowsumsfunc rowsumsfn = row_sums;
+static colsumfunc colsumfn = colsum;
+static moorecountsfunc moorecountsfn = moore_counts;
+static updaterow2func updaterow2fn = update_row2;
+
+// -----------------------------------------------------------------------------
+
 // Create a new empty universe.
 
 ltlalgo::ltlalgo()
@@ -49,6 +217,9 @@ ltlalgo::ltlalgo()
     range = 1;
     ntype = 'M';
     colcounts = NULL;
+    packed = false;
+    currbits = NULL;
+    nextbits = NULL;
     create_grids(DEFAULTSIZE, DEFAULTSIZE);
     generation = 0;
     increment = 1;
@@ -62,6 +233,24 @@ ltlalgo::ltlalgo()
     stateweights = NULL;
     customneighborhood = NULL;
     customlength = 0;
+    ruleintervals = false;
+    threads = NULL;
+    if (spreadbits[255] == 0) {
+        for (int b = 0; b < 256; b++) {
+            spreadbits[b] = 0;
+            for (int i = 0; i < 8; i++) {
+                if (b & (1 << i)) spreadbits[b] |= 1ULL << (8 * i);
+            }
+        }
+    }
+#ifdef LTLAVX2
+    if (__builtin_cpu_supports("avx2")) {
+        rowsumsfn = row_sums_avx2;
+        colsumfn = colsum_avx2;
+        moorecountsfn = moore_counts_avx2;
+        updaterow2fn = update_row2_avx2;
+    }
+#endif
 }
 
 // -----------------------------------------------------------------------------
@@ -71,6 +260,7 @@ ltlalgo::ltlalgo()
 ltlalgo::~ltlalgo()
 {
     free(outergrid1);
+    free_packed();
     if (outergrid2) free(outergrid2);
     if (colcounts) free(colcounts);
     if (shape) free(shape);
@@ -81,6 +271,17 @@ ltlalgo::~ltlalgo()
     if (weights) free(weights);
     if (stateweights) free(stateweights);
     if (customneighborhood) free(customneighborhood);
+    delete threads;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::setNumThreads(int n)
+{
+    lifealgo::setNumThreads(n);
+    delete threads;
+    threads = NULL;
+    if (numthreads > 1) threads = new lifethreads(numthreads);
 }
 
 // -----------------------------------------------------------------------------
@@ -121,25 +322,37 @@ void ltlalgo::create_grids(int wd, int ht)
     outerht = ght + border * 2;         // add top and bottom border
     outerbytes = outerwd * outerht;
     
-    allocate_colcounts();
-
-    // allocate memory for grid
-    int offset = border * outerwd + border;
-    outergrid1 = (unsigned char*) calloc(outerbytes, sizeof(unsigned char));
-    if (outergrid1 == NULL) lifefatal("Not enough memory for LtL grid!");
-    // point currgrid to top left non-border cells within outergrid1
-    currgrid = outergrid1 + offset;
-
-    // if using fast_Moore or fast_Neumann we need to allocate outergrid2
-    if (colcounts == NULL) {
-        outergrid2 = (unsigned char*) calloc(outerbytes, sizeof(unsigned char));
-        if (outergrid2 == NULL) lifefatal("Not enough memory for LtL grids!");
-        // point nextgrid to top left non-border cells within outergrid2
-        nextgrid = outergrid2 + offset;
+    if (packed) {
+        // allocate bit grids; no border is needed (see packed_gen)
+        if (colcounts) free(colcounts);
+        colcounts = NULL;
+        outergrid1 = currgrid = NULL;
+        outergrid2 = nextgrid = NULL;
+        packwd = (gwd + 31) / 32;
+        currbits = (unsigned int*) calloc((size_t)packwd * ght, sizeof(unsigned int));
+        nextbits = (unsigned int*) calloc((size_t)packwd * ght, sizeof(unsigned int));
+        if (currbits == NULL || nextbits == NULL) lifefatal("Not enough memory for LtL grids!");
     } else {
-        // faster_* calls don't use outergrid2
-        outergrid2 = NULL;
-        nextgrid = NULL;
+        allocate_colcounts();
+
+        // allocate memory for grid
+        int offset = border * outerwd + border;
+        outergrid1 = (unsigned char*) calloc(outerbytes, sizeof(unsigned char));
+        if (outergrid1 == NULL) lifefatal("Not enough memory for LtL grid!");
+        // point currgrid to top left non-border cells within outergrid1
+        currgrid = outergrid1 + offset;
+
+        // if using fast_Moore or fast_Neumann we need to allocate outergrid2
+        if (colcounts == NULL) {
+            outergrid2 = (unsigned char*) calloc(outerbytes, sizeof(unsigned char));
+            if (outergrid2 == NULL) lifefatal("Not enough memory for LtL grids!");
+            // point nextgrid to top left non-border cells within outergrid2
+            nextgrid = outergrid2 + offset;
+        } else {
+            // faster_* calls don't use outergrid2
+            outergrid2 = NULL;
+            nextgrid = NULL;
+        }
     }
 
     // set grid coordinates of cell at bottom right corner of inner grid
@@ -177,6 +390,41 @@ void ltlalgo::empty_boundaries()
 
 // -----------------------------------------------------------------------------
 
+void ltlalgo::free_packed()
+{
+    if (currbits) free(currbits);
+    if (nextbits) free(nextbits);
+    currbits = NULL;
+    nextbits = NULL;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::unpack_grid()
+{
+    // switch from currbits to a bounded byte grid of the same size
+    // (called by setrule before the universe becomes unbounded)
+    unsigned char* grid = (unsigned char*) calloc(outerbytes, sizeof(unsigned char));
+    if (grid == NULL) lifefatal("Not enough memory for LtL grid!");
+    unsigned char* gridptr = grid + border * outerwd + border;
+    if (population > 0) {
+        for (int y = miny; y <= maxy; y++) {
+            for (int x = minx; x <= maxx; x++) {
+                gridptr[y * outerwd + x] = (unsigned char)getbit(x, y);
+            }
+        }
+    }
+    free_packed();
+    packed = false;
+    outergrid1 = grid;
+    currgrid = gridptr;
+    outergrid2 = NULL;
+    nextgrid = NULL;
+    allocate_colcounts();
+}
+
+// -----------------------------------------------------------------------------
+
 int ltlalgo::NumCellStates()
 {
     return maxCellStates;
@@ -338,13 +586,26 @@ int ltlalgo::setcell(int x, int y, int newstate)
         if (y < gtop || y > gbottom) return -1;
     }
 
-    // set x,y cell in currgrid
+    // set x,y cell in currgrid (or currbits)
     int gx = x - gleft;
     int gy = y - gtop;
-    unsigned char* cellptr = currgrid + gy * outerwd + gx;
-    int oldstate = *cellptr;
+    unsigned char* cellptr = NULL;
+    unsigned int* wordptr = NULL;
+    int oldstate;
+    if (packed) {
+        wordptr = currbits + gy * packwd + (gx >> 5);
+        oldstate = (*wordptr >> (gx & 31)) & 1;
+        if (newstate > 1) newstate = 1;
+    } else {
+        cellptr = currgrid + gy * outerwd + gx;
+        oldstate = *cellptr;
+    }
     if (newstate != oldstate) {
-        *cellptr = (unsigned char)newstate;
+        if (packed) {
+            *wordptr ^= 1u << (gx & 31);
+        } else {
+            *cellptr = (unsigned char)newstate;
+        }
         // population might change
         if (oldstate == 0 && newstate > 0) {
             population++;
@@ -363,6 +624,66 @@ int ltlalgo::setcell(int x, int y, int newstate)
 
 // -----------------------------------------------------------------------------
 
+// Set a row of cells given as (length, state) runs.  Setting the first and
+// last live cells with setcell grows the grid (or checks the bounded grid)
+// just as setcell would; the cells between are then filled straight into
+// currgrid a run at a time.
+
+int ltlalgo::setrow(int x, int y, const int* runs, int nruns)
+{
+    int lo = 0, hi = -1, lostate = 0, histate = 0, cx = 0;
+    for (int i = 0; i < nruns; i++) {
+        int state = runs[2*i+1];
+        if (state < 0 || state >= maxCellStates) return -1;
+        if (state > 0 && runs[2*i] > 0) {
+            if (hi < lo) {
+                lo = cx;
+                lostate = state;
+            }
+            hi = cx + runs[2*i] - 1;
+            histate = state;
+        }
+        cx += runs[2*i];
+    }
+    if (hi < lo) return 0;
+
+    if (setcell(x + lo, y, lostate) < 0 || setcell(x + hi, y, histate) < 0) {
+        // let setcell deal with any cells outside a bounded grid
+        if (unbounded) return -1;
+        return lifealgo::setrow(x, y, runs, nruns);
+    }
+
+    int gy = y - gtop;
+    int gx = x - gleft;
+    for (int i = 0; i < nruns; i++, runs += 2) {
+        int len = runs[0];
+        int state = runs[1];
+        if (state > 0 && len > 0) {
+            if (packed) {
+                unsigned int* row = currbits + gy * packwd;
+                for (int c = gx; c < gx + len; c++) {
+                    unsigned int bit = 1u << (c & 31);
+                    if ((row[c >> 5] & bit) == 0) {
+                        row[c >> 5] |= bit;
+                        population++;
+                    }
+                }
+            } else {
+                unsigned char* cellptr = currgrid + gy * outerwd + gx;
+                for (int c = 0; c < len; c++) {
+                    if (cellptr[c] == 0) population++;
+                }
+                memset(cellptr, state, len);
+            }
+        }
+        gx += len;
+    }
+    // setcell has already stretched the boundaries to the first and last cells
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 // Get the state of the cell at the given location.
 
 int ltlalgo::getcell(int x, int y)
@@ -377,7 +698,8 @@ int ltlalgo::getcell(int x, int y)
         if (y < gtop || y > gbottom) return -1;
     }
 
-    // get x,y cell in currgrid
+    // get x,y cell in currgrid (or currbits)
+    if (packed) return getbit(x - gleft, y - gtop);
     unsigned char* cellptr = currgrid + (y - gtop) * outerwd + (x - gleft);
     return *cellptr;
 }
@@ -408,6 +730,30 @@ int ltlalgo::nextcell(int x, int y, int& v)
         x = gleft;
     }
     
+    if (packed) {
+        // skip words with no live cells
+        int gx = x - gleft;
+        int gy = y - gtop;
+        unsigned int* row = currbits + gy * packwd;
+        while (gx <= gwdm1) {
+            unsigned int word = row[gx >> 5] >> (gx & 31);
+            if (word == 0) {
+                int skip = 32 - (gx & 31);
+                gx += skip;
+                d += skip;
+            } else {
+                while ((word & 1) == 0) {
+                    word >>= 1;
+                    gx++;
+                    d++;
+                }
+                v = 1;
+                return d;
+            }
+        }
+        return -1;
+    }
+
     // get x,y cell in currgrid
     unsigned char* cellptr = currgrid + (y - gtop) * outerwd + (x - gleft);
     
@@ -1720,6 +2066,396 @@ void ltlalgo::faster_Neumann_unbounded(int mincol, int minrow, int maxcol, int m
 
 // -----------------------------------------------------------------------------
 
+void ltlalgo::faster_Moore_banded(int mincol, int minrow, int maxcol, int maxrow)
+{
+    // same as faster_Moore_* but the work is split into bands that are
+    // run in parallel if we have threads
+
+    // the cumulative counts are needed for the given limits expanded by range
+    // (relative to outergrid1, which is currgrid in an unbounded universe)
+    int b = unbounded ? 0 : border;
+    int r0 = minrow + b - range;
+    int r1 = maxrow + b + range;
+    if (threads) {
+        // calculate the row sums in bands of rows and then add them
+        // up in strips of columns
+        run_bands(BAND_ROWSUMS, r0, r1, mincol, minrow, maxcol, maxrow);
+        run_bands(BAND_COLSUMS, mincol + b - range, maxcol + b + range, mincol, minrow, maxcol, maxrow);
+    } else {
+        run_bands(BAND_SUMS, r0, r1, mincol, minrow, maxcol, maxrow);
+    }
+
+    // calculate final neighborhood counts using values in colcounts
+    // and update the corresponding cells in current grid
+    run_bands(BAND_MOORE, minrow, maxrow, mincol, minrow, maxcol, maxrow);
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::faster_Neumann_banded(int mincol, int minrow, int maxcol, int maxrow)
+{
+    // same as faster_Neumann_* but the final neighborhood counts are
+    // calculated in bands that are run in parallel if we have threads
+    int bmr = unbounded ? 0 : border - range;
+    int e = unbounded ? 0 : 2 * range;
+    int rowoffset = minrow + bmr;
+    int coloffset = mincol + bmr;
+
+    // set variables used below and in getcount
+    nrows = maxrow - minrow + 1 + e;
+    ncols = maxcol - mincol + 1 + e;
+    ccht = nrows + (ncols-1)/2;
+    halfccwd = ncols/2;
+
+    // calculate cumulative counts in top left corner of colcounts
+    for (int i = 0; i < ccht; i++) {
+        int* Coffset = colcounts + i * outerwd;
+        unsigned char* Goffset = outergrid1 + (i + rowoffset) * outerwd;
+        int im1 = i - 1;
+        int im2 = im1 - 1;
+        for (int j = 0; j < ncols; j++) {
+            int* Cij = Coffset + j;
+            *Cij = getcount(im1,j-1) + getcount(im1,j+1) - getcount(im2,j);
+            if (i < nrows) {
+                unsigned char* Gij = Goffset + j + coloffset;
+                if (*Gij == 1) *Cij += *Gij;
+            }
+        }
+    }
+
+    // calculate final neighborhood counts and update the corresponding cells in the grid
+    run_bands(BAND_NEUMANN, minrow, maxrow, mincol, minrow, maxcol, maxrow);
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::run_bands(int pass, int lo, int hi, int mincol, int minrow, int maxcol, int maxrow)
+{
+    // split lo..hi into bands and run the given pass on each band
+    int nbands = 1;
+    if (threads && pass != BAND_SUMS) {
+        // use a few bands per thread so a slow band doesn't hold up the others
+        nbands = 4 * threads->size();
+        if (nbands > hi - lo + 1) nbands = hi - lo + 1;
+        if (pass == BAND_PACKED) {
+            // each band starts by adding up 2*range+1 rows so don't make bands
+            // much thinner than that
+            int maxbands = (hi - lo + 1) / (2 * range + 1);
+            if (nbands > maxbands) nbands = maxbands < 1 ? 1 : maxbands;
+        }
+    }
+    vector<ltlband> bands(nbands);
+    vector<lifetask*> tasks(nbands);
+    for (int k = 0; k < nbands; k++) {
+        ltlband& band = bands[k];
+        band.algo = this;
+        band.pass = pass;
+        band.lo = lo + (int)((long long)(hi - lo + 1) * k / nbands);
+        band.hi = lo + (int)((long long)(hi - lo + 1) * (k + 1) / nbands) - 1;
+        band.mincol = mincol;
+        band.minrow = minrow;
+        band.maxcol = maxcol;
+        band.maxrow = maxrow;
+        band.popchange = 0;
+        band.minx = INT_MAX;
+        band.miny = INT_MAX;
+        band.maxx = INT_MIN;
+        band.maxy = INT_MIN;
+        band.cornerlives = false;
+        tasks[k] = &band;
+    }
+    if (nbands == 1) {
+        do_band(bands[0]);
+    } else {
+        threads->runbatch(&tasks[0], nbands);
+    }
+    if (pass < BAND_MOORE) return;
+
+    // combine the population changes and boundaries of the bands
+    for (int k = 0; k < nbands; k++) {
+        ltlband& band = bands[k];
+        population += band.popchange;
+        if (band.minx < minx) minx = band.minx;
+        if (band.maxx > maxx) maxx = band.maxx;
+        if (band.miny < miny) miny = band.miny;
+        if (band.maxy > maxy) maxy = band.maxy;
+        if (band.cornerlives) {
+            // faster_Moore_*2 use the whole region as the boundary in this case
+            if (mincol < minx) minx = mincol;
+            if (maxcol > maxx) maxx = maxcol;
+            if (minrow < miny) miny = minrow;
+            if (maxrow > maxy) maxy = maxrow;
+        }
+    }
+    if (population == 0) empty_boundaries();
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::do_band(ltlband& band)
+{
+    int b = unbounded ? 0 : border;
+    int width = band.maxcol - band.mincol + 1;
+    switch (band.pass) {
+        case BAND_SUMS:
+        case BAND_ROWSUMS: {
+            // calculate the sum of state-1 cells in each row up to each column
+            // and (for BAND_SUMS) add the cumulative counts in the row above
+            int r0 = band.minrow + b - range;
+            int c0 = band.mincol + b - range;
+            int sumwd = width + 2 * range;
+            for (int i = band.lo; i <= band.hi; i++) {
+                int* ccptr = colcounts + i * outerwd + c0;
+                rowsumsfn(ccptr, outergrid1 + i * outerwd + c0, sumwd);
+                if (band.pass == BAND_SUMS && i > r0) colsumfn(ccptr, ccptr - outerwd, sumwd);
+            }
+            break;
+        }
+        case BAND_COLSUMS: {
+            // add up the row sums in columns lo..hi to get the cumulative counts
+            int r0 = band.minrow + b - range;
+            int r1 = band.maxrow + b + range;
+            int* ccptr = colcounts + r0 * outerwd + band.lo;
+            for (int i = r0 + 1; i <= r1; i++) {
+                ccptr += outerwd;
+                colsumfn(ccptr, ccptr - outerwd, band.hi - band.lo + 1);
+            }
+            break;
+        }
+        case BAND_MOORE: {
+            vector<int> counts(width);
+            int span = 2 * range + 1;
+            for (int i = band.lo; i <= band.hi; i++) {
+                // the square for each cell spans rows i-range..i+range and columns
+                // j-range..j+range, so there are no rows above it in colcounts if i is minrow
+                int* bot = colcounts + (i + b + range) * outerwd + band.mincol + b + range;
+                int* top = i == band.minrow ? NULL : bot - span * outerwd;
+                moorecountsfn(&counts[0], bot, top, width, span);
+                update_row(band, i, currgrid + i * outerwd + band.mincol, &counts[0]);
+            }
+            break;
+        }
+        case BAND_NEUMANN: {
+            vector<int> counts(width);
+            int e = unbounded ? 0 : range;
+            for (int row = band.lo; row <= band.hi; row++) {
+                // i and j are relative to the top left corner of the rectangle used by getcount
+                int i = row - band.minrow + e;
+                int im1 = i - 1;
+                int ipr = i + range;
+                int iprm1 = ipr - 1;
+                int imrm1 = i - range - 1;
+                int imrm2 = imrm1 - 1;
+                for (int k = 0; k < width; k++) {
+                    int j = k + e;
+                    int jpr = j + range;
+                    int jmr = j - range;
+                    counts[k] = getcount(ipr,j)   - getcount(im1,jpr+1) - getcount(im1,jmr-1) + getcount(imrm2,j) +
+                                getcount(iprm1,j) - getcount(im1,jpr)   - getcount(im1,jmr)   + getcount(imrm1,j);
+                }
+                update_row(band, row, currgrid + row * outerwd + band.mincol, &counts[0]);
+            }
+            break;
+        }
+        case BAND_PACKED: {
+            // colsums[x] is the number of live cells in column x of rows
+            // i-range..i+range; it is updated by adding the row entering the
+            // square and subtracting the row leaving it, then counts[k] is
+            // the sum of colsums in columns mincol+k-range..mincol+k+range
+            // (all live cells are inside columns mincol..maxcol so only the
+            // words covering those columns need to be added up)
+            int x0 = band.mincol & ~7;
+            int x1 = (band.maxcol + 8) & ~7;
+            int span = 2 * range + 1;
+            vector<int> colsums(x1, 0);
+            vector<int> sums(width + span);
+            vector<int> counts(width);
+            // each row of cells from x0 to x1-1 is unpacked into bytes so
+            // update_row can be used
+            vector<unsigned char> states(x1 - x0);
+            for (int i = band.lo - range; i <= band.lo + range; i++) {
+                packed_col_sums(i, &colsums[0], x0, x1, 1);
+            }
+            for (int i = band.lo; i <= band.hi; i++) {
+                if (i > band.lo) {
+                    packed_col_sums(i + range, &colsums[0], x0, x1, 1);
+                    packed_col_sums(i - range - 1, &colsums[0], x0, x1, -1);
+                }
+                packed_row_sums(&sums[0], &colsums[0], band.mincol - range, width + span - 1, x1);
+                for (int k = 0; k < width; k++) counts[k] = sums[k + span] - sums[k];
+
+                const unsigned int* oldrow = currbits + i * packwd;
+                for (int x = x0; x < x1; x += 8) {
+                    unsigned long long bytes = spreadbits[(oldrow[x >> 5] >> (x & 24)) & 0xff];
+                    memcpy(&states[x - x0], &bytes, 8);
+                }
+                update_row(band, i, &states[band.mincol - x0], &counts[0]);
+                // pack the new states into nextbits (the multiply moves bit 0 of
+                // byte k to bit 56+k)
+                unsigned int* newrow = nextbits + i * packwd;
+                for (int x = x0; x < x1; x += 8) {
+                    unsigned long long bytes;
+                    memcpy(&bytes, &states[x - x0], 8);
+                    if (bytes) {
+                        unsigned int b = (unsigned int)((bytes * 0x0102040810204080ULL) >> 56);
+                        newrow[x >> 5] |= b << (x & 24);
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::packed_col_sums(int row, int* colsums, int x0, int x1, int delta)
+{
+    // add delta to colsums[x] for each live cell at column x (x0 <= x < x1)
+    // in the given row of currbits; rows outside the grid wrap around on a
+    // torus and are empty on a plane
+    if (row < 0 || row > ghtm1) {
+        if (topology != 'T') return;
+        row = (row % ght + ght) % ght;
+    }
+    const unsigned int* bits = currbits + row * packwd;
+    for (int x = x0; x < x1; x += 8) {
+        unsigned int b = (bits[x >> 5] >> (x & 24)) & 0xff;
+        if (b) {
+            unsigned long long cells = spreadbits[b];
+            for (int k = 0; k < 8; k++) colsums[x + k] += delta * (int)((cells >> (8 * k)) & 1);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::packed_row_sums(int* sums, const int* colsums, int from, int n, int x1)
+{
+    // set sums[k] to the total of colsums in columns from..from+k-1 for k = 0..n;
+    // colsums is zero from x1 up to the right edge of the grid (x1 might be
+    // a few columns past the edge), and columns
+    // outside the grid wrap around on a torus and are empty on a plane
+    bool torus = topology == 'T';
+    int x = from;
+    if (torus) x = (x % gwd + gwd) % gwd;
+    if (x1 > gwd) x1 = gwd;
+    int total = 0;
+    int k = 0;
+    sums[0] = 0;
+    while (k < n) {
+        // do as many columns as possible without checking x
+        int len = n - k;
+        if (x < 0) {
+            // columns left of a plane are empty
+            if (len > -x) len = -x;
+            for (int j = 1; j <= len; j++) sums[k + j] = total;
+        } else if (x >= x1) {
+            // columns up to the right edge are empty
+            if (torus && len > gwd - x) len = gwd - x;
+            for (int j = 1; j <= len; j++) sums[k + j] = total;
+        } else {
+            if (len > x1 - x) len = x1 - x;
+            const int* colptr = colsums + x - 1;
+            for (int j = 1; j <= len; j++) {
+                total += colptr[j];
+                sums[k + j] = total;
+            }
+        }
+        k += len;
+        x += len;
+        if (torus && x == gwd) x = 0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::packed_gen(int mincol, int minrow, int maxcol, int maxrow)
+{
+    // calculate the next generation of the cells in the given rectangle of
+    // currbits; new cells are written to nextbits (which is all zero) and
+    // then the grids are swapped
+    run_bands(BAND_PACKED, minrow, maxrow, mincol, minrow, maxcol, maxrow);
+
+    unsigned int* temp = currbits;
+    currbits = nextbits;
+    nextbits = temp;
+
+    // all live cells in the old generation were inside the rectangle
+    // so clearing its rows makes nextbits all zero again
+    memset(nextbits + minrow * packwd, 0, (size_t)(maxrow - minrow + 1) * packwd * sizeof(unsigned int));
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::update_row(ltlband& band, int row, unsigned char* stateptr, const int* counts)
+{
+    // update the cells in the given row (stateptr points to the cell at band.mincol)
+    // using the given neighborhood counts; this does the same as update_current_grid
+    // but records the population change and boundary in the band so bands can be
+    // updated in parallel
+    int width = band.maxcol - band.mincol + 1;
+    unsigned char corner = *stateptr;
+    int alive = 0;
+    if (maxCellStates == 2 && ruleintervals && births != altbirths) {
+        int rule[4] = { blo, bhi, slo, shi };
+        alive = updaterow2fn(stateptr, counts, width, rule, band.popchange);
+    } else {
+        for (int j = 0; j < width; j++) {
+            unsigned char state = stateptr[j];
+            int ncount = counts[j];
+            if (state == 0) {
+                // new cell might be born
+                if (births[ncount]) {
+                    state = 1;
+                    band.popchange++;
+                }
+            } else if (state == 1) {
+                // this cell is alive
+                if (!survivals[ncount]) {
+                    if (maxCellStates > 2) {
+                        // cell decays to state 2
+                        state = 2;
+                    } else {
+                        // cell dies
+                        state = 0;
+                        band.popchange--;
+                    }
+                }
+            } else {
+                // state is > 1 so this cell will eventually die
+                if (state + 1 < maxCellStates) {
+                    state++;
+                } else {
+                    state = 0;
+                    band.popchange--;
+                }
+            }
+            stateptr[j] = state;
+            alive |= state;
+        }
+    }
+
+    // faster_Moore_*2 set the boundary to the whole region if the top left
+    // cell survives, so do the same to get identical results
+    if (band.pass != BAND_NEUMANN && maxCellStates == 2 && row == band.minrow && corner && *stateptr) {
+        band.cornerlives = true;
+    }
+
+    if (alive) {
+        int first = 0;
+        int last = width - 1;
+        while (stateptr[first] == 0) first++;
+        while (stateptr[last] == 0) last--;
+        if (band.mincol + first < band.minx) band.minx = band.mincol + first;
+        if (band.mincol + last > band.maxx) band.maxx = band.mincol + last;
+        if (row < band.miny) band.miny = row;
+        if (row > band.maxy) band.maxy = row;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 void ltlalgo::fast_Asterisk(int mincol, int minrow, int maxcol, int maxrow)
 {
     for (int y = minrow; y <= maxrow; y++) {
@@ -2449,7 +3185,11 @@ void ltlalgo::do_gen(int mincol, int minrow, int maxcol, int maxrow)
 
     switch (ntype) {
         case 'M':
-            if (unbounded) {
+            if (packed) {
+                packed_gen(mincol, minrow, maxcol, maxrow);
+            } else if (colcounts && (threads || (maxcol - mincol + 1) * (maxrow - minrow + 1) >= MIN_BANDED_CELLS)) {
+                faster_Moore_banded(mincol, minrow, maxcol, maxrow);
+            } else if (unbounded) {
                 if (colcounts) {
                     if (maxCellStates == 2) {
                         faster_Moore_unbounded2(mincol, minrow, maxcol, maxrow);
@@ -2473,7 +3213,9 @@ void ltlalgo::do_gen(int mincol, int minrow, int maxcol, int maxrow)
             break;
 
         case 'N':
-            if (unbounded) {
+            if (colcounts && threads) {
+                faster_Neumann_banded(mincol, minrow, maxcol, maxrow);
+            } else if (unbounded) {
                 if (colcounts) {
                     faster_Neumann_unbounded(mincol, minrow, maxcol, maxrow);
                 } else {
@@ -2585,6 +3327,13 @@ void ltlalgo::do_bounded_gen()
         if (torus) minrow = 0;
     }
 
+    if (packed) {
+        // no border cells are needed (see packed_col_sums)
+        empty_boundaries();
+        do_gen(mincol, minrow, maxcol, maxrow);
+        return;
+    }
+
     // save pattern limits for clearing border cells at end
     int sminx = minx;
     int smaxx = maxx;
@@ -2902,6 +3651,18 @@ void ltlalgo::step()
 
 void ltlalgo::save_cells()
 {
+    if (packed) {
+        for (int y = miny; y <= maxy; y++) {
+            for (int x = minx; x <= maxx; x++) {
+                if (getbit(x, y)) {
+                    cell_list.push_back(x + gleft);
+                    cell_list.push_back(y + gtop);
+                    cell_list.push_back(1);
+                }
+            }
+        }
+        return;
+    }
     for (int y = miny; y <= maxy; y++) {
         int yoffset = y * outerwd;
         for (int x = minx; x <= maxx; x++) {
@@ -3909,7 +4670,10 @@ const char *ltlalgo::setrule(const char *s)
         
         // if the new size is different or range has changed or ntype has changed
         // or the old universe is unbounded then we need to create new grids
-        if (gwd != newwd || ght != newht || range != oldrange || ntype != oldtype || unbounded) {
+        // or we need to switch between byte grids and bit grids
+        bool usepacked = scount <= 2 && ntype == 'M';
+        if (gwd != newwd || ght != newht || range != oldrange || ntype != oldtype || unbounded ||
+            usepacked != packed) {
             if (population > 0) {
                 save_cells();       // store the current pattern in cell_list
             }
@@ -3919,6 +4683,8 @@ const char *ltlalgo::setrule(const char *s)
                 free(outergrid2);
                 outergrid2 = NULL;
             }
+            free_packed();
+            packed = usepacked;
             create_grids(newwd, newht);
             if (cell_list.size() > 0) {
                 // restore the pattern (if the new grid is smaller then any live cells
@@ -3937,6 +4703,9 @@ const char *ltlalgo::setrule(const char *s)
         // no suffix given so use an unbounded universe
         unbounded = true;
         
+        // unbounded universes always use byte grids
+        if (packed) unpack_grid();
+        
         // set unbounded grid dimensions used by GUI code
         gridwd = 0;
         gridht = 0;
@@ -4096,13 +4865,40 @@ const char *ltlalgo::setrule(const char *s)
             free(altsurvivals);
             altsurvivals = ss;
         }
+        maxs++;
     }
 
+    find_rule_intervals(maxb + 1, maxs + 1);
+
     return 0;
 }
 
 // -----------------------------------------------------------------------------
 
+static bool find_interval(const unsigned char* flags, int size, int& lo, int& hi)
+{
+    // return true if the set flags are a single range of counts (or none)
+    lo = 0;
+    while (lo < size && !flags[lo]) lo++;
+    hi = lo;
+    while (hi < size && flags[hi]) hi++;
+    for (int i = hi; i < size; i++) {
+        if (flags[i]) return false;
+    }
+    hi--;
+    return true;
+}
+
+void ltlalgo::find_rule_intervals(int bsize, int ssize)
+{
+    // faster_*_banded can test for births and survivals without table lookups
+    // (and so vectorize the updates) if each is a single range of counts;
+    // counts past the end of the tables are never passed in
+    ruleintervals = find_interval(births, bsize, blo, bhi) && find_interval(survivals, ssize, slo, shi);
+}
+
+// -----------------------------------------------------------------------------
+
 const char* ltlalgo::getrule()
 {
    return canonrule;
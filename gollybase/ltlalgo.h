@@ -8,8 +8,11 @@
 
 #include "lifealgo.h"
 #include "liferules.h"  // for MAXRULESIZE
+#include "util.h"       // for lifethreads
 #include <vector>
 
+struct ltlband;
+
 class ltlalgo : public lifealgo {
 public:
     ltlalgo();
@@ -17,6 +20,7 @@ public:
     virtual int setcell(int x, int y, int newstate);
     virtual int getcell(int x, int y);
     virtual int nextcell(int x, int y, int& v);
+    virtual int setrow(int x, int y, const int* runs, int nruns);
     virtual void endofpattern();
     virtual void setIncrement(bigint inc) { increment = inc; }
     virtual void setIncrement(int inc) { increment = inc; }
@@ -31,6 +35,7 @@ public:
     virtual const char* DefaultRule();
     virtual int NumCellStates();
     virtual int NumRandomizedCellStates() { return 2 ; }
+    virtual void setNumThreads(int n);
     virtual void step();
     virtual void* getcurrentstate() { return 0; }
     virtual void setcurrentstate(void*) {}
@@ -55,6 +60,14 @@ private:
     vector<int> cell_list;              // used by save_cells and restore_cells
     bool show_warning;                  // flag used to avoid multiple warning dialogs
     int* colcounts;                     // cumulative column counts of state-1 cells
+
+    // bounded universes with 2-state Moore rules store each row of the grid as bits
+    // (32 cells per word) in currbits and nextbits; outergrid1, outergrid2 and
+    // colcounts are not used (see packed_gen)
+    bool packed;                        // true if using currbits and nextbits
+    unsigned int* currbits;             // packwd*ght words for current generation
+    unsigned int* nextbits;             // packwd*ght words for next generation
+    int packwd;                         // number of words in each row
     
     // bounded grids are surrounded by a border of cells (with thickness = range+1)
     // so we can calculate neighborhood counts without checking for edge conditions;
@@ -72,6 +85,11 @@ private:
     int ccht;                           // height of colcounts array when ntype = N
     int halfccwd;                       // half width of colcounts array when ntype = N
     int nrows, ncols;                   // size of rectangle being processed
+
+    // these variables are used by the banded versions of faster_Moore_* and faster_Neumann_*
+    lifethreads* threads;               // worker threads (NULL if numthreads < 2)
+    bool ruleintervals;                 // births and survivals are each a single range of counts
+    int blo, bhi, slo, shi;             // those ranges (if ruleintervals is true)
     
     // rule parameters (set by setrule)
     int range;                          // neighborhood radius
@@ -96,12 +114,18 @@ private:
     void create_grids(int wd, int ht);  // create a bounded universe of given width and height
     void allocate_colcounts();          // allocate the colcounts array
     void empty_boundaries();            // set minx, miny, maxx, maxy when population is 0
+    void free_packed();                 // free currbits and nextbits
+    void unpack_grid();                 // convert currbits into a byte grid
+    int getbit(int x, int y) { return (currbits[y * packwd + (x >> 5)] >> (x & 31)) & 1; }
+    int gridcell(int x, int y) { return packed ? getbit(x, y) : currgrid[y * outerwd + x]; }
     void save_cells();                  // save current pattern in cell_list
     void restore_cells();               // restore pattern from cell_list
     void do_gen(int mincol, int minrow, int maxcol, int maxrow); // calculate next generation
     void do_bounded_gen();              // calculate the next generation in a bounded universe
+    void packed_gen(int mincol, int minrow, int maxcol, int maxrow); // same when packed is true
     bool do_unbounded_gen();            // calculate the next generation in an unbounded universe
     int getcount(int i, int j);         // used in faster_Neumann_*
+    void find_rule_intervals(int bsize, int ssize); // set ruleintervals, blo, bhi, slo, shi
 
     const char* resize_grids(int up, int down, int left, int right);
     // try to resize an unbounded universe by the given amounts (possibly -ve);
@@ -115,6 +139,8 @@ private:
     void fast_Neumann(int mincol, int minrow, int maxcol, int maxrow);
     void faster_Neumann_bounded(int mincol, int minrow, int maxcol, int maxrow);
     void faster_Neumann_unbounded(int mincol, int minrow, int maxcol, int maxrow);
+    void faster_Moore_banded(int mincol, int minrow, int maxcol, int maxrow);
+    void faster_Neumann_banded(int mincol, int minrow, int maxcol, int maxrow);
     void fast_Shaped(int mincol, int minrow, int maxcol, int maxrow);
     void fast_Asterisk(int mincol, int minrow, int maxcol, int maxrow);
     void fast_Tripod(int mincol, int minrow, int maxcol, int maxrow);
@@ -136,6 +162,14 @@ private:
     void update_next_grid(int x, int y, int xyoffset, int ncount);
     // called from each of the fast* routines to set the state of the x,y cell
     // in nextgrid based on the given neighborhood count
+
+    void run_bands(int pass, int lo, int hi, int mincol, int minrow, int maxcol, int maxrow);
+    void do_band(ltlband& band);
+    void update_row(ltlband& band, int row, unsigned char* stateptr, const int* counts);
+    void packed_col_sums(int row, int* colsums, int x0, int x1, int delta);
+    void packed_row_sums(int* sums, const int* colsums, int from, int n, int x1);
+    // used by faster_*_banded to split the work into bands that can run in parallel
+    friend struct ltlband;
 };
 
 #endif
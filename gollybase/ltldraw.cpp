@@ -117,6 +117,27 @@ void ltlalgo::draw(viewport &view, liferender &renderer)
                renderer.stateblit(x, y, wd, ht, currgrid) ;
             else
                renderer.pixblit(x, y, wd, ht, currgrid, pmag);
+        } else if (packed) {
+            // there is no border so unpack strips of rows from currbits and
+            // draw them one at a time
+            int striprows = (1 << 16) / gwd;
+            if (striprows < 1) striprows = 1;
+            if (striprows > ght) striprows = ght;
+            vector<unsigned char> strip((size_t)gwd * striprows);
+            for (int row = 0; row < ght; row += striprows) {
+                int numrows = row + striprows <= ght ? striprows : ght - row;
+                int x = ltpxl.first;
+                int y = ltpxl.second + row * pmag;
+                if (!renderer.justState() && (y >= viewh || y + numrows * pmag <= 0)) continue;
+                unsigned char* cellptr = &strip[0];
+                for (int j = 0; j < numrows; j++) {
+                    for (int i = 0; i < gwd; i++) *cellptr++ = (unsigned char)getbit(i, row + j);
+                }
+                if (renderer.justState())
+                   renderer.stateblit(x, y, gwd * pmag, numrows * pmag, &strip[0]) ;
+                else
+                   renderer.pixblit(x, y, gwd * pmag, numrows * pmag, &strip[0], pmag);
+            }
         } else {
             // the universe is bounded so we need to include the outer border
             bigint outerleft = gridleft;
@@ -151,18 +172,13 @@ void ltlalgo::draw(viewport &view, liferender &renderer)
                     if (x >= vieww || y >= viewh || x+imax <= 0 || y+jmax <= 0) {
                         // not visible
                     } else {
-                        // get cell at top left corner of this block
-                        unsigned char* cellptr = currgrid + row * outerwd + col;
-                        
                         // find live cells in this block and store their RGBA data in pixbuf
                         for (int j = 0; j < jmax; j++) {
-                            unsigned char* p = cellptr;
                             int pixrow = j * pmsize;
                             for (int i = 0; i < imax; i++) {
-                                if (*p > 0) pixRGBAbuf[pixrow + i] = cellRGBA[*p];
-                                p++;
+                                int state = gridcell(col + i, row + j);
+                                if (state > 0) pixRGBAbuf[pixrow + i] = cellRGBA[state];
                             }
-                            cellptr += outerwd;
                         }
                         
                         // draw this block
@@ -200,15 +216,11 @@ void ltlalgo::draw(viewport &view, liferender &renderer)
                     if (x >= vieww || y >= viewh || x+pmsize <= 0 || y+pmsize <= 0) {
                         // not visible
                     } else {
-                        // get cell at top left corner of this big block
-                        unsigned char* cellptr = currgrid + row * outerwd + col;
-                        
                         // avoid going way beyond bottom/right edges of grid
                         int jmax = row + blocksize <= ght ? blocksize : blocksize - (row + blocksize - ght);
                         int imax = col + blocksize <= gwd ? blocksize : blocksize - (col + blocksize - gwd);
                         
                         for (int j = 0; j < jmax; j += pmag) {
-                            unsigned char* p = cellptr;
                             int sqtop = row + j;
                             for (int i = 0; i < imax; i += pmag) {
                             
@@ -216,11 +228,9 @@ void ltlalgo::draw(viewport &view, liferender &renderer)
                                 int sqleft = col + i;
                                 for (int r = 0; r < pmag; r++) {
                                     if (sqtop + r < ght) {
-                                        unsigned char* topleft = p + r * outerwd;
                                         for (int c = 0; c < pmag; c++) {
                                             if (sqleft + c < gwd) {
-                                                unsigned char* q = topleft + c;
-                                                if (*q > 0) {
+                                                if (gridcell(sqleft + c, sqtop + r) > 0) {
                                                     pixRGBAbuf[(j >> mag) * pmsize + (i >> mag)] = state1RGBA;
                                                     // no need to keep looking in this square
                                                     goto found1;
@@ -230,10 +240,8 @@ void ltlalgo::draw(viewport &view, liferender &renderer)
                                     }
                                 }
                                 found1:
-                                p += pmag;
-                                
+                                ;
                             }
-                            cellptr += outerwd * pmag;
                         }
                         
                         // draw the shrunken block
@@ -266,13 +274,11 @@ void ltlalgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pr
 
     // find the top edge (miny)
     for (int row = miny; row <= maxy; row++) {
-        unsigned char* cellptr = currgrid + row * outerwd + minx;
         for (int col = minx; col <= maxx; col++) {
-            if (*cellptr > 0) {
+            if (gridcell(col, row) > 0) {
                 miny = row;
                 goto found_top;
             }
-            cellptr++;
         }
     }
     // should never get here if population > 0
@@ -282,13 +288,11 @@ void ltlalgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pr
     
     // find the bottom edge (maxy)
     for (int row = maxy; row >= miny; row--) {
-        unsigned char* cellptr = currgrid + row * outerwd + minx;
         for (int col = minx; col <= maxx; col++) {
-            if (*cellptr > 0) {
+            if (gridcell(col, row) > 0) {
                 maxy = row;
                 goto found_bottom;
             }
-            cellptr++;
         }
     }
     
@@ -296,13 +300,11 @@ void ltlalgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pr
     
     // find the left edge (minx)
     for (int col = minx; col <= maxx; col++) {
-        unsigned char* cellptr = currgrid + miny * outerwd + col;
         for (int row = miny; row <= maxy; row++) {
-            if (*cellptr > 0) {
+            if (gridcell(col, row) > 0) {
                 minx = col;
                 goto found_left;
             }
-            cellptr += outerwd;
         }
     }
     
@@ -310,13 +312,11 @@ void ltlalgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pr
     
     // find the right edge (maxx)
     for (int col = maxx; col >= minx; col--) {
-        unsigned char* cellptr = currgrid + miny * outerwd + col;
         for (int row = miny; row <= maxy; row++) {
-            if (*cellptr > 0) {
+            if (gridcell(col, row) > 0) {
                 maxx = col;
                 goto found_right;
             }
-            cellptr += outerwd;
         }
     }
     
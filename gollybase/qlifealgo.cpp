@@ -12,6 +12,7 @@
 #include <string.h>
 #include <limits.h>
 #include <iostream>
+#include <mutex>
 using namespace std ;
 /*
  *   The ai array is used to figure out the index number of the bit set in
@@ -20,6 +21,9 @@ using namespace std ;
  *   of code.
  */
 static unsigned char ai[129] ;
+#if !defined(__GNUC__) && !defined(NOBRICKKERNEL)
+#define NOBRICKKERNEL
+#endif
 /*
  *   This define is the size of memory to ask for at one time.  8K is a good
  *   size; we drop 16 bits because malloc overhead is probably near this.
@@ -29,6 +33,13 @@ static unsigned char ai[129] ;
  *   memory for small universes.
  */
 #define MEMCHUNK (8192-16)
+/*
+ *   When stepping in parallel the workers share the free lists, so
+ *   taking from them (and refilling them) is done under a lock.
+ */
+struct qparallel {
+   std::mutex alloclock ;
+} ;
 /*
  *   When we need a bunch more structures of a particular size, we call this.
  *   This code allocates the memory, adds it to our universe memory allocated
@@ -74,10 +85,14 @@ static int bricks, tiles, supertiles, rcc, dq, ds, rccs, dqs, dss ;
  */
 brick *qlifealgo::newbrick() {
    brick *r ;
+   if (parallel)
+      pctx->alloclock.lock() ;
    if (bricklist == 0)
       bricklist = filllist(sizeof(brick)) ;
    r = (brick *)(bricklist) ;
    bricklist = bricklist->next ;
+   if (parallel)
+      pctx->alloclock.unlock() ;
    memset(r, 0, sizeof(brick)) ;
    STAT(bricks++) ;
    return r ;
@@ -88,10 +103,14 @@ brick *qlifealgo::newbrick() {
  */
 tile *qlifealgo::newtile() {
    tile *r ;
+   if (parallel)
+      pctx->alloclock.lock() ;
    if (tilelist == 0)
       tilelist = filllist(sizeof(tile)) ;
    r = (tile *)(tilelist) ;
    tilelist = tilelist->next ;
+   if (parallel)
+      pctx->alloclock.unlock() ;
    r->b[0] = r->b[1] = r->b[2] = r->b[3] = emptybrick ;
    r->flags = -1 ;
    r->localdeltaforward = 0 ;
@@ -104,10 +123,14 @@ tile *qlifealgo::newtile() {
  */
 supertile *qlifealgo::newsupertile(int lev) {
    supertile *r ;
+   if (parallel)
+      pctx->alloclock.lock() ;
    if (supertilelist == 0)
       supertilelist = filllist(sizeof(supertile)) ;
    r = (supertile *)supertilelist ;
    supertilelist = supertilelist->next ;
+   if (parallel)
+      pctx->alloclock.unlock() ;
    r->d[0] = r->d[1] = r->d[2] = r->d[3] = r->d[4] = r->d[5] =
                                  r->d[6] = r->d[7] = nullroots[lev-1] ;
    STAT(supertiles++) ;
@@ -189,6 +212,173 @@ void qlifealgo::uproot() {
    // in the new root.
    popValid = 0 ;
 }
+#ifndef NOBRICKKERNEL
+/*
+ *   The brick kernel.  Each of the eight slices of a brick is a lane
+ *   of a vector; for every cell of every lane nb[k] holds its neighbor
+ *   k (in rule3x3 bit order), we add up the neighbors the rule counts
+ *   with bit-sliced adders and then pick out the counts that give a
+ *   live cell.  This needs the GCC/clang vector extensions; elsewhere
+ *   we just use the table.
+ */
+typedef unsigned int brickvec __attribute__((vector_size(32))) ;
+static inline __attribute__((always_inline))
+void brickadd(brickvec &s, brickvec &c, const brickvec &a,
+              const brickvec &b, const brickvec &d) {
+   brickvec t = a ^ b ;
+   s = t ^ d ;
+   c = (a & b) | (t & d) ;
+}
+static inline __attribute__((always_inline))
+void brickcount(const brickvec *nb, int nbrs, const int *rule,
+                brickvec &v) {
+   brickvec s0, s1, s2, s3 ;
+   if (nbrs == 0x1ef) {
+      // all eight neighbors:  a tree of full adders
+      brickvec a0, a1, b0, b1, c0, c1, d0, d1, e0, e1 ;
+      brickadd(a0, a1, nb[0], nb[1], nb[2]) ;
+      brickadd(b0, b1, nb[3], nb[5], nb[6]) ;
+      c0 = nb[7] ^ nb[8] ;
+      c1 = nb[7] & nb[8] ;
+      brickadd(s0, d0, a0, b0, c0) ;
+      brickadd(e0, e1, a1, b1, c1) ;
+      s1 = e0 ^ d0 ;
+      d1 = e0 & d0 ;
+      s2 = e1 ^ d1 ;
+      s3 = e1 & d1 ;
+   } else {
+      s0 = s1 = s2 = s3 = nb[4] ^ nb[4] ;
+      for (int k=0; k<9; k++) {
+         if (k == 4 || !(nbrs & (256 >> k)))
+            continue ;
+         brickvec c0 = s0 & nb[k] ;
+         s0 ^= nb[k] ;
+         brickvec c1 = s1 & c0 ;
+         s1 ^= c0 ;
+         brickvec c2 = s2 & c1 ;
+         s2 ^= c1 ;
+         s3 |= c2 ;
+      }
+   }
+   // a count k is lo[k&3] & hi[k>>2]
+   brickvec lo[4], hi[3], born = s0 ^ s0, live = born ;
+   lo[0] = ~(s0 | s1) ;
+   lo[1] = s0 & ~s1 ;
+   lo[2] = s1 & ~s0 ;
+   lo[3] = s0 & s1 ;
+   hi[0] = ~(s2 | s3) ;
+   hi[1] = s2 ;
+   hi[2] = s3 ;
+   for (int h=0; h<3; h++) {
+      brickvec bh = born ^ born, lh = bh ;
+      for (int j=0; j<4; j++) {
+         if ((rule[0] >> (4 * h + j)) & 1)
+            bh |= lo[j] ;
+         if ((rule[1] >> (4 * h + j)) & 1)
+            lh |= lo[j] ;
+      }
+      born |= bh & hi[h] ;
+      live |= lh & hi[h] ;
+   }
+   v = (nb[4] & live) | (~nb[4] & born) ;
+}
+/*
+ *   Even to odd:  the new cell at (r,c) comes from rows r..r+2 and
+ *   columns c..c+2, so we need each slice (z), the slice to its right
+ *   (t), and the same two from the brick below (u, ut).
+ */
+static inline __attribute__((always_inline))
+void brick01body(const unsigned int *pz, const unsigned int *pt,
+                 const unsigned int *pu, const unsigned int *put,
+                 int nbrs, const int *rule, unsigned int *out) {
+   brickvec z, t, u, ut, r[3], tr[3], nb[9] ;
+   memcpy(&z, pz, sizeof(z)) ;
+   memcpy(&t, pt, sizeof(t)) ;
+   memcpy(&u, pu, sizeof(u)) ;
+   memcpy(&ut, put, sizeof(ut)) ;
+   r[0] = z ;
+   r[1] = (z << 4) | (u >> 28) ;
+   r[2] = (z << 8) | (u >> 24) ;
+   tr[0] = t ;
+   tr[1] = (t << 4) | (ut >> 28) ;
+   tr[2] = (t << 8) | (ut >> 24) ;
+   for (int dr=0; dr<3; dr++) {
+      nb[3*dr] = r[dr] ;
+      nb[3*dr+1] = ((r[dr] << 1) & 0xeeeeeeee) | ((tr[dr] >> 3) & 0x11111111) ;
+      nb[3*dr+2] = ((r[dr] << 2) & 0xcccccccc) | ((tr[dr] >> 2) & 0x33333333) ;
+   }
+   brickvec v ;
+   brickcount(nb, nbrs, rule, v) ;
+   memcpy(out, &v, sizeof(v)) ;
+}
+/*
+ *   Odd to even:  the new cell at (r,c) comes from rows r-2..r and
+ *   columns c-2..c, so we need each slice (z), the slice to its left
+ *   (l), and the same two from the brick above (o, ol).
+ */
+static inline __attribute__((always_inline))
+void brick10body(const unsigned int *pz, const unsigned int *pl,
+                 const unsigned int *po, const unsigned int *pol,
+                 int nbrs, const int *rule, unsigned int *out) {
+   brickvec z, l, o, ol, r[3], lr[3], nb[9] ;
+   memcpy(&z, pz, sizeof(z)) ;
+   memcpy(&l, pl, sizeof(l)) ;
+   memcpy(&o, po, sizeof(o)) ;
+   memcpy(&ol, pol, sizeof(ol)) ;
+   r[0] = (z >> 8) | (o << 24) ;
+   r[1] = (z >> 4) | (o << 28) ;
+   r[2] = z ;
+   lr[0] = (l >> 8) | (ol << 24) ;
+   lr[1] = (l >> 4) | (ol << 28) ;
+   lr[2] = l ;
+   for (int dr=0; dr<3; dr++) {
+      nb[3*dr] = ((r[dr] >> 2) & 0x33333333) | ((lr[dr] << 2) & 0xcccccccc) ;
+      nb[3*dr+1] = ((r[dr] >> 1) & 0x77777777) | ((lr[dr] << 3) & 0x88888888) ;
+      nb[3*dr+2] = r[dr] ;
+   }
+   brickvec v ;
+   brickcount(nb, nbrs, rule, v) ;
+   memcpy(out, &v, sizeof(v)) ;
+}
+typedef void (*brickfunc)(const unsigned int *, const unsigned int *,
+                          const unsigned int *, const unsigned int *,
+                          int, const int *, unsigned int *) ;
+static void brick01(const unsigned int *z, const unsigned int *t,
+                    const unsigned int *u, const unsigned int *ut,
+                    int nbrs, const int *rule, unsigned int *out) {
+   brick01body(z, t, u, ut, nbrs, rule, out) ;
+}
+static void brick10(const unsigned int *z, const unsigned int *l,
+                    const unsigned int *o, const unsigned int *ol,
+                    int nbrs, const int *rule, unsigned int *out) {
+   brick10body(z, l, o, ol, nbrs, rule, out) ;
+}
+/*
+ *   On x86 the plain versions get SSE2 (two registers per vector),
+ *   which every x86-64 has; we also build AVX2 versions (one register)
+ *   and pick them at run time if the CPU has AVX2.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define BRICKAVX2
+__attribute__((target("avx2")))
+static void brick01avx2(const unsigned int *z, const unsigned int *t,
+                        const unsigned int *u, const unsigned int *ut,
+                        int nbrs, const int *rule, unsigned int *out) {
+   brick01body(z, t, u, ut, nbrs, rule, out) ;
+}
+__attribute__((target("avx2")))
+static void brick10avx2(const unsigned int *z, const unsigned int *l,
+                        const unsigned int *o, const unsigned int *ol,
+                        int nbrs, const int *rule, unsigned int *out) {
+   brick10body(z, l, o, ol, nbrs, rule, out) ;
+}
+#endif
+static brickfunc brick01fn = brick01, brick10fn = brick10 ;
+/*
+ *   Below this many slices to recompute the table is faster.
+ */
+#define BRICKMIN 6
+#endif
 /*
  *   This subroutine allocates a new empty universe.  The universe starts
  *   out as a 256x256 universe.
@@ -210,6 +400,9 @@ qlifealgo::qlifealgo() {
    cleandowncounter = 63 ;
    usedmemory = 0 ;
    deltaforward = 0 ;
+   threads = 0 ;
+   pctx = 0 ;
+   parallel = 0 ;
    ai[0] = 4 ; ai[1] = 0 ; ai[2] = 1 ; ai[4] = 2 ; ai[8] = 3 ;
    ai[16] = 4 ; ai[32] = 5 ; ai[64] = 6 ; ai[128] = 7 ;
    minlow32 = min = 0 ;
@@ -227,11 +420,23 @@ qlifealgo::qlifealgo() {
    if (bc[255] == 0)
      for (int i=1; i<256; i++)
        bc[i] = bc[i & (i-1)] + 1 ;
+#ifndef NOBRICKKERNEL
+#ifdef BRICKAVX2
+   if (__builtin_cpu_supports("avx2")) {
+      brick01fn = brick01avx2 ;
+      brick10fn = brick10avx2 ;
+   }
+#endif
+   bricknbrs[0] = bricknbrs[1] = -1 ;
+   brickuse = 0 ;
+#endif
 }
 /*
  *   This subroutine frees a universe.
  */
 qlifealgo::~qlifealgo() {
+   delete threads ;
+   delete pctx ;
    while (memused) {
       linkedmem *nu = memused->next ;
       free(memused) ;
@@ -293,12 +498,19 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  *   Note that the parallel and corner have already been recomputed so
  *   their changing bits are shifted up 10 positions in c.
  */
-   poller->poll() ;
+   if (!parallel || lifethreads::threadindex() == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
    supertile *p, *pf, *pu, *pfu ;
    STAT(ds++) ;
+/*
+ *   With more than one thread, hand this supertile to the workers if
+ *   there is enough to do below it; see pardoquad().
+ */
+   if (threads && !parallel && lev >= 3 && parworth(zis, changing, lev, 0))
+      return pardoquad(zis, edge, par, cor, lev, 0) ;
 /*
  *   Only if the first subtile needs to be recomputed do we actually need to
  *   `visit' the edge and corner neighbors.  We always keep track of the
@@ -360,12 +572,15 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  */
 int qlifealgo::doquad10(supertile *zis, supertile *edge,
                         supertile *par, supertile *cor, int lev) {
-   poller->poll() ;
+   if (!parallel || lifethreads::threadindex() == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
    supertile *p, *pf, *pu, *pfu ;
    STAT(ds++) ;
+   if (threads && !parallel && lev >= 3 && parworth(zis, changing, lev, 1))
+      return pardoquad(zis, edge, par, cor, lev, 1) ;
    if (changing & 1) {
       x = 0 ;
       b = 1 ;
@@ -401,6 +616,149 @@ int qlifealgo::doquad10(supertile *zis, supertile *edge,
    zis->flags = nchanging | 0xf0000000 ;
    return upchanging(nchanging) ;
 }
+/*
+ *   Stepping in parallel.  A tile only reads the other generation's half
+ *   of its neighbors' bricks, so all that orders the recursion is the
+ *   changing flags:  doquad01() expects the neighbors it looks at (right,
+ *   down, and down-right; for doquad10() left, up, and up-left) to have
+ *   been recomputed already, and finds their old edge bits shifted up.
+ *   So we take the grandchildren of a supertile as an 8x8 grid and hand
+ *   them out in diagonal waves; everything in a wave has its neighbors in
+ *   earlier waves.  The work doquad would do on the way down and back up
+ *   through the supertile and its children (choosing what to recompute,
+ *   allocating empty supertiles, and setting flags) is done here before
+ *   and after the waves, just as the serial code would do it.
+ */
+struct qquadtask : public lifetask {
+   virtual void run() ;
+   qlifealgo *algo ;
+   supertile *zis, *edge, *par, *cor ;
+   int lev, odd ;
+   int *out ;
+} ;
+void qquadtask::run() {
+   if (odd)
+      *out = algo->doquad10(zis, edge, par, cor, lev) ;
+   else
+      *out = algo->doquad01(zis, edge, par, cor, lev) ;
+}
+/*
+ *   Is there enough below this supertile to keep the threads busy?  We
+ *   go by the changing bits of the children; if not, doquad carries on
+ *   down and asks again one level lower.
+ */
+int qlifealgo::parworth(supertile *zis, int changing, int lev, int odd) {
+   int k, n = 0 ;
+   for (k=0; k<8; k++)
+      if (changing & (1 << k))
+         n += bc[zis->d[odd ? k : 7 - k]->flags & 0xff] ;
+   return n >= (lev == 3 ? 2 : 2 * threads->size()) ;
+}
+int qlifealgo::pardoquad(supertile *zis, supertile *edge, supertile *par,
+                         supertile *cor, int lev, int odd) {
+   int k, j, w, n, x[8], first = (odd ? 7 : 0) ;
+   int kidchanging[8], ret[8][8] ;
+   supertile *kid[8], *pf[8], *pu[8], *pfu[8] ;
+   qquadtask tasks[8] ;
+   lifetask *tp[8] ;
+/*
+ *   Subtile k in the order doquad visits them is x[k].
+ */
+   for (k=0; k<8; k++)
+      x[k] = (odd ? k : 7 - k) ;
+   int changing = (zis->flags | (par->flags >> 19) |
+                   (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
+   int nchanging = (zis->flags & 0x3ff00) << 10 ;
+   for (k=0; k<8; k++)
+      if ((changing & (1 << k)) && zis->d[x[k]] == nullroots[lev-1])
+         zis->d[x[k]] = newsupertile(lev-1) ;
+   for (k=0; k<8; k++) {
+      kid[k] = zis->d[x[k]] ;
+      pu[k] = par->d[x[k]] ;
+      pf[k] = (k ? kid[k-1] : edge->d[first]) ;
+      pfu[k] = (k ? pu[k-1] : cor->d[first]) ;
+      kidchanging[k] = 0 ;
+      if (!(changing & (1 << k)))
+         continue ;
+/*
+ *   If the previous child is going to be recomputed, its old bits are
+ *   still where they are now, not shifted up.
+ */
+      int pfflags = (k && (changing & (1 << (k-1)))) ? pf[k]->flags >> 9 :
+                                                       pf[k]->flags >> 19 ;
+      kidchanging[k] = (kid[k]->flags | pfflags |
+                (((pu[k]->flags >> 18) | (pfu[k]->flags >> 27)) & 1)) & 0xff ;
+      for (j=0; j<8; j++)
+         if ((kidchanging[k] & (1 << j)) &&
+             kid[k]->d[x[j]] == nullroots[lev-2])
+            kid[k]->d[x[j]] = newsupertile(lev-2) ;
+   }
+/*
+ *   Now the waves.  Grandchild j of child k has its edge neighbor in
+ *   child k-1 and its parallel neighbor at j-1, so wave k+j.
+ */
+   parallel = 1 ;
+   for (w=0; w<15; w++) {
+      n = 0 ;
+      for (k=0; k<8; k++) {
+         j = w - k ;
+         if (j < 0 || j > 7 || !(kidchanging[k] & (1 << j)))
+            continue ;
+         qquadtask &t = tasks[n] ;
+         t.algo = this ;
+         t.zis = kid[k]->d[x[j]] ;
+         t.edge = pf[k]->d[x[j]] ;
+         t.par = (j ? kid[k]->d[x[j-1]] : pu[k]->d[first]) ;
+         t.cor = (j ? pf[k]->d[x[j-1]] : pfu[k]->d[first]) ;
+         t.lev = lev - 2 ;
+         t.odd = odd ;
+         t.out = &ret[k][j] ;
+         t.level = lev - 2 ;
+         tp[n++] = &t ;
+      }
+      if (n == 1)
+         tp[0]->run() ;
+      else if (n > 1)
+         threads->runbatch(tp, n) ;
+   }
+   parallel = 0 ;
+/*
+ *   And back up, setting the flags of the children and of zis.
+ */
+   for (k=0; k<8; k++) {
+      if (!(changing & (1 << k)))
+         continue ;
+      int kc = (kid[k]->flags & 0x3ff00) << 10 ;
+      for (j=0; j<8; j++)
+         if (kidchanging[k] & (1 << j))
+            kc |= ret[k][j] << (7 - j) ;
+      kid[k]->flags = kc | 0xf0000000 ;
+      nchanging |= upchanging(kc) << (7 - k) ;
+   }
+   zis->flags = nchanging | 0xf0000000 ;
+   return upchanging(nchanging) ;
+}
+/*
+ *   Workers never poll; the main thread polls while it waits for them.
+ */
+void qlifealgo::waithook(void *arg) {
+   qlifealgo *q = (qlifealgo *)arg ;
+   if (lifethreads::threadindex() == 0)
+      q->poller->poll() ;
+}
+void qlifealgo::setNumThreads(int n) {
+   poller->bailIfCalculating() ;
+   lifealgo::setNumThreads(n) ;
+   delete threads ;
+   delete pctx ;
+   threads = 0 ;
+   pctx = 0 ;
+   if (numthreads > 1) {
+      threads = new lifethreads(numthreads) ;
+      threads->setwaithook(&waithook, this) ;
+      pctx = new qparallel ;
+   }
+}
 /*
  *   This is our monster subroutine that, with its mirror below, accounts for
  *   about 90% of the runtime.  It handles recomputation for a 32x32 tile.
@@ -436,6 +794,25 @@ int qlifealgo::p01(tile *p, tile *pr, tile *pd, tile *prd) {
          p->flags |= 1 << i ;
          if (b == emptybrick)
             p->b[i] = b = newbrick() ;
+#ifndef NOBRICKKERNEL
+/*
+ *   If the rule just counts neighbors and enough slices need it, do the
+ *   whole brick with the kernel up front.
+ */
+         unsigned int kv[8] ;
+         int usekernel = (bricknbrs[brickuse] >= 0 && bc[recomp] >= BRICKMIN) ;
+         if (usekernel) {
+            unsigned int t[8], ut[8] ;
+            for (j=0; j<7; j++) {
+               t[j] = b->d[j+1] ;
+               ut[j] = db->d[j+1] ;
+            }
+            t[7] = rb->d[0] ;
+            ut[7] = rdb->d[0] ;
+            brick01fn(b->d, t, db->d, ut, bricknbrs[brickuse],
+                      brickrule[brickuse], kv) ;
+         }
+#endif
 /*
  *   If we need to recompute the end slice, now is a good time to get the
  *   right neighbor's data.
@@ -470,18 +847,26 @@ int qlifealgo::p01(tile *p, tile *pr, tile *pd, tile *prd) {
  */
                unsigned int zisdata = b->d[j] ;
                unsigned int underdata = (zisdata << 8) + (db->d[j] >> 24) ;
+               int newv ;
+#ifndef NOBRICKKERNEL
+               if (usekernel)
+                  newv = kv[j] ;
+               else
+#endif
+               {
                unsigned int otherdata = ((zisdata << 2) & 0xcccccccc) +
                                         ((traildata >> 2) & 0x33333333) ;
                unsigned int otherunderdata = ((underdata << 2) & 0xcccccccc) +
                                     ((trailunderdata >> 2) & 0x33333333) ;
-               int newv = (ruletable[zisdata >> 16] << 26) +
-                          (ruletable[underdata >> 16] << 18) +
-                          (ruletable[zisdata & 0xffff] << 10) +
-                          (ruletable[underdata & 0xffff] << 2) +
-                          (ruletable[otherdata >> 16] << 24) +
-                          (ruletable[otherunderdata >> 16] << 16) +
-                          (ruletable[otherdata & 0xffff] << 8) +
-                           ruletable[otherunderdata & 0xffff] ;
+               newv = (ruletable[zisdata >> 16] << 26) +
+                      (ruletable[underdata >> 16] << 18) +
+                      (ruletable[zisdata & 0xffff] << 10) +
+                      (ruletable[underdata & 0xffff] << 2) +
+                      (ruletable[otherdata >> 16] << 24) +
+                      (ruletable[otherunderdata >> 16] << 16) +
+                      (ruletable[otherdata & 0xffff] << 8) +
+                       ruletable[otherunderdata & 0xffff] ;
+               }
 /*
  *   Has anything changed?
  *   Keep track of what has changed in the entire cell, the rightmost
@@ -562,6 +947,21 @@ int qlifealgo::p10(tile *plu, tile *pu, tile *pl, tile *p) {
          p->flags |= 1 << i ;
          if (b == emptybrick)
             p->b[i] = b = newbrick() ;
+#ifndef NOBRICKKERNEL
+         unsigned int kv[8] ;
+         int usekernel = (bricknbrs[brickuse] >= 0 && bc[recomp] >= BRICKMIN) ;
+         if (usekernel) {
+            unsigned int l[8], ol[8] ;
+            l[0] = lb->d[15] ;
+            ol[0] = lub->d[15] ;
+            for (j=1; j<8; j++) {
+               l[j] = b->d[j+7] ;
+               ol[j] = ub->d[j+7] ;
+            }
+            brick10fn(b->d + 8, l, ub->d + 8, ol, bricknbrs[brickuse],
+                      brickrule[brickuse], kv) ;
+         }
+#endif
          if (recomp & 1) {
             j = 0 ;
             traildata = lb->d[15] ;
@@ -577,18 +977,26 @@ int qlifealgo::p10(tile *plu, tile *pu, tile *pl, tile *p) {
             if (recomp & 1) {
                unsigned int zisdata = b->d[j + 8] ;
                unsigned int overdata = (zisdata >> 8) + (ub->d[j + 8] << 24) ;
+               int newv ;
+#ifndef NOBRICKKERNEL
+               if (usekernel)
+                  newv = kv[j] ;
+               else
+#endif
+               {
                unsigned int otherdata = ((zisdata >> 2) & 0x33333333) +
                                         ((traildata << 2) & 0xcccccccc) ;
                unsigned int otheroverdata = ((overdata >> 2) & 0x33333333) +
                                     ((trailoverdata << 2) & 0xcccccccc) ;
-               int newv = (ruletable[otheroverdata >> 16] << 26) +
-                          (ruletable[otherdata >> 16] << 18) +
-                          (ruletable[otheroverdata & 0xffff] << 10) +
-                          (ruletable[otherdata & 0xffff] << 2) +
-                          (ruletable[overdata >> 16] << 24) +
-                          (ruletable[zisdata >> 16] << 16) +
-                          (ruletable[overdata & 0xffff] << 8) +
-                           ruletable[zisdata & 0xffff] ;
+               newv = (ruletable[otheroverdata >> 16] << 26) +
+                      (ruletable[otherdata >> 16] << 18) +
+                      (ruletable[otheroverdata & 0xffff] << 10) +
+                      (ruletable[otherdata & 0xffff] << 2) +
+                      (ruletable[overdata >> 16] << 24) +
+                      (ruletable[zisdata >> 16] << 16) +
+                      (ruletable[overdata & 0xffff] << 8) +
+                       ruletable[zisdata & 0xffff] ;
+               }
                int delta = (b->d[j] ^ newv) | deltaforward | p->localdeltaforward ;
                STAT(rcc++) ;
                maska = cdelta | (delta & 0xcccccccc) ;
@@ -702,25 +1110,13 @@ void qlifealgo::markglobalchange() {
    deltaforward = 0xffffffff ;
 }
 /*
- *   This subroutine sets a bit at a particular location.
- *
- *   We walk down the tree to the particular bit, setting changing flags as
- *   we go.
+ *   Walk down to the tile holding (x, y), already adjusted for the
+ *   generation's parity and inside the universe, creating it if need
+ *   be and flagging everything on the way as changed near that cell.
  */
-int qlifealgo::setcell(int x, int y, int newstate) {
-   if (newstate & ~1)
-      return -1 ;
-   y = - y ;
+tile *qlifealgo::marktile(int x, int y, int odd) {
    supertile *b ;
-   tile *p ;
    int lev ;
-   int odd = generation.odd() ;
-   if (odd) {
-      x-- ;
-      y-- ;
-   }
-   while (x < min || x > max || y < min || y > max)
-      uproot() ;
    int xdel = (x >> 5) - minlow32 ;
    int ydel = (y >> 5) - minlow32 ;
    int xc = x - (minlow32 << 5) ;
@@ -759,9 +1155,106 @@ int qlifealgo::setcell(int x, int y, int newstate) {
       lev -= 1 ;
       b = b->d[i] ;
    }
+   return (tile *)b ;
+}
+/*
+ *   Set a row a tile at a time.  The flags marktile sets depend only
+ *   on whether a cell is in the first or last two columns of its tile,
+ *   so marking the first and last cell we set in each tile covers all
+ *   the ones between; the bits themselves go straight into the bricks.
+ */
+int qlifealgo::setrow(int x, int y, const int *runs, int nruns) {
+   int lo = 0, hi = -1, cx = 0 ;
+   for (int i=0; i<nruns; i++) {
+      if (runs[2*i+1] & ~1)
+         return -1 ;
+      if (runs[2*i+1] && runs[2*i] > 0) {
+         if (hi < lo)
+            lo = cx ;
+         hi = cx + runs[2*i] - 1 ;
+      }
+      cx += runs[2*i] ;
+   }
+   if (hi < lo)
+      return 0 ;
+   y = - y ;
+   int odd = generation.odd() ;
+   if (odd) {
+      x-- ;
+      y-- ;
+   }
+   while (x + lo < min || x + hi > max || y < min || y > max)
+      uproot() ;
+   int yy = y & 31 ;
+   int bi = (yy >> 3) & 0x3 ;
+   int rowshift = 31 - (yy & 7) * 4 ;
+   tile *p = 0 ;
+   unsigned int *d = 0 ;
+   int first = 0, last = 0, mor = 0 ;
+   for (int i=0; i<nruns; i++, runs += 2) {
+      int a = x, b = x + runs[0] - 1 ;
+      x += runs[0] ;
+      if (runs[1] == 0)
+         continue ;
+      while (a <= b) {
+         if (p == 0 || (a >> 5) != (last >> 5)) {
+            if (p != 0) {
+               if (last != first)
+                  marktile(last, y, odd) ;
+               p->c[bi + 1] |= mor ;
+               if (odd ? (yy & 6) == 6 : (yy & 6) == 0)
+                  p->c[odd ? bi + 2 : bi] |= mor ;
+            }
+            p = marktile(a, y, odd) ;
+            p->flags = -1 ;
+            if (p->b[bi] == emptybrick)
+               p->b[bi] = newbrick() ;
+            d = p->b[bi]->d + (odd ? 8 : 0) ;
+            first = a ;
+            mor = 0 ;
+         }
+         int e = (b < (a | 31)) ? b : (a | 31) ;
+         for (int c=a&31; c<=(e&31); c++) {
+            unsigned int bit = 1 << (rowshift - (c & 3)) ;
+            d[(c >> 2) & 0x7] |= bit ;
+            p->localdeltaforward |= bit ;
+            if (odd)
+               mor |= ((c & 2) ? 3 : 1) << ((c >> 2) & 0x7) ;
+            else
+               mor |= ((c & 2) ? 1 : 3) << (7 - ((c >> 2) & 0x7)) ;
+         }
+         last = e ;
+         a = e + 1 ;
+      }
+   }
+   if (last != first)
+      marktile(last, y, odd) ;
+   p->c[bi + 1] |= mor ;
+   if (odd ? (yy & 6) == 6 : (yy & 6) == 0)
+      p->c[odd ? bi + 2 : bi] |= mor ;
+   return 0 ;
+}
+/*
+ *   This subroutine sets a bit at a particular location.
+ *
+ *   We walk down the tree to the particular bit, setting changing flags as
+ *   we go.
+ */
+int qlifealgo::setcell(int x, int y, int newstate) {
+   if (newstate & ~1)
+      return -1 ;
+   y = - y ;
+   tile *p ;
+   int odd = generation.odd() ;
+   if (odd) {
+      x-- ;
+      y-- ;
+   }
+   while (x < min || x > max || y < min || y > max)
+      uproot() ;
+   p = marktile(x, y, odd) ;
    x &= 31 ;
    y &= 31 ;
-   p = (tile *)b ;
    if (p->b[(y >> 3) & 0x3] == emptybrick)
       p->b[(y >> 3) & 0x3] = newbrick() ;
    if (odd) {
@@ -1153,6 +1646,9 @@ void qlifealgo::step() {
       } else {
          ruletable = qliferules.rule0 ;
       }
+#ifndef NOBRICKKERNEL
+      brickuse = (ruletable == qliferules.rule1) ;
+#endif
       dogen() ;
       if (poller->isInterrupted())
          break ;
@@ -1204,6 +1700,12 @@ const char *qlifealgo::setrule(const char *s) {
    
    // ruletable is set in step(), but play safe
    ruletable = qliferules.rule0 ;
+#ifndef NOBRICKKERNEL
+   bricknbrs[0] = liferules::countingRule(qliferules.rule0, brickrule[0]) ;
+   bricknbrs[1] = qliferules.alternate_rules ?
+              liferules::countingRule(qliferules.rule1, brickrule[1]) : -1 ;
+   brickuse = 0 ;
+#endif
    
    if (qliferules.isHexagonal())
       grid_type = HEX_GRID;
@@ -8,6 +8,7 @@
 #define QLIFEALGO_H
 #include "lifealgo.h"
 #include "liferules.h"
+#include "util.h"
 #include <vector>
 /*
  *   The smallest unit of the universe is the `slice', which is a
@@ -153,6 +154,7 @@ struct supertile { /* 44 bytes */
 struct linkedmem {
    struct linkedmem *next ;
 } ;
+struct qparallel ;
 /*
  *   This structure contains all of our variables that pertain to a
  *   particular universe.  (Thus, we support multiple universes.)
@@ -193,6 +195,7 @@ public:
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &v) ;
+   virtual int setrow(int x, int y, const int *runs, int nruns) ;
    // call after setcell calls
    virtual void endofpattern() {
      poller->bailIfCalculating() ;
@@ -207,6 +210,7 @@ public:
    virtual int hyperCapable() { return 0 ; }
    virtual void setMaxMemory(int m) ;
    virtual int getMaxMemory() { return (int)(maxmemory >> 20) ; }
+   virtual void setNumThreads(int n) ;
    virtual const char *setrule(const char *s) ;
    virtual const char *getrule() { return qliferules.getrule() ; }
    virtual void step() ;
@@ -226,10 +230,14 @@ private:
    tile *newtile() ;
    supertile *newsupertile(int lev) ;
    void uproot() ;
+   tile *marktile(int x, int y, int odd) ;
    int doquad01(supertile *zis, supertile *edge,
                 supertile *par, supertile *cor, int lev) ;
    int doquad10(supertile *zis, supertile *edge,
                 supertile *par, supertile *cor, int lev) ;
+   int parworth(supertile *zis, int changing, int lev, int odd) ;
+   int pardoquad(supertile *zis, supertile *edge, supertile *par,
+                 supertile *cor, int lev, int odd) ;
    int p01(tile *p, tile *pr, tile *pd, tile *prd) ;
    int p10(tile *plu, tile *pu, tile *pl, tile *p) ;
    G_INT64 find_set_bits(supertile *p, int lev, int gm1) ;
@@ -265,6 +273,19 @@ private:
    int cleandowncounter ;
    g_uintptr_t maxmemory, usedmemory ;
    char *ruletable ;
+#ifndef NOBRICKKERNEL
+/*
+ *   The brick kernel recomputes all eight slices of a brick at once
+ *   with bit-sliced adders when the rule just counts neighbors.  For
+ *   rule0 and rule1, bricknbrs[] is the neighbor subset (rule3x3 bit
+ *   order, or -1 if the rule does more than count) and brickrule[][c]
+ *   has bit k set if k neighbors give a live cell when the center is c;
+ *   brickuse selects the pair that goes with ruletable.
+ */
+   int bricknbrs[2] ;
+   int brickrule[2][2] ;
+   int brickuse ;
+#endif
    // when drawing, these are used
    liferender *renderer ;
    viewport *view ;
@@ -275,5 +296,17 @@ private:
    int llbits, llsize ;
    char *llxb, *llyb ;
    liferules qliferules ;
+/*
+ *   Parallel stepping.  With more than one thread, the first supertile
+ *   on the way down with enough changing below it is stepped as an 8x8
+ *   grid of its grandchildren, a diagonal wave at a time; see
+ *   pardoquad().  The parallel flag is set only
+ *   while the workers are running.
+ */
+   lifethreads *threads ;
+   qparallel *pctx ;
+   int parallel ;
+   static void waithook(void *arg) ;
+   friend struct qquadtask ;
 } ;
 #endif
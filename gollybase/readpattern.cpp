@@ -15,6 +15,15 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+#ifndef WIN32
+// big uncompressed RLE and macrocell files are parsed from a memory mapping
+#define MAPPATTERN
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define LINESIZE 20000
 #define CR 13
@@ -37,6 +46,8 @@ FILE *pattfile ;
 
 char filebuff[BUFFSIZE];
 int buffpos, bytesread, prevchar;
+long buffstart;             // offset in file of filebuff[0]
+const char *mappath;        // file mappattern may map, if not compressed
 
 long filesize;              // length of file in bytes
 
@@ -45,6 +56,7 @@ long filesize;              // length of file in bytes
 int mgetchar() {
    if (buffpos == BUFFSIZE) {
       double filepos;
+      buffstart += bytesread;
       #ifdef ZLIB
          bytesread = gzread(zinstream, filebuff, BUFFSIZE);
          filepos = gzoffset(zinstream);
@@ -92,6 +104,83 @@ char *getline(char *line, int maxlinelen) {
    return line;
 }
 
+#ifdef MAPPATTERN
+void *mapbase ;             // the mapping made by mappattern
+size_t mapsize ;
+#endif
+
+const char *mappattern(const char **rest, const char **end, long minsize) {
+#ifdef MAPPATTERN
+#ifdef ZLIB
+   if (!gzdirect(zinstream))
+      return 0 ;
+#endif
+   if (mappath == 0)
+      return 0 ;
+   long offset = buffstart + buffpos ;
+   int fd = open(mappath, O_RDONLY) ;
+   if (fd < 0)
+      return 0 ;
+   struct stat st ;
+   if (fstat(fd, &st) != 0 || st.st_size - offset < minsize) {
+      close(fd) ;
+      return 0 ;
+   }
+   size_t size = (size_t)st.st_size ;
+   void *m = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0) ;
+   close(fd) ;
+   if (m == MAP_FAILED)
+      return 0 ;
+#ifdef MADV_SEQUENTIAL
+   madvise(m, size, MADV_SEQUENTIAL) ;
+#endif
+   mapbase = m ;
+   mapsize = size ;
+   const char *data = (const char *)m ;
+   *rest = data + offset ;
+   *end = data + size ;
+   return data ;
+#else
+   return 0 ;
+#endif
+}
+
+void releasepattern(const char *upto) {
+#if defined(MAPPATTERN) && defined(MADV_DONTNEED)
+   size_t done = (size_t)(upto - (const char *)mapbase) ;
+   madvise(mapbase, done & ~(size_t)(getpagesize() - 1), MADV_DONTNEED) ;
+#endif
+}
+
+void unmappattern() {
+#ifdef MAPPATTERN
+   munmap(mapbase, mapsize) ;
+   mapbase = 0 ;
+#endif
+}
+
+size_t getbytes(char *buf, size_t n) {
+   size_t got = 0 ;
+   if (buffpos < bytesread) {
+      got = (size_t)(bytesread - buffpos) ;
+      if (got > n) got = n ;
+      memcpy(buf, filebuff + buffpos, got) ;
+      buffpos += (int)got ;
+   }
+   while (got < n) {
+      size_t want = n - got ;
+      if (want > (1 << 30)) want = 1 << 30 ;
+      #ifdef ZLIB
+         int r = gzread(zinstream, buf + got, (unsigned int)want) ;
+      #else
+         int r = (int)fread(buf + got, 1, want, pattfile) ;
+      #endif
+      if (r <= 0) break ;
+      got += r ;
+   }
+   return got ;
+}
+
 const char *SETCELLERROR = "Impossible; set cell error for state 1" ;
 
 // Read a text pattern like "...ooo$$$ooo" where '.', ',' and chars <= ' '
@@ -160,6 +249,252 @@ void ParseXRLELine(char *line, int *xoff, int *yoff, bool *sawpos, bigint &gen)
    }
 }
 
+#ifdef MAPPATTERN
+/*
+ *   The body of a big RLE file is parsed straight out of a memory
+ *   mapping instead of a character at a time through mgetchar, and
+ *   cells go in a row at a time through setrow.  We work through the
+ *   file a window at a time; each window is cut into chunks just after
+ *   '$' tokens, so every chunk but the first starts at x = 0 and only
+ *   its starting row is unknown.  The chunks are parsed on as many
+ *   threads as the algorithm calculates with into rows of runs with
+ *   rows numbered from the chunk start, and then added in file order.
+ */
+const long MINFASTRLE = 1 << 20 ;   // smaller bodies aren't worth mapping
+const long RLECHUNK = 1 << 22 ;     // bytes per parse task
+
+struct rlerow {
+   int y, x ;           // y is relative to the chunk start
+   int first, nruns ;   // pairs of (length, state) in rlechunk::runs
+} ;
+
+class rlechunk : public lifetask {
+public:
+   virtual void run() ;
+   const char *start, *end ;
+   int x, y ;                 // x at the start; both at the end
+   std::vector<rlerow> rows ;
+   std::vector<int> runs ;
+   const char *err ;
+   bool done ;                // saw the '!'
+} ;
+
+// the same grammar as the line by line loop in readrle
+void rlechunk::run() {
+   int n = 0, rowend = 0 ;
+   y = 0 ;
+   err = 0 ;
+   done = false ;
+   rows.clear() ;
+   runs.clear() ;
+   for (const char *p=start; p<end; p++) {
+      char c = *p ;
+      if ('0' <= c && c <= '9') {
+         if (c == '0' && n == 0) {
+            err = "Leading zero in count" ;
+            return ;
+         }
+         n = n * 10 + c - '0' ;
+         continue ;
+      }
+      if (c == ' ' || c == '\t' || c == CR || c == LF) {
+         if (n != 0) {
+            err = "Illegal whitespace after count" ;
+            return ;
+         }
+         continue ;
+      }
+      if (n == 0)
+         n = 1 ;
+      if (c == 'b' || c == '.') {
+         x += n ;
+      } else if (c == '$') {
+         x = 0 ;
+         y += n ;
+      } else if (c == '!') {
+         done = true ;
+         return ;
+      } else if (('o' <= c && c <= 'y') || ('A' <= c && c <= 'X')) {
+         int state ;
+         if (c == 'o') {
+            state = 1 ;
+         } else if (c < 'o') {
+            state = c - 'A' + 1 ;
+         } else {
+            state = 24 * (c - 'p' + 1) ;
+            if (p + 1 < end && 'A' <= p[1] && p[1] <= 'X')
+               state += *++p - 'A' + 1 ;
+            else
+               state = 1 ;
+         }
+         if (!rows.empty() && rows.back().y == y && x == rowend &&
+             runs.back() == state) {
+            // extend the last run rather than start another like it
+            runs[runs.size() - 2] += n ;
+         } else {
+            if (rows.empty() || rows.back().y != y) {
+               rlerow r ;
+               r.y = y ;
+               r.x = x ;
+               r.first = (int)(runs.size() >> 1) ;
+               r.nruns = 0 ;
+               rows.push_back(r) ;
+            } else if (x > rowend) {
+               // the gap since the last run becomes a run of state 0
+               runs.push_back(x - rowend) ;
+               runs.push_back(0) ;
+               rows.back().nruns++ ;
+            }
+            runs.push_back(n) ;
+            runs.push_back(state) ;
+            rows.back().nruns++ ;
+         }
+         x += n ;
+         rowend = x ;
+      }
+      n = 0 ;
+   }
+   if (n != 0)
+      err = "Illegal whitespace after count" ;
+}
+
+/*
+ *   Find where to cut [p, end):  just after the first '$' at or past
+ *   p, or end if there isn't one.
+ */
+static const char *rlecut(const char *p, const char *end) {
+   if (p >= end)
+      return end ;
+   const char *d = (const char *)memchr(p, '$', end - p) ;
+   return d ? d + 1 : end ;
+}
+
+/*
+ *   Lines starting with '#' or a header 'x' can change the rule; if
+ *   the body has any before its '!' we leave it to the line by line
+ *   loop.
+ */
+static bool plainbody(const char *p, const char *end) {
+   const char *bang = (const char *)memchr(p, '!', end - p) ;
+   if (bang)
+      end = bang ;
+   while (p < end) {
+      const char *eol = (const char *)memchr(p, LF, end - p) ;
+      const char *cr = (const char *)memchr(p, CR, (eol ? eol : end) - p) ;
+      if (cr)
+         eol = cr ;
+      if (eol == 0)
+         return true ;
+      p = eol + 1 ;
+      while (p < end && (*p == ' ' || *p == '\t'))
+         p++ ;
+      if (p < end && (*p == '#' ||
+                      (*p == 'x' && (p + 1 == end || p[1] <= ' ' || p[1] == '='))))
+         return false ;
+   }
+   return true ;
+}
+
+/*
+ *   Read the rest of an RLE body from the mapped file, starting at
+ *   (x, y) relative to (xoff, yoff) just after the line readrle has
+ *   parsed.  Sets finished to false, and does nothing, if the file
+ *   can't or needn't be mapped.
+ */
+static const char *readrlebody(lifealgo &imp, int xoff, int yoff,
+                               int x, int y, bool &finished) {
+   finished = false ;
+   const char *p, *end ;
+   const char *data = mappattern(&p, &end, MINFASTRLE) ;
+   if (data == 0)
+      return 0 ;
+   size_t size = end - data ;
+   if (!plainbody(p, end)) {
+      unmappattern() ;
+      return 0 ;
+   }
+   finished = true ;
+   // plainbody paged in the whole file; the page cache still has it
+   releasepattern(end) ;
+   int nthreads = imp.getNumThreads() ;
+   lifethreads *threads = nthreads > 1 ? new lifethreads(nthreads) : 0 ;
+   int nchunks = 2 * nthreads ;
+   std::vector<rlechunk> chunks(nchunks) ;
+   std::vector<lifetask *> tasks(nchunks) ;
+   int gwd = (int)imp.gridwd ;
+   int ght = (int)imp.gridht ;
+   std::vector<int> clipped ;
+   const char *errmsg = 0 ;
+   bool stop = false ;
+   while (p < end && !stop) {
+      if (lifeabortprogress((double)(p - data) / size, ""))
+         break ;
+      int ntasks = 0 ;
+      while (ntasks < nchunks && p < end) {
+         rlechunk &c = chunks[ntasks] ;
+         c.start = p ;
+         c.end = p = rlecut(end - p > RLECHUNK ? p + RLECHUNK - 1 : end, end) ;
+         c.x = (ntasks == 0 ? x : 0) ;
+         c.level = 0 ;
+         tasks[ntasks++] = &c ;
+      }
+      if (threads)
+         threads->runbatch(&tasks[0], ntasks) ;
+      else
+         for (int i=0; i<ntasks; i++)
+            tasks[i]->run() ;
+      for (int i=0; i<ntasks && !stop; i++) {
+         rlechunk &c = chunks[i] ;
+         for (size_t j=0; j<c.rows.size(); j++) {
+            rlerow &r = c.rows[j] ;
+            int ry = y + r.y ;
+            if (ght != 0 && ry >= ght)
+               continue ;
+            const int *runs = &c.runs[2 * r.first] ;
+            int nruns = r.nruns ;
+            if (gwd != 0) {
+               // keep the cells within the bounded grid
+               clipped.clear() ;
+               int rx = r.x ;
+               for (int k=0; k<nruns && rx < gwd; k++) {
+                  int len = runs[2 * k] ;
+                  if (rx + len > gwd)
+                     len = gwd - rx ;
+                  clipped.push_back(len) ;
+                  clipped.push_back(runs[2 * k + 1]) ;
+                  rx += len ;
+               }
+               if (clipped.empty())
+                  continue ;
+               runs = &clipped[0] ;
+               nruns = (int)(clipped.size() >> 1) ;
+            }
+            if (imp.setrow(xoff + r.x, yoff + ry, runs, nruns) < 0) {
+               errmsg = "Cell state out of range for this algorithm" ;
+               stop = true ;
+               break ;
+            }
+         }
+         if (stop)
+            break ;
+         if (c.err) {
+            errmsg = c.err ;
+            stop = true ;
+         } else if (c.done) {
+            stop = true ;
+         }
+         y += c.y ;
+         x = c.x ;
+      }
+      // we won't look at this window again
+      releasepattern(p) ;
+   }
+   delete threads ;
+   unmappattern() ;
+   return errmsg ;
+}
+#endif
+
 /*
  *   Read an RLE pattern into given life algorithm implementation.
  */
@@ -313,13 +648,12 @@ const char *readrle(lifealgo &imp, char *line, size_t nwsindex) {
                      }
                      // write run of cells to grid checking cells are within any bounded grid
                      if (ght == 0 || y < ght) {
-                        while (n-- > 0) {
-                           if (gwd == 0 || x < gwd) {
-                              if (imp.setcell(xoff + x, yoff + y, state) < 0)
-                                 return "Cell state out of range for this algorithm";
-                           }
-                           x++;
-                        }
+                        int run[2];
+                        run[0] = (gwd == 0 || x + n <= gwd) ? n : (x < gwd ? gwd - x : 0);
+                        run[1] = state;
+                        if (run[0] > 0 && imp.setrow(xoff + x, yoff + y, run, 1) < 0)
+                           return "Cell state out of range for this algorithm";
+                        x += n;
                      }
                   }
                   n = 0;
@@ -331,6 +665,15 @@ const char *readrle(lifealgo &imp, char *line, size_t nwsindex) {
          if (n > 0) {
             return "Illegal whitespace after count";
          }
+#ifdef MAPPATTERN
+         if (mappath) {
+            // parse the rest of a big file in bulk
+            bool finished;
+            errmsg = readrlebody(imp, xoff, yoff, x, y, finished);
+            if (finished) return errmsg;
+            mappath = 0;
+         }
+#endif
       }
 
       line = buffer;   // reset line to the start of the buffer
@@ -854,7 +1197,10 @@ const char *readpattern(const char *filename, lifealgo &imp) {
 #endif
    buffpos = BUFFSIZE;                       // for 1st getchar call
    prevchar = 0;                             // for 1st getline call
+   buffstart = bytesread = 0;
+   mappath = filename;
    const char *errmsg = loadpattern(filename, imp) ;
+   mappath = 0;
 #ifdef ZLIB
    gzclose(zinstream) ;
 #else
@@ -883,7 +1229,10 @@ const char *readclipboard(const char *filename, lifealgo &imp,
    bottom = 0;
    right = 0;
    getedges = true;
+   buffstart = bytesread = 0;
+   mappath = filename;
    const char *errmsg = loadpattern(filename, imp);
+   mappath = 0;
    getedges = false;
    *t = top;
    *l = left;
@@ -4,6 +4,7 @@
 #ifndef READPATTERN_H
 #define READPATTERN_H
 #include "bigint.h"
+#include <cstddef>
 class lifealgo ;
 
 // allocate a 1MB buffer for storing comment data (big enough
@@ -20,6 +21,27 @@ const char *readpattern(const char *filename, lifealgo &imp) ;
  */
 char *getline(char *line, int maxlinelen) ;
 
+/*
+ *   Map the current pattern file into memory so a reader can parse the
+ *   rest of it in bulk.  Returns the start of the mapping, or NULL if
+ *   the file is compressed or fewer than minsize bytes are left; *rest
+ *   is set to just after the last line getline returned and *end to
+ *   the end of the file.  Once the rest has been read from the mapping
+ *   getline mustn't be called again.  releasepattern lets the system
+ *   drop the pages before upto, and unmappattern removes the mapping.
+ */
+const char *mappattern(const char **rest, const char **end, long minsize) ;
+void releasepattern(const char *upto) ;
+void unmappattern() ;
+
+/*
+ *   Read up to n bytes of the current pattern file following the last
+ *   line getline returned, for binary readers that can't map the file
+ *   (say because it is compressed).  Returns how many were read; as
+ *   with mappattern, don't call getline afterwards.
+ */
+size_t getbytes(char *buf, size_t n) ;
+
 /*
  *   Similar to readpattern but we return the pattern edges
  *   (not necessarily the minimal bounding box; eg. if an
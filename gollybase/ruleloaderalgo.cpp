@@ -5,6 +5,9 @@
 #include "util.h"       // for lifegetuserrules, lifegetrulesdir, lifegettempdir, lifefatal
 #include <string.h>     // for strcmp, strchr
 #include <string>       // for std::string
+#include <vector>
+#include <map>
+#include <stdlib.h>     // for malloc, free
 
 const int MAX_LINE_LEN = 4096;
 const char* noTABLEorTREE = "No @TABLE or @TREE section found in .rule file.";
@@ -68,10 +71,283 @@ void ruleloaderalgo::SetAlgoVariables(RuleTypes ruletype)
         vshift = LocalRuleTree->vshift;
     }
     
+    CompileRule();
+
     // need to clear cache
     ghashbase::setrule("not used");
 }
 
+/*
+ *   Both kinds of rule are compiled into the same decision diagram.
+ *   Level i of the diagram looks at neighbor ddorder[i]; a node is an
+ *   array of num_states entries indexed by that neighbor's state, holding
+ *   the offset of a node one level down (or, at the last level, the new
+ *   state).  Identical nodes are shared, so a table becomes about as
+ *   small as the equivalent tree, and slowcalc is a chain of ddvars
+ *   loads instead of a scan over all the transitions.
+ *
+ *   Nodes are laid out breadth first from the root, so the top levels
+ *   (which every lookup goes through) are contiguous, and siblings sit
+ *   next to each other.
+ */
+const size_t MAXDDENTRIES = 1 << 22;    // give up beyond 16MB or so
+
+class ddbuilder {
+public:
+    ddbuilder(int vars, int states)
+        : nvars(vars), nstates(states), entries(0), nodes(vars), unique(vars) {}
+
+    // return the id of the node at given level with these children
+    int node(int level, const std::vector<int>& kids) {
+        std::map<std::vector<int>, int>::iterator it = unique[level].find(kids);
+        if (it != unique[level].end()) return it->second;
+        int id = (int)nodes[level].size();
+        nodes[level].push_back(kids);
+        unique[level][kids] = id;
+        entries += nstates;
+        return id;
+    }
+
+    bool toobig() { return entries > MAXDDENTRIES; }
+
+    // lay out the diagram under the given root; false if out of memory
+    bool layout(int root, int*& dd, state*& ddleaf) {
+        std::vector< std::vector<int> > order(nvars);
+        std::vector< std::vector<int> > offset(nvars);
+        order[0].push_back(root);
+        for (int level = 0; level < nvars; level++)
+            offset[level].assign(nodes[level].size(), -1);
+        offset[0][root] = 0;
+        int next = nstates;
+        for (int level = 0; level + 1 < nvars; level++) {
+            if (level + 2 == nvars) next = 0;   // children are in ddleaf
+            for (size_t i = 0; i < order[level].size(); i++) {
+                const std::vector<int>& kids = nodes[level][order[level][i]];
+                for (int s = 0; s < nstates; s++) {
+                    if (offset[level+1][kids[s]] < 0) {
+                        offset[level+1][kids[s]] = next;
+                        next += nstates;
+                        order[level+1].push_back(kids[s]);
+                    }
+                }
+            }
+        }
+        size_t ninner = 0;
+        for (int level = 0; level + 1 < nvars; level++)
+            ninner += order[level].size() * nstates;
+        dd = (int*)malloc(ninner * sizeof(int));
+        ddleaf = (state*)malloc(order[nvars-1].size() * nstates);
+        if (dd == 0 || ddleaf == 0) {
+            free(dd);
+            free(ddleaf);
+            dd = 0;
+            ddleaf = 0;
+            return false;
+        }
+        for (int level = 0; level < nvars; level++) {
+            for (size_t i = 0; i < order[level].size(); i++) {
+                int id = order[level][i];
+                const std::vector<int>& kids = nodes[level][id];
+                int off = offset[level][id];
+                for (int s = 0; s < nstates; s++) {
+                    if (level + 1 == nvars)
+                        ddleaf[off + s] = (state)kids[s];
+                    else
+                        dd[off + s] = offset[level+1][kids[s]];
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    int nvars, nstates;
+    size_t entries;
+    std::vector< std::vector< std::vector<int> > > nodes;
+    std::vector< std::map< std::vector<int>, int > > unique;
+};
+
+/*
+ *   A table is compiled by following the set of transitions that can
+ *   still match, one neighbor at a time, starting with the center cell.
+ *   Once some transition matches whatever the remaining neighbors are,
+ *   the ones after it can never be chosen and are dropped, which keeps
+ *   the number of distinct sets (and so the compile time) small.
+ */
+typedef unsigned long long TBits;
+
+class tablecompiler {
+public:
+    tablecompiler(const std::vector< std::vector< std::vector<TBits> > >& lut,
+                  const std::vector<state>& output, int nvars, int nstates)
+        : lut(lut), output(output), nvars(nvars), nstates(nstates),
+          nwords(lut[0][0].size()), builder(nvars, nstates),
+          constid(nvars, std::vector<int>(nstates, -1)), memo(nvars),
+          catchall(nvars + 1, std::vector<TBits>(lut[0][0].size(), ~(TBits)0)) {
+        for (int level = nvars - 1; level >= 0; level--) {
+            catchall[level] = catchall[level+1];
+            for (int s = 0; s < nstates; s++)
+                for (size_t w = 0; w < nwords; w++)
+                    catchall[level][w] &= lut[level][s][w];
+        }
+    }
+
+    // compile the whole table; returns false if the diagram gets too big
+    bool compile(int*& dd, state*& ddleaf) {
+        std::vector<int> kids(nstates);
+        std::vector<TBits> mask(nwords);
+        for (int c = 0; c < nstates; c++) {
+            for (size_t w = 0; w < nwords; w++)
+                mask[w] = lut[0][c][w];
+            kids[c] = build(1, mask, c);
+            if (builder.toobig()) return false;
+        }
+        return builder.layout(builder.node(0, kids), dd, ddleaf);
+    }
+
+private:
+    // node that yields v whatever the neighbors from this level on are
+    int constant(int level, int v) {
+        if (constid[level][v] < 0) {
+            std::vector<int> kids(nstates, level + 1 == nvars ? v : constant(level + 1, v));
+            constid[level][v] = builder.node(level, kids);
+        }
+        return constid[level][v];
+    }
+
+    // index of first bit set in mask, or -1
+    int firstbit(const std::vector<TBits>& mask) {
+        for (size_t w = 0; w < nwords; w++)
+            if (mask[w]) {
+                TBits m = mask[w];
+                int i = 0;
+                while (!(m & 1)) {
+                    m >>= 1;
+                    i++;
+                }
+                return (int)(w * 64) + i;
+            }
+        return -1;
+    }
+
+    // node for transitions in mask, center state c (c is the result if
+    // none of them match)
+    int build(int level, std::vector<TBits>& mask, int c) {
+        if (builder.toobig()) return 0;
+        int first = firstbit(mask);
+        if (first < 0) return constant(level, c);
+        std::vector<TBits> key(mask);
+        for (size_t w = 0; w < nwords; w++)
+            key[w] &= catchall[level][w];
+        int last = firstbit(key);
+        if (last == first) return constant(level, output[first]);
+        key = mask;
+        if (last >= 0) {
+            // transitions after last are unreachable, and so is c
+            size_t w = last / 64;
+            key[w] &= ~(TBits)0 >> (63 - last % 64);
+            while (++w < nwords) key[w] = 0;
+            key.push_back(0);
+        } else {
+            key.push_back((TBits)c + 1);
+        }
+        std::map<std::vector<TBits>, int>::iterator it = memo[level].find(key);
+        if (it != memo[level].end()) return it->second;
+        std::vector<int> kids(nstates);
+        std::vector<TBits> sub(nwords);
+        for (int s = 0; s < nstates; s++) {
+            for (size_t w = 0; w < nwords; w++)
+                sub[w] = key[w] & lut[level][s][w];
+            if (level + 1 == nvars) {
+                int match = firstbit(sub);
+                kids[s] = match < 0 ? c : output[match];
+            } else {
+                kids[s] = build(level + 1, sub, c);
+            }
+        }
+        int id = builder.node(level, kids);
+        memo[level][key] = id;
+        return id;
+    }
+
+    const std::vector< std::vector< std::vector<TBits> > >& lut;
+    const std::vector<state>& output;
+    int nvars, nstates;
+    size_t nwords;
+    ddbuilder builder;
+    std::vector< std::vector<int> > constid;
+    std::vector< std::map<std::vector<TBits>, int> > memo;
+    std::vector< std::vector<TBits> > catchall;   // transitions that match
+                                                  // any state from level on
+};
+
+// walk a RuleTree's diagram, sharing nodes reached by different paths
+static int compiletree(ddbuilder& builder, std::vector< std::map<int,int> >& memo,
+                       const int* a, const state* b, int level, int nvars,
+                       int nstates, int off)
+{
+    std::map<int,int>::iterator it = memo[level].find(off);
+    if (it != memo[level].end()) return it->second;
+    std::vector<int> kids(nstates);
+    for (int s = 0; s < nstates; s++) {
+        if (level + 1 == nvars)
+            kids[s] = b[off + s];
+        else
+            kids[s] = compiletree(builder, memo, a, b, level + 1, nvars,
+                                  nstates, a[off + s]);
+    }
+    int id = builder.node(level, kids);
+    memo[level][off] = id;
+    return id;
+}
+
+void ruleloaderalgo::FreeCompiledRule()
+{
+    if (dd) free(dd);
+    if (ddleaf) free(ddleaf);
+    dd = 0;
+    ddleaf = 0;
+}
+
+void ruleloaderalgo::CompileRule()
+{
+    // neighbors are numbered as in slowcalc's argument list:
+    // nw=0, n=1, ne=2, w=3, c=4, e=5, sw=6, s=7, se=8
+    static const int tableorder[4][9] = {
+        {4,1,5,7,3},                    // vonNeumann: c,n,e,s,w
+        {4,1,2,5,8,7,6,3,0},            // Moore: c,n,ne,e,se,s,sw,w,nw
+        {4,1,5,8,7,3,0},                // hexagonal: c,n,e,se,s,w,nw
+        {4,3,5}                         // oneDimensional: c,w,e
+    };
+    static const int tablevars[4] = {5, 9, 7, 3};
+    static const int treeorder[2][9] = {
+        {1,3,5,7,4},                    // n,w,e,s,c
+        {0,2,6,8,1,3,5,7,4}             // nw,ne,sw,se,n,w,e,s,c
+    };
+    
+    FreeCompiledRule();
+    if (rule_type == TABLE) {
+        ruletable_algo* t = LocalRuleTable;
+        if (t->n_compressed_rules == 0) return;
+        ddvars = tablevars[t->neighborhood];
+        ddstates = t->n_states;
+        for (int i = 0; i < ddvars; i++) ddorder[i] = tableorder[t->neighborhood][i];
+        tablecompiler tc(t->lut, t->output, ddvars, t->n_states);
+        if (!tc.compile(dd, ddleaf)) FreeCompiledRule();
+    } else {
+        ruletreealgo* t = LocalRuleTree;
+        ddvars = t->num_neighbors + 1;
+        ddstates = t->num_states;
+        for (int i = 0; i < ddvars; i++)
+            ddorder[i] = treeorder[t->num_neighbors == 8][i];
+        ddbuilder builder(ddvars, t->num_states);
+        std::vector< std::map<int,int> > memo(ddvars);
+        int root = compiletree(builder, memo, t->a, t->b, 0, ddvars,
+                               t->num_states, t->base);
+        if (!builder.layout(root, dd, ddleaf)) FreeCompiledRule();
+    }
+}
+
 const char* ruleloaderalgo::LoadTableOrTree(FILE* rulefile, const char* rule, size_t offset)
 {
     const char *err;
@@ -229,6 +505,10 @@ const char* ruleloaderalgo::DefaultRule() {
 
 ruleloaderalgo::ruleloaderalgo()
 {
+    dd = 0;
+    ddleaf = 0;
+    ddvars = 0;
+    ddstates = 0;
     LocalRuleTable = new ruletable_algo();
     LocalRuleTree = new ruletreealgo();
 
@@ -243,6 +523,8 @@ ruleloaderalgo::ruleloaderalgo()
 
 ruleloaderalgo::~ruleloaderalgo()
 {
+    spillallpinned();
+    FreeCompiledRule();
     delete LocalRuleTable;
     delete LocalRuleTree;
 }
@@ -250,12 +532,55 @@ ruleloaderalgo::~ruleloaderalgo()
 state ruleloaderalgo::slowcalc(state nw, state n, state ne, state w, state c,
                                state e, state sw, state s, state se) 
 {
+    if (dd) {
+        state v[9] = {nw, n, ne, w, c, e, sw, s, se};
+        int x = 0;
+        for (int i = 0; i < ddvars - 1; i++)
+            x = dd[x + v[ddorder[i]]];
+        return ddleaf[x + v[ddorder[ddvars - 1]]];
+    }
     if (rule_type == TABLE)
         return LocalRuleTable->slowcalc(nw, n, ne, w, c, e, sw, s, se);
     else // rule_type == TREE
         return LocalRuleTree->slowcalc(nw, n, ne, w, c, e, sw, s, se);
 }
 
+/*
+ *   A whole block at once:  every cell walks the diagram a level at a
+ *   time, in step with the others.  The n*n chains of loads don't depend
+ *   on each other, so their cache misses overlap instead of queuing, and
+ *   there is no per-cell hashing or virtual call.  Blocks holding states
+ *   the rule doesn't have (left over from a rule change) go cell by cell.
+ */
+void ruleloaderalgo::slowcalcblock(const state* in, state* out, int n)
+{
+    int wd = n + 2;
+    state top = 0;
+    for (int i = 0; i < wd * wd; i++)
+        if (in[i] > top) top = in[i];
+    if (dd == 0 || top >= ddstates) {
+        ghashbase::slowcalcblock(in, out, n);
+        return;
+    }
+    int cells = n * n;
+    int at[MAXCALCBLOCK * MAXCALCBLOCK];     // each cell's nw neighbor
+    int x[MAXCALCBLOCK * MAXCALCBLOCK];      // and where it is in dd
+    for (int y = 0, k = 0; y < n; y++) {
+        for (int i = 0; i < n; i++, k++) {
+            at[k] = y * wd + i;
+            x[k] = 0;
+        }
+    }
+    for (int i = 0; i < ddvars - 1; i++) {
+        const state* v = in + ddorder[i] / 3 * wd + ddorder[i] % 3;
+        for (int k = 0; k < cells; k++)
+            x[k] = dd[x[k] + v[at[k]]];
+    }
+    const state* v = in + ddorder[ddvars-1] / 3 * wd + ddorder[ddvars-1] % 3;
+    for (int k = 0; k < cells; k++)
+        out[k] = ddleaf[x[k] + v[at[k]]];
+}
+
 static lifealgo* creator()
 {
     return new ruleloaderalgo();
@@ -19,6 +19,7 @@ public:
     virtual ~ruleloaderalgo();
     virtual state slowcalc(state nw, state n, state ne, state w, state c,
                            state e, state sw, state s, state se);
+    virtual void slowcalcblock(const state* in, state* out, int n);
     virtual const char* setrule(const char* s);
     virtual const char* getrule();
     virtual const char* DefaultRule();
@@ -33,7 +34,17 @@ protected:
 
     enum RuleTypes {TABLE, TREE} rule_type;
     
+    // whichever type was loaded is compiled into a decision diagram
+    // with one level per neighbor (dd is null if it got too big)
+    int* dd;                             // offsets into dd or ddleaf
+    state* ddleaf;                       // new states
+    int ddvars;                          // number of neighbors examined
+    int ddstates;                        // states each node is indexed by
+    int ddorder[9];                      // neighbor examined at each level
+    
     void SetAlgoVariables(RuleTypes ruletype);
+    void CompileRule();
+    void FreeCompiledRule();
     const char* LoadTableOrTree(FILE* rulefile, const char* rule, size_t offset);
 };
 
@@ -671,6 +671,7 @@ ruletable_algo::ruletable_algo()
 
 ruletable_algo::~ruletable_algo()
 {
+   spillallpinned() ;
 }
 
 // --- the update function ---
@@ -30,6 +30,8 @@ public:
 
 protected:
 
+   friend class ruleloaderalgo;         // compiles lut into a decision diagram
+
    std::string LoadRuleTable(std::string filename);
    void PackTransitions(const std::string& symmetries, int n_inputs, 
                         const std::vector< std::pair< std::vector< std::vector<state> >, state> > & transition_table);
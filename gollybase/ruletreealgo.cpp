@@ -210,6 +210,7 @@ ruletreealgo::ruletreealgo() : ghashbase(), a(0), base(0), b(0),
 }
 
 ruletreealgo::~ruletreealgo() {
+   spillallpinned() ;
    if (a != 0) {
       free(a) ;
       a = 0 ;
@@ -24,6 +24,7 @@ public:
    const char* LoadTree(FILE* rulefile, int lineno, char endchar, const char* s);
 
 private:
+   friend class ruleloaderalgo ;        // recompiles the tree
    int *a, base ;
    state *b ;
    int num_neighbors, num_states, num_nodes ;
@@ -1928,6 +1928,7 @@ superalgo::superalgo() {
 }
 
 superalgo::~superalgo() {
+   spillallpinned() ;
 }
 
 // initialize
@@ -4,6 +4,14 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -207,7 +215,7 @@ double hperf::reportInterval = 2 ; // time between reports
 /*
  *   Static buffer for status updates.
  */
-char perfstatusline[200] ;
+char perfstatusline[400] ;
 void hperf::report(hperf &mark, int verbose) {
    double ts = gollySecondCount() ;
    double elapsed = ts - mark.timeStamp ;
@@ -252,9 +260,258 @@ void hperf::reportStep(hperf &mark, hperf &ratemark, double newGen, int verbose)
           "PERF gps %g nps %g fps %g depth %g half %g npg %g nodes %g",
           genspersec, nodeCount/elapsed, fps, 1+depthDelta/nodeCount, halfFrac,
           nodespergen, nodeCount) ;
+      double gcs = gcCount - mark.gcCount ;
+      if (gcs > 0) {
+         double seen = gcSeen - mark.gcSeen ;
+         sprintf(perfstatusline+strlen(perfstatusline),
+             " gc %g minor %g pause %g maxpause %g freed %g MB %g",
+             gcs, gcMinor - mark.gcMinor, (gcTime - mark.gcTime) / gcs,
+             gcMaxPause, seen > 0 ? (gcFreed - mark.gcFreed) / seen : 0,
+             (gcBytes - mark.gcBytes) / (1024.0 * 1024.0)) ;
+      }
+      double lookups = cacheLookups - mark.cacheLookups ;
+      if (lookups > 0)
+         sprintf(perfstatusline+strlen(perfstatusline),
+             " hits %g misses %g evicted %g", lookups - nodeCount, nodeCount,
+             cacheEvictions - mark.cacheEvictions) ;
       lifestatus(perfstatusline) ;
    }
+   gcMaxPause = 0 ;
    genval = newGen ;
    mark = *this ;
    ratemark = *this ;
 }
+/*
+ *   Totals since we were cleared, for verbose output at exit.
+ */
+const char *hperf::summary() {
+   nodesCalculated += fastNodeInc ;
+   fastNodeInc = 0 ;
+   sprintf(perfstatusline, "TOTAL nodes %g", nodesCalculated) ;
+   if (cacheLookups > 0)
+      sprintf(perfstatusline+strlen(perfstatusline),
+          " hits %g misses %g evicted %g", cacheLookups - nodesCalculated,
+          nodesCalculated, cacheEvictions) ;
+   if (gcCount > 0)
+      sprintf(perfstatusline+strlen(perfstatusline),
+          " gc %g minor %g gctime %g freed %g MB %g", gcCount, gcMinor,
+          gcTime, gcSeen > 0 ? gcFreed / gcSeen : 0,
+          gcBytes / (1024.0 * 1024.0)) ;
+   if (memNodes > 0)
+      sprintf(perfstatusline+strlen(perfstatusline),
+          " memory %g MB for %g nodes (%g bytes/node)",
+          memBytes / (1024.0 * 1024.0), memNodes, memBytes / memNodes) ;
+   if (calcLookups > 0)
+      sprintf(perfstatusline+strlen(perfstatusline),
+          " slowcalc hits %g misses %g (%.1f%% hits) table %g KB",
+          calcLookups - calcMisses, calcMisses,
+          100.0 * (calcLookups - calcMisses) / calcLookups,
+          calcBytes / 1024.0) ;
+   return perfstatusline ;
+}
+/*
+ *   The worker thread pool.  Each thread owns a deque protected by its
+ *   own lock; the owner pushes and pops at the back, thieves take from
+ *   the front, so thieves tend to get the biggest pending pieces of work.
+ */
+static thread_local int lifethreadindex = 0 ;
+struct lifebatch {
+   std::atomic<int> pending ;
+} ;
+struct lifequeue {
+   std::mutex lock ;
+   std::deque<lifetask *> tasks ;
+} ;
+struct lifethreadpool {
+   lifethreadpool(int n) : nthreads(n), queues(n), quit(0), queued(0),
+                           waithook(0), waitarg(0) {}
+   void workerloop(int me) ;
+   void push(int me, lifetask *t) ;
+   lifetask *grab(int me, int maxlevel) ;
+   void execute(lifetask *t) ;
+   int nthreads ;
+   std::vector<lifequeue> queues ;
+   std::vector<std::thread> workers ;
+   std::atomic<int> quit ;
+   std::atomic<int> queued ;
+   std::mutex idlelock ;
+   std::condition_variable idlecond ;
+   void (*waithook)(void *) ;
+   void *waitarg ;
+} ;
+void lifethreadpool::push(int me, lifetask *t) {
+   {
+      std::lock_guard<std::mutex> g(queues[me].lock) ;
+      queues[me].tasks.push_back(t) ;
+   }
+   queued++ ;
+}
+lifetask *lifethreadpool::grab(int me, int maxlevel) {
+   if (queued.load(std::memory_order_relaxed) == 0)
+      return 0 ;
+   {
+      lifequeue &q = queues[me] ;
+      std::lock_guard<std::mutex> g(q.lock) ;
+      if (!q.tasks.empty() && q.tasks.back()->level <= maxlevel) {
+         lifetask *t = q.tasks.back() ;
+         q.tasks.pop_back() ;
+         queued-- ;
+         return t ;
+      }
+   }
+   for (int i=1; i<nthreads; i++) {
+      lifequeue &q = queues[(me + i) % nthreads] ;
+      std::lock_guard<std::mutex> g(q.lock) ;
+      if (!q.tasks.empty() && q.tasks.front()->level <= maxlevel) {
+         lifetask *t = q.tasks.front() ;
+         q.tasks.pop_front() ;
+         queued-- ;
+         return t ;
+      }
+   }
+   return 0 ;
+}
+void lifethreadpool::execute(lifetask *t) {
+   lifebatch *b = (lifebatch *)t->batch ;
+   t->run() ;
+   b->pending.fetch_sub(1, std::memory_order_release) ;
+}
+void lifethreadpool::workerloop(int me) {
+   lifethreadindex = me ;
+   while (!quit) {
+      lifetask *t = grab(me, INT_MAX) ;
+      if (t) {
+         execute(t) ;
+      } else {
+         std::unique_lock<std::mutex> g(idlelock) ;
+         idlecond.wait(g, [this]{ return quit || queued > 0 ; }) ;
+      }
+   }
+}
+lifethreads::lifethreads(int n) {
+   if (n < 1)
+      n = 1 ;
+   nthreads = n ;
+   lifethreadpool *p = new lifethreadpool(n) ;
+   impl = p ;
+   for (int i=1; i<n; i++)
+      p->workers.push_back(std::thread(&lifethreadpool::workerloop, p, i)) ;
+}
+lifethreads::~lifethreads() {
+   lifethreadpool *p = (lifethreadpool *)impl ;
+   {
+      std::lock_guard<std::mutex> g(p->idlelock) ;
+      p->quit = 1 ;
+   }
+   p->idlecond.notify_all() ;
+   for (size_t i=0; i<p->workers.size(); i++)
+      p->workers[i].join() ;
+   delete p ;
+}
+void lifethreads::setwaithook(void (*hook)(void *), void *arg) {
+   lifethreadpool *p = (lifethreadpool *)impl ;
+   p->waithook = hook ;
+   p->waitarg = arg ;
+}
+int lifethreads::threadindex() {
+   return lifethreadindex ;
+}
+void lifethreads::runbatch(lifetask **tasks, int ntasks) {
+   lifethreadpool *p = (lifethreadpool *)impl ;
+   int me = lifethreadindex ;
+   int level = INT_MIN ;
+   lifebatch b ;
+   b.pending = ntasks ;
+   for (int i=0; i<ntasks; i++) {
+      tasks[i]->batch = &b ;
+      if (tasks[i]->level > level)
+         level = tasks[i]->level ;
+   }
+   for (int i=ntasks-1; i>0; i--)
+      p->push(me, tasks[i]) ;
+   if (ntasks > 1) {
+      { std::lock_guard<std::mutex> g(p->idlelock) ; }
+      p->idlecond.notify_all() ;
+   }
+   if (ntasks > 0)
+      p->execute(tasks[0]) ;
+   while (b.pending.load(std::memory_order_acquire) > 0) {
+      lifetask *t = p->grab(me, level) ;
+      if (t) {
+         p->execute(t) ;
+      } else {
+         if (p->waithook)
+            (*p->waithook)(p->waitarg) ;
+         std::this_thread::yield() ;
+      }
+   }
+}
+/*
+ *   Node blocks.  With COMPACTNODES the slab numbers are handed out
+ *   from a free list so a long session that creates and destroys many
+ *   universes does not run through them.
+ */
+#ifdef COMPACTNODES
+g_uintptr_t nodeslabs::chunk[NODECHUNKS] ;
+static std::mutex slablock ;
+static std::vector<unsigned int> freeslabs ;
+static unsigned int nextslab = 1 ;
+void *nodeblockalloc(int size) {
+   if (size != NODESLOTSIZE)
+      lifefatal("Bad node size for COMPACTNODES.") ;
+   unsigned int n ;
+   {
+      std::lock_guard<std::mutex> g(slablock) ;
+      if (freeslabs.size() > 0) {
+         n = freeslabs.back() ;
+         freeslabs.pop_back() ;
+      } else if (nextslab < MAXNODESLABS) {
+         n = nextslab++ ;
+      } else {
+         return 0 ;
+      }
+   }
+   void *p = 0 ;
+#ifdef _WIN32
+   p = _aligned_malloc(1 << NODESLABBITS, 1 << NODESLABBITS) ;
+#else
+   if (posix_memalign(&p, 1 << NODESLABBITS, 1 << NODESLABBITS))
+      p = 0 ;
+#endif
+   if (p == 0) {
+      std::lock_guard<std::mutex> g(slablock) ;
+      freeslabs.push_back(n) ;
+      return 0 ;
+   }
+   memset(p, 0, 1 << NODESLABBITS) ;
+   *(unsigned int *)p = n ;
+   g_uintptr_t base = (g_uintptr_t)p + 8 - (g_uintptr_t)n * NODEBLOCK * NODESLOTSIZE ;
+   for (int i=0; i<(NODEBLOCK >> NODECHUNKBITS); i++)
+      nodeslabs::chunk[n * (NODEBLOCK >> NODECHUNKBITS) + i] = base ;
+   return (char *)p + 8 ;
+}
+void nodeblockfree(void *block) {
+   char *p = (char *)block - 8 ;
+   unsigned int n = *(unsigned int *)p ;
+   for (int i=0; i<(NODEBLOCK >> NODECHUNKBITS); i++)
+      nodeslabs::chunk[n * (NODEBLOCK >> NODECHUNKBITS) + i] = 0 ;
+#ifdef _WIN32
+   _aligned_free(p) ;
+#else
+   free(p) ;
+#endif
+   std::lock_guard<std::mutex> g(slablock) ;
+   freeslabs.push_back(n) ;
+}
+int nodeblocksleft() {
+   std::lock_guard<std::mutex> g(slablock) ;
+   return (int)(MAXNODESLABS - nextslab + freeslabs.size()) ;
+}
+#else
+void *nodeblockalloc(int size) {
+   return calloc(NODEBLOCK, size) ;
+}
+void nodeblockfree(void *block) {
+   free(block) ;
+}
+#endif
@@ -7,6 +7,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 #include <cstdio> // for FILE *
+#include "platform.h"
 
 void lifefatal(const char *s) ;
 void lifewarning(const char *s) ;
@@ -84,9 +85,24 @@ struct hperf {
       genval = 0 ;
       frames = 0 ;
       halfNodes = 0 ;
+      gcCount = 0 ;
+      gcMinor = 0 ;
+      gcTime = 0 ;
+      gcMaxPause = 0 ;
+      gcFreed = 0 ;
+      gcSeen = 0 ;
+      gcBytes = 0 ;
+      cacheLookups = 0 ;
+      cacheEvictions = 0 ;
+      memBytes = 0 ;
+      memNodes = 0 ;
+      calcLookups = 0 ;
+      calcMisses = 0 ;
+      calcBytes = 0 ;
    }
    void report(hperf&, int verbose) ;
    void reportStep(hperf&, hperf&, double genval, int verbose) ;
+   const char *summary() ;
    int fastinc(int depth, int half) {
       depthSum += depth ;
       if (half)
@@ -102,6 +118,22 @@ struct hperf {
    void setReportInterval(double v) {
       reportInterval = v ;
    }
+   /*
+    *   Record one garbage collection:  how long the world was stopped,
+    *   how many of the nodes we had it gave back, and their size.
+    */
+   void gcdone(int minor, double pause, double freed, double total,
+               double bytes) {
+      gcCount++ ;
+      if (minor)
+         gcMinor++ ;
+      gcTime += pause ;
+      if (pause > gcMaxPause)
+         gcMaxPause = pause ;
+      gcFreed += freed ;
+      gcSeen += total ;
+      gcBytes += bytes ;
+   }
    int fastNodeInc ;
    double frames ;
    double nodesCalculated ;
@@ -109,7 +141,279 @@ struct hperf {
    double depthSum ;
    double timeStamp ;
    double genval ;
+   double gcCount ;    // collections, and how many of them were minor
+   double gcMinor ;
+   double gcTime ;     // total and longest pause, in seconds
+   double gcMaxPause ;
+   double gcFreed ;    // nodes reclaimed, out of gcSeen allocated
+   double gcSeen ;
+   double gcBytes ;    // memory reclaimed
+   double cacheLookups ;   // hits are lookups less nodesCalculated
+   double cacheEvictions ;
+   double memBytes ;   // memory in use and the nodes it holds, filled
+   double memNodes ;   // in by the algorithm before calling summary()
+   double calcLookups ;    // memoized slowcalc calls (ghashbase only)
+   double calcMisses ;
+   double calcBytes ;      // size of the slowcalc memo table
    static int reportMask ;
    static double reportInterval ;
 } ;
+/*
+ *   Blocks of hash nodes for hlifealgo and ghashbase.  Normally a block
+ *   is just NODEBLOCK nodes from calloc, the first of which links the
+ *   blocks together.  If COMPACTNODES is defined at build time, nodes
+ *   refer to each other with 32-bit compactptrs instead of pointers,
+ *   which takes a node from 48 bytes to 24 on 64-bit machines and so
+ *   about doubles the pattern we can hold in the same memory.  Each
+ *   block is then an aligned 64K slab with its number in a small
+ *   header.  A compactptr holds the node's index, counting every slot
+ *   of every slab in turn (slab*NODEBLOCK + slot), above the low three
+ *   bits of the pointer (which the garbage collectors and the cache
+ *   use as flags), so all 2^29 indices name a real slot.  A slab holds
+ *   a whole number of 128-slot chunks (which leaves 1.5% of it idle),
+ *   and the chunk table keeps, for each chunk, its slab's address less
+ *   the offset of the slab's first index; decoding is then a shift and
+ *   a lookup.  Slab 0 is never used, so a zero compactptr is a null
+ *   pointer.  The slabs are shared by every universe; nodeblocksleft()
+ *   says how many are still to be had.
+ */
+#ifdef COMPACTNODES
+#define NODESLABBITS 16
+#define NODESLOTSIZE 24
+#define NODECHUNKBITS 7
+#define NODEBLOCK ((((1 << NODESLABBITS) - 8) / NODESLOTSIZE) >> NODECHUNKBITS << NODECHUNKBITS)
+#define NODECHUNKS (1 << (29 - NODECHUNKBITS))
+#define MAXNODESLABS (NODECHUNKS / (NODEBLOCK >> NODECHUNKBITS))
+class nodeslabs {
+public:
+   static g_uintptr_t chunk[NODECHUNKS] ;
+   static unsigned int encode(const void *p) {
+      g_uintptr_t v = (g_uintptr_t)p, low = v & 7 ;
+      if ((v -= low) == 0)
+         return (unsigned int)low ;
+      unsigned int *hdr = (unsigned int *)(v & ~(g_uintptr_t)((1 << NODESLABBITS) - 1)) ;
+      return (*hdr * NODEBLOCK + (unsigned int)((v - (g_uintptr_t)hdr - 8) /
+                                                NODESLOTSIZE)) << 3 | (unsigned int)low ;
+   }
+   static void *decode(unsigned int i) {
+      return (void *)(chunk[i >> (3 + NODECHUNKBITS)] +
+                      (g_uintptr_t)(i >> 3) * NODESLOTSIZE + (i & 7)) ;
+   }
+} ;
+int nodeblocksleft() ;
+template <class T> class compactptr {
+public:
+   compactptr() = default ;
+   compactptr(T *p) : i(nodeslabs::encode(p)) {}
+   compactptr &operator=(T *p) { i = nodeslabs::encode(p) ; return *this ; }
+   operator T *() const { return (T *)nodeslabs::decode(i) ; }
+   T *operator->() const { return (T *)nodeslabs::decode(i) ; }
+   explicit operator g_uintptr_t() const {
+      return (g_uintptr_t)nodeslabs::decode(i) ;
+   }
+   explicit operator bool() const { return i != 0 ; }
+   template <class U> explicit operator U *() const {
+      return (U *)nodeslabs::decode(i) ;
+   }
+   unsigned int i ;
+} ;
+#else
+#define NODEBLOCK 1001
+#endif
+void *nodeblockalloc(int size) ;
+void nodeblockfree(void *block) ;
+/*
+ *   If OPENHASH is defined at build time, hlifealgo and ghashbase
+ *   canonicalize nodes in an open-addressing table instead of chaining
+ *   them through their next fields.  It works like a Swiss table:  a
+ *   control byte per slot holds seven bits of the hash (or marks the
+ *   slot empty or deleted), and a lookup compares sixteen control
+ *   bytes at a time, with SSE2 where we have it, before touching any
+ *   node.  The control array repeats its first sixteen bytes at the
+ *   end so a group never wraps.  Deleted slots stay deleted until the
+ *   table is rebuilt, which every full gc and resize does.
+ */
+#ifdef OPENHASH
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OPENHASHSSE2
+#endif
+#define HASHEMPTY 0x80
+#define HASHDELETED 0xfe
+template <class P> class openhashtable {
+public:
+   openhashtable() : ctrl(0), slots(0), size(0), shift(60), deleted(0) {}
+   static g_uintptr_t bytes(g_uintptr_t n) {
+      return n * (sizeof(P) + 1) + 16 ;
+   }
+   // n must be a power of two, at least 16
+   int alloc(g_uintptr_t n) {
+      unsigned char *c = (unsigned char *)malloc(n + 16) ;
+      P *s = (P *)malloc(n * sizeof(P)) ;
+      if (c == 0 || s == 0) {
+         free(c) ;
+         free(s) ;
+         return 0 ;
+      }
+      release() ;
+      ctrl = c ;
+      slots = s ;
+      size = n ;
+      for (shift=64; (1ULL << (64 - shift)) < n; shift--) ;
+      clear() ;
+      return 1 ;
+   }
+   void release() {
+      free(ctrl) ;
+      free(slots) ;
+      ctrl = 0 ;
+      slots = 0 ;
+   }
+   void clear() {
+      memset(ctrl, HASHEMPTY, size + 16) ;
+      deleted = 0 ;
+   }
+   int full(g_uintptr_t i) const { return ctrl[i] < HASHEMPTY ; }
+   void prefetch(g_uintptr_t h) const {
+      unsigned char tag ;
+      g_uintptr_t i = home(h, tag) ;
+      PREFETCH(ctrl + i) ;
+      PREFETCH(slots + i) ;
+   }
+   /*
+    *   Return the slot holding the entry for which match() is true, or
+    *   null.  match() only sees entries whose control byte fits.
+    */
+   template <class F> P *find(g_uintptr_t h, F match) const {
+      unsigned char tag ;
+      g_uintptr_t pos = home(h, tag), step = 0 ;
+      for (;;) {
+         const unsigned char *g = ctrl + pos ;
+         for (unsigned int m = group(g, tag); m; m &= m - 1) {
+            P *s = slots + ((pos + lowbit(m)) & (size - 1)) ;
+            if (match(*s))
+               return s ;
+         }
+         if (group(g, HASHEMPTY))
+            return 0 ;
+         step += 16 ;
+         pos = (pos + step) & (size - 1) ;
+      }
+   }
+   // the entry must not be present already
+   void insert(g_uintptr_t h, P p) {
+      unsigned char tag ;
+      g_uintptr_t pos = home(h, tag), step = 0 ;
+      for (;;) {
+         unsigned int m = freeslots(ctrl + pos) ;
+         if (m) {
+            g_uintptr_t i = (pos + lowbit(m)) & (size - 1) ;
+            if (ctrl[i] == HASHDELETED)
+               deleted-- ;
+            setctrl(i, tag) ;
+            slots[i] = p ;
+            return ;
+         }
+         step += 16 ;
+         pos = (pos + step) & (size - 1) ;
+      }
+   }
+   void erase(P *s) {
+      setctrl(s - slots, HASHDELETED) ;
+      deleted++ ;
+   }
+   unsigned char *ctrl ;
+   P *slots ;
+   g_uintptr_t size ;
+   int shift ;
+   g_uintptr_t deleted ;
+private:
+   /*
+    *   Node hashes are sums of multiples of addresses, so their low bits
+    *   are poor; we take the slot and the tag from the high bits of a
+    *   multiplicative hash instead.
+    */
+   g_uintptr_t home(g_uintptr_t h, unsigned char &tag) const {
+      unsigned long long x = (unsigned long long)h * 0x9e3779b97f4a7c15ULL ;
+      tag = (unsigned char)((x >> (shift - 7)) & 0x7f) ;
+      return (g_uintptr_t)(x >> shift) ;
+   }
+   void setctrl(g_uintptr_t i, unsigned char c) {
+      ctrl[i] = c ;
+      if (i < 16)
+         ctrl[size + i] = c ;
+   }
+   static int lowbit(unsigned int m) {
+#if defined(__GNUC__) || defined(__clang__)
+      return __builtin_ctz(m) ;
+#else
+      int r = 0 ;
+      while ((m & 1) == 0) {
+         m >>= 1 ;
+         r++ ;
+      }
+      return r ;
+#endif
+   }
+   static unsigned int group(const unsigned char *g, unsigned char c) {
+#ifdef OPENHASHSSE2
+      __m128i v = _mm_loadu_si128((const __m128i *)g) ;
+      return (unsigned int)_mm_movemask_epi8(
+                               _mm_cmpeq_epi8(v, _mm_set1_epi8((char)c))) ;
+#else
+      unsigned int m = 0 ;
+      for (int i=0; i<16; i++)
+         if (g[i] == c)
+            m |= 1 << i ;
+      return m ;
+#endif
+   }
+   // empty and deleted are the control bytes with the high bit set
+   static unsigned int freeslots(const unsigned char *g) {
+#ifdef OPENHASHSSE2
+      return (unsigned int)_mm_movemask_epi8(
+                               _mm_loadu_si128((const __m128i *)g)) ;
+#else
+      unsigned int m = 0 ;
+      for (int i=0; i<16; i++)
+         if (g[i] & 0x80)
+            m |= 1 << i ;
+      return m ;
+#endif
+   }
+} ;
+#endif
+/**
+ *   A small pool of worker threads for algorithms that can calculate
+ *   in parallel.  Work is handed out in batches of tasks; each thread
+ *   keeps its own deque of pending tasks and steals from the front of
+ *   the other deques when its own runs dry.  A thread waiting for a
+ *   batch to complete keeps running tasks whose level is no larger
+ *   than that of the batch, so nested batches cannot deadlock and the
+ *   recursion stays bounded.  The thread that creates the pool is
+ *   thread 0; the workers are numbered 1..size()-1.
+ */
+class lifetask {
+public:
+   virtual ~lifetask() {}
+   virtual void run() = 0 ;
+   int level ;    // size of this task; smaller tasks nest inside larger
+   void *batch ;  // owned by lifethreads
+} ;
+class lifethreads {
+public:
+   lifethreads(int nthreads) ;
+   ~lifethreads() ;
+   int size() { return nthreads ; }
+   // run all the tasks, returning once every one has completed
+   void runbatch(lifetask **tasks, int ntasks) ;
+   // called regularly by threads that are waiting on a batch
+   void setwaithook(void (*hook)(void *), void *arg) ;
+   static int threadindex() ;
+private:
+   void *impl ;
+   int nthreads ;
+} ;
 #endif
@@ -11,6 +11,12 @@
 #ifdef ZLIB
 #include <zlib.h>
 #include <streambuf>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <system_error>
+#include <mutex>
+#include <condition_variable>
 #endif
 
 #ifdef __APPLE__
@@ -230,65 +236,279 @@ const char *writemacrocell(std::ostream &os, char *comments, lifealgo &imp)
 }
 
 #ifdef ZLIB
+// gzbuf collects the output in big blocks and deflates them on background
+// threads, so writing a pattern overlaps with compressing it.  As in pigz,
+// each block is compressed on its own, primed with the last 32K of the
+// input before it, and ends on a byte boundary (a sync flush), so the
+// compressed blocks can simply be concatenated into one gzip member whose
+// crc is combined from theirs.
+
+const size_t GZBLOCK = 1 << 20;     // input bytes per block
+const size_t GZWINDOW = 32768;      // deflate's window, primed from before
+
+struct gzblock {
+   std::vector<char> dict, in;
+   std::vector<unsigned char> out;
+   uLong crc;
+   int state;                       // 0 = queued, 1 = compressing, 2 = done
+   bool last;
+};
+
 class gzbuf : public std::streambuf
 {
 public:
-   gzbuf() : file(NULL) { }
-   gzbuf(const char *path) : file(NULL) { open(path); }
+   gzbuf() : file(NULL), block(NULL) { }
+   gzbuf(const char *path) : file(NULL), block(NULL) { open(path); }
    ~gzbuf() { close(); }
 
    gzbuf *open(const char *path)
    {
       if (file) return NULL;
-      file = gzopen(path, "wb");
-      return file ? this : NULL;
+      file = fopen(path, "wb");
+      if (!file) return NULL;
+      // gzip header: no name or time, unknown OS
+      static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+      bad = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+      written = sizeof(header);
+      crc = crc32(0L, Z_NULL, 0);
+      isize = 0;
+      quit = false;
+      window.clear();
+      nextblock();
+      int n = (int)std::thread::hardware_concurrency() - 1;
+      if (n > 8) n = 8;
+      for (int i = 0; i < n; i++) {
+         try {
+            threads.push_back(std::thread(&gzbuf::compressor, this));
+         } catch (const std::system_error &) {
+            break;      // eg. a build without thread support
+         }
+      }
+      maxqueued = 2 * threads.size() + 2;
+      if (threads.empty()) {
+         // no helpers, so push compresses each block itself
+         memset(&z, 0, sizeof(z));
+         if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                          Z_DEFAULT_STRATEGY) != Z_OK)
+            bad = true;
+      }
+      return this;
    }
 
    gzbuf *close()
    {
       if (!file) return NULL;
-      int res = gzclose(file);
+      push(true);
+      drain();
+      {
+         std::lock_guard<std::mutex> g(lock);
+         quit = true;
+      }
+      wake.notify_all();
+      if (threads.empty())
+         deflateEnd(&z);
+      for (size_t i = 0; i < threads.size(); i++)
+         threads[i].join();
+      threads.clear();
+      for (size_t i = 0; i < spare.size(); i++)
+         delete spare[i];
+      spare.clear();
+      // gzip trailer: crc and length, little-endian
+      unsigned char trailer[8];
+      for (int i = 0; i < 4; i++) {
+         trailer[i] = (unsigned char)(crc >> (8 * i));
+         trailer[4 + i] = (unsigned char)(isize >> (8 * i));
+      }
+      if (fwrite(trailer, 1, sizeof(trailer), file) != sizeof(trailer))
+         bad = true;
+      if (fclose(file) != 0)
+         bad = true;
       file = NULL;
-      return res == Z_OK ? this : NULL;
+      return bad ? NULL : this;
    }
 
    bool is_open() const { return file!=NULL; }
 
    int overflow(int c=EOF)
    {
-      if (c == EOF)
-         return c ;
-      return gzputc(file, c) ;
-   }
-
-   std::streamsize xsputn(const char_type *s, std::streamsize n)
-   {
-      return gzwrite(file, s, (unsigned int)n);
+      if (!push(false))
+         return EOF;
+      if (c != EOF) {
+         *pptr() = (char)c;
+         pbump(1);
+      }
+      return traits_type::not_eof(c);
    }
 
    int sync()
    {
-      return gzflush(file, Z_SYNC_FLUSH) == Z_OK ? 0 : -1;
+      if (pptr() > pbase() && !push(false))
+         return -1;
+      drain();
+      std::lock_guard<std::mutex> g(lock);
+      return bad || fflush(file) != 0 ? -1 : 0;
    }
 
    pos_type seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which)
    {
       if (file && off == 0 && way == std::ios_base::cur && which == std::ios_base::out)
       {
-         #if ZLIB_VERNUM >= 0x1240
-            // gzoffset is only available in zlib 1.2.4 or later
-            return pos_type(gzoffset(file));
-         #else
-            // return an approximation of file size (only used in progress dialog)
-            z_off_t offset = gztell(file);
-            if (offset > 0) offset /= 4;
-            return pos_type(offset);
-         #endif
+         // the compressed size so far (only used in progress dialog)
+         std::lock_guard<std::mutex> g(lock);
+         return pos_type(off_type(written));
       }
       return pos_type(off_type(-1));
    }
 private:
-   gzFile file;
+   // make a fresh (or recycled) block the put area
+   void nextblock()
+   {
+      {
+         std::lock_guard<std::mutex> g(lock);
+         if (spare.empty()) {
+            block = new gzblock;
+         } else {
+            block = spare.back();
+            spare.pop_back();
+         }
+      }
+      block->in.resize(GZBLOCK);
+      setp(&block->in[0], &block->in[0] + GZBLOCK);
+   }
+
+   // queue the put area for compression, waiting if we're too far ahead
+   bool push(bool last)
+   {
+      gzblock *b = block;
+      b->in.resize(pptr() - pbase());
+      b->dict = window;
+      b->last = last;
+      b->state = 0;
+      if (b->in.size() >= GZWINDOW) {
+         window.assign(b->in.end() - GZWINDOW, b->in.end());
+      } else {
+         window.insert(window.end(), b->in.begin(), b->in.end());
+         if (window.size() > GZWINDOW)
+            window.erase(window.begin(), window.end() - GZWINDOW);
+      }
+      bool ok;
+      if (threads.empty()) {
+         if (!bad) deflateblock(z, *b);
+         std::lock_guard<std::mutex> g(lock);
+         writeblock(b);
+         ok = !bad;
+      } else {
+         std::unique_lock<std::mutex> g(lock);
+         while (blocks.size() >= maxqueued && !bad)
+            room.wait(g);
+         blocks.push_back(b);
+         ok = !bad;
+      }
+      wake.notify_one();
+      if (last) {
+         block = NULL;
+         setp(NULL, NULL);
+      } else {
+         nextblock();
+      }
+      return ok;
+   }
+
+   // wait until every queued block has been written
+   void drain()
+   {
+      std::unique_lock<std::mutex> g(lock);
+      while (!blocks.empty())
+         room.wait(g);
+   }
+
+   void deflateblock(z_stream &z, gzblock &b)
+   {
+      deflateReset(&z);
+      if (!b.dict.empty())
+         deflateSetDictionary(&z, (const Bytef *)&b.dict[0], (uInt)b.dict.size());
+      b.out.resize(deflateBound(&z, (uLong)b.in.size()) + 16);
+      z.next_in = (Bytef *)(b.in.empty() ? NULL : &b.in[0]);
+      z.avail_in = (uInt)b.in.size();
+      z.next_out = &b.out[0];
+      z.avail_out = (uInt)b.out.size();
+      for (;;) {
+         int ret = deflate(&z, b.last ? Z_FINISH : Z_SYNC_FLUSH);
+         if (b.last ? ret == Z_STREAM_END : z.avail_out != 0)
+            break;
+         // out of room (unlikely); grow the output and carry on
+         size_t used = b.out.size() - z.avail_out;
+         b.out.resize(b.out.size() * 2);
+         z.next_out = &b.out[used];
+         z.avail_out = (uInt)(b.out.size() - used);
+      }
+      b.out.resize(b.out.size() - z.avail_out);
+      b.crc = crc32(0L, Z_NULL, 0);
+      if (!b.in.empty())
+         b.crc = crc32(b.crc, (const Bytef *)&b.in[0], (uInt)b.in.size());
+   }
+
+   // append a compressed block to the file (with the lock held)
+   void writeblock(gzblock *w)
+   {
+      if (!bad && !w->out.empty() &&
+          fwrite(&w->out[0], 1, w->out.size(), file) != w->out.size())
+         bad = true;
+      written += w->out.size();
+      crc = crc32_combine(crc, w->crc, (z_off_t)w->in.size());
+      isize += (uLong)w->in.size();
+      spare.push_back(w);
+   }
+
+   // each background thread takes the oldest queued block, compresses it,
+   // then writes out whatever finished blocks are next in line
+   void compressor()
+   {
+      z_stream z;
+      memset(&z, 0, sizeof(z));
+      bool ok = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                             Z_DEFAULT_STRATEGY) == Z_OK;
+      std::unique_lock<std::mutex> g(lock);
+      if (!ok) bad = true;
+      for (;;) {
+         gzblock *b = NULL;
+         for (size_t i = 0; i < blocks.size(); i++)
+            if (blocks[i]->state == 0) {
+               b = blocks[i];
+               break;
+            }
+         if (!b) {
+            if (quit) break;
+            wake.wait(g);
+            continue;
+         }
+         b->state = 1;
+         g.unlock();
+         if (ok) deflateblock(z, *b);
+         g.lock();
+         b->state = 2;
+         while (!blocks.empty() && blocks.front()->state == 2) {
+            writeblock(blocks.front());
+            blocks.pop_front();
+         }
+         room.notify_all();
+      }
+      if (ok) deflateEnd(&z);
+   }
+
+   FILE *file;
+   gzblock *block;                  // the put area
+   std::vector<char> window;        // the last 32K pushed
+   std::vector<std::thread> threads;
+   z_stream z;                      // for compressing inline
+   std::mutex lock;                 // guards everything below
+   std::condition_variable wake, room;
+   std::deque<gzblock *> blocks;    // queued, in file order
+   std::vector<gzblock *> spare;
+   size_t maxqueued;
+   G_INT64 written;
+   uLong crc, isize;
+   bool bad, quit;
 };
 #endif
 
@@ -362,6 +582,11 @@ const char *writepattern(const char *filename, lifealgo &imp,
          errmsg = writemacrocell(os, comments, imp);
          break;
 
+      case MCB_format:
+         // so does binary macrocell format, and it has no comments
+         errmsg = imp.writeBinaryMacrocell(os);
+         break;
+
       default:
          errmsg = "Unsupported pattern format!";
    }
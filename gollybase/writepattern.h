@@ -8,7 +8,8 @@ class lifealgo;
 typedef enum {
    RLE_format,          // run length encoded
    XRLE_format,         // extended RLE
-   MC_format            // macrocell (native hashlife format)
+   MC_format,           // macrocell (native hashlife format)
+   MCB_format           // binary macrocell (hashlife snapshot)
 } pattern_format;
 
 typedef enum {
@@ -9,6 +9,7 @@
 #include "ltlalgo.h"
 #include "jvnalgo.h"
 #include "superalgo.h"
+#include "adaptivealgo.h"
 #include "ruleloaderalgo.h"
 
 #include "utils.h"      // for Fatal, Warning, SetColor, Poller
@@ -885,6 +886,7 @@ void InitAlgorithms()
     ltlalgo::doInitializeAlgoInfo(AlgoData::tick());
     jvnalgo::doInitializeAlgoInfo(AlgoData::tick());
     superalgo::doInitializeAlgoInfo(AlgoData::tick());
+    adaptivealgo::doInitializeAlgoInfo(AlgoData::tick());
     
     // RuleLoader must be last so we can display detailed error messages
     // (see LoadRule in file.cpp)
@@ -233,9 +233,10 @@ void MainFrame::RestorePattern(bigint& gen, const wxString& filename,
         // restore starting pattern (false means don't call SyncUndoHistory)
         ResetPattern(false);
     } else {
-        // restore pattern in given filename;
+        // restore pattern in given filename, unless the algorithm kept it in memory;
         // false means don't update status bar (algorithm should NOT change)
-        LoadPattern(filename, wxEmptyString, false);
+        if (!currlayer->algo->restorepinned(FILEPATH(filename)))
+            LoadPattern(filename, wxEmptyString, false);
         
         if (currlayer->algo->getGeneration() != gen) {
             // best to clear the pattern and set the expected gen count
@@ -881,7 +882,7 @@ void MainFrame::OnGenTimer(wxTimerEvent& WXUNUSED(event))
     
     if (currlayer->algo->isrecording()) {
         if (showtimeline) UpdateTimelineBar();
-        if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+        if (currlayer->algo->timelinefull()) {
             if (generating) {
                 // call StopGenerating() to stop gentimer
                 Stop();
@@ -890,7 +891,11 @@ void MainFrame::OnGenTimer(wxTimerEvent& WXUNUSED(event))
                 FinishUp();
             }
             wxString msg;
-            msg.Printf(_("No more frames can be recorded (maximum = %d)."), MAX_FRAME_COUNT);
+            if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+                msg.Printf(_("No more frames can be recorded (maximum = %d)."), MAX_FRAME_COUNT);
+            } else {
+                msg = _("No more frames can be recorded (out of memory).");
+            }
             Warning(msg);
             in_timer = false;
             return;
@@ -22,7 +22,7 @@
 #include "writepattern.h"  // for writepattern, pattern_format
 
 #include "wxgolly.h"       // for wxGetApp, statusptr, viewptr, bigview
-#include "wxutils.h"       // for Warning
+#include "wxutils.h"       // for Warning, FILEPATH
 #include "wxprefs.h"       // for SavePrefs, allowundo, userrules, etc
 #include "wxrule.h"        // for GetRuleName
 #include "wxinfo.h"        // for GetInfoFrame
@@ -37,13 +37,6 @@
 #include "wxhelp.h"        // for ShowHelp, LoadRule
 #include "wxtimeline.h"    // for InitTimelineFrame, ToggleTimelineBar, etc
 
-#ifdef __WXMAC__
-    // convert path to decomposed UTF8 so fopen will work
-    #define FILEPATH path.fn_str()
-#else
-    #define FILEPATH path.mb_str(wxConvLocal)
-#endif
-
 // File menu functions:
 
 // -----------------------------------------------------------------------------
@@ -315,7 +308,7 @@ void MainFrame::LoadPattern(const wxString& path, const wxString& newtitle,
         LoadImage(path);
         viewptr->nopattupdate = false;
     } else {
-        const char* err = readpattern(FILEPATH, *currlayer->algo);
+        const char* err = readpattern(FILEPATH(path), *currlayer->algo);
         if (err) {
             wxString bigerr = _("File could not be loaded by any algorithm.");
             wxString algoname = wxString(GetAlgoName(currlayer->algtype), wxConvLocal);
@@ -329,7 +322,7 @@ void MainFrame::LoadPattern(const wxString& path, const wxString& newtitle,
                     delete currlayer->algo;
                     currlayer->algo = CreateNewUniverse(currlayer->algtype);
                     // readpattern will call setrule
-                    err = readpattern(FILEPATH, *currlayer->algo);
+                    err = readpattern(FILEPATH(path), *currlayer->algo);
                     if (err) {
                         algoname = wxString(GetAlgoName(currlayer->algtype), wxConvLocal);
                         bigerr += wxString::Format(_("\n\nError from %s:\n"), algoname.c_str());
@@ -347,7 +340,7 @@ void MainFrame::LoadPattern(const wxString& path, const wxString& newtitle,
                 currlayer->algo = CreateNewUniverse(currlayer->algtype);
                 RestoreRule(oldrule);
                 // also show full path to file (useful when debugging!)
-                bigerr += wxString::Format(_("\n\nFile path:\n%s"), wxString(FILEPATH,wxConvLocal).c_str());
+                bigerr += wxString::Format(_("\n\nFile path:\n%s"), wxString(FILEPATH(path),wxConvLocal).c_str());
                 Warning(bigerr);
             }
         }
@@ -948,6 +941,7 @@ void MainFrame::OpenPattern()
     filetypes +=         _("|RLE (*.rle)|*.rle");
     filetypes +=         _("|RLE3 (*.rle3)|*.rle3");
     filetypes +=         _("|Macrocell (*.mc)|*.mc");
+    filetypes +=         _("|Binary macrocell (*.mcb)|*.mcb");
     filetypes +=         _("|Gzip (*.gz)|*.gz");
     filetypes +=         _("|Life 1.05/1.06 (*.lif)|*.lif");
     filetypes +=         _("|dblife (*.l)|*.l");
@@ -1471,7 +1465,7 @@ const char* MainFrame::WritePattern(const wxString& path,
     // position info is recorded (this position will be used when the file is read)
     if (format == RLE_format && (currlayer->algo->gridwd > 0 || currlayer->algo->gridht > 0))
         format = XRLE_format;
-    const char* err = writepattern(FILEPATH, *currlayer->algo, format,
+    const char* err = writepattern(FILEPATH(path), *currlayer->algo, format,
                                    compression, top, left, bottom, right);    
     return err;
 }
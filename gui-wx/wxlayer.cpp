@@ -2816,9 +2816,11 @@ Layer::~Layer()
         }
         
     } else {
-        // this layer is not a clone, so delete universe and undo/redo history
-        delete algo;
+        // this layer is not a clone, so delete undo/redo history and universe
+        // (in that order because deleting the history unpins any patterns
+        // the universe is keeping in memory for it)
         delete undoredo;
+        delete algo;
         
         // delete tempstart file if it exists
         if (wxFileExists(tempstart)) wxRemoveFile(tempstart);
@@ -60,6 +60,9 @@
 
 #include "lua.hpp"          // Lua header files for C++
 
+#include <vector>           // for std::vector
+#include <algorithm>        // for std::stable_sort
+
 // -----------------------------------------------------------------------------
 
 // some useful macros
@@ -1026,6 +1029,60 @@ static int g_evolve(lua_State* L)
 
 static const char* BAD_STATE = "putcells error: state value is out of range.";
 
+// -----------------------------------------------------------------------------
+
+struct RowCell {
+    int y, x, state;
+    bool operator<(const RowCell& c) const { return y < c.y || (y == c.y && x < c.x); }
+};
+
+// Set the given cells a row at a time with setrow.  If a cell appears more
+// than once then the last state wins, just as if setcell had been called.
+
+static const char* PutRowCells(lifealgo* algo, std::vector<RowCell>& cells)
+{
+    std::stable_sort(cells.begin(), cells.end());
+    std::vector<int> runs;
+    size_t i = 0;
+    while (i < cells.size()) {
+        int y = cells[i].y;
+        int x0 = cells[i].x;
+        int x = x0;     // just past the last run
+        runs.clear();
+        for ( ; i < cells.size() && cells[i].y == y; i++) {
+            const RowCell& c = cells[i];
+            if (c.x < x) {
+                // same cell as the last one
+                if (c.state != runs.back()) {
+                    if (runs[runs.size() - 2] == 1) {
+                        runs.back() = c.state;
+                    } else {
+                        runs[runs.size() - 2]--;
+                        runs.push_back(1);
+                        runs.push_back(c.state);
+                    }
+                }
+                continue;
+            }
+            if (c.x > x) {
+                runs.push_back(c.x - x);
+                runs.push_back(0);
+            }
+            if (!runs.empty() && runs.back() == c.state) {
+                runs[runs.size() - 2]++;
+            } else {
+                runs.push_back(1);
+                runs.push_back(c.state);
+            }
+            x = c.x + 1;
+        }
+        if (algo->setrow(x0, y, &runs[0], (int)runs.size() / 2) < 0) return BAD_STATE;
+    }
+    return NULL;
+}
+
+// -----------------------------------------------------------------------------
+
 static int g_putcells(lua_State* L)
 {
     AUTORELEASE_POOL
@@ -1148,6 +1205,44 @@ static int g_putcells(lua_State* L)
                 pattchanged = true;
             }
         }
+    } else if (modestr.IsSameAs(wxT("or"), false) && !savecells) {
+        // with no changes to record we don't need the old states, so collect
+        // the cells and set them a row at a time (much faster in big patterns)
+        std::vector<RowCell> cells;
+        cells.reserve(num_cells);
+        int newstate = 1;
+        int numstates = curralgo->NumCellStates();
+        for (int n = 0; n < num_cells; n++) {
+            int item = ints_per_cell * n;
+            lua_rawgeti(L, 1, item+1); int x = lua_tointeger(L,-1); lua_pop(L,1);
+            lua_rawgeti(L, 1, item+2); int y = lua_tointeger(L,-1); lua_pop(L,1);
+            int newx = x0 + x * axx + y * axy;
+            int newy = y0 + x * ayx + y * ayy;
+            // check if newx,newy is outside bounded grid
+            err = GSF_checkpos(curralgo, newx, newy);
+            if (err) break;
+            if (multistate) {
+                // in 'or' mode dead cells in a multi-state array change nothing
+                lua_rawgeti(L, 1, item+3); newstate = lua_tointeger(L,-1); lua_pop(L,1);
+                if (newstate == 0) continue;
+                // check the state now because PutRowCells sets the cells in
+                // sorted order, so stop at the same cell as the other modes
+                if (newstate < 0 || newstate >= numstates) {
+                    err = BAD_STATE;
+                    break;
+                }
+            }
+            RowCell c;
+            c.y = newy;
+            c.x = newx;
+            c.state = newstate;
+            cells.push_back(c);
+        }
+        if (!cells.empty()) {
+            const char* rowerr = PutRowCells(curralgo, cells);
+            if (rowerr) err = rowerr;
+            pattchanged = true;
+        }
     } else {
         bool notmode = modestr.IsSameAs(wxT("not"), false);
         bool ormode = modestr.IsSameAs(wxT("or"), false);
@@ -1194,6 +1289,34 @@ static int g_putcells(lua_State* L)
 
 // -----------------------------------------------------------------------------
 
+// appends the live cells in the rows passed to it by lifealgo::getrows
+// to the cell array on top of the Lua stack
+
+class LuaCellArray : public rowvisitor {
+public:
+    LuaCellArray(lua_State* L, bool multistate) : L(L), multistate(multistate), arraylen(0) {}
+    virtual bool row(int x, int y, const int* runs, int nruns) {
+        for (int i = 0; i < nruns; i++, runs += 2) {
+            if (runs[1] > 0) {
+                for (int cx = x; cx < x + runs[0]; cx++) {
+                    lua_pushinteger(L, cx); lua_rawseti(L, -2, ++arraylen);
+                    lua_pushinteger(L, y); lua_rawseti(L, -2, ++arraylen);
+                    if (multistate) {
+                        lua_pushinteger(L, runs[1]); lua_rawseti(L, -2, ++arraylen);
+                    }
+                }
+            }
+            x += runs[0];
+        }
+        return true;
+    }
+    lua_State* L;
+    bool multistate;
+    int arraylen;
+};
+
+// -----------------------------------------------------------------------------
+
 static int g_getcells(lua_State* L)
 {
     AUTORELEASE_POOL
@@ -1216,30 +1339,11 @@ static int g_getcells(lua_State* L)
         const char* err = GSF_checkrect(ileft, itop, wd, ht);
         if (err) GollyError(L, err);
         
-        int iright = ileft + wd - 1;
-        int ibottom = itop + ht - 1;
-        int cx, cy;
-        int v = 0;
         lifealgo* curralgo = currlayer->algo;
         bool multistate = curralgo->NumCellStates() > 2;
-        for ( cy=itop; cy<=ibottom; cy++ ) {
-            for ( cx=ileft; cx<=iright; cx++ ) {
-                int skip = curralgo->nextcell(cx, cy, v);
-                if (skip >= 0) {
-                    // found next live cell in this row
-                    cx += skip;
-                    if (cx <= iright) {
-                        lua_pushinteger(L, cx); lua_rawseti(L, -2, ++arraylen);
-                        lua_pushinteger(L, cy); lua_rawseti(L, -2, ++arraylen);
-                        if (multistate) {
-                            lua_pushinteger(L, v); lua_rawseti(L, -2, ++arraylen);
-                        }
-                    }
-                } else {
-                    cx = iright;  // done this row
-                }
-            }
-        }
+        LuaCellArray cells(L, multistate);
+        curralgo->getrows(ileft, itop, wd, ht, cells);
+        arraylen = cells.arraylen;
         if (multistate && arraylen > 0 && (arraylen & 1) == 0) {
             // add padding zero
             lua_pushinteger(L, 0); lua_rawseti(L, -2, ++arraylen);
@@ -679,7 +679,7 @@ void MainFrame::UpdateMenuItems()
         mbar->Enable(ID_HINFO,        active);
         mbar->Enable(ID_SHOW_POP,     active);
         mbar->Enable(ID_AUTOSTOP,     active);
-        mbar->Enable(ID_RECORD,       active && !inscript && currlayer->algo->hyperCapable());
+        mbar->Enable(ID_RECORD,       active && !inscript);
         mbar->Enable(ID_DELTIME,      active && !inscript && timeline && !currlayer->algo->isrecording());
         mbar->Enable(ID_SETALGO,      active && !timeline && !inscript);
         mbar->Enable(ID_SETRULE,      active && !timeline && !inscript);
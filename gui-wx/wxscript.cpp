@@ -640,37 +640,39 @@ const char* GSF_checkrect(int x, int y, int wd, int ht)
 
 // -----------------------------------------------------------------------------
 
-int GSF_hash(int x, int y, int wd, int ht)
-{
-    // calculate a hash value for pattern in given rect
-    int hash = 31415962;
-    int right = x + wd - 1;
-    int bottom = y + ht - 1;
-    int cx, cy;
-    int v = 0;
-    lifealgo* curralgo = currlayer->algo;
-    bool multistate = curralgo->NumCellStates() > 2;
-
-    for ( cy=y; cy<=bottom; cy++ ) {
-        int yshift = cy - y;
-        for ( cx=x; cx<=right; cx++ ) {
-            int skip = curralgo->nextcell(cx, cy, v);
-            if (skip >= 0) {
-                // found next live cell in this row (v is >= 1 if multistate)
-                cx += skip;
-                if (cx <= right) {
+// hashes the live cells in the rows passed to it by lifealgo::getrows
+
+class HashRows : public rowvisitor {
+public:
+    HashRows(int x, int y, bool multistate) : left(x), top(y), multistate(multistate), hash(31415962) {}
+    virtual bool row(int x, int y, const int* runs, int nruns) {
+        int yshift = y - top;
+        for (int i = 0; i < nruns; i++, runs += 2) {
+            int v = runs[1];
+            if (v > 0) {
+                for (int cx = x; cx < x + runs[0]; cx++) {
                     // need to use a good hash function for patterns like AlienCounter.rle
                     hash = (hash * 1000003) ^ yshift;
-                    hash = (hash * 1000003) ^ (cx - x);
+                    hash = (hash * 1000003) ^ (cx - left);
                     if (multistate) hash = (hash * 1000003) ^ v;
                 }
-            } else {
-                cx = right;  // done this row
             }
+            x += runs[0];
         }
+        return true;
     }
+    int left, top;
+    bool multistate;
+    int hash;
+};
 
-    return hash;
+int GSF_hash(int x, int y, int wd, int ht)
+{
+    // calculate a hash value for pattern in given rect
+    lifealgo* curralgo = currlayer->algo;
+    HashRows hasher(x, y, curralgo->NumCellStates() > 2);
+    curralgo->getrows(x, y, wd, ht, hasher);
+    return hasher.hash;
 }
 
 // -----------------------------------------------------------------------------
@@ -22,6 +22,8 @@
 #include "wxlayer.h"       // for currlayer, MarkLayerDirty, etc
 #include "wxselect.h"
 
+#include <vector>
+
 // This module implements operations on selections.
 
 // -----------------------------------------------------------------------------
@@ -1381,6 +1383,135 @@ void Selection::AddRun(int state,                // in: state of cell to write
 
 // -----------------------------------------------------------------------------
 
+// CopyToClipboard passes one of these to lifealgo::getrows to turn the rows
+// of live cells in the selection into RLE data
+
+class Selection::CopyRows : public rowvisitor {
+public:
+    CopyRows(Selection* sel, int itop, int ileft, unsigned int wd, unsigned int ht,
+             bool cut, int multistate, char* textptr, char* chptr, int cursize)
+        : sel(sel), itop(itop), ileft(ileft), wd(wd), ht(ht), cut(cut),
+          multistate(multistate), textptr(textptr), chptr(chptr),
+          etextptr(textptr + cursize), cursize(cursize), nexty(itop),
+          livecount(0), linelen(0), brun(0), orun(0), dollrun(0), cntr(0) {}
+    virtual bool row(int x, int y, const int* runs, int nruns);
+    bool Reserve();
+
+    Selection* sel;
+    int itop, ileft;
+    unsigned int wd, ht;
+    bool cut;
+    int multistate;
+    char* textptr;
+    char* chptr;
+    char* etextptr;
+    int cursize;
+    int nexty;                  // row after the last one we were given
+    unsigned int livecount;
+    unsigned int linelen;
+    unsigned int brun;
+    unsigned int orun;
+    unsigned int dollrun;
+    int cntr;
+    std::vector<int> cutruns;   // x, y, length and state of each run copied if cutting
+};
+
+// -----------------------------------------------------------------------------
+
+bool Selection::CopyRows::Reserve()
+{
+    if (chptr + 60 >= etextptr) {
+        // nearly out of space; try to increase allocation
+        ptrdiff_t delta = chptr - textptr;
+        char* ntxtptr = (char*) realloc(textptr, 2*cursize);
+        if (ntxtptr == 0) {
+            statusptr->ErrorMessage(_("No more memory for clipboard data!"));
+            // stop here so that partially cut/copied portion gets saved to clipboard
+            return false;
+        }
+        chptr = ntxtptr + delta;
+        cursize *= 2;
+        etextptr = ntxtptr + cursize;
+        textptr = ntxtptr;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Selection::CopyRows::row(int x, int y, const int* runs, int nruns)
+{
+    // each row we weren't given is empty
+    dollrun += y - nexty;
+    nexty = y + 1;
+
+    int laststate = WRLE_NONE;
+    int pos = ileft;            // just past the last live cell
+    for (int i = 0; i < nruns; i++, runs += 2) {
+        int len = runs[0];
+        int v = runs[1];
+        if (v > 0) {
+            if (!Reserve()) return false;
+            if (x > pos) {
+                // have exactly x - pos empty cells here
+                if (laststate == 0) {
+                    brun += x - pos;
+                } else {
+                    if (orun > 0) {
+                        // output current run of live cells
+                        sel->AddRun(laststate, multistate, orun, linelen, chptr);
+                    }
+                    laststate = 0;
+                    brun = x - pos;
+                }
+            }
+            if (laststate == v) {
+                orun += len;
+            } else {
+                if (dollrun > 0)
+                    // output current run of $ chars
+                    sel->AddRun(WRLE_NEWLINE, multistate, dollrun, linelen, chptr);
+                if (brun > 0)
+                    // output current run of dead cells
+                    sel->AddRun(0, multistate, brun, linelen, chptr);
+                if (orun > 0)
+                    // output current run of other live cells
+                    sel->AddRun(laststate, multistate, orun, linelen, chptr);
+                laststate = v;
+                orun = len;
+            }
+            livecount += len;
+            if (cut) {
+                cutruns.push_back(x);
+                cutruns.push_back(y);
+                cutruns.push_back(len);
+                cutruns.push_back(v);
+            }
+            pos = x + len;
+            cntr += len;
+            if (cntr >= 4096) {
+                cntr = 0;
+                double prog = ((y - itop) * (double)wd + (x - ileft)) / ((double)wd * (double)ht);
+                if (AbortProgress(prog, wxEmptyString)) return false;
+            }
+        }
+        x += len;
+    }
+
+    // end of current row
+    if (!Reserve()) return false;
+    if (laststate == 0)
+        // forget dead cells at end of row
+        brun = 0;
+    else if (laststate >= 0)
+        // output current run of live cells
+        sel->AddRun(laststate, multistate, orun, linelen, chptr);
+    dollrun++;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
 void Selection::CopyToClipboard(bool cut)
 {
     if (insideYield > 0) return; // avoid recursion
@@ -1400,7 +1531,6 @@ void Selection::CopyToClipboard(bool cut)
 
     // convert cells in selection to RLE data in textptr
     char* textptr;
-    char* etextptr;
     int cursize = 4096;
 
     textptr = (char*)malloc(cursize);
@@ -1408,7 +1538,6 @@ void Selection::CopyToClipboard(bool cut)
         statusptr->ErrorMessage(_("Not enough memory for clipboard data!"));
         return;
     }
-    etextptr = textptr + cursize;
 
     // add RLE header line
     sprintf(textptr, "x = %u, y = %u, rule = %s", wd, ht, currlayer->algo->getrule());
@@ -1418,108 +1547,37 @@ void Selection::CopyToClipboard(bool cut)
     // save start of data in case livecount is zero
     int datastart = chptr - textptr;
 
-    // add RLE pattern data
-    unsigned int livecount = 0;
-    unsigned int linelen = 0;
-    unsigned int brun = 0;
-    unsigned int orun = 0;
-    unsigned int dollrun = 0;
-    int laststate;
-    int cx, cy;
-    int v = 0;
-
     // save cell changes if undo/redo is enabled and script isn't constructing a pattern
     bool savecells = allowundo && !currlayer->stayclean;
     if (savecells && inscript) SavePendingChanges();
 
-    double maxcount = (double)wd * (double)ht;
-    int cntr = 0;
-    bool abort = false;
     if (cut)
         BeginProgress(_("Cutting selection"));
     else
         BeginProgress(_("Copying selection"));
 
+    // add RLE pattern data
     lifealgo* curralgo = currlayer->algo;
-    int multistate = curralgo->NumCellStates() > 2;
-    for ( cy=itop; cy<=ibottom; cy++ ) {
-        laststate = WRLE_NONE;
-        for ( cx=ileft; cx<=iright; cx++ ) {
-            int skip = curralgo->nextcell(cx, cy, v);
-            if (skip + cx > iright)
-                skip = -1;           // pretend we found no more live cells
-            if (skip > 0) {
-                // have exactly "skip" empty cells here
-                if (laststate == 0) {
-                    brun += skip;
-                } else {
-                    if (orun > 0) {
-                        // output current run of live cells
-                        AddRun(laststate, multistate, orun, linelen, chptr);
-                    }
-                    laststate = 0;
-                    brun = skip;
-                }
-            }
-            if (skip >= 0) {
-                // found next live cell
-                cx += skip;
-                livecount++;
-                if (cut) {
-                    curralgo->setcell(cx, cy, 0);
-                    if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, v, 0);
-                }
-                if (laststate == v) {
-                    orun++;
-                } else {
-                    if (dollrun > 0)
-                        // output current run of $ chars
-                        AddRun(WRLE_NEWLINE, multistate, dollrun, linelen, chptr);
-                    if (brun > 0)
-                        // output current run of dead cells
-                        AddRun(0, multistate, brun, linelen, chptr);
-                    if (orun > 0)
-                        // output current run of other live cells
-                        AddRun(laststate, multistate, orun, linelen, chptr);
-                    laststate = v;
-                    orun = 1;
-                }
-            } else {
-                cx = iright + 1;     // done this row
-            }
-            cntr++;
-            if ((cntr % 4096) == 0) {
-                double prog = ((cy - itop) * (double)(iright - ileft + 1) +
-                               (cx - ileft)) / maxcount;
-                abort = AbortProgress(prog, wxEmptyString);
-                if (abort) break;
-            }
-            if (chptr + 60 >= etextptr) {
-                // nearly out of space; try to increase allocation
-                ptrdiff_t delta = chptr - textptr;
-                char* ntxtptr = (char*) realloc(textptr, 2*cursize);
-                if (ntxtptr == 0) {
-                    statusptr->ErrorMessage(_("No more memory for clipboard data!"));
-                    // don't return here -- best to set abort flag and break so that
-                    // partially cut/copied portion gets saved to clipboard
-                    abort = true;
-                    break;
-                }
-                chptr = ntxtptr + delta;
-                cursize *= 2;
-                etextptr = ntxtptr + cursize;
-                textptr = ntxtptr;
+    CopyRows rows(this, itop, ileft, wd, ht, cut, curralgo->NumCellStates() > 2,
+                  textptr, chptr, cursize);
+    curralgo->getrows(ileft, itop, wd, ht, rows);
+    textptr = rows.textptr;
+    chptr = rows.chptr;
+    unsigned int livecount = rows.livecount;
+    unsigned int linelen = rows.linelen;
+    unsigned int dollrun;
+    int multistate = rows.multistate;
+
+    if (cut) {
+        // now we've finished walking the pattern we can kill the cells we copied
+        for (size_t i = 0; i < rows.cutruns.size(); i += 4) {
+            int cy = rows.cutruns[i+1];
+            int v = rows.cutruns[i+3];
+            for (int cx = rows.cutruns[i]; cx < rows.cutruns[i] + rows.cutruns[i+2]; cx++) {
+                curralgo->setcell(cx, cy, 0);
+                if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, v, 0);
             }
         }
-        if (abort) break;
-        // end of current row
-        if (laststate == 0)
-            // forget dead cells at end of row
-            brun = 0;
-        else if (laststate >= 0)
-            // output current run of live cells
-            AddRun(laststate, multistate, orun, linelen, chptr);
-        dollrun++;
     }
 
     if (livecount == 0) {
@@ -119,6 +119,8 @@ private:
                 unsigned int &linelen, char* &chptr);
     
     void AddEOL(char* &chptr);
+    
+    class CopyRows;
     // these routines are used by CopyToClipboard to create RLE data
     
     bool SaveDifferences(lifealgo* oldalgo, lifealgo* newalgo,
@@ -340,41 +340,23 @@ void TimelineBar::DrawTimelineBar(wxDC& dc, int wd, int ht)
     dc.DrawLine(0, 0, r.width, 0);
     dc.SetPen(wxNullPen);
     
-    if (currlayer->algo->hyperCapable()) {
-        bool canplay = TimelineExists() && !currlayer->algo->isrecording();
-        tlbutt[RECORD_BUTT]->Show(true);
-        tlbutt[BACKWARDS_BUTT]->Show(canplay);
-        tlbutt[FORWARDS_BUTT]->Show(canplay);
-        tlbutt[DELETE_BUTT]->Show(canplay);
-        slider->Show(canplay);
-        framebar->Show(canplay);
-        
-        if (currlayer->algo->isrecording()) {
-            // show number of frames recorded so far
-            SetTimelineFont(dc);
-            dc.SetPen(*wxBLACK_PEN);
-            int x = smallgap + BUTTON_WD + 10;
-            int y = TBARHT - 8;
-            wxString str;
-            str.Printf(_("Frames recorded: %d"), currlayer->algo->getframecount());
-            DisplayText(dc, str, x, y - (SCROLLHT - digitht)/2);
-            dc.SetPen(wxNullPen);
-        }
-        
-    } else {
-        tlbutt[RECORD_BUTT]->Show(false);
-        tlbutt[BACKWARDS_BUTT]->Show(false);
-        tlbutt[FORWARDS_BUTT]->Show(false);
-        tlbutt[DELETE_BUTT]->Show(false);
-        slider->Show(false);
-        framebar->Show(false);
-        
+    bool canplay = TimelineExists() && !currlayer->algo->isrecording();
+    tlbutt[RECORD_BUTT]->Show(true);
+    tlbutt[BACKWARDS_BUTT]->Show(canplay);
+    tlbutt[FORWARDS_BUTT]->Show(canplay);
+    tlbutt[DELETE_BUTT]->Show(canplay);
+    slider->Show(canplay);
+    framebar->Show(canplay);
+    
+    if (currlayer->algo->isrecording()) {
+        // show number of frames recorded so far
         SetTimelineFont(dc);
         dc.SetPen(*wxBLACK_PEN);
-        int x = 6;
+        int x = smallgap + BUTTON_WD + 10;
         int y = TBARHT - 8;
-        DisplayText(dc, _("The current algorithm does not support timelines."),
-                    x, y - (SCROLLHT - digitht)/2);
+        wxString str;
+        str.Printf(_("Frames recorded: %d"), currlayer->algo->getframecount());
+        DisplayText(dc, str, x, y - (SCROLLHT - digitht)/2);
         dc.SetPen(wxNullPen);
     }
 }
@@ -822,7 +804,7 @@ void UpdateTimelineBar()
         // may need to change bitmaps in some buttons
         tbarptr->UpdateButtons();
         
-        tbarptr->EnableButton(RECORD_BUTT, active && currlayer->algo->hyperCapable());
+        tbarptr->EnableButton(RECORD_BUTT, active);
         
         // note that slider, scroll bar and some buttons are only shown if there is
         // a timeline and we're not recording (see DrawTimelineBar)
@@ -884,7 +866,7 @@ void ToggleTimelineBar()
 
 void StartStopRecording()
 {
-    if (!inscript && currlayer->algo->hyperCapable()) {
+    if (!inscript) {
         if (currlayer->algo->isrecording()) {
             mainptr->Stop();
             // StopGenerating() has called currlayer->algo->stoprecording()
@@ -899,10 +881,14 @@ void StartStopRecording()
             
             if (!showtimeline) ToggleTimelineBar();
             
-            if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+            if (currlayer->algo->timelinefull()) {
                 wxString msg;
-                msg.Printf(_("The timeline can't be extended any further (max frames = %d)."),
-                           MAX_FRAME_COUNT);
+                if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+                    msg.Printf(_("The timeline can't be extended any further (max frames = %d)."),
+                               MAX_FRAME_COUNT);
+                } else {
+                    msg = _("The timeline can't be extended any further (out of memory).");
+                }
                 statusptr->ErrorMessage(msg);
                 return;
             }
@@ -16,7 +16,7 @@
 #include "wxmain.h"        // for mainptr->...
 #include "wxselect.h"      // for Selection
 #include "wxview.h"        // for viewptr->...
-#include "wxutils.h"       // for Warning, Fatal
+#include "wxutils.h"       // for Warning, Fatal, FILEPATH
 #include "wxscript.h"      // for inscript
 #include "wxalgos.h"       // for algo_type
 #include "wxlayer.h"       // for currlayer, numclones, MarkLayerDirty, etc
@@ -41,6 +41,27 @@ const wxString dupe6_prefix = wxT("g6_");
 
 // -----------------------------------------------------------------------------
 
+// a genchange temporary file might not have been written yet because the
+// pattern is pinned in memory by the algorithm (see lifealgo::pinstate);
+// clones share their algo so it's simplest to ask every layer's algo
+
+static void ForgetPinnedState(const wxString& path)
+{
+    for (int i = 0; i < numlayers; i++)
+        GetLayer(i)->algo->unpinstate(FILEPATH(path));
+}
+
+// -----------------------------------------------------------------------------
+
+static void SpillPinnedState(const wxString& path)
+{
+    // write the file now because we're about to copy it
+    for (int i = 0; i < numlayers; i++)
+        GetLayer(i)->algo->spillpinned(FILEPATH(path));
+}
+
+// -----------------------------------------------------------------------------
+
 // the next two classes are needed because Golly allows multiple starting points
 // (by setting the generation count back to 0), so we need to ensure that a Reset
 // goes back to the correct starting info
@@ -292,10 +313,12 @@ ChangeNode::~ChangeNode()
     // it's always ok to delete oldfile and newfile if they exist
     
     if (!oldfile.IsEmpty() && wxFileExists(oldfile)) {
+        ForgetPinnedState(oldfile);
         wxRemoveFile(oldfile);
     }
     
     if (!newfile.IsEmpty() && wxFileExists(newfile)) {
+        ForgetPinnedState(newfile);
         wxRemoveFile(newfile);
     }
 
@@ -768,6 +791,10 @@ void UndoRedo::RememberSelection(const wxString& action)
 
 void UndoRedo::SaveCurrentPattern(const wxString& tempfile)
 {
+    // if the algo can keep the pattern in memory then the file won't be
+    // written unless the algo is about to be deleted or memory runs short
+    if ( currlayer->algo->pinstate(FILEPATH(tempfile)) ) return;
+    
     const char* err = NULL;
     if ( currlayer->algo->hyperCapable() ) {
         // save hlife pattern in a macrocell file
@@ -828,6 +855,9 @@ void UndoRedo::RememberGenStart()
         // save current pattern in a unique temporary file
         prevfile = wxFileName::CreateTempFileName(tempdir + genchange_prefix);
         
+        // pinning the pattern is even faster than copying a file
+        if ( currlayer->algo->pinstate(FILEPATH(prevfile)) ) return;
+        
         // if head of undo list is a genchange node then we can copy that
         // change node's newfile to prevfile; this makes consecutive generating
         // runs faster (setting prevfile to newfile would be even faster but it's
@@ -836,6 +866,7 @@ void UndoRedo::RememberGenStart()
             wxList::compatibility_iterator node = undolist.GetFirst();
             ChangeNode* change = (ChangeNode*) node->GetData();
             if (change->changeid == genchange) {
+                SpillPinnedState(change->newfile);
                 if (wxCopyFile(change->newfile, prevfile, true)) {
                     return;
                 } else {
@@ -869,6 +900,7 @@ void UndoRedo::RememberGenFinish()
     if (prevgen == currlayer->algo->getGeneration()) {
         // delete prevfile created by RememberGenStart
         if (!prevfile.IsEmpty() && wxFileExists(prevfile)) {
+            ForgetPinnedState(prevfile);
             wxRemoveFile(prevfile);
         }
         prevfile = wxEmptyString;
@@ -1554,6 +1586,7 @@ void UndoRedo::ClearUndoRedo()
     if (startcount > 0) {
         // RememberGenStart was not followed by RememberGenFinish
         if (!prevfile.IsEmpty() && wxFileExists(prevfile)) {
+            ForgetPinnedState(prevfile);
             wxRemoveFile(prevfile);
         }
         prevfile = wxEmptyString;
@@ -1591,12 +1624,14 @@ bool CopyTempFiles(ChangeNode* srcnode, ChangeNode* destnode, const wxString& te
     bool allcopied = true;
     
     if ( !srcnode->oldfile.IsEmpty() && wxFileExists(srcnode->oldfile) ) {
+        SpillPinnedState(srcnode->oldfile);
         destnode->oldfile = wxFileName::CreateTempFileName(tempdir + dupe1_prefix);
         if ( !wxCopyFile(srcnode->oldfile, destnode->oldfile, true) )
             allcopied = false;
     }
     
     if ( !srcnode->newfile.IsEmpty() && wxFileExists(srcnode->newfile) ) {
+        SpillPinnedState(srcnode->newfile);
         destnode->newfile = wxFileName::CreateTempFileName(tempdir + dupe2_prefix);
         if ( !wxCopyFile(srcnode->newfile, destnode->newfile, true) )
             allcopied = false;
@@ -1686,6 +1721,7 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
     
     // copy existing temporary file to new name
     if ( !prevfile.IsEmpty() && wxFileExists(prevfile) ) {
+        SpillPinnedState(prevfile);
         prevfile = wxFileName::CreateTempFileName(tempdir + genchange_prefix);
         if ( !wxCopyFile(history->prevfile, prevfile, true) ) {
             Warning(_("Could not copy prevfile!"));
@@ -6,6 +6,14 @@
 
 // Various utility routines:
 
+#ifdef __WXMAC__
+    // convert path to decomposed UTF8 so fopen will work
+    #define FILEPATH(path) (path).fn_str()
+#else
+    #define FILEPATH(path) (path).mb_str(wxConvLocal)
+#endif
+// Convert given wxString path to the char* form expected by gollybase.
+
 void Note(const wxString& msg, bool showCancel = true);
 // Display given message in a modal dialog.
 // If called from a script then an optional Cancel button